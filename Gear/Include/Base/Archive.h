@@ -1,7 +1,156 @@
 #pragma once
 
+#include "Base/Types.h"
+
+#include <cassert>
+#include <vector>
+#include <type_traits>
+
 BEGIN_NAMESPACE_GEAR
 
+// Fast-load image, one relocatable blob holding a whole object graph.
+// Everything inside is addressed by offset from the beginning of the image:
+//  |- FastLoadHeader
+//  |- payload, objects laid out as they are in memory, pointer fields hold offsets
+//  |- relocation table, offsets of every pointer field in payload
+// Loading is a single read (or mmap) followed by patching the pointer fields in place,
+// no per-object allocation or construction happens.
+
+#define FASTLOAD_MAGIC     0x4C534146  // 'FASL'
+#define FASTLOAD_VERSION   1
+#define FASTLOAD_ALIGNMENT 16
+
+enum FastLoadFlags : uint32
+{
+    FLF_None     = 0,
+    FLF_FixedUp  = 1 << 0,
+};
+
+struct FastLoadHeader
+{
+    uint32 Magic;
+    uint32 Version;
+    uint32 Flags;
+    uint32 Reserved;
+    uint64 ImageSize;
+    uint64 RootOffset;
+    uint64 RelocationOffset;
+    uint64 RelocationCount;
+};
+
+static_assert(sizeof(FastLoadHeader) % FASTLOAD_ALIGNMENT == 0, "[error] Payload should start aligned..");
+
+// Pointer field inside a fast-load image, always 8 bytes so the layout does not depend on target.
+// Holds an offset (0 means null) until the image is fixed up, a real pointer afterwards.
+template<typename T>
+struct FastLoadPtr
+{
+    union
+    {
+        T* Ptr;
+        uint64 Offset;
+    };
+
+    T* Get() const { return Ptr; }
+    T* operator -> () const { return Ptr; }
+    T& operator * () const { return *Ptr; }
+    T& operator [] (size_t index) const { return Ptr[index]; }
+    explicit operator bool () const { return Ptr != nullptr; }
+};
+
+static_assert(sizeof(FastLoadPtr<int>) == sizeof(uint64), "[error] FastLoadPtr should be 8 bytes..");
+
+// Builds a fast-load image, objects are placed with Allocate() and linked by offset with Link().
+// Pointers returned from Resolve() are invalidated by the next Allocate()/Write().
+class FastLoadWriter
+{
+public:
+    FastLoadWriter();
+
+    uint64 Allocate(size_t size, size_t alignment = FASTLOAD_ALIGNMENT);
+    uint64 Write(const void* data, size_t size, size_t alignment = FASTLOAD_ALIGNMENT);
+
+    template<typename T>
+    uint64 Allocate(size_t count = 1)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "[error] Only POD like type can be fast loaded..");
+        return Allocate(sizeof(T) * count, alignof(T));
+    }
+
+    template<typename T>
+    T* Resolve(uint64 offset)
+    {
+        assertf(offset + sizeof(T) <= Image.size(), "[Error] Offset out of image!");
+        return reinterpret_cast<T*>(Image.data() + offset);
+    }
+
+    // Make the pointer field at fieldOffset point to targetOffset once loaded
+    void Link(uint64 fieldOffset, uint64 targetOffset);
+    void SetRoot(uint64 offset);
+
+    // Append relocation table and fill the header, image is ready to be saved after it
+    const std::vector<uint8>& Finalize();
+    bool SaveToFile(const Char* fileName);
+
+private:
+    std::vector<uint8> Image;
+    std::vector<uint64> Relocations;
+    uint64 RootOffset;
+    bool bFinalized;
+};
+
+// Owns (or borrows) a fixed up fast-load image.
+class FastLoadImage
+{
+public:
+    FastLoadImage() = default;
+    ~FastLoadImage();
+
+    FastLoadImage(const FastLoadImage&) = delete;
+    FastLoadImage& operator = (const FastLoadImage&) = delete;
+
+    // One allocation and one read for the whole image
+    bool LoadFromFile(const Char* fileName);
+    // Private copy-on-write mapping, only touched pages get copied while fixing up
+    bool MapFromFile(const Char* fileName);
+    // Fix up memory owned by caller, it must outlive this object
+    bool LoadInPlace(void* data, size_t size);
+    // Through FileSystem, stored pak entries are fixed up where they are mapped (pak stays mounted meanwhile),
+    // compressed ones are decompressed to heap and loose files are mapped like MapFromFile()
+    bool LoadFromFileSystem(const Char* path);
+    // Cooked asset through FileSystem, or its loose file even if a mounted pak has the same path (bLooseOnly),
+    // e.g. right after cooking it again. False without an error if there is no such file.
+    bool LoadIfExists(const Char* path, bool bLooseOnly = false);
+
+    void Release();
+
+    template<typename T>
+    T* GetRoot() const
+    {
+        return Data ? reinterpret_cast<T*>(Data + reinterpret_cast<const FastLoadHeader*>(Data)->RootOffset) : nullptr;
+    }
+
+    uint8* GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+
+protected:
+    static bool Fixup(uint8* data, size_t size);
+
+private:
+    enum class StorageType : uint8
+    {
+        ST_None,
+        ST_Heap,
+        ST_Mapped,
+        ST_External
+    };
 
+    uint8* Data{ nullptr };
+    size_t Size{ 0 };
+    StorageType Storage{ StorageType::ST_None };
+#if PLATFORM_WINDOWS
+    void* MappingHandle{ nullptr };
+#endif
+};
 
-END_NAMESPACE
\ No newline at end of file
+END_NAMESPACE
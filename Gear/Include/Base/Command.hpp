@@ -0,0 +1,319 @@
+#pragma once
+
+#include "Base/Types.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define COMMAND_CPU_RELAX() _mm_pause()
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMMAND_CPU_RELAX() _mm_pause()
+#else
+#define COMMAND_CPU_RELAX() ((void)0)
+#endif
+
+BEGIN_NAMESPACE_GEAR
+
+#define COMMAND_ALIGNMENT 16
+#define COMMAND_PAGE_SIZE (64 * 1024)
+
+// Commands recorded on one thread and executed later on another one.
+// Any type with 'void Execute(TContext&)' can be a command, it is constructed in place
+// in linear pages, executed in record order and destroyed right after execution.
+template<typename TContext>
+class TCommandList
+{
+public:
+    TCommandList() = default;
+
+    ~TCommandList()
+    {
+        Reset();
+        for (Page& page : Pages)
+        {
+            FreePage(page);
+        }
+    }
+
+    TCommandList(const TCommandList&) = delete;
+    TCommandList& operator = (const TCommandList&) = delete;
+
+    template<typename TCommand, typename... TArgs>
+    TCommand* Enqueue(TArgs&&... args)
+    {
+        static_assert(alignof(TCommand) <= COMMAND_ALIGNMENT, "[error] Command alignment exceeded..");
+
+        void* memory = Allocate(sizeof(TCommand), &ExecuteCommand<TCommand>, &DestroyCommand<TCommand>);
+        return new (memory) TCommand(std::forward<TArgs>(args)...);
+    }
+
+    template<typename TLambda>
+    void EnqueueLambda(TLambda&& lambda)
+    {
+        Enqueue<TLambdaCommand<typename std::decay<TLambda>::type>>(std::forward<TLambda>(lambda));
+    }
+
+    // Run all commands in order, list is empty afterwards
+    void Execute(TContext& context)
+    {
+        ForEachCommand([&context](CommandHeader* header, void* command)
+        {
+            header->Execute(command, context);
+            header->Destroy(command);
+        });
+        Clear();
+    }
+
+    // Drop all commands without running them
+    void Reset()
+    {
+        ForEachCommand([](CommandHeader* header, void* command)
+        {
+            header->Destroy(command);
+        });
+        Clear();
+    }
+
+    uint32 GetCommandCount() const { return CommandCount; }
+    bool IsEmpty() const { return CommandCount == 0; }
+
+private:
+    typedef void (*ExecuteFunc)(void* command, TContext& context);
+    typedef void (*DestroyFunc)(void* command);
+
+    struct alignas(COMMAND_ALIGNMENT) CommandHeader
+    {
+        ExecuteFunc Execute;
+        DestroyFunc Destroy;
+        uint32 Size;  // header included
+    };
+
+    struct Page
+    {
+        uint8* Memory;
+        size_t Capacity;
+        size_t Used;
+    };
+
+    template<typename TLambda>
+    struct TLambdaCommand
+    {
+        explicit TLambdaCommand(TLambda&& lambda) : Lambda(std::move(lambda)) {}
+        explicit TLambdaCommand(const TLambda& lambda) : Lambda(lambda) {}
+
+        void Execute(TContext& context) { Lambda(context); }
+
+        TLambda Lambda;
+    };
+
+    template<typename TCommand>
+    static void ExecuteCommand(void* command, TContext& context)
+    {
+        static_cast<TCommand*>(command)->Execute(context);
+    }
+
+    template<typename TCommand>
+    static void DestroyCommand(void* command)
+    {
+        static_cast<TCommand*>(command)->~TCommand();
+    }
+
+    static size_t AlignUp(size_t value)
+    {
+        return (value + COMMAND_ALIGNMENT - 1) & ~(size_t)(COMMAND_ALIGNMENT - 1);
+    }
+
+    void* Allocate(size_t commandSize, ExecuteFunc execute, DestroyFunc destroy)
+    {
+        const size_t size = sizeof(CommandHeader) + AlignUp(commandSize);
+
+        // Move to next page if current one is full, pages are kept for following frames
+        while (true)
+        {
+            if (CurrentPage == Pages.size())
+            {
+                Pages.push_back(AllocatePage(size));
+                break;
+            }
+
+            Page& page = Pages[CurrentPage];
+            if (page.Used + size <= page.Capacity)
+            {
+                break;
+            }
+
+            if (page.Used == 0)
+            {
+                // Empty page too small for this command, grow it
+                FreePage(page);
+                page = AllocatePage(size);
+                break;
+            }
+
+            ++CurrentPage;
+        }
+
+        Page& page = Pages[CurrentPage];
+        CommandHeader* header = reinterpret_cast<CommandHeader*>(page.Memory + page.Used);
+        header->Execute = execute;
+        header->Destroy = destroy;
+        header->Size = static_cast<uint32>(size);
+        page.Used += size;
+        ++CommandCount;
+
+        return header + 1;
+    }
+
+    static Page AllocatePage(size_t size)
+    {
+        size_t capacity = size > COMMAND_PAGE_SIZE ? size : COMMAND_PAGE_SIZE;
+        Page page = { static_cast<uint8*>(::operator new(capacity, std::align_val_t(COMMAND_ALIGNMENT))), capacity, 0 };
+        return page;
+    }
+
+    static void FreePage(Page& page)
+    {
+        ::operator delete(page.Memory, std::align_val_t(COMMAND_ALIGNMENT));
+        page.Memory = nullptr;
+    }
+
+    template<typename TFunc>
+    void ForEachCommand(TFunc&& func)
+    {
+        for (Page& page : Pages)
+        {
+            for (size_t offset = 0; offset < page.Used;)
+            {
+                CommandHeader* header = reinterpret_cast<CommandHeader*>(page.Memory + offset);
+                offset += header->Size;
+                func(header, header + 1);
+            }
+        }
+    }
+
+    void Clear()
+    {
+        for (Page& page : Pages)
+        {
+            page.Used = 0;
+        }
+        CurrentPage = 0;
+        CommandCount = 0;
+    }
+
+private:
+    std::vector<Page> Pages;
+    size_t CurrentPage{ 0 };
+    uint32 CommandCount{ 0 };
+};
+
+// Lock-free single producer/ single consumer ring of command lists, one list per frame.
+// Producer records frame N+1 while consumer executes frame N, with 2 lists the producer
+// is at most one frame ahead and blocks in BeginFrame() until the consumer catches up.
+template<typename TContext, uint32 NumLists = 2>
+class TCommandRing
+{
+    static_assert(NumLists >= 2, "[error] Command ring needs at least double buffering..");
+
+public:
+    TCommandRing() = default;
+
+    TCommandRing(const TCommandRing&) = delete;
+    TCommandRing& operator = (const TCommandRing&) = delete;
+
+    // Producer side, returns null once the ring is shut down
+    TCommandList<TContext>* BeginFrame()
+    {
+        if (bShutdown.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+
+        const uint64 produced = Produced.load(std::memory_order_relaxed);
+
+        for (uint32 spin = 0; produced - Consumed.load(std::memory_order_acquire) >= NumLists; ++spin)
+        {
+            if (bShutdown.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+            Backoff(spin);
+        }
+
+        return &Lists[produced % NumLists];
+    }
+
+    void EndFrame()
+    {
+        Produced.fetch_add(1, std::memory_order_release);
+    }
+
+    // Consumer side, blocks until a frame is published.
+    // Returns false once the ring is shut down and every published frame is executed.
+    bool ExecuteFrame(TContext& context)
+    {
+        const uint64 consumed = Consumed.load(std::memory_order_relaxed);
+
+        for (uint32 spin = 0; consumed == Produced.load(std::memory_order_acquire); ++spin)
+        {
+            if (bShutdown.load(std::memory_order_acquire) && consumed == Produced.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            Backoff(spin);
+        }
+
+        Lists[consumed % NumLists].Execute(context);
+        Consumed.store(consumed + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Wake both sides up, consumer still drains published frames
+    void Shutdown()
+    {
+        bShutdown.store(true, std::memory_order_release);
+    }
+
+    bool IsShutdown() const { return bShutdown.load(std::memory_order_acquire); }
+
+    uint64 GetProducedFrames() const { return Produced.load(std::memory_order_acquire); }
+    uint64 GetConsumedFrames() const { return Consumed.load(std::memory_order_acquire); }
+
+private:
+    // Spin briefly for short waits, then give the core away so an idle side does not burn it
+    static void Backoff(uint32 spin)
+    {
+        if (spin < 64)
+        {
+            COMMAND_CPU_RELAX();
+        }
+        else if (spin < 1024)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+private:
+    TCommandList<TContext> Lists[NumLists];
+
+    // Separate cache lines, each counter is written by one side only
+    alignas(64) std::atomic<uint64> Produced{ 0 };
+    alignas(64) std::atomic<uint64> Consumed{ 0 };
+    alignas(64) std::atomic<bool> bShutdown{ false };
+};
+
+END_NAMESPACE
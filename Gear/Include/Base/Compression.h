@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Base/Types.h"
+
+BEGIN_NAMESPACE_GEAR
+
+// LZ77 block compression in the LZ4 block format, no frame, no checksum.
+// Greedy single probe matcher, so compression is quick and decompression is a plain copy loop
+// bound by memory bandwidth. Meant for asset payloads, which are decompressed far more often than compressed.
+
+// Worst case compressed size of size bytes
+size_t LZCompressBound(size_t size);
+
+// Returns compressed size, 0 if it does not fit in dstCapacity
+size_t LZCompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity);
+
+// Fails on corrupted input and when src does not decompress to exactly dstSize bytes, never writes past dst + dstSize
+bool LZDecompress(const void* src, size_t srcSize, void* dst, size_t dstSize);
+
+END_NAMESPACE
@@ -11,8 +11,25 @@
 
 #endif
 
+#if defined(_WIN32) || defined(_WIN64)
+#define PLATFORM_WINDOWS 1
+#else
+#define PLATFORM_WINDOWS 0
+#endif
+
+#if defined(__linux__)
+#define PLATFORM_LINUX 1
+#else
+#define PLATFORM_LINUX 0
+#endif
+
+#if defined(_MSC_VER)
 #define FORCEINLINE __forceinline
 #define INLINE __inline
+#else
+#define FORCEINLINE inline __attribute__((always_inline))
+#define INLINE inline
+#endif
 
 // To avoid warning
 #define assertf(exp, msg) assert(((void)msg, exp))
\ No newline at end of file
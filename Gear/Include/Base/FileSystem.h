@@ -0,0 +1,200 @@
+#pragma once
+
+#include "Base/Types.h"
+
+#include <memory>
+#include <vector>
+
+BEGIN_NAMESPACE_GEAR
+
+// Virtual file system over pak files, with loose files as fallback during development.
+// A pak is one read-only file holding many assets:
+//  |- PakHeader
+//  |- entry table, PakEntry per file
+//  |- hash table of entry indices, open addressing on the path hash
+//  |- path strings, normalized and null terminated
+//  |- entry data, every entry aligned to PAK_ALIGNMENT, large ones to PAK_PAGE_SIZE
+// Paks are mapped as a whole, so a lookup is a hash probe in memory and reading a stored entry is a pointer
+// into the mapping. Cold start pays one open() per pak instead of an open()/ stat() per asset.
+// Virtual paths are relative to the asset root, '/' or '\' separated and case insensitive, loose files included.
+
+#define PAK_MAGIC       0x4B415047  // 'GPAK'
+#define PAK_VERSION     1
+#define PAK_ALIGNMENT   16          // same as FASTLOAD_ALIGNMENT, fast-load images are fixed up where they are mapped
+#define PAK_PAGE_SIZE   4096        // entries at least this large start on their own page
+#define PAK_EMPTY_SLOT  0xFFFFFFFF
+
+enum PakEntryFlags : uint32
+{
+    PEF_None        = 0,
+    PEF_Compressed  = 1 << 0,   // LZ block, see Compression.h
+};
+
+struct PakHeader
+{
+    uint32 Magic;
+    uint32 Version;
+    uint32 EntryCount;
+    uint32 SlotCount;           // power of 2, at least twice the entry count
+    uint64 EntryOffset;
+    uint64 SlotOffset;
+    uint64 PathOffset;
+    uint64 PathSize;
+};
+
+struct PakEntry
+{
+    uint64 Hash;                // of the normalized path
+    uint64 Offset;              // from the beginning of the pak
+    uint64 Size;                // once decompressed
+    uint64 StoredSize;          // in the pak
+    uint32 PathOffset;          // into path strings
+    uint32 Flags;
+};
+
+static_assert(sizeof(PakHeader) % PAK_ALIGNMENT == 0, "[error] Entry table should start aligned..");
+
+// Lower case, '/' separated, without leading "./" or '/'
+StdString NormalizePath(const Char* path);
+uint64 HashPath(const StdString& normalizedPath);
+
+// Builds a pak in memory, entries are written sorted by path so the output does not depend on add order.
+class PakWriter
+{
+public:
+    // Compressed copy is only kept if it saves at least 1/8, already compressed formats end up stored
+    void AddFile(const Char* path, const void* data, size_t size, bool bCompress = true);
+    bool AddFileFromDisk(const Char* path, const Char* sourceFile, bool bCompress = true);
+    // Every regular file under directory, virtual paths relative to it. Returns number of files added.
+    // compressFilter picks files worth compressing by virtual path, all of them if null.
+    uint32 AddDirectory(const Char* directory, bool (*compressFilter)(const Char* path) = nullptr);
+
+    uint32 GetEntryCount() const { return static_cast<uint32>(Entries.size()); }
+
+    bool SaveToFile(const Char* fileName);
+
+private:
+    struct Entry
+    {
+        StdString Path;
+        uint64 Size;
+        uint32 Flags;
+        std::vector<uint8> Data;    // as stored
+    };
+
+    std::vector<Entry> Entries;
+};
+
+// Read-only view of a mapped pak.
+class PakFile
+{
+public:
+    PakFile() = default;
+    ~PakFile();
+
+    PakFile(const PakFile&) = delete;
+    PakFile& operator = (const PakFile&) = delete;
+
+    // Private copy-on-write mapping, writes through GetEntryData() never reach the file
+    bool Open(const Char* fileName);
+    void Close();
+
+    const PakEntry* Find(const StdString& normalizedPath, uint64 hash) const;
+    const PakEntry* Find(const Char* path) const;
+
+    uint32 GetEntryCount() const { return Header ? Header->EntryCount : 0; }
+    const PakEntry& GetEntry(uint32 index) const { return Entries[index]; }
+    const Char* GetEntryPath(const PakEntry& entry) const { return Paths + entry.PathOffset; }
+
+    // Bytes as stored, compressed entries have to go through ReadEntry()
+    uint8* GetEntryData(const PakEntry& entry) const { return Data + entry.Offset; }
+    // Decompresses or copies entry.Size bytes to dst
+    bool ReadEntry(const PakEntry& entry, void* dst) const;
+
+private:
+    bool Validate() const;
+
+    uint8* Data{ nullptr };
+    size_t Size{ 0 };
+    const PakHeader* Header{ nullptr };
+    const PakEntry* Entries{ nullptr };
+    const uint32* Slots{ nullptr };
+    const Char* Paths{ nullptr };
+#if PLATFORM_WINDOWS
+    void* MappingHandle{ nullptr };
+#endif
+};
+
+// Contents of a file read through FileSystem, a view into a mounted pak or a buffer owned by this object.
+class FileData
+{
+public:
+    FileData() = default;
+    ~FileData();
+
+    FileData(FileData&& other);
+    FileData& operator = (FileData&& other);
+
+    FileData(const FileData&) = delete;
+    FileData& operator = (const FileData&) = delete;
+
+    // Views into a pak are copy-on-write memory, they stay valid until the pak is unmounted
+    uint8* GetData() const { return Data; }
+    size_t GetSize() const { return Size; }
+    bool IsMapped() const { return Data && !bOwned; }
+
+    explicit operator bool () const { return Data != nullptr; }
+
+    // Caller takes over the owned buffer and frees it with free(), null for views into a pak
+    uint8* Detach();
+
+private:
+    friend class FileSystem;
+
+    void Reset();
+
+    uint8* Data{ nullptr };
+    size_t Size{ 0 };
+    bool bOwned{ false };
+};
+
+// Global file system, mount paks at start up, reads are thread safe afterwards.
+class FileSystem
+{
+public:
+    static FileSystem& Get();
+
+    ~FileSystem();
+
+    // Later mounts shadow earlier ones, so patches go last. Missing pak fails quietly, a broken one is logged.
+    bool Mount(const Char* pakFile);
+    void UnmountAll();
+
+    // Files not found in any pak are read from here, empty disables the fallback (shipping)
+    void SetLooseRoot(const Char* directory);
+    const StdString& GetLooseRoot() const { return LooseRoot; }
+    // Where a loose file lives on disk, also where tools write cooked files to. Paths resolve like in paks,
+    // separators are normalized and a file differing only in case is found on case sensitive file systems.
+    StdString GetLoosePath(const Char* path) const;
+
+    bool Exists(const Char* path) const;
+    // Loose file only, whether a pak shadows it or not
+    bool ExistsLoose(const Char* path) const;
+    bool IsPacked(const Char* path) const;
+
+    // Stored pak entries are returned without a copy, compressed and loose ones in a buffer
+    FileData Read(const Char* path) const;
+
+    FileSystem(const FileSystem&) = delete;
+    FileSystem& operator = (const FileSystem&) = delete;
+
+private:
+    FileSystem() = default;
+
+    const PakEntry* FindPacked(const Char* path, const PakFile** outPak) const;
+
+    std::vector<std::unique_ptr<PakFile>> Paks;
+    StdString LooseRoot;
+};
+
+END_NAMESPACE
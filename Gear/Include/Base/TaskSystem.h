@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Base/Types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+BEGIN_NAMESPACE_GEAR
+
+// Fixed pool of worker threads for data parallel work.
+// ParallelFor() cuts a range into batches which are picked up by workers and the calling thread.
+// The caller always takes part, so nested ParallelFor() from inside a batch can not dead lock.
+// Runs everything inline on the calling thread if not initialized.
+class TaskSystem
+{
+public:
+    static TaskSystem& Get();
+
+    ~TaskSystem();
+
+    // 0 workers means one per hardware thread except the calling one
+    void Initialize(uint32 workerCount = 0);
+    void Shutdown();
+
+    uint32 GetWorkerCount() const { return static_cast<uint32>(Workers.size()); }
+    // Workers plus the calling thread
+    uint32 GetConcurrency() const { return GetWorkerCount() + 1; }
+
+    // Calls func(begin, end) for batches covering [0, count), blocks until all batches are done.
+    // Batches are at least minBatchSize long, except the last one.
+    template<typename TFunc>
+    void ParallelFor(uint32 count, uint32 minBatchSize, TFunc&& func)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        const uint32 batchSize = GetBatchSize(count, minBatchSize);
+        if (Workers.empty() || batchSize >= count)
+        {
+            func(0u, count);
+            return;
+        }
+
+        typedef typename std::remove_reference<TFunc>::type FuncType;
+
+        ParallelForJob job;
+        job.Func = [](void* context, uint32 begin, uint32 end) { (*static_cast<FuncType*>(context))(begin, end); };
+        job.Context = const_cast<void*>(static_cast<const void*>(&func));
+        job.Count = count;
+        job.BatchSize = batchSize;
+
+        Run(job);
+    }
+
+    TaskSystem(const TaskSystem&) = delete;
+    TaskSystem& operator = (const TaskSystem&) = delete;
+
+private:
+    TaskSystem() = default;
+
+    struct ParallelForJob
+    {
+        void (*Func)(void* context, uint32 begin, uint32 end);
+        void* Context;
+        uint32 Count;
+        uint32 BatchSize;
+        std::atomic<uint32> NextIndex{ 0 };
+        std::atomic<uint32> ActiveWorkers{ 0 };
+    };
+
+    uint32 GetBatchSize(uint32 count, uint32 minBatchSize) const;
+
+    void Run(ParallelForJob& job);
+    void WorkerMain();
+    static void ExecuteBatches(ParallelForJob& job);
+
+private:
+    std::vector<std::thread> Workers;
+
+    // Jobs which may still have batches left, guarded by Mutex
+    std::vector<ParallelForJob*> Jobs;
+    std::mutex Mutex;
+    std::condition_variable WakeCondition;
+    bool bShutdown{ false };
+};
+
+END_NAMESPACE
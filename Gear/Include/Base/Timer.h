@@ -0,0 +1,160 @@
+#pragma once
+
+#include "Base/Types.h"
+
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define TIMER_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMER_HAS_RDTSC 1
+#else
+#define TIMER_HAS_RDTSC 0
+#endif
+
+BEGIN_NAMESPACE_GEAR
+
+// Global clock, timestamps are read from invariant TSC when available and calibrated
+// against the OS monotonic clock (CLOCK_MONOTONIC/ QueryPerformanceCounter) once at start up.
+// Falls back to the monotonic clock itself if TSC is not usable.
+// Initialize() should be called before any timestamp is taken.
+class Timer
+{
+public:
+    static void Initialize();
+    static bool IsInitialized() { return bInitialized; }
+    static bool IsUsingTSC() { return bUseTSC; }
+
+    // Raw timestamp in clock ticks, only comparable with other ticks
+    static FORCEINLINE uint64 GetCycles()
+    {
+#if TIMER_HAS_RDTSC
+        if (bUseTSC)
+        {
+            return __rdtsc();
+        }
+#endif
+        return GetMonotonicTicks();
+    }
+
+    static uint64 GetCyclesPerSecond() { return CyclesPerSecond; }
+
+    static FORCEINLINE double CyclesToSeconds(uint64 cycles) { return cycles * SecondsPerCycle; }
+    static FORCEINLINE double CyclesToMilliseconds(uint64 cycles) { return cycles * SecondsPerCycle * 1000.0; }
+
+    // Seconds since Initialize()
+    static FORCEINLINE double GetSeconds() { return CyclesToSeconds(GetCycles() - BaseCycles); }
+
+protected:
+    static uint64 GetMonotonicTicks();
+    static uint64 GetMonotonicFrequency();
+    static bool IsInvariantTSCSupported();
+    static uint64 CalibrateTSC();
+
+private:
+    static bool bInitialized;
+    static bool bUseTSC;
+    static uint64 CyclesPerSecond;
+    static uint64 BaseCycles;
+    static double SecondsPerCycle;
+};
+
+class Stopwatch
+{
+public:
+    Stopwatch() = default;
+
+    void Start();
+    void Stop();
+    void Reset();
+    void Restart() { Reset(); Start(); }
+
+    bool IsRunning() const { return bRunning; }
+
+    uint64 GetElapsedCycles() const;
+    double GetElapsedSeconds() const { return Timer::CyclesToSeconds(GetElapsedCycles()); }
+    double GetElapsedMilliseconds() const { return Timer::CyclesToMilliseconds(GetElapsedCycles()); }
+
+private:
+    uint64 StartCycles{ 0 };
+    uint64 AccumulatedCycles{ 0 };
+    bool bRunning{ false };
+};
+
+// Measure a scope, result is added to the output if given or printed with the name otherwise
+class ScopedStopwatch
+{
+public:
+    explicit ScopedStopwatch(const Char* name, double* outMilliseconds = nullptr) :
+        Name(name),
+        OutMilliseconds(outMilliseconds),
+        StartCycles(Timer::GetCycles())
+    {
+    }
+
+    ~ScopedStopwatch();
+
+    ScopedStopwatch(const ScopedStopwatch&) = delete;
+    ScopedStopwatch& operator = (const ScopedStopwatch&) = delete;
+
+private:
+    const Char* Name;
+    double* OutMilliseconds;
+    uint64 StartCycles;
+};
+
+#define SCOPED_STOPWATCH_CONCAT_INNER(_a, _b) _a##_b
+#define SCOPED_STOPWATCH_CONCAT(_a, _b) SCOPED_STOPWATCH_CONCAT_INNER(_a, _b)
+#define SCOPED_STOPWATCH(_name) \
+    Gear::ScopedStopwatch SCOPED_STOPWATCH_CONCAT(_scoped_stopwatch_, __LINE__)(_name)
+
+struct FrameTimeStats
+{
+    double MinMilliseconds;
+    double AvgMilliseconds;
+    double MaxMilliseconds;
+    double P99Milliseconds;
+    uint32 SampleCount;
+    uint64 HitchCount;
+};
+
+// Rolling statistics over the last N frames.
+// A frame is a hitch when it takes longer than HitchScale times the rolling average,
+// and longer than HitchMinMilliseconds so noise on very fast frames is ignored.
+class FrameTimeTracker
+{
+public:
+    explicit FrameTimeTracker(uint32 windowSize = 240, double hitchScale = 2.0, double hitchMinMilliseconds = 8.0);
+
+    // Call once per frame, records the time since previous call
+    void Tick();
+    void AddSample(double milliseconds);
+    void Reset();
+
+    double GetDeltaSeconds() const { return LastMilliseconds * 0.001; }
+    double GetDeltaMilliseconds() const { return LastMilliseconds; }
+    bool IsLastFrameHitch() const { return bLastFrameHitch; }
+    uint64 GetFrameCount() const { return FrameCount; }
+
+    // Average is kept incrementally, min/max/p99 are computed from the window on demand
+    FrameTimeStats GetStats() const;
+
+private:
+    std::vector<double> Samples;
+    uint32 WindowSize;
+    uint32 NextSample{ 0 };
+    double WindowSum{ 0.0 };
+
+    double HitchScale;
+    double HitchMinMilliseconds;
+    uint64 HitchCount{ 0 };
+
+    uint64 LastCycles{ 0 };
+    double LastMilliseconds{ 0.0 };
+    uint64 FrameCount{ 0 };
+    bool bLastFrameHitch{ false };
+};
+
+END_NAMESPACE
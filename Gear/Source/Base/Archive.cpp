@@ -0,0 +1,402 @@
+#include "Base/Archive.h"
+#include "Base/FileSystem.h"
+#include "Base/Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BEGIN_NAMESPACE_GEAR
+
+static inline uint64 AlignUp(uint64 value, uint64 alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+FastLoadWriter::FastLoadWriter() :
+	RootOffset(0),
+	bFinalized(false)
+{
+	// Reserve the header, it is filled in Finalize()
+	Image.resize(sizeof(FastLoadHeader), 0);
+}
+
+uint64 FastLoadWriter::Allocate(size_t size, size_t alignment)
+{
+	assertf(!bFinalized, "[Error] Image already finalized!");
+	assertf(alignment && !(alignment & (alignment - 1)), "[Error] Alignment should be power of 2!");
+	assertf(alignment <= FASTLOAD_ALIGNMENT, "[Error] Alignment exceeds image alignment!");
+
+	uint64 offset = AlignUp(Image.size(), alignment);
+	Image.resize(offset + size, 0);
+
+	return offset;
+}
+
+uint64 FastLoadWriter::Write(const void* data, size_t size, size_t alignment)
+{
+	uint64 offset = Allocate(size, alignment);
+	if (size)
+	{
+		memcpy(Image.data() + offset, data, size);
+	}
+
+	return offset;
+}
+
+void FastLoadWriter::Link(uint64 fieldOffset, uint64 targetOffset)
+{
+	assertf(!bFinalized, "[Error] Image already finalized!");
+	assertf(fieldOffset + sizeof(uint64) <= Image.size(), "[Error] Pointer field out of image!");
+	assertf(targetOffset < Image.size(), "[Error] Pointer target out of image!");
+
+	// Offset 0 is the header, so it stands for null
+	memcpy(Image.data() + fieldOffset, &targetOffset, sizeof(uint64));
+	if (targetOffset)
+	{
+		Relocations.push_back(fieldOffset);
+	}
+}
+
+void FastLoadWriter::SetRoot(uint64 offset)
+{
+	RootOffset = offset;
+}
+
+const std::vector<uint8>& FastLoadWriter::Finalize()
+{
+	if (bFinalized)
+	{
+		return Image;
+	}
+
+	// Sorted relocations keep the fix up walking memory forward
+	std::sort(Relocations.begin(), Relocations.end());
+
+	uint64 relocationOffset = Write(Relocations.data(), Relocations.size() * sizeof(uint64), alignof(uint64));
+	Image.resize(AlignUp(Image.size(), FASTLOAD_ALIGNMENT), 0);
+
+	FastLoadHeader* header = reinterpret_cast<FastLoadHeader*>(Image.data());
+	header->Magic = FASTLOAD_MAGIC;
+	header->Version = FASTLOAD_VERSION;
+	header->Flags = FLF_None;
+	header->Reserved = 0;
+	header->ImageSize = Image.size();
+	header->RootOffset = RootOffset;
+	header->RelocationOffset = relocationOffset;
+	header->RelocationCount = Relocations.size();
+
+	bFinalized = true;
+
+	return Image;
+}
+
+bool FastLoadWriter::SaveToFile(const Char* fileName)
+{
+	const std::vector<uint8>& image = Finalize();
+
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+	{
+		LOG_ERR(Asset, "Failed to open fast-load image for writing.");
+		return false;
+	}
+
+	bool ret = fwrite(image.data(), 1, image.size(), file) == image.size();
+	fclose(file);
+
+	if (!ret)
+	{
+		LOG_ERR(Asset, "Failed to write fast-load image.");
+	}
+
+	return ret;
+}
+
+FastLoadImage::~FastLoadImage()
+{
+	Release();
+}
+
+bool FastLoadImage::LoadFromFile(const Char* fileName)
+{
+	Release();
+
+	FILE* file = fopen(fileName, "rb");
+	if (!file)
+	{
+		LOG_ERR(Asset, "Failed to open fast-load image.");
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (fileSize < (long)sizeof(FastLoadHeader))
+	{
+		fclose(file);
+		LOG_ERR(Asset, "Invalid fast-load image size.");
+		return false;
+	}
+
+	// malloc is at least 16 bytes aligned on 64 bits platforms, which is what the image requires
+	uint8* data = static_cast<uint8*>(malloc(fileSize));
+	bool ret = data && fread(data, 1, fileSize, file) == (size_t)fileSize;
+	fclose(file);
+
+	if (!ret || !Fixup(data, fileSize))
+	{
+		free(data);
+		return false;
+	}
+
+	Data = data;
+	Size = fileSize;
+	Storage = StorageType::ST_Heap;
+
+	return true;
+}
+
+bool FastLoadImage::MapFromFile(const Char* fileName)
+{
+	Release();
+
+#if PLATFORM_WINDOWS
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		LOG_ERR(Asset, "Failed to open fast-load image.");
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+	{
+		LOG_ERR(Asset, "Failed to map fast-load image.");
+		return false;
+	}
+
+	uint8* data = static_cast<uint8*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	size_t size = static_cast<size_t>(fileSize.QuadPart);
+	if (!data || !Fixup(data, size))
+	{
+		if (data)
+		{
+			UnmapViewOfFile(data);
+		}
+		CloseHandle(mapping);
+		return false;
+	}
+
+	MappingHandle = mapping;
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+	{
+		LOG_ERR(Asset, "Failed to open fast-load image.");
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0)
+	{
+		close(file);
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(fileStat.st_size);
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapped == MAP_FAILED)
+	{
+		LOG_ERR(Asset, "Failed to map fast-load image.");
+		return false;
+	}
+
+	// Pointers are patched all over the image, get it paged in ahead
+	madvise(mapped, size, MADV_WILLNEED);
+
+	uint8* data = static_cast<uint8*>(mapped);
+	if (!Fixup(data, size))
+	{
+		munmap(mapped, size);
+		return false;
+	}
+#endif
+
+	Data = data;
+	Size = size;
+	Storage = StorageType::ST_Mapped;
+
+	return true;
+}
+
+bool FastLoadImage::LoadInPlace(void* data, size_t size)
+{
+	Release();
+
+	if (!Fixup(static_cast<uint8*>(data), size))
+	{
+		return false;
+	}
+
+	Data = static_cast<uint8*>(data);
+	Size = size;
+	Storage = StorageType::ST_External;
+
+	return true;
+}
+
+bool FastLoadImage::LoadFromFileSystem(const Char* path)
+{
+	Release();
+
+	FileSystem& fileSystem = FileSystem::Get();
+	if (!fileSystem.IsPacked(path))
+	{
+		return !fileSystem.GetLooseRoot().empty() && MapFromFile(fileSystem.GetLoosePath(path).c_str());
+	}
+
+	FileData file = fileSystem.Read(path);
+	if (!file)
+	{
+		return false;
+	}
+
+	if (file.IsMapped())
+	{
+		return LoadInPlace(file.GetData(), file.GetSize());
+	}
+
+	size_t size = file.GetSize();
+	uint8* data = file.Detach();
+	if (!Fixup(data, size))
+	{
+		free(data);
+		return false;
+	}
+
+	Data = data;
+	Size = size;
+	Storage = StorageType::ST_Heap;
+
+	return true;
+}
+
+bool FastLoadImage::LoadIfExists(const Char* path, bool bLooseOnly)
+{
+	Release();
+
+	// Assets are missing before their first cook, only broken files are logged
+	const FileSystem& fileSystem = FileSystem::Get();
+	if (bLooseOnly)
+	{
+		return fileSystem.ExistsLoose(path) && MapFromFile(fileSystem.GetLoosePath(path).c_str());
+	}
+	return fileSystem.Exists(path) && LoadFromFileSystem(path);
+}
+
+void FastLoadImage::Release()
+{
+	switch (Storage)
+	{
+	case StorageType::ST_Heap:
+		free(Data);
+		break;
+	case StorageType::ST_Mapped:
+#if PLATFORM_WINDOWS
+		UnmapViewOfFile(Data);
+		CloseHandle(MappingHandle);
+		MappingHandle = nullptr;
+#else
+		munmap(Data, Size);
+#endif
+		break;
+	default:
+		break;
+	}
+
+	Data = nullptr;
+	Size = 0;
+	Storage = StorageType::ST_None;
+}
+
+bool FastLoadImage::Fixup(uint8* data, size_t size)
+{
+	if (!data || size < sizeof(FastLoadHeader) || (reinterpret_cast<uintptr_t>(data) & (FASTLOAD_ALIGNMENT - 1)))
+	{
+		LOG_ERR(Asset, "Invalid fast-load image memory.");
+		return false;
+	}
+
+	FastLoadHeader* header = reinterpret_cast<FastLoadHeader*>(data);
+	if (header->Magic != FASTLOAD_MAGIC || header->Version != FASTLOAD_VERSION || header->ImageSize != size)
+	{
+		LOG_ERR(Asset, "Fast-load image header mismatch.");
+		return false;
+	}
+
+	// Already patched, happens when the same memory is handed in twice
+	if (header->Flags & FLF_FixedUp)
+	{
+		return true;
+	}
+
+	if (header->RootOffset >= size ||
+		header->RelocationOffset > size ||
+		header->RelocationCount > (size - header->RelocationOffset) / sizeof(uint64))
+	{
+		LOG_ERR(Asset, "Fast-load image relocation table out of range.");
+		return false;
+	}
+
+	const uint64* relocations = reinterpret_cast<const uint64*>(data + header->RelocationOffset);
+	const uint64 payloadEnd = header->RelocationOffset;
+	const uint64 count = header->RelocationCount;
+
+	// Validate first, so a broken image leaves memory untouched
+	for (uint64 i = 0; i < count; ++i)
+	{
+		uint64 fieldOffset = relocations[i];
+		if (fieldOffset < sizeof(FastLoadHeader) || fieldOffset + sizeof(uint64) > payloadEnd || (fieldOffset & (sizeof(uint64) - 1)))
+		{
+			LOG_ERR(Asset, "Fast-load image relocation out of payload.");
+			return false;
+		}
+
+		uint64 targetOffset = *reinterpret_cast<const uint64*>(data + fieldOffset);
+		if (targetOffset >= size)
+		{
+			LOG_ERR(Asset, "Fast-load image pointer out of image.");
+			return false;
+		}
+	}
+
+	const uint64 base = static_cast<uint64>(reinterpret_cast<uintptr_t>(data));
+	for (uint64 i = 0; i < count; ++i)
+	{
+		uint64* field = reinterpret_cast<uint64*>(data + relocations[i]);
+		*field += base;
+	}
+
+	header->Flags |= FLF_FixedUp;
+
+	return true;
+}
+
+END_NAMESPACE
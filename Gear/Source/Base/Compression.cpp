@@ -0,0 +1,252 @@
+#include "Base/Compression.h"
+
+#include <cstring>
+
+BEGIN_NAMESPACE_GEAR
+
+// Block format limits, same as LZ4 so blocks stay compatible with its decoder
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_LAST_LITERALS = 5;	// block always ends with at least this many literals
+static const size_t LZ_MATCH_FIND_LIMIT = 12;	// no match starts closer to the end than this
+static const size_t LZ_MAX_OFFSET = 65535;
+
+static const uint32 LZ_HASH_BITS = 14;
+// Skip ahead faster on incompressible data, step grows every 2^LZ_SKIP_TRIGGER misses
+static const uint32 LZ_SKIP_TRIGGER = 6;
+
+static inline uint32 Read32(const uint8* p)
+{
+	uint32 value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32 HashSequence(uint32 sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static inline void WriteLength(uint8*& out, size_t length)
+{
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = static_cast<uint8>(length);
+}
+
+static inline bool ReadLength(const uint8*& in, const uint8* inEnd, size_t& length)
+{
+	uint8 byte;
+	do
+	{
+		if (in >= inEnd)
+		{
+			return false;
+		}
+		byte = *in++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+// Literals followed by a match, matchLength 0 for the closing literals only sequence
+static bool WriteSequence(uint8*& out, const uint8* outEnd, const uint8* literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+	size_t needed = 1 + literalLength + literalLength / 255 + 1;
+	if (matchLength)
+	{
+		needed += 2 + matchLength / 255 + 1;
+	}
+	if (static_cast<size_t>(outEnd - out) < needed)
+	{
+		return false;
+	}
+
+	uint8* token = out++;
+	*token = static_cast<uint8>((literalLength < 15 ? literalLength : 15) << 4);
+	if (literalLength >= 15)
+	{
+		WriteLength(out, literalLength - 15);
+	}
+	if (literalLength)
+	{
+		memcpy(out, literals, literalLength);
+		out += literalLength;
+	}
+
+	if (matchLength)
+	{
+		*out++ = static_cast<uint8>(offset);
+		*out++ = static_cast<uint8>(offset >> 8);
+
+		size_t length = matchLength - LZ_MIN_MATCH;
+		*token |= static_cast<uint8>(length < 15 ? length : 15);
+		if (length >= 15)
+		{
+			WriteLength(out, length - 15);
+		}
+	}
+
+	return true;
+}
+
+size_t LZCompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t LZCompress(const void* src, size_t srcSize, void* dst, size_t dstCapacity)
+{
+	const uint8* in = static_cast<const uint8*>(src);
+	const uint8* inEnd = in + srcSize;
+	uint8* out = static_cast<uint8*>(dst);
+	const uint8* outEnd = out + dstCapacity;
+	const uint8* anchor = in;
+
+	if (srcSize > LZ_MATCH_FIND_LIMIT)
+	{
+		// Positions relative to in, stale or empty slots are rejected by comparing bytes
+		uint32 table[1 << LZ_HASH_BITS] = {};
+
+		const uint8* matchFindLimit = inEnd - LZ_MATCH_FIND_LIMIT;
+		const uint8* matchLimit = inEnd - LZ_LAST_LITERALS;
+		const uint8* ip = in + 1;
+		uint32 misses = 0;
+
+		while (ip < matchFindLimit)
+		{
+			const uint32 sequence = Read32(ip);
+			const uint32 hash = HashSequence(sequence);
+			const uint8* ref = in + table[hash];
+			table[hash] = static_cast<uint32>(ip - in);
+
+			if (ref >= ip || static_cast<size_t>(ip - ref) > LZ_MAX_OFFSET || Read32(ref) != sequence)
+			{
+				ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+				continue;
+			}
+			misses = 0;
+
+			// Grow the match both ways, literals already pending may be part of it
+			while (ip > anchor && ref > in && ip[-1] == ref[-1])
+			{
+				--ip;
+				--ref;
+			}
+
+			const uint8* matchEnd = ip + LZ_MIN_MATCH;
+			const uint8* refEnd = ref + LZ_MIN_MATCH;
+			while (matchEnd < matchLimit && *matchEnd == *refEnd)
+			{
+				++matchEnd;
+				++refEnd;
+			}
+
+			if (!WriteSequence(out, outEnd, anchor, ip - anchor, ip - ref, matchEnd - ip))
+			{
+				return 0;
+			}
+
+			ip = matchEnd;
+			anchor = ip;
+
+			// Position right before the next search gets the next match going sooner
+			if (ip < matchFindLimit)
+			{
+				table[HashSequence(Read32(ip - 2))] = static_cast<uint32>(ip - 2 - in);
+			}
+		}
+	}
+
+	if (!WriteSequence(out, outEnd, anchor, inEnd - anchor, 0, 0))
+	{
+		return 0;
+	}
+
+	return out - static_cast<uint8*>(dst);
+}
+
+bool LZDecompress(const void* src, size_t srcSize, void* dst, size_t dstSize)
+{
+	const uint8* in = static_cast<const uint8*>(src);
+	const uint8* inEnd = in + srcSize;
+	uint8* out = static_cast<uint8*>(dst);
+	uint8* outBegin = out;
+	uint8* outEnd = out + dstSize;
+
+	for (;;)
+	{
+		if (in >= inEnd)
+		{
+			return false;
+		}
+
+		const uint8 token = *in++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == 15 && !ReadLength(in, inEnd, literalLength))
+		{
+			return false;
+		}
+		if (literalLength > static_cast<size_t>(inEnd - in) || literalLength > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+		if (literalLength)
+		{
+			memcpy(out, in, literalLength);
+			in += literalLength;
+			out += literalLength;
+		}
+
+		// Closing sequence has no match
+		if (in == inEnd)
+		{
+			break;
+		}
+
+		if (inEnd - in < 2)
+		{
+			return false;
+		}
+		const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > static_cast<size_t>(out - outBegin))
+		{
+			return false;
+		}
+
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !ReadLength(in, inEnd, matchLength))
+		{
+			return false;
+		}
+		matchLength += LZ_MIN_MATCH;
+		if (matchLength > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		const uint8* match = out - offset;
+		if (offset >= matchLength)
+		{
+			memcpy(out, match, matchLength);
+			out += matchLength;
+		}
+		else
+		{
+			// Overlapping match repeats the last offset bytes
+			for (size_t i = 0; i < matchLength; ++i)
+			{
+				*out++ = match[i];
+			}
+		}
+	}
+
+	return out == outEnd;
+}
+
+END_NAMESPACE
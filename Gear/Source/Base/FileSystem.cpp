@@ -0,0 +1,730 @@
+#include "Base/FileSystem.h"
+#include "Base/Compression.h"
+#include "Base/Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#if PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BEGIN_NAMESPACE_GEAR
+
+static inline uint64 AlignUp(uint64 value, uint64 alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// '/' separated, without leading "./" or '/', lower case for pak lookups
+static StdString CleanPath(const Char* path, bool bLowerCase)
+{
+	for (;;)
+	{
+		if (path[0] == '/' || path[0] == '\\')
+		{
+			++path;
+		}
+		else if (path[0] == '.' && (path[1] == '/' || path[1] == '\\'))
+		{
+			path += 2;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	StdString normalized;
+	normalized.reserve(strlen(path));
+	for (; *path; ++path)
+	{
+		Char c = *path == '\\' ? '/' : *path;
+		if (c == '/' && !normalized.empty() && normalized.back() == '/')
+		{
+			continue;
+		}
+		normalized.push_back(bLowerCase && c >= 'A' && c <= 'Z' ? static_cast<Char>(c - 'A' + 'a') : c);
+	}
+
+	return normalized;
+}
+
+StdString NormalizePath(const Char* path)
+{
+	return CleanPath(path, true);
+}
+
+uint64 HashPath(const StdString& normalizedPath)
+{
+	// FNV-1a
+	uint64 hash = 14695981039346656037ull;
+	for (Char c : normalizedPath)
+	{
+		hash ^= static_cast<uint8>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void PakWriter::AddFile(const Char* path, const void* data, size_t size, bool bCompress)
+{
+	Entry entry;
+	entry.Path = NormalizePath(path);
+	entry.Size = size;
+	entry.Flags = PEF_None;
+
+	if (bCompress && size)
+	{
+		entry.Data.resize(LZCompressBound(size));
+		size_t compressedSize = LZCompress(data, size, entry.Data.data(), entry.Data.size());
+		if (compressedSize && compressedSize <= size - size / 8)
+		{
+			entry.Data.resize(compressedSize);
+			entry.Flags = PEF_Compressed;
+		}
+	}
+
+	if (!(entry.Flags & PEF_Compressed))
+	{
+		const uint8* bytes = static_cast<const uint8*>(data);
+		entry.Data.assign(bytes, bytes + size);
+	}
+
+	Entries.push_back(std::move(entry));
+}
+
+bool PakWriter::AddFileFromDisk(const Char* path, const Char* sourceFile, bool bCompress)
+{
+	FILE* file = fopen(sourceFile, "rb");
+	if (!file)
+	{
+		LOG_ERR(Asset, "Failed to open file to pack.");
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long fileSize = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	std::vector<uint8> data(fileSize > 0 ? fileSize : 0);
+	bool ret = fileSize >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+
+	if (!ret)
+	{
+		LOG_ERR(Asset, "Failed to read file to pack.");
+		return false;
+	}
+
+	AddFile(path, data.data(), data.size(), bCompress);
+
+	return true;
+}
+
+uint32 PakWriter::AddDirectory(const Char* directory, bool (*compressFilter)(const Char* path))
+{
+	std::error_code error;
+	std::filesystem::recursive_directory_iterator it(directory, error);
+	if (error)
+	{
+		LOG_ERR(Asset, "Failed to open directory to pack.");
+		return 0;
+	}
+
+	uint32 count = 0;
+	for (const std::filesystem::directory_entry& file : it)
+	{
+		if (!file.is_regular_file())
+		{
+			continue;
+		}
+
+		StdString path = file.path().lexically_relative(directory).generic_string();
+		bool bCompress = !compressFilter || compressFilter(path.c_str());
+		if (AddFileFromDisk(path.c_str(), file.path().string().c_str(), bCompress))
+		{
+			++count;
+		}
+	}
+
+	return count;
+}
+
+bool PakWriter::SaveToFile(const Char* fileName)
+{
+	// Sorted by path, when a path is added twice the last one wins
+	std::stable_sort(Entries.begin(), Entries.end(), [](const Entry& a, const Entry& b) { return a.Path < b.Path; });
+	for (size_t i = 1; i < Entries.size();)
+	{
+		if (Entries[i - 1].Path == Entries[i].Path)
+		{
+			Entries.erase(Entries.begin() + (i - 1));
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	const uint32 entryCount = static_cast<uint32>(Entries.size());
+	uint32 slotCount = 1;
+	while (slotCount < entryCount * 2)
+	{
+		slotCount *= 2;
+	}
+
+	// Table of contents up front, so header, entries and paths are paged in together
+	PakHeader header = {};
+	header.Magic = PAK_MAGIC;
+	header.Version = PAK_VERSION;
+	header.EntryCount = entryCount;
+	header.SlotCount = slotCount;
+	header.EntryOffset = sizeof(PakHeader);
+	header.SlotOffset = header.EntryOffset + entryCount * sizeof(PakEntry);
+	header.PathOffset = header.SlotOffset + slotCount * sizeof(uint32);
+
+	std::vector<PakEntry> entries(entryCount);
+	std::vector<uint32> slots(slotCount, PAK_EMPTY_SLOT);
+	std::vector<Char> paths;
+
+	for (uint32 i = 0; i < entryCount; ++i)
+	{
+		PakEntry& entry = entries[i];
+		entry.Hash = HashPath(Entries[i].Path);
+		entry.Size = Entries[i].Size;
+		entry.StoredSize = Entries[i].Data.size();
+		entry.PathOffset = static_cast<uint32>(paths.size());
+		entry.Flags = Entries[i].Flags;
+		paths.insert(paths.end(), Entries[i].Path.c_str(), Entries[i].Path.c_str() + Entries[i].Path.size() + 1);
+
+		uint32 slot = static_cast<uint32>(entry.Hash) & (slotCount - 1);
+		while (slots[slot] != PAK_EMPTY_SLOT)
+		{
+			slot = (slot + 1) & (slotCount - 1);
+		}
+		slots[slot] = i;
+	}
+	header.PathSize = paths.size();
+
+	uint64 cursor = header.PathOffset + header.PathSize;
+	for (PakEntry& entry : entries)
+	{
+		entry.Offset = AlignUp(cursor, entry.StoredSize >= PAK_PAGE_SIZE ? PAK_PAGE_SIZE : PAK_ALIGNMENT);
+		cursor = entry.Offset + entry.StoredSize;
+	}
+
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+	{
+		LOG_ERR(Asset, "Failed to open pak for writing.");
+		return false;
+	}
+
+	bool ret = fwrite(&header, sizeof(header), 1, file) == 1;
+	ret = ret && fwrite(entries.data(), sizeof(PakEntry), entries.size(), file) == entries.size();
+	ret = ret && fwrite(slots.data(), sizeof(uint32), slots.size(), file) == slots.size();
+	ret = ret && fwrite(paths.data(), 1, paths.size(), file) == paths.size();
+
+	static const uint8 padding[PAK_PAGE_SIZE] = {};
+	uint64 written = header.PathOffset + header.PathSize;
+	for (uint32 i = 0; ret && i < entryCount; ++i)
+	{
+		ret = fwrite(padding, 1, entries[i].Offset - written, file) == entries[i].Offset - written;
+		ret = ret && fwrite(Entries[i].Data.data(), 1, Entries[i].Data.size(), file) == Entries[i].Data.size();
+		written = entries[i].Offset + entries[i].StoredSize;
+	}
+
+	fclose(file);
+
+	if (!ret)
+	{
+		LOG_ERR(Asset, "Failed to write pak.");
+	}
+
+	return ret;
+}
+
+PakFile::~PakFile()
+{
+	Close();
+}
+
+bool PakFile::Open(const Char* fileName)
+{
+	Close();
+
+#if PLATFORM_WINDOWS
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		DWORD error = GetLastError();
+		if (error != ERROR_FILE_NOT_FOUND && error != ERROR_PATH_NOT_FOUND)
+		{
+			LOG_ERR(Asset, "Failed to open pak.");
+		}
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+	{
+		LOG_ERR(Asset, "Failed to map pak.");
+		return false;
+	}
+
+	uint8* data = static_cast<uint8*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+	if (!data)
+	{
+		CloseHandle(mapping);
+		LOG_ERR(Asset, "Failed to map pak.");
+		return false;
+	}
+
+	MappingHandle = mapping;
+	Data = data;
+	Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+	{
+		if (errno != ENOENT)
+		{
+			LOG_ERR(Asset, "Failed to open pak.");
+		}
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(PakHeader))
+	{
+		close(file);
+		LOG_ERR(Asset, "Invalid pak size.");
+		return false;
+	}
+
+	size_t size = static_cast<size_t>(fileStat.st_size);
+	void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapped == MAP_FAILED)
+	{
+		LOG_ERR(Asset, "Failed to map pak.");
+		return false;
+	}
+
+	// Entries are read in whatever order assets are requested
+	madvise(mapped, size, MADV_RANDOM);
+
+	Data = static_cast<uint8*>(mapped);
+	Size = size;
+#endif
+
+	Header = reinterpret_cast<const PakHeader*>(Data);
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+
+	Entries = reinterpret_cast<const PakEntry*>(Data + Header->EntryOffset);
+	Slots = reinterpret_cast<const uint32*>(Data + Header->SlotOffset);
+	Paths = reinterpret_cast<const Char*>(Data + Header->PathOffset);
+
+	return true;
+}
+
+void PakFile::Close()
+{
+	if (Data)
+	{
+#if PLATFORM_WINDOWS
+		UnmapViewOfFile(Data);
+		CloseHandle(MappingHandle);
+		MappingHandle = nullptr;
+#else
+		munmap(Data, Size);
+#endif
+	}
+
+	Data = nullptr;
+	Size = 0;
+	Header = nullptr;
+	Entries = nullptr;
+	Slots = nullptr;
+	Paths = nullptr;
+}
+
+bool PakFile::Validate() const
+{
+	if (Size < sizeof(PakHeader) || Header->Magic != PAK_MAGIC || Header->Version != PAK_VERSION)
+	{
+		LOG_ERR(Asset, "Pak header mismatch.");
+		return false;
+	}
+
+	const uint64 entryCount = Header->EntryCount;
+	const uint64 slotCount = Header->SlotCount;
+	if (slotCount == 0 || (slotCount & (slotCount - 1)) || slotCount < entryCount * 2 ||
+		Header->EntryOffset != sizeof(PakHeader) ||
+		Header->SlotOffset != Header->EntryOffset + entryCount * sizeof(PakEntry) ||
+		Header->PathOffset != Header->SlotOffset + slotCount * sizeof(uint32) ||
+		Header->PathOffset > Size || Header->PathSize > Size - Header->PathOffset ||
+		(Header->PathSize && Data[Header->PathOffset + Header->PathSize - 1] != 0))
+	{
+		LOG_ERR(Asset, "Pak table of contents out of range.");
+		return false;
+	}
+
+	const PakEntry* entries = reinterpret_cast<const PakEntry*>(Data + Header->EntryOffset);
+	for (uint64 i = 0; i < entryCount; ++i)
+	{
+		const PakEntry& entry = entries[i];
+		if (entry.Offset > Size || entry.StoredSize > Size - entry.Offset || (entry.Offset & (PAK_ALIGNMENT - 1)) ||
+			entry.PathOffset >= Header->PathSize ||
+			(!(entry.Flags & PEF_Compressed) && entry.StoredSize != entry.Size))
+		{
+			LOG_ERR(Asset, "Pak entry out of range.");
+			return false;
+		}
+	}
+
+	const uint32* slots = reinterpret_cast<const uint32*>(Data + Header->SlotOffset);
+	for (uint64 i = 0; i < slotCount; ++i)
+	{
+		if (slots[i] != PAK_EMPTY_SLOT && slots[i] >= entryCount)
+		{
+			LOG_ERR(Asset, "Pak hash table out of range.");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+const PakEntry* PakFile::Find(const StdString& normalizedPath, uint64 hash) const
+{
+	if (!Header)
+	{
+		return nullptr;
+	}
+
+	// Load factor stays under 1/2, an empty slot ends every probe sequence
+	const uint32 mask = Header->SlotCount - 1;
+	for (uint32 slot = static_cast<uint32>(hash) & mask, probe = 0; probe <= mask; slot = (slot + 1) & mask, ++probe)
+	{
+		const uint32 index = Slots[slot];
+		if (index == PAK_EMPTY_SLOT)
+		{
+			break;
+		}
+
+		const PakEntry& entry = Entries[index];
+		if (entry.Hash == hash && normalizedPath == GetEntryPath(entry))
+		{
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+const PakEntry* PakFile::Find(const Char* path) const
+{
+	StdString normalizedPath = NormalizePath(path);
+	return Find(normalizedPath, HashPath(normalizedPath));
+}
+
+bool PakFile::ReadEntry(const PakEntry& entry, void* dst) const
+{
+	if (entry.Flags & PEF_Compressed)
+	{
+		if (!LZDecompress(GetEntryData(entry), entry.StoredSize, dst, entry.Size))
+		{
+			LOG_ERR(Asset, "Corrupted pak entry.");
+			return false;
+		}
+		return true;
+	}
+
+	memcpy(dst, GetEntryData(entry), entry.Size);
+	return true;
+}
+
+FileData::~FileData()
+{
+	Reset();
+}
+
+FileData::FileData(FileData&& other) :
+	Data(other.Data),
+	Size(other.Size),
+	bOwned(other.bOwned)
+{
+	other.Data = nullptr;
+	other.Size = 0;
+	other.bOwned = false;
+}
+
+FileData& FileData::operator = (FileData&& other)
+{
+	if (this != &other)
+	{
+		Reset();
+		std::swap(Data, other.Data);
+		std::swap(Size, other.Size);
+		std::swap(bOwned, other.bOwned);
+	}
+	return *this;
+}
+
+uint8* FileData::Detach()
+{
+	if (!bOwned)
+	{
+		return nullptr;
+	}
+
+	uint8* data = Data;
+	Data = nullptr;
+	Size = 0;
+	bOwned = false;
+
+	return data;
+}
+
+void FileData::Reset()
+{
+	if (bOwned)
+	{
+		free(Data);
+	}
+
+	Data = nullptr;
+	Size = 0;
+	bOwned = false;
+}
+
+FileSystem& FileSystem::Get()
+{
+	static FileSystem instance;
+	return instance;
+}
+
+FileSystem::~FileSystem()
+{
+	UnmountAll();
+}
+
+bool FileSystem::Mount(const Char* pakFile)
+{
+	std::unique_ptr<PakFile> pak(new PakFile());
+	if (!pak->Open(pakFile))
+	{
+		return false;
+	}
+
+	Paks.push_back(std::move(pak));
+
+	return true;
+}
+
+void FileSystem::UnmountAll()
+{
+	Paks.clear();
+}
+
+void FileSystem::SetLooseRoot(const Char* directory)
+{
+	LooseRoot = directory ? directory : "";
+	if (!LooseRoot.empty() && LooseRoot.back() != '/' && LooseRoot.back() != '\\')
+	{
+		LooseRoot.push_back('/');
+	}
+}
+
+#if !PLATFORM_WINDOWS
+// Matches every directory and file of path which exists with another case, walking one component at a time.
+// Components not found are kept as they are, e.g. for a file about to be written.
+static StdString ResolveLooseCase(const StdString& root, const StdString& path)
+{
+	std::filesystem::path resolved = root.empty() ? std::filesystem::path(".") : std::filesystem::path(root);
+	std::error_code error;
+
+	size_t begin = 0;
+	bool bFound = true;
+	while (begin < path.size())
+	{
+		size_t end = path.find('/', begin);
+		end = end == StdString::npos ? path.size() : end;
+		const StdString component = path.substr(begin, end - begin);
+		begin = end + 1;
+
+		if (!bFound || std::filesystem::exists(resolved / component, error))
+		{
+			resolved /= component;
+			continue;
+		}
+
+		const StdString normalizedComponent = NormalizePath(component.c_str());
+		StdString match = component;
+		bFound = false;
+		for (std::filesystem::directory_iterator it(resolved, error), itEnd; !error && it != itEnd; it.increment(error))
+		{
+			const StdString name = it->path().filename().string();
+			if (NormalizePath(name.c_str()) == normalizedComponent)
+			{
+				match = name;
+				bFound = true;
+				break;
+			}
+		}
+		resolved /= match;
+	}
+
+	return root.empty() ? resolved.lexically_relative(".").generic_string() : resolved.generic_string();
+}
+#endif
+
+StdString FileSystem::GetLoosePath(const Char* path) const
+{
+	// Separators as in paks, the case of the path is kept for files not there yet
+	const StdString cleanPath = CleanPath(path, false);
+	StdString loosePath = LooseRoot + cleanPath;
+
+#if !PLATFORM_WINDOWS
+	// Case insensitive like pak lookups, only costs a directory walk when the exact path is missing
+	struct stat fileStat;
+	if (stat(loosePath.c_str(), &fileStat) != 0)
+	{
+		return ResolveLooseCase(LooseRoot, cleanPath);
+	}
+#endif
+
+	return loosePath;
+}
+
+const PakEntry* FileSystem::FindPacked(const Char* path, const PakFile** outPak) const
+{
+	if (Paks.empty())
+	{
+		return nullptr;
+	}
+
+	StdString normalizedPath = NormalizePath(path);
+	uint64 hash = HashPath(normalizedPath);
+
+	for (auto it = Paks.rbegin(); it != Paks.rend(); ++it)
+	{
+		if (const PakEntry* entry = (*it)->Find(normalizedPath, hash))
+		{
+			*outPak = it->get();
+			return entry;
+		}
+	}
+
+	return nullptr;
+}
+
+bool FileSystem::Exists(const Char* path) const
+{
+	return IsPacked(path) || ExistsLoose(path);
+}
+
+bool FileSystem::ExistsLoose(const Char* path) const
+{
+	if (LooseRoot.empty())
+	{
+		return false;
+	}
+
+#if PLATFORM_WINDOWS
+	DWORD attributes = GetFileAttributesA(GetLoosePath(path).c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat fileStat;
+	return stat(GetLoosePath(path).c_str(), &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+#endif
+}
+
+bool FileSystem::IsPacked(const Char* path) const
+{
+	const PakFile* pak = nullptr;
+	return FindPacked(path, &pak) != nullptr;
+}
+
+FileData FileSystem::Read(const Char* path) const
+{
+	FileData file;
+
+	const PakFile* pak = nullptr;
+	if (const PakEntry* entry = FindPacked(path, &pak))
+	{
+		if (!(entry->Flags & PEF_Compressed))
+		{
+			file.Data = pak->GetEntryData(*entry);
+			file.Size = entry->Size;
+			return file;
+		}
+
+		// malloc is at least 16 bytes aligned on 64 bits platforms, enough for fast-load images
+		uint8* data = static_cast<uint8*>(malloc(std::max<uint64>(entry->Size, 1)));
+		if (!data || !pak->ReadEntry(*entry, data))
+		{
+			free(data);
+			return file;
+		}
+
+		file.Data = data;
+		file.Size = entry->Size;
+		file.bOwned = true;
+		return file;
+	}
+
+	// Missing file is up to the caller, it is often just not cooked yet
+	if (LooseRoot.empty())
+	{
+		return file;
+	}
+
+	FILE* looseFile = fopen(GetLoosePath(path).c_str(), "rb");
+	if (!looseFile)
+	{
+		return file;
+	}
+
+	fseek(looseFile, 0, SEEK_END);
+	long fileSize = ftell(looseFile);
+	fseek(looseFile, 0, SEEK_SET);
+
+	uint8* data = fileSize >= 0 ? static_cast<uint8*>(malloc(std::max<long>(fileSize, 1))) : nullptr;
+	bool ret = data && fread(data, 1, fileSize, looseFile) == (size_t)fileSize;
+	fclose(looseFile);
+
+	if (!ret)
+	{
+		free(data);
+		LOG_ERR(Asset, "Failed to read loose file.");
+		return file;
+	}
+
+	file.Data = data;
+	file.Size = fileSize;
+	file.bOwned = true;
+
+	return file;
+}
+
+END_NAMESPACE
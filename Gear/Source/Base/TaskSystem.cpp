@@ -0,0 +1,140 @@
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+
+BEGIN_NAMESPACE_GEAR
+
+// Batches per thread, a few more than one so uneven batches even out
+#define TASK_BATCHES_PER_THREAD 4
+
+TaskSystem& TaskSystem::Get()
+{
+	static TaskSystem instance;
+	return instance;
+}
+
+TaskSystem::~TaskSystem()
+{
+	Shutdown();
+}
+
+void TaskSystem::Initialize(uint32 workerCount)
+{
+	if (!Workers.empty())
+	{
+		return;
+	}
+
+	if (workerCount == 0)
+	{
+		uint32 hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	bShutdown = false;
+	Workers.reserve(workerCount);
+	for (uint32 i = 0; i < workerCount; ++i)
+	{
+		Workers.emplace_back(&TaskSystem::WorkerMain, this);
+	}
+}
+
+void TaskSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		bShutdown = true;
+	}
+	WakeCondition.notify_all();
+
+	for (std::thread& worker : Workers)
+	{
+		worker.join();
+	}
+	Workers.clear();
+}
+
+uint32 TaskSystem::GetBatchSize(uint32 count, uint32 minBatchSize) const
+{
+	uint32 batchCount = GetConcurrency() * TASK_BATCHES_PER_THREAD;
+	uint32 batchSize = (count + batchCount - 1) / batchCount;
+	return std::max(batchSize, std::max(minBatchSize, 1u));
+}
+
+void TaskSystem::Run(ParallelForJob& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Jobs.push_back(&job);
+	}
+	WakeCondition.notify_all();
+
+	ExecuteBatches(job);
+
+	// No new worker can pick the job up once it is off the list
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		auto it = std::find(Jobs.begin(), Jobs.end(), &job);
+		if (it != Jobs.end())
+		{
+			Jobs.erase(it);
+		}
+	}
+
+	// Workers still inside are finishing their last batch
+	while (job.ActiveWorkers.load(std::memory_order_acquire) != 0)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void TaskSystem::WorkerMain()
+{
+	while (true)
+	{
+		ParallelForJob* job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			WakeCondition.wait(lock, [this]() { return bShutdown || !Jobs.empty(); });
+
+			if (bShutdown)
+			{
+				return;
+			}
+
+			// Drop jobs with every batch handed out, their owners wait for running batches only
+			while (!Jobs.empty() && Jobs.front()->NextIndex.load(std::memory_order_relaxed) >= Jobs.front()->Count)
+			{
+				Jobs.erase(Jobs.begin());
+			}
+
+			if (Jobs.empty())
+			{
+				continue;
+			}
+
+			job = Jobs.front();
+			job->ActiveWorkers.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		ExecuteBatches(*job);
+		job->ActiveWorkers.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+void TaskSystem::ExecuteBatches(ParallelForJob& job)
+{
+	while (true)
+	{
+		uint32 begin = job.NextIndex.fetch_add(job.BatchSize, std::memory_order_relaxed);
+		if (begin >= job.Count)
+		{
+			break;
+		}
+
+		uint32 end = std::min(begin + job.BatchSize, job.Count);
+		job.Func(job.Context, begin, end);
+	}
+}
+
+END_NAMESPACE
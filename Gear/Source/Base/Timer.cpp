@@ -0,0 +1,265 @@
+#include "Base/Timer.h"
+#include "Base/Misc.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+#if PLATFORM_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if TIMER_HAS_RDTSC && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+BEGIN_NAMESPACE_GEAR
+
+// Time spent spinning for each calibration sample
+#define TIMER_CALIBRATION_MILLISECONDS 10
+#define TIMER_CALIBRATION_SAMPLES 3
+
+bool Timer::bInitialized = false;
+bool Timer::bUseTSC = false;
+uint64 Timer::CyclesPerSecond = 1;
+uint64 Timer::BaseCycles = 0;
+double Timer::SecondsPerCycle = 1.0;
+
+void Timer::Initialize()
+{
+	static std::once_flag initFlag;
+	std::call_once(initFlag, []()
+	{
+		uint64 tscFrequency = IsInvariantTSCSupported() ? CalibrateTSC() : 0;
+
+		// Keep monotonic clock if calibration came out obviously wrong
+		bUseTSC = tscFrequency > GetMonotonicFrequency() / 1000;
+		CyclesPerSecond = bUseTSC ? tscFrequency : GetMonotonicFrequency();
+		SecondsPerCycle = 1.0 / static_cast<double>(CyclesPerSecond);
+		BaseCycles = GetCycles();
+
+		bInitialized = true;
+	});
+}
+
+uint64 Timer::GetMonotonicTicks()
+{
+#if PLATFORM_WINDOWS
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return static_cast<uint64>(counter.QuadPart);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64>(ts.tv_sec) * 1000000000ull + static_cast<uint64>(ts.tv_nsec);
+#endif
+}
+
+uint64 Timer::GetMonotonicFrequency()
+{
+#if PLATFORM_WINDOWS
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return static_cast<uint64>(frequency.QuadPart);
+#else
+	return 1000000000ull;
+#endif
+}
+
+bool Timer::IsInvariantTSCSupported()
+{
+#if TIMER_HAS_RDTSC
+	// CPUID.80000007H:EDX[8], TSC runs at constant rate across P/C states
+	uint32 regs[4] = { 0, 0, 0, 0 };
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0x80000000);
+	if (static_cast<uint32>(info[0]) < 0x80000007)
+	{
+		return false;
+	}
+	__cpuid(info, 0x80000007);
+	regs[3] = static_cast<uint32>(info[3]);
+#else
+	if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+	{
+		return false;
+	}
+	__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+	return (regs[3] & (1u << 8)) != 0;
+#else
+	return false;
+#endif
+}
+
+uint64 Timer::CalibrateTSC()
+{
+#if TIMER_HAS_RDTSC
+	const uint64 monotonicFrequency = GetMonotonicFrequency();
+	const uint64 spinTicks = monotonicFrequency * TIMER_CALIBRATION_MILLISECONDS / 1000;
+
+	uint64 samples[TIMER_CALIBRATION_SAMPLES];
+	for (uint32 i = 0; i < TIMER_CALIBRATION_SAMPLES; ++i)
+	{
+		uint64 monotonicBegin = GetMonotonicTicks();
+		uint64 tscBegin = __rdtsc();
+
+		uint64 monotonicEnd = monotonicBegin;
+		while (monotonicEnd - monotonicBegin < spinTicks)
+		{
+			monotonicEnd = GetMonotonicTicks();
+		}
+		uint64 tscEnd = __rdtsc();
+
+		double elapsedSeconds = static_cast<double>(monotonicEnd - monotonicBegin) / monotonicFrequency;
+		samples[i] = static_cast<uint64>((tscEnd - tscBegin) / elapsedSeconds);
+	}
+
+	// Median rejects a sample disturbed by preemption
+	std::sort(samples, samples + TIMER_CALIBRATION_SAMPLES);
+	return samples[TIMER_CALIBRATION_SAMPLES / 2];
+#else
+	return 0;
+#endif
+}
+
+void Stopwatch::Start()
+{
+	if (!bRunning)
+	{
+		StartCycles = Timer::GetCycles();
+		bRunning = true;
+	}
+}
+
+void Stopwatch::Stop()
+{
+	if (bRunning)
+	{
+		AccumulatedCycles += Timer::GetCycles() - StartCycles;
+		bRunning = false;
+	}
+}
+
+void Stopwatch::Reset()
+{
+	StartCycles = 0;
+	AccumulatedCycles = 0;
+	bRunning = false;
+}
+
+uint64 Stopwatch::GetElapsedCycles() const
+{
+	return bRunning ? AccumulatedCycles + (Timer::GetCycles() - StartCycles) : AccumulatedCycles;
+}
+
+ScopedStopwatch::~ScopedStopwatch()
+{
+	double elapsedMilliseconds = Timer::CyclesToMilliseconds(Timer::GetCycles() - StartCycles);
+
+	if (OutMilliseconds)
+	{
+		*OutMilliseconds += elapsedMilliseconds;
+	}
+	else
+	{
+		Char msg[256];
+		snprintf(msg, sizeof(msg), "[Stopwatch] %s: %.3f ms\n", Name, elapsedMilliseconds);
+		ApplicationMisc::PrintMessage(msg);
+	}
+}
+
+FrameTimeTracker::FrameTimeTracker(uint32 windowSize, double hitchScale, double hitchMinMilliseconds) :
+	WindowSize(std::max(windowSize, 1u)),
+	HitchScale(hitchScale),
+	HitchMinMilliseconds(hitchMinMilliseconds)
+{
+	Samples.reserve(WindowSize);
+}
+
+void FrameTimeTracker::Tick()
+{
+	uint64 cycles = Timer::GetCycles();
+
+	// First tick only sets the reference point
+	if (LastCycles)
+	{
+		AddSample(Timer::CyclesToMilliseconds(cycles - LastCycles));
+	}
+	LastCycles = cycles;
+}
+
+void FrameTimeTracker::AddSample(double milliseconds)
+{
+	// Compare against the window before this frame gets in
+	bLastFrameHitch = false;
+	if (!Samples.empty())
+	{
+		double average = WindowSum / Samples.size();
+		bLastFrameHitch = milliseconds > average * HitchScale && milliseconds > HitchMinMilliseconds;
+		if (bLastFrameHitch)
+		{
+			++HitchCount;
+		}
+	}
+
+	if (Samples.size() < WindowSize)
+	{
+		Samples.push_back(milliseconds);
+	}
+	else
+	{
+		WindowSum -= Samples[NextSample];
+		Samples[NextSample] = milliseconds;
+	}
+	WindowSum += milliseconds;
+	NextSample = (NextSample + 1) % WindowSize;
+
+	LastMilliseconds = milliseconds;
+	++FrameCount;
+}
+
+void FrameTimeTracker::Reset()
+{
+	Samples.clear();
+	NextSample = 0;
+	WindowSum = 0.0;
+	HitchCount = 0;
+	LastCycles = 0;
+	LastMilliseconds = 0.0;
+	FrameCount = 0;
+	bLastFrameHitch = false;
+}
+
+FrameTimeStats FrameTimeTracker::GetStats() const
+{
+	FrameTimeStats stats = {};
+	stats.SampleCount = static_cast<uint32>(Samples.size());
+	stats.HitchCount = HitchCount;
+
+	if (Samples.empty())
+	{
+		return stats;
+	}
+
+	auto minmax = std::minmax_element(Samples.begin(), Samples.end());
+	stats.MinMilliseconds = *minmax.first;
+	stats.MaxMilliseconds = *minmax.second;
+	stats.AvgMilliseconds = WindowSum / Samples.size();
+
+	// Nearest rank
+	std::vector<double> sorted(Samples);
+	size_t rank = (sorted.size() * 99 + 99) / 100 - 1;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	stats.P99Milliseconds = sorted[rank];
+
+	return stats;
+}
+
+END_NAMESPACE
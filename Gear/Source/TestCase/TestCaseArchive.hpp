@@ -0,0 +1,76 @@
+#pragma once
+
+#include "TestCase/TestCase.h"
+#include "Base/Archive.h"
+
+#include <cstring>
+
+BEGIN_NAMESPACE_GEAR
+
+struct FastLoadTestNode
+{
+    uint32 Id;
+    uint32 ChildCount;
+    FastLoadPtr<FastLoadTestNode> Children;
+    FastLoadPtr<const Char> Name;
+};
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseFastLoad)
+{
+    const Char* fileName = "TestCaseFastLoad.bin";
+    const Char* names[] = { "Root", "ChildA", "ChildB" };
+
+    // Root with two children, names stored as blobs in the image
+    FastLoadWriter writer;
+    uint64 rootOffset = writer.Allocate<FastLoadTestNode>();
+    uint64 childrenOffset = writer.Allocate<FastLoadTestNode>(2);
+
+    for (uint32 i = 0; i < 3; ++i)
+    {
+        uint64 nodeOffset = i == 0 ? rootOffset : childrenOffset + (i - 1) * sizeof(FastLoadTestNode);
+        uint64 nameOffset = writer.Write(names[i], strlen(names[i]) + 1, 1);
+
+        FastLoadTestNode* node = writer.Resolve<FastLoadTestNode>(nodeOffset);
+        node->Id = i;
+        node->ChildCount = i == 0 ? 2 : 0;
+
+        writer.Link(nodeOffset + offsetof(FastLoadTestNode, Name), nameOffset);
+        writer.Link(nodeOffset + offsetof(FastLoadTestNode, Children), i == 0 ? childrenOffset : 0);
+    }
+    writer.SetRoot(rootOffset);
+
+    if (!writer.SaveToFile(fileName))
+    {
+        return false;
+    }
+
+    auto verify = [&names](const FastLoadImage& image)
+    {
+        const FastLoadTestNode* root = image.GetRoot<FastLoadTestNode>();
+        if (!root || root->ChildCount != 2 || strcmp(root->Name.Get(), names[0]) != 0)
+        {
+            return false;
+        }
+
+        for (uint32 i = 0; i < root->ChildCount; ++i)
+        {
+            const FastLoadTestNode& child = root->Children[i];
+            if (child.Id != i + 1 || child.Children || strcmp(child.Name.Get(), names[i + 1]) != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    FastLoadImage loaded;
+    FastLoadImage mapped;
+    bool ret = loaded.LoadFromFile(fileName) && verify(loaded) &&
+               mapped.MapFromFile(fileName) && verify(mapped);
+
+    remove(fileName);
+
+    return ret;
+}
+
+END_NAMESPACE
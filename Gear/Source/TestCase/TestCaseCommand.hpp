@@ -0,0 +1,67 @@
+#pragma once
+
+#include "TestCase/TestCase.h"
+#include "Base/Command.hpp"
+
+#include <thread>
+
+BEGIN_NAMESPACE_GEAR
+
+struct CommandTestContext
+{
+    uint64 Sum = 0;
+    uint64 NextValue = 0;
+    bool bInOrder = true;
+};
+
+struct CommandTestAdd
+{
+    explicit CommandTestAdd(uint64 value) : Value(value) {}
+
+    void Execute(CommandTestContext& context)
+    {
+        context.bInOrder &= context.NextValue == Value;
+        context.NextValue = Value + 1;
+        context.Sum += Value;
+    }
+
+    uint64 Value;
+};
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseCommandRing)
+{
+    const uint64 frameCount = 1000;
+    const uint64 commandsPerFrame = 3000;  // spills over several pages
+
+    TCommandRing<CommandTestContext> ring;
+    CommandTestContext context;
+
+    std::thread consumer([&ring, &context]()
+    {
+        while (ring.ExecuteFrame(context)) {}
+    });
+
+    uint64 value = 0;
+    uint64 lambdaFrames = 0;
+    for (uint64 frame = 0; frame < frameCount; ++frame)
+    {
+        TCommandList<CommandTestContext>* commands = ring.BeginFrame();
+        for (uint64 i = 0; i < commandsPerFrame; ++i)
+        {
+            commands->Enqueue<CommandTestAdd>(value++);
+        }
+        commands->EnqueueLambda([&lambdaFrames](CommandTestContext&) { ++lambdaFrames; });
+        ring.EndFrame();
+    }
+
+    ring.Shutdown();
+    consumer.join();
+
+    const uint64 total = frameCount * commandsPerFrame;
+    return context.bInOrder &&
+           context.Sum == total * (total - 1) / 2 &&
+           lambdaFrames == frameCount &&
+           ring.GetConsumedFrames() == frameCount;
+}
+
+END_NAMESPACE
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "TestCase/TestCase.h"
+#include "Base/Archive.h"
+#include "Base/Compression.h"
+#include "Base/FileSystem.h"
+
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+BEGIN_NAMESPACE_GEAR
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseCompression)
+{
+    std::mt19937 random(7);
+
+    std::vector<std::vector<uint8>> inputs(5);
+    // Text like, runs, noise, tiny and empty
+    const Char* text = "vertex position normal texcoord ";
+    for (uint32 i = 0; i < 4096; ++i)
+    {
+        inputs[0].push_back(static_cast<uint8>(text[(i * 7 + i / 31) % strlen(text)]));
+    }
+    inputs[1].assign(100000, 0xAB);
+    for (uint32 i = 0; i < 65536; ++i)
+    {
+        inputs[2].push_back(static_cast<uint8>(random()));
+    }
+    inputs[3] = { 1, 2, 3 };
+
+    for (const std::vector<uint8>& input : inputs)
+    {
+        std::vector<uint8> compressed(LZCompressBound(input.size()));
+        size_t compressedSize = LZCompress(input.data(), input.size(), compressed.data(), compressed.size());
+        if (compressedSize == 0)
+        {
+            return false;
+        }
+
+        std::vector<uint8> output(input.size());
+        if (!LZDecompress(compressed.data(), compressedSize, output.data(), output.size()) || output != input)
+        {
+            return false;
+        }
+
+        // Truncated blocks and wrong sizes are rejected, not read or written out of bounds
+        if (compressedSize > 1 && LZDecompress(compressed.data(), compressedSize - 1, output.data(), output.size()))
+        {
+            return false;
+        }
+        output.resize(input.size() + 1);
+        if (LZDecompress(compressed.data(), compressedSize, output.data(), output.size()))
+        {
+            return false;
+        }
+    }
+
+    // Repetitive data has to shrink
+    std::vector<uint8> compressed(LZCompressBound(inputs[1].size()));
+    return LZCompress(inputs[1].data(), inputs[1].size(), compressed.data(), compressed.size()) < inputs[1].size() / 100;
+}
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseFileSystem)
+{
+    const Char* looseRoot = "TestCaseFileSystem";
+    const Char* pakFile = "TestCaseFileSystem.pak";
+
+    std::mt19937 random(11);
+
+    std::vector<uint8> text(20000);
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        text[i] = static_cast<uint8>('a' + (i % 13));
+    }
+    std::vector<uint8> noise(10000);
+    for (uint8& byte : noise)
+    {
+        byte = static_cast<uint8>(random());
+    }
+
+    FastLoadWriter imageWriter;
+    uint64 rootOffset = imageWriter.Allocate<FastLoadPtr<const Char>>();
+    imageWriter.Link(rootOffset, imageWriter.Write("Packed", 7, 1));
+    imageWriter.SetRoot(rootOffset);
+    const std::vector<uint8>& image = imageWriter.Finalize();
+
+    // Loose only file, and one the pak shadows
+    std::filesystem::create_directories(std::filesystem::path(looseRoot) / "Mesh");
+    auto writeLoose = [looseRoot](const Char* path, const Char* content)
+    {
+        FILE* file = fopen((StdString(looseRoot) + "/" + path).c_str(), "wb");
+        fwrite(content, 1, strlen(content), file);
+        fclose(file);
+    };
+    writeLoose("Mesh/Loose.txt", "loose");
+    writeLoose("Mesh/Shadowed.txt", "loose");
+
+    FastLoadWriter looseImageWriter;
+    rootOffset = looseImageWriter.Allocate<FastLoadPtr<const Char>>();
+    looseImageWriter.Link(rootOffset, looseImageWriter.Write("Loose", 6, 1));
+    looseImageWriter.SetRoot(rootOffset);
+    bool ret = looseImageWriter.SaveToFile((StdString(looseRoot) + "/Mesh/Image.lod").c_str());
+
+    PakWriter writer;
+    writer.AddFile("Shader/Text.spv", text.data(), text.size());
+    writer.AddFile("Mesh/Noise.bin", noise.data(), noise.size());
+    writer.AddFile("Mesh/Image.lod", image.data(), image.size(), false);
+    writer.AddFile("Mesh/Shadowed.txt", "stale", 5);
+    writer.AddFile("Mesh/Shadowed.txt", "packed", 6);
+    ret = writer.SaveToFile(pakFile) && ret;
+
+    FileSystem& fileSystem = FileSystem::Get();
+    fileSystem.SetLooseRoot(looseRoot);
+    ret = ret && fileSystem.Mount(pakFile) && !fileSystem.Mount("TestCaseFileSystemMissing.pak");
+
+    auto matches = [](const FileData& file, const void* data, size_t size)
+    {
+        return file && file.GetSize() == size && memcmp(file.GetData(), data, size) == 0;
+    };
+
+    if (ret)
+    {
+        // Compressible entry is decompressed to a buffer, noise is stored and read in place
+        FileData textFile = fileSystem.Read("Shader/Text.spv");
+        FileData noiseFile = fileSystem.Read("./mesh\\NOISE.bin");
+        ret = matches(textFile, text.data(), text.size()) && !textFile.IsMapped() &&
+              matches(noiseFile, noise.data(), noise.size()) && noiseFile.IsMapped() &&
+              (reinterpret_cast<uintptr_t>(noiseFile.GetData()) & (PAK_PAGE_SIZE - 1)) == 0;
+
+        ret = ret && matches(fileSystem.Read("Mesh/Shadowed.txt"), "packed", 6) &&
+              matches(fileSystem.Read("Mesh/Loose.txt"), "loose", 5) && !fileSystem.IsPacked("Mesh/Loose.txt") &&
+              fileSystem.Exists("Mesh/Loose.txt") && !fileSystem.Exists("Mesh/Missing.txt") && !fileSystem.Read("Mesh/Missing.txt");
+
+        // Loose files resolve like packed ones whatever the case and separators, so do directories of files not written yet
+        ret = ret && matches(fileSystem.Read("./MESH\\loose.TXT"), "loose", 5) && fileSystem.Exists("mesh//LOOSE.txt") &&
+              fileSystem.GetLoosePath("mesh\\loose.txt") == StdString(looseRoot) + "/Mesh/Loose.txt" &&
+              fileSystem.GetLoosePath("MESH/New.txt") == StdString(looseRoot) + "/Mesh/New.txt";
+
+        FastLoadImage packedImage;
+        ret = ret && packedImage.LoadFromFileSystem("Mesh/Image.lod") &&
+              strcmp(packedImage.GetRoot<FastLoadPtr<const Char>>()->Get(), "Packed") == 0;
+
+        // Cooked assets, the loose copy is found under the pak on request and missing ones are no error
+        FastLoadImage looseImage;
+        ret = ret && packedImage.LoadIfExists("mesh/IMAGE.lod") && strcmp(packedImage.GetRoot<FastLoadPtr<const Char>>()->Get(), "Packed") == 0 &&
+              looseImage.LoadIfExists("mesh/IMAGE.lod", true) && strcmp(looseImage.GetRoot<FastLoadPtr<const Char>>()->Get(), "Loose") == 0 &&
+              !looseImage.LoadIfExists("Mesh/Missing.lod") && !looseImage.LoadIfExists("Mesh/Missing.lod", true) && !looseImage.GetData();
+    }
+
+    // Without loose root only packed files are there
+    fileSystem.SetLooseRoot("");
+    ret = ret && !fileSystem.Read("Mesh/Loose.txt") && fileSystem.Read("Mesh/Shadowed.txt");
+
+    fileSystem.UnmountAll();
+    remove(pakFile);
+    std::filesystem::remove_all(looseRoot);
+
+    return ret;
+}
+
+END_NAMESPACE
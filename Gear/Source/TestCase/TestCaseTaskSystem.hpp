@@ -0,0 +1,67 @@
+#pragma once
+
+#include "TestCase/TestCase.h"
+#include "Base/TaskSystem.h"
+
+#include <atomic>
+#include <vector>
+
+BEGIN_NAMESPACE_GEAR
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseTaskSystem)
+{
+    TaskSystem& taskSystem = TaskSystem::Get();
+    taskSystem.Initialize(4);
+
+    // Every index visited exactly once
+    const uint32 count = 1000003;
+    std::vector<uint8> visits(count, 0);
+    taskSystem.ParallelFor(count, 64, [&visits](uint32 begin, uint32 end)
+    {
+        for (uint32 i = begin; i < end; ++i)
+        {
+            ++visits[i];
+        }
+    });
+
+    bool bVisitedOnce = true;
+    for (uint8 visit : visits)
+    {
+        bVisitedOnce &= visit == 1;
+    }
+
+    // Nested calls from inside a batch
+    const uint32 outerCount = 64;
+    const uint32 innerCount = 1000;
+    std::atomic<uint64> nestedSum{ 0 };
+    taskSystem.ParallelFor(outerCount, 1, [&taskSystem, &nestedSum](uint32 begin, uint32 end)
+    {
+        for (uint32 outer = begin; outer < end; ++outer)
+        {
+            taskSystem.ParallelFor(innerCount, 16, [&nestedSum](uint32 innerBegin, uint32 innerEnd)
+            {
+                uint64 sum = 0;
+                for (uint32 inner = innerBegin; inner < innerEnd; ++inner)
+                {
+                    sum += inner;
+                }
+                nestedSum += sum;
+            });
+        }
+    });
+
+    // Small ranges run inline
+    uint32 inlineCalls = 0;
+    taskSystem.ParallelFor(10, 100, [&inlineCalls](uint32 begin, uint32 end)
+    {
+        inlineCalls += (begin == 0 && end == 10) ? 1 : 100;
+    });
+
+    taskSystem.Shutdown();
+
+    return bVisitedOnce &&
+           nestedSum == uint64(outerCount) * innerCount * (innerCount - 1) / 2 &&
+           inlineCalls == 1;
+}
+
+END_NAMESPACE
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "TestCase/TestCase.h"
+#include "Base/Timer.h"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+BEGIN_NAMESPACE_GEAR
+
+DECLARE_AND_IMPLEMENT_TESTCASE(TestCaseTimer)
+{
+    Timer::Initialize();
+
+    // Calibrated clock should agree with std::chrono over a short sleep
+    auto chronoBegin = std::chrono::steady_clock::now();
+    Stopwatch stopwatch;
+    stopwatch.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    stopwatch.Stop();
+    double chronoMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - chronoBegin).count();
+
+    if (std::fabs(stopwatch.GetElapsedMilliseconds() - chronoMilliseconds) > chronoMilliseconds * 0.05)
+    {
+        return false;
+    }
+
+    // Steady frames followed by one spike
+    FrameTimeTracker tracker(100);
+    for (uint32 i = 0; i < 99; ++i)
+    {
+        tracker.AddSample(16.0);
+        if (tracker.IsLastFrameHitch())
+        {
+            return false;
+        }
+    }
+    tracker.AddSample(100.0);
+
+    FrameTimeStats stats = tracker.GetStats();
+    return tracker.IsLastFrameHitch() &&
+           stats.HitchCount == 1 &&
+           stats.MinMilliseconds == 16.0 &&
+           stats.MaxMilliseconds == 100.0 &&
+           stats.P99Milliseconds == 16.0 &&
+           std::fabs(stats.AvgMilliseconds - 16.84) < 1e-6;
+}
+
+END_NAMESPACE
@@ -1,8 +1,21 @@
-#include "TestCase\TestCase.h"
+#include "TestCase/TestCase.h"
+#include "TestCase/TestCaseArchive.hpp"
+#include "TestCase/TestCaseCommand.hpp"
+#include "TestCase/TestCaseFileSystem.hpp"
+#include "TestCase/TestCaseTaskSystem.hpp"
+#include "TestCase/TestCaseTimer.hpp"
 
 int main()
 {
+	Gear::Timer::Initialize();
+
 	RUN_TESTCASE_SIMPLE(Gear::TestCaseDebug, log);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseFastLoad, fastload);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseCompression, compression);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseFileSystem, filesystem);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseTimer, timer);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseCommandRing, command);
+	RUN_TESTCASE_CONDITIONAL(Gear::TestCaseTaskSystem, task);
 
 	return 0;
 }
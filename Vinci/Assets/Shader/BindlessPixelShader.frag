@@ -0,0 +1,38 @@
+#version 450
+#extension GL_ARB_separate_shader_objects: enable
+#extension GL_EXT_nonuniform_qualifier: require
+
+// Bindless variant of DummyPixelShader.frag, textures come from the bindless set (set 1) through the material table.
+// Material index is per instance, so it may differ within one instanced draw and needs nonuniformEXT.
+
+// Slot of the material table in bindless buffers, same as MATERIAL_TABLE_BUFFER in main.cpp
+#define MATERIAL_TABLE_BUFFER 0
+
+// Same layout as MaterialData in main.cpp
+struct Material
+{
+	uint albedoTexture;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+	vec4 baseColor;
+};
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragMaterialIndex;
+
+layout(set = 1, binding = 0) uniform sampler2D bindlessTextures[];
+
+layout(std430, set = 1, binding = 1) readonly buffer MaterialTable
+{
+	Material materials[];
+}bindlessMaterials[];
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    Material material = bindlessMaterials[MATERIAL_TABLE_BUFFER].materials[fragMaterialIndex];
+    outColor = texture(bindlessTextures[nonuniformEXT(material.albedoTexture)], fragUV)* material.baseColor;
+}
@@ -11,5 +11,10 @@ REM glslangValidator -V -x -o glsl_shader.vert.u32 glsl_shader.vert
 
 %VULKAN_SDK%/Bin/glslangValidator.exe -V DummyVertexShader.vert
 %VULKAN_SDK%/Bin/glslangValidator.exe -V DummyPixelShader.frag
+%VULKAN_SDK%/Bin/glslangValidator.exe -V BindlessPixelShader.frag -o bindless_frag.spv
+%VULKAN_SDK%/Bin/glslangValidator.exe -V CullInstances.comp -o cull.spv
+%VULKAN_SDK%/Bin/glslangValidator.exe -V CompactDraws.comp -o compact.spv
+%VULKAN_SDK%/Bin/glslangValidator.exe -V ClusterCull.comp -o clustercull.spv
+%VULKAN_SDK%/Bin/glslangValidator.exe -V Skinning.comp -o skinning.spv
 
 pause
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragMaterialIndex;
 layout(binding = 1) uniform sampler2D defaultSampler;
 
 layout(location = 0) out vec4 outColor;
@@ -7,6 +7,7 @@ layout(location= 2) in vec2 inUV;
 
 layout(location= 0) out vec3 fragColor;
 layout(location= 1) out vec2 fragUV;
+layout(location= 2) flat out uint fragMaterialIndex;
 
 layout(binding = 0) uniform UniformBufferObject
 { 
@@ -15,6 +16,29 @@ layout(binding = 0) uniform UniformBufferObject
 	mat4 proj;
 }ubo;
 
+// Per-instance data in SoA layout, indexed by gl_InstanceIndex (firstInstance included)
+layout(std430, binding = 2) readonly buffer InstanceTransforms
+{
+	mat4 transforms[];
+}instanceTransforms;
+
+layout(std430, binding = 3) readonly buffer InstanceMaterials
+{
+	uint materialIndices[];
+}instanceMaterials;
+
+// Instances that survived culling, written by compute pass or by CPU culling
+layout(std430, binding = 4) readonly buffer VisibleInstances
+{
+	uint indices[];
+}visibleInstances;
+
+// Added to gl_InstanceIndex, CPU culled draws push their visible slot here and keep firstInstance 0
+layout(push_constant) uniform DrawConstants
+{
+	uint firstInstance;
+}drawConstants;
+
 out gl_PerVertex
 {
     vec4 gl_Position;
@@ -22,7 +46,10 @@ out gl_PerVertex
 
 void main()
 {
-    gl_Position = ubo.proj* ubo.view* ubo.model* vec4(inPosition, 1.0f);
+    uint instanceIdx = visibleInstances.indices[drawConstants.firstInstance + gl_InstanceIndex];
+    mat4 instanceTransform = instanceTransforms.transforms[instanceIdx];
+    gl_Position = ubo.proj* ubo.view* ubo.model* instanceTransform* vec4(inPosition, 1.0f);
+    fragMaterialIndex = instanceMaterials.materialIndices[instanceIdx];
     fragColor = inColor;
     fragUV = inUV;
 }
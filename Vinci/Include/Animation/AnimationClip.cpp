@@ -0,0 +1,671 @@
+#include "AnimationClip.h"
+
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Bones blended per SIMD iteration
+static const uint32_t POSE_GROUP_SIZE = 8;
+
+// Smallest three components of a normalized quaternion are within +-1/sqrt(2)
+static const float SMALLEST_THREE_RANGE = 0.70710678f;
+static const float SMALLEST_THREE_SCALE = 32767.0f;
+static const float SMALLEST_THREE_STEP = 2.0f * SMALLEST_THREE_RANGE / SMALLEST_THREE_SCALE;
+
+// Translations/ scales get as many bits as error budget needs over the range of their track,
+// keys convert to float exactly up to 24
+static const uint32_t VECTOR_MIN_BITS = 16;
+static const uint32_t VECTOR_MAX_BITS = 24;
+
+static uint32_t PadToPoseGroup(uint32_t count)
+{
+	return (count + POSE_GROUP_SIZE - 1) & ~(POSE_GROUP_SIZE - 1);
+}
+
+//// Quantization
+
+// 3 x 15 bits for smallest components, index of dropped (largest) one in top bits of first two
+static void EncodeRotation(const Math::Quat& rotation, uint16_t* outKey)
+{
+	float q[4] = { rotation.x, rotation.y, rotation.z, rotation.w };
+
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i)
+	{
+		largest = fabsf(q[i]) > fabsf(q[largest]) ? i : largest;
+	}
+
+	// q and -q are the same rotation, make dropped component positive
+	const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint32_t component = 0;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		if (i == largest)
+		{
+			continue;
+		}
+
+		float normalized = std::min(std::max(q[i] * sign / SMALLEST_THREE_RANGE, -1.0f), 1.0f);
+		outKey[component++] = static_cast<uint16_t>(floorf((normalized * 0.5f + 0.5f) * SMALLEST_THREE_SCALE + 0.5f));
+	}
+
+	outKey[0] |= static_cast<uint16_t>((largest & 1) << 15);
+	outKey[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+}
+
+static Math::Quat DecodeRotation(const uint16_t* key)
+{
+	const uint32_t largest = (key[0] >> 15) | ((key[1] >> 15) << 1);
+
+	float smallest[3];
+	float sumSquares = 0.0f;
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		smallest[i] = (key[i] & 0x7FFF) * SMALLEST_THREE_STEP - SMALLEST_THREE_RANGE;
+		sumSquares += smallest[i] * smallest[i];
+	}
+
+	float q[4];
+	uint32_t component = 0;
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		q[i] = i == largest ? sqrtf(std::max(1.0f - sumSquares, 0.0f)) : smallest[component++];
+	}
+
+	return Math::Quat(q[0], q[1], q[2], q[3]);
+}
+
+// Scale is 2^bits - 1, quantized in double as 24 bit keys are past float precision
+static void EncodeVector(const Math::Vec4& value, const float* rangeMin, const float* rangeExtent, double scale, uint32_t* outKey)
+{
+	const float v[3] = { value.x, value.y, value.z };
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		double normalized = rangeExtent[i] > 0.0f ? (double(v[i]) - rangeMin[i]) / rangeExtent[i] : 0.0;
+		outKey[i] = static_cast<uint32_t>(floor(std::min(std::max(normalized, 0.0), 1.0) * scale + 0.5));
+	}
+}
+
+// Step is range extent / (2^bits - 1), precomputed so decoding needs no division
+static Math::Vec4 DecodeVector(const uint32_t* key, const float* rangeMin, const float* rangeStep, float w)
+{
+	return Math::Vec4(
+		rangeMin[0] + key[0] * rangeStep[0],
+		rangeMin[1] + key[1] * rangeStep[1],
+		rangeMin[2] + key[2] * rangeStep[2],
+		w);
+}
+
+static Math::Quat NormalizedLerp(const Math::Quat& a, const Math::Quat& b, float alpha)
+{
+	// Shortest path
+	const float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0f : 1.0f;
+	Math::Quat r(
+		a.x + (b.x * sign - a.x) * alpha,
+		a.y + (b.y * sign - a.y) * alpha,
+		a.z + (b.z * sign - a.z) * alpha,
+		a.w + (b.w * sign - a.w) * alpha);
+	return Math::Normalize(r);
+}
+
+// Angle between rotations from chord length of unit quaternions, |a - b| = 2 sin(angle / 4).
+// acos of dot loses all precision at the small angles the budget is about.
+static float RotationError(const Math::Quat& a, const Math::Quat& b)
+{
+	const double sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0 : 1.0;
+	const double dx = a.x - b.x * sign, dy = a.y - b.y * sign, dz = a.z - b.z * sign, dw = a.w - b.w * sign;
+	const double chord = sqrt(dx * dx + dy * dy + dz * dz + dw * dw);
+	return static_cast<float>(4.0 * asin(std::min(chord * 0.5, 1.0)));
+}
+
+static float VectorError(const Math::Vec4& a, const Math::Vec4& b)
+{
+	return std::max(std::max(fabsf(a.x - b.x), fabsf(a.y - b.y)), fabsf(a.z - b.z));
+}
+
+static Math::Vec4 LerpVector(const Math::Vec4& a, const Math::Vec4& b, float alpha)
+{
+	return a + (b - a) * alpha;
+}
+
+//// Key reduction
+
+// Greedy: from the last kept key extend the segment as long as every raw key in between
+// is reproduced within maxError by interpolating the decoded end points.
+template<typename TValue, typename TLerp, typename TError>
+static void ReduceKeys(const std::vector<TValue>& raw, const std::vector<TValue>& decoded, float maxError, TLerp lerp, TError error, std::vector<uint32_t>& outKeyFrames)
+{
+	const uint32_t frameCount = static_cast<uint32_t>(raw.size());
+	outKeyFrames.clear();
+	outKeyFrames.push_back(0);
+
+	// Constant channel needs a single key
+	bool bConstant = true;
+	for (uint32_t frame = 0; frame < frameCount && bConstant; ++frame)
+	{
+		bConstant = error(decoded[0], raw[frame]) <= maxError;
+	}
+	if (bConstant)
+	{
+		return;
+	}
+
+	uint32_t start = 0;
+	for (uint32_t end = 2; end < frameCount; ++end)
+	{
+		bool bFits = true;
+		for (uint32_t frame = start + 1; frame < end && bFits; ++frame)
+		{
+			float alpha = static_cast<float>(frame - start) / static_cast<float>(end - start);
+			bFits = error(lerp(decoded[start], decoded[end], alpha), raw[frame]) <= maxError;
+		}
+
+		if (!bFits)
+		{
+			start = end - 1;
+			outKeyFrames.push_back(start);
+		}
+	}
+
+	if (frameCount > 1)
+	{
+		outKeyFrames.push_back(frameCount - 1);
+	}
+}
+
+//// Compression
+
+namespace
+{
+	struct CompressedChannel
+	{
+		std::vector<uint16_t> frames;
+		std::vector<uint16_t> keys;
+	};
+
+	struct CompressedVectorChannel
+	{
+		std::vector<uint16_t> frames;
+		std::vector<uint32_t> keys;
+	};
+
+	struct CompressedTrack
+	{
+		CompressedChannel rotation;
+		CompressedVectorChannel translation;
+		CompressedVectorChannel scale;
+		float translationMin[3];
+		float translationStep[3];
+		float scaleMin[3];
+		float scaleStep[3];
+	};
+
+	void ComputeRange(const std::vector<Math::Vec4>& values, float* outMin, float* outExtent)
+	{
+		float rangeMin[3] = { values[0].x, values[0].y, values[0].z };
+		float rangeMax[3] = { values[0].x, values[0].y, values[0].z };
+		for (const Math::Vec4& value : values)
+		{
+			const float v[3] = { value.x, value.y, value.z };
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				rangeMin[i] = std::min(rangeMin[i], v[i]);
+				rangeMax[i] = std::max(rangeMax[i], v[i]);
+			}
+		}
+
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			outMin[i] = rangeMin[i];
+			outExtent[i] = rangeMax[i] - rangeMin[i];
+		}
+	}
+
+	// Bits of the widest component so a half step stays within half of maxError, the other half
+	// is left for float rounding while decoding. Budgets finer than 24 bits over the range are
+	// below float precision of the values themselves, they get 24.
+	uint32_t ComputeVectorBits(const float* extent, float maxError)
+	{
+		const double maxExtent = std::max(std::max(extent[0], extent[1]), extent[2]);
+		const double stepCount = maxError > 0.0f ? ceil(maxExtent / maxError) : double(1u << VECTOR_MAX_BITS);
+
+		uint32_t bits = VECTOR_MIN_BITS;
+		while (bits < VECTOR_MAX_BITS && double((1u << bits) - 1) < stepCount)
+		{
+			++bits;
+		}
+		return bits;
+	}
+
+	void CompressVectorChannel(const std::vector<Math::Vec4>& values, float w, float maxError, float* outMin, float* outStep, CompressedVectorChannel& outChannel)
+	{
+		float extent[3];
+		ComputeRange(values, outMin, extent);
+
+		const uint32_t bits = ComputeVectorBits(extent, maxError);
+		const double scale = double((1u << bits) - 1);
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			outStep[i] = static_cast<float>(extent[i] / scale);
+		}
+
+		std::vector<Math::Vec4> decoded(values.size());
+		for (size_t frame = 0; frame < values.size(); ++frame)
+		{
+			uint32_t key[3];
+			EncodeVector(values[frame], outMin, extent, scale, key);
+			decoded[frame] = DecodeVector(key, outMin, outStep, w);
+		}
+
+		std::vector<uint32_t> keyFrames;
+		ReduceKeys(values, decoded, maxError, LerpVector, VectorError, keyFrames);
+
+		for (uint32_t frame : keyFrames)
+		{
+			outChannel.frames.push_back(static_cast<uint16_t>(frame));
+			uint32_t key[3];
+			EncodeVector(values[frame], outMin, extent, scale, key);
+			outChannel.keys.insert(outChannel.keys.end(), key, key + 3);
+		}
+	}
+
+	void CompressRotationChannel(const std::vector<Math::Quat>& values, float maxError, CompressedChannel& outChannel)
+	{
+		std::vector<Math::Quat> normalized(values.size());
+		std::vector<Math::Quat> decoded(values.size());
+		std::vector<uint16_t> encoded(values.size() * 3);
+		for (size_t frame = 0; frame < values.size(); ++frame)
+		{
+			normalized[frame] = Math::Normalize(values[frame]);
+			EncodeRotation(normalized[frame], &encoded[frame * 3]);
+			decoded[frame] = DecodeRotation(&encoded[frame * 3]);
+		}
+
+		std::vector<uint32_t> keyFrames;
+		ReduceKeys(normalized, decoded, maxError, NormalizedLerp, RotationError, keyFrames);
+
+		for (uint32_t frame : keyFrames)
+		{
+			outChannel.frames.push_back(static_cast<uint16_t>(frame));
+			outChannel.keys.insert(outChannel.keys.end(), &encoded[frame * 3], &encoded[frame * 3] + 3);
+		}
+	}
+
+	template<typename T>
+	void Append(std::vector<T>& dst, const std::vector<T>& src)
+	{
+		dst.insert(dst.end(), src.begin(), src.end());
+	}
+}
+
+void AnimationClip::Compress(const RawAnimationClip& rawClip, const AnimationCompressionSettings& settings)
+{
+	assert(rawClip.frameCount > 0 && rawClip.frameCount <= UINT16_MAX + 1u);
+
+	m_Name = rawClip.name;
+	m_SampleRate = rawClip.sampleRate;
+	m_FrameCount = rawClip.frameCount;
+
+	const uint32_t trackCount = static_cast<uint32_t>(rawClip.tracks.size());
+
+	// Tracks compress independently, key reduction is the expensive part
+	std::vector<CompressedTrack> compressed(trackCount);
+	Gear::TaskSystem::Get().ParallelFor(trackCount, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t trackIdx = begin; trackIdx < end; ++trackIdx)
+		{
+			const RawAnimationClip::BoneTrack& raw = rawClip.tracks[trackIdx];
+			CompressedTrack& track = compressed[trackIdx];
+
+			CompressRotationChannel(raw.rotations, settings.rotationError, track.rotation);
+			CompressVectorChannel(raw.translations, 1.0f, settings.translationError, track.translationMin, track.translationStep, track.translation);
+			CompressVectorChannel(raw.scales, 0.0f, settings.scaleError, track.scaleMin, track.scaleStep, track.scale);
+		}
+	});
+
+	m_Tracks.resize(trackCount);
+	m_BoneNames.resize(trackCount);
+
+	// Padding bones decode to zero
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_TranslationMin[i].assign(PadToPoseGroup(trackCount), 0.0f);
+		m_TranslationStep[i].assign(PadToPoseGroup(trackCount), 0.0f);
+		m_ScaleMin[i].assign(PadToPoseGroup(trackCount), 0.0f);
+		m_ScaleStep[i].assign(PadToPoseGroup(trackCount), 0.0f);
+	}
+	m_RotationFrames.clear();
+	m_RotationKeys.clear();
+	m_TranslationFrames.clear();
+	m_TranslationKeys.clear();
+	m_ScaleFrames.clear();
+	m_ScaleKeys.clear();
+
+	for (uint32_t trackIdx = 0; trackIdx < trackCount; ++trackIdx)
+	{
+		const CompressedTrack& source = compressed[trackIdx];
+		Track& track = m_Tracks[trackIdx];
+
+		track.rotation = { static_cast<uint32_t>(m_RotationFrames.size()), static_cast<uint32_t>(source.rotation.frames.size()) };
+		track.translation = { static_cast<uint32_t>(m_TranslationFrames.size()), static_cast<uint32_t>(source.translation.frames.size()) };
+		track.scale = { static_cast<uint32_t>(m_ScaleFrames.size()), static_cast<uint32_t>(source.scale.frames.size()) };
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			m_TranslationMin[i][trackIdx] = source.translationMin[i];
+			m_TranslationStep[i][trackIdx] = source.translationStep[i];
+			m_ScaleMin[i][trackIdx] = source.scaleMin[i];
+			m_ScaleStep[i][trackIdx] = source.scaleStep[i];
+		}
+
+		Append(m_RotationFrames, source.rotation.frames);
+		Append(m_RotationKeys, source.rotation.keys);
+		Append(m_TranslationFrames, source.translation.frames);
+		Append(m_TranslationKeys, source.translation.keys);
+		Append(m_ScaleFrames, source.scale.frames);
+		Append(m_ScaleKeys, source.scale.keys);
+
+		m_BoneNames[trackIdx] = rawClip.tracks[trackIdx].boneName;
+	}
+}
+
+uint32_t AnimationClip::GetKeyCount() const
+{
+	return static_cast<uint32_t>(m_RotationFrames.size() + m_TranslationFrames.size() + m_ScaleFrames.size());
+}
+
+size_t AnimationClip::GetMemorySize() const
+{
+	return sizeof(*this) +
+		m_Tracks.size() * sizeof(Track) +
+		m_TranslationMin[0].size() * sizeof(float) * 12 +
+		(m_RotationFrames.size() + m_RotationKeys.size() + m_TranslationFrames.size() + m_ScaleFrames.size()) * sizeof(uint16_t) +
+		(m_TranslationKeys.size() + m_ScaleKeys.size()) * sizeof(uint32_t);
+}
+
+//// Sampling
+
+void AnimationPose::Resize(uint32_t count)
+{
+	const uint32_t paddedCount = PadToPoseGroup(count);
+	for (std::vector<float>* values : { &translationX, &translationY, &translationZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+	{
+		values->resize(paddedCount);
+	}
+	keyCursors.assign(count * 3, 0);
+	boneCount = count;
+}
+
+void AnimationPose::ToLocalMatrices(Math::Mat4* outMatrices) const
+{
+	for (uint32_t bone = 0; bone < boneCount; ++bone)
+	{
+		outMatrices[bone] = Math::ComposeTransform(
+			Math::Vec4(translationX[bone], translationY[bone], translationZ[bone], 1.0f),
+			Math::Quat(rotationX[bone], rotationY[bone], rotationZ[bone], rotationW[bone]),
+			Math::Vec4(scaleX[bone], scaleY[bone], scaleZ[bone], 0.0f));
+	}
+}
+
+// Keys around frame and blend factor between them.
+// Playback moves forward a little each time, so the segment of last call (or the next one)
+// is checked before falling back to binary search.
+static void FindKeys(const uint16_t* frames, uint32_t count, float frame, uint16_t& inOutCursor, uint32_t& outFirst, uint32_t& outSecond, float& outAlpha)
+{
+	uint32_t second = count;
+	for (uint32_t candidate = inOutCursor + 1u; candidate <= inOutCursor + 2u && candidate < count; ++candidate)
+	{
+		if (frames[candidate - 1] <= frame && frame < frames[candidate])
+		{
+			second = candidate;
+			break;
+		}
+	}
+
+	if (second == count)
+	{
+		second = static_cast<uint32_t>(std::upper_bound(frames, frames + count, frame) - frames);
+	}
+	inOutCursor = static_cast<uint16_t>(second ? second - 1 : 0);
+
+	if (second == 0 || second == count)
+	{
+		outFirst = outSecond = second == 0 ? 0 : count - 1;
+		outAlpha = 0.0f;
+		return;
+	}
+
+	outFirst = second - 1;
+	outSecond = second;
+	outAlpha = (frame - frames[outFirst]) / static_cast<float>(frames[outSecond] - frames[outFirst]);
+}
+
+namespace
+{
+	// Quantized end points of a group of 8 bones, one row per component, decoded with SIMD
+	enum PoseKeyComponent
+	{
+		PK_TranslationX, PK_TranslationY, PK_TranslationZ,
+		PK_Rotation0, PK_Rotation1, PK_Rotation2,
+		PK_ScaleX, PK_ScaleY, PK_ScaleZ,
+		PK_Count
+	};
+
+	struct alignas(32) PoseGroup
+	{
+		int32_t from[PK_Count][POSE_GROUP_SIZE];
+		int32_t to[PK_Count][POSE_GROUP_SIZE];
+		float translationAlpha[POSE_GROUP_SIZE];
+		float rotationAlpha[POSE_GROUP_SIZE];
+		float scaleAlpha[POSE_GROUP_SIZE];
+	};
+
+	// 16 bit rotation keys or up to 24 bit translation/ scale keys
+	template<typename TKey>
+	void CopyKey(const TKey* key, PoseKeyComponent firstComponent, uint32_t lane, int32_t (*outKeys)[POSE_GROUP_SIZE])
+	{
+		outKeys[firstComponent][lane] = static_cast<int32_t>(key[0]);
+		outKeys[firstComponent + 1][lane] = static_cast<int32_t>(key[1]);
+		outKeys[firstComponent + 2][lane] = static_cast<int32_t>(key[2]);
+	}
+
+#if MATH_SIMD_AVX2
+	inline __m256 Lerp8(__m256 from, __m256 to, __m256 alpha)
+	{
+		return _mm256_add_ps(from, _mm256_mul_ps(_mm256_sub_ps(to, from), alpha));
+	}
+
+	inline __m256 DecodeComponent8(const int32_t* keys, const float* rangeMin, const float* rangeStep)
+	{
+		__m256 key = _mm256_cvtepi32_ps(_mm256_load_si256(reinterpret_cast<const __m256i*>(keys)));
+		return _mm256_add_ps(_mm256_loadu_ps(rangeMin), _mm256_mul_ps(key, _mm256_loadu_ps(rangeStep)));
+	}
+
+	// Smallest three of 8 rotations, outRotation is x, y, z, w
+	inline void DecodeRotation8(const int32_t (*keys)[POSE_GROUP_SIZE], __m256* outRotation)
+	{
+		const __m256i k0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys[PK_Rotation0]));
+		const __m256i k1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys[PK_Rotation1]));
+		const __m256i k2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(keys[PK_Rotation2]));
+		const __m256i valueMask = _mm256_set1_epi32(0x7FFF);
+		const __m256 step = _mm256_set1_ps(SMALLEST_THREE_STEP);
+		const __m256 range = _mm256_set1_ps(SMALLEST_THREE_RANGE);
+
+		const __m256i largest = _mm256_or_si256(_mm256_srli_epi32(k0, 15), _mm256_slli_epi32(_mm256_srli_epi32(k1, 15), 1));
+
+		__m256 s0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(k0, valueMask)), step), range);
+		__m256 s1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(k1, valueMask)), step), range);
+		__m256 s2 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(k2), step), range);
+
+		__m256 sumSquares = _mm256_add_ps(_mm256_mul_ps(s0, s0), _mm256_add_ps(_mm256_mul_ps(s1, s1), _mm256_mul_ps(s2, s2)));
+		__m256 l = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), sumSquares), _mm256_setzero_ps()));
+
+		// Component i is the largest one or the next smallest one not yet placed
+		__m256 is0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(0)));
+		__m256 is1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(1)));
+		__m256 is2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(2)));
+		__m256 is3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(3)));
+		__m256 below2 = _mm256_or_ps(is0, is1);
+
+		outRotation[0] = _mm256_blendv_ps(s0, l, is0);
+		outRotation[1] = _mm256_blendv_ps(_mm256_blendv_ps(s1, s0, is0), l, is1);
+		outRotation[2] = _mm256_blendv_ps(_mm256_blendv_ps(s2, s1, below2), l, is2);
+		outRotation[3] = _mm256_blendv_ps(s2, l, is3);
+	}
+#endif
+}
+
+void AnimationClip::SamplePose(float time, AnimationPose& outPose) const
+{
+	const uint32_t boneCount = GetBoneCount();
+	if (outPose.GetBoneCount() != boneCount)
+	{
+		outPose.Resize(boneCount);
+	}
+
+	const float frame = std::min(std::max(time * m_SampleRate, 0.0f), static_cast<float>(m_FrameCount ? m_FrameCount - 1 : 0));
+
+	PoseGroup group;
+	for (uint32_t groupBegin = 0; groupBegin < boneCount; groupBegin += POSE_GROUP_SIZE)
+	{
+		// Scalar part: find keys of each bone, copy them quantized
+		for (uint32_t lane = 0; lane < POSE_GROUP_SIZE; ++lane)
+		{
+			const uint32_t bone = groupBegin + lane;
+			if (bone >= boneCount)
+			{
+				// Padding lanes, any valid key will do (zero ranges)
+				for (uint32_t c = 0; c < PK_Count; ++c)
+				{
+					group.from[c][lane] = group.to[c][lane] = 0;
+				}
+				group.translationAlpha[lane] = group.rotationAlpha[lane] = group.scaleAlpha[lane] = 0.0f;
+				continue;
+			}
+
+			const Track& track = m_Tracks[bone];
+			uint16_t* cursors = &outPose.keyCursors[bone * 3];
+			uint32_t first, second;
+
+			FindKeys(&m_TranslationFrames[track.translation.offset], track.translation.count, frame, cursors[0], first, second, group.translationAlpha[lane]);
+			CopyKey(&m_TranslationKeys[(track.translation.offset + first) * 3], PK_TranslationX, lane, group.from);
+			CopyKey(&m_TranslationKeys[(track.translation.offset + second) * 3], PK_TranslationX, lane, group.to);
+
+			FindKeys(&m_RotationFrames[track.rotation.offset], track.rotation.count, frame, cursors[1], first, second, group.rotationAlpha[lane]);
+			CopyKey(&m_RotationKeys[(track.rotation.offset + first) * 3], PK_Rotation0, lane, group.from);
+			CopyKey(&m_RotationKeys[(track.rotation.offset + second) * 3], PK_Rotation0, lane, group.to);
+
+			FindKeys(&m_ScaleFrames[track.scale.offset], track.scale.count, frame, cursors[2], first, second, group.scaleAlpha[lane]);
+			CopyKey(&m_ScaleKeys[(track.scale.offset + first) * 3], PK_ScaleX, lane, group.from);
+			CopyKey(&m_ScaleKeys[(track.scale.offset + second) * 3], PK_ScaleX, lane, group.to);
+		}
+
+		// SIMD part: decode 8 bones at once, lerp translations/ scales, nlerp rotations
+#if MATH_SIMD_AVX2
+		const __m256 translationAlpha = _mm256_load_ps(group.translationAlpha);
+		const __m256 rotationAlpha = _mm256_load_ps(group.rotationAlpha);
+		const __m256 scaleAlpha = _mm256_load_ps(group.scaleAlpha);
+
+		float* translations[3] = { outPose.translationX.data(), outPose.translationY.data(), outPose.translationZ.data() };
+		float* scales[3] = { outPose.scaleX.data(), outPose.scaleY.data(), outPose.scaleZ.data() };
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const float* rangeMin = &m_TranslationMin[i][groupBegin];
+			const float* rangeStep = &m_TranslationStep[i][groupBegin];
+			__m256 from = DecodeComponent8(group.from[PK_TranslationX + i], rangeMin, rangeStep);
+			__m256 to = DecodeComponent8(group.to[PK_TranslationX + i], rangeMin, rangeStep);
+			_mm256_storeu_ps(translations[i] + groupBegin, Lerp8(from, to, translationAlpha));
+
+			rangeMin = &m_ScaleMin[i][groupBegin];
+			rangeStep = &m_ScaleStep[i][groupBegin];
+			from = DecodeComponent8(group.from[PK_ScaleX + i], rangeMin, rangeStep);
+			to = DecodeComponent8(group.to[PK_ScaleX + i], rangeMin, rangeStep);
+			_mm256_storeu_ps(scales[i] + groupBegin, Lerp8(from, to, scaleAlpha));
+		}
+
+		__m256 from[4], to[4];
+		DecodeRotation8(group.from, from);
+		DecodeRotation8(group.to, to);
+
+		// Flip target to shortest path, then lerp and normalize
+		__m256 dot = _mm256_setzero_ps();
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(from[i], to[i]));
+		}
+		const __m256 flip = _mm256_and_ps(dot, _mm256_set1_ps(-0.0f));
+
+		__m256 blended[4];
+		__m256 lengthSq = _mm256_setzero_ps();
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			blended[i] = Lerp8(from[i], _mm256_xor_ps(to[i], flip), rotationAlpha);
+			lengthSq = _mm256_add_ps(lengthSq, _mm256_mul_ps(blended[i], blended[i]));
+		}
+
+		const __m256 invLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSq));
+		float* rotations[4] = { outPose.rotationX.data(), outPose.rotationY.data(), outPose.rotationZ.data(), outPose.rotationW.data() };
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			_mm256_storeu_ps(rotations[i] + groupBegin, _mm256_mul_ps(blended[i], invLength));
+		}
+#else
+		for (uint32_t lane = 0; lane < POSE_GROUP_SIZE; ++lane)
+		{
+			const uint32_t bone = groupBegin + lane;
+
+			uint32_t key[3];
+			float rangeMin[3], rangeStep[3];
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				rangeMin[i] = m_TranslationMin[i][bone];
+				rangeStep[i] = m_TranslationStep[i][bone];
+			}
+			for (uint32_t i = 0; i < 3; ++i) key[i] = static_cast<uint32_t>(group.from[PK_TranslationX + i][lane]);
+			Math::Vec4 t0 = DecodeVector(key, rangeMin, rangeStep, 1.0f);
+			for (uint32_t i = 0; i < 3; ++i) key[i] = static_cast<uint32_t>(group.to[PK_TranslationX + i][lane]);
+			Math::Vec4 t = LerpVector(t0, DecodeVector(key, rangeMin, rangeStep, 1.0f), group.translationAlpha[lane]);
+
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				rangeMin[i] = m_ScaleMin[i][bone];
+				rangeStep[i] = m_ScaleStep[i][bone];
+			}
+			for (uint32_t i = 0; i < 3; ++i) key[i] = static_cast<uint32_t>(group.from[PK_ScaleX + i][lane]);
+			Math::Vec4 s0 = DecodeVector(key, rangeMin, rangeStep, 0.0f);
+			for (uint32_t i = 0; i < 3; ++i) key[i] = static_cast<uint32_t>(group.to[PK_ScaleX + i][lane]);
+			Math::Vec4 sc = LerpVector(s0, DecodeVector(key, rangeMin, rangeStep, 0.0f), group.scaleAlpha[lane]);
+
+			uint16_t rotationKey[3];
+			for (uint32_t i = 0; i < 3; ++i) rotationKey[i] = static_cast<uint16_t>(group.from[PK_Rotation0 + i][lane]);
+			Math::Quat r0 = DecodeRotation(rotationKey);
+			for (uint32_t i = 0; i < 3; ++i) rotationKey[i] = static_cast<uint16_t>(group.to[PK_Rotation0 + i][lane]);
+			Math::Quat r = NormalizedLerp(r0, DecodeRotation(rotationKey), group.rotationAlpha[lane]);
+
+			outPose.translationX[bone] = t.x;
+			outPose.translationY[bone] = t.y;
+			outPose.translationZ[bone] = t.z;
+			outPose.rotationX[bone] = r.x;
+			outPose.rotationY[bone] = r.y;
+			outPose.rotationZ[bone] = r.z;
+			outPose.rotationW[bone] = r.w;
+			outPose.scaleX[bone] = sc.x;
+			outPose.scaleY[bone] = sc.y;
+			outPose.scaleZ[bone] = sc.z;
+		}
+#endif
+	}
+}
+
+void SampleAnimationPoses(const AnimationClip* const* clips, const float* times, AnimationPose* outPoses, uint32_t characterCount)
+{
+	Gear::TaskSystem::Get().ParallelFor(characterCount, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t character = begin; character < end; ++character)
+		{
+			clips[character]->SamplePose(times[character], outPoses[character]);
+		}
+	});
+}
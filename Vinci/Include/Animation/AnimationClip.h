@@ -0,0 +1,112 @@
+#pragma once
+
+#include "Math/Math.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Uncompressed local transforms of every bone sampled at a fixed rate, e.g. an FBX take
+struct RawAnimationClip
+{
+	struct BoneTrack
+	{
+		std::string boneName;
+		std::vector<Math::Vec4> translations;  // one per frame
+		std::vector<Math::Quat> rotations;
+		std::vector<Math::Vec4> scales;
+	};
+
+	std::string name;
+	float sampleRate{ 30.0f };
+	uint32_t frameCount{ 0 };
+	std::vector<BoneTrack> tracks;
+};
+
+// Max error of reconstructed keys against raw ones, quantization included
+struct AnimationCompressionSettings
+{
+	float translationError{ 0.0001f };  // scene units
+	float rotationError{ 0.0005f };     // radians
+	float scaleError{ 0.0001f };
+};
+
+// Local bone transforms in SoA layout, bone count padded to multiple of 8
+struct AnimationPose
+{
+	void Resize(uint32_t boneCount);
+	uint32_t GetBoneCount() const { return boneCount; }
+
+	// Bone local matrices, T * R * S
+	void ToLocalMatrices(Math::Mat4* outMatrices) const;
+
+	std::vector<float> translationX, translationY, translationZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	uint32_t boneCount{ 0 };
+
+	// Last key segment of translation/ rotation/ scale per bone, speeds up sampling
+	// when the same pose keeps playing forward. Only a hint, any value is safe.
+	std::vector<uint16_t> keyCursors;
+};
+
+// Compressed clip:
+//  |- rotations as smallest three, 15 bits per component, 6 bytes per key
+//  |- translations/ scales as 16 to 24 bits per component in per track range, as many as the error
+//     budget needs over the range, 12 bytes per key
+//  |- keys which can be interpolated from their neighbors within error budget are removed
+class AnimationClip
+{
+public:
+	void Compress(const RawAnimationClip& rawClip, const AnimationCompressionSettings& settings = AnimationCompressionSettings());
+
+	// Time in seconds, clamped to clip range. Rotations are normalized lerped.
+	void SamplePose(float time, AnimationPose& outPose) const;
+
+	const std::string& GetName() const { return m_Name; }
+	float GetDuration() const { return m_FrameCount > 1 ? (m_FrameCount - 1) / m_SampleRate : 0.0f; }
+	uint32_t GetBoneCount() const { return static_cast<uint32_t>(m_Tracks.size()); }
+	const std::string& GetBoneName(uint32_t bone) const { return m_BoneNames[bone]; }
+
+	uint32_t GetKeyCount() const;
+	size_t GetMemorySize() const;
+
+private:
+	struct KeyRange
+	{
+		uint32_t offset;  // into frame and value arrays of the channel
+		uint32_t count;
+	};
+
+	struct Track
+	{
+		KeyRange rotation;
+		KeyRange translation;
+		KeyRange scale;
+	};
+
+	std::string m_Name;
+	float m_SampleRate{ 30.0f };
+	uint32_t m_FrameCount{ 0 };
+
+	std::vector<Track> m_Tracks;
+	std::vector<std::string> m_BoneNames;
+
+	// Quantization range per bone and component in SoA, so 8 bones decode with one load.
+	// Step is range / (2^bits - 1). Padded to multiple of 8 bones.
+	std::vector<float> m_TranslationMin[3];
+	std::vector<float> m_TranslationStep[3];
+	std::vector<float> m_ScaleMin[3];
+	std::vector<float> m_ScaleStep[3];
+
+	// Per channel, key frame indices and 3 quantized components per key
+	std::vector<uint16_t> m_RotationFrames;
+	std::vector<uint16_t> m_RotationKeys;
+	std::vector<uint16_t> m_TranslationFrames;
+	std::vector<uint32_t> m_TranslationKeys;
+	std::vector<uint16_t> m_ScaleFrames;
+	std::vector<uint32_t> m_ScaleKeys;
+};
+
+// Sample one clip per character, characters are split over Gear::TaskSystem
+void SampleAnimationPoses(const AnimationClip* const* clips, const float* times, AnimationPose* outPoses, uint32_t characterCount);
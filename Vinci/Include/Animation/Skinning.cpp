@@ -0,0 +1,263 @@
+#include "Skinning.h"
+
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Vertices per parallel batch
+static const uint32_t SKINNING_BATCH_SIZE = 1024;
+
+static const float UNORM8_TO_FLOAT = 1.0f / 255.0f;
+
+#if MATH_SIMD_AVX2
+static inline __m256 MulAdd8(__m256 a, __m256 b, __m256 c)
+{
+#if MATH_HAS_FMA
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+static SkinWeights QuantizeWeights(const uint32_t* boneIndices, const float* weights, uint32_t count)
+{
+	SkinWeights packed = {};
+
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		sum += weights[i];
+	}
+
+	// Vertex without weights sticks to first bone
+	if (sum <= 0.0f)
+	{
+		packed.boneIndices[0] = count ? static_cast<uint8_t>(boneIndices[0]) : 0;
+		packed.weights[0] = 255;
+		return packed;
+	}
+
+	uint32_t total = 0;
+	uint32_t strongest = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		packed.boneIndices[i] = static_cast<uint8_t>(boneIndices[i]);
+		packed.weights[i] = static_cast<uint8_t>(std::min(255.0f, floorf(weights[i] / sum * 255.0f + 0.5f)));
+		total += packed.weights[i];
+		strongest = weights[i] > weights[strongest] ? i : strongest;
+	}
+
+	// Rounding error goes to the strongest influence so weights sum to exactly 1
+	packed.weights[strongest] = static_cast<uint8_t>(static_cast<int>(packed.weights[strongest]) + 255 - static_cast<int>(total));
+
+	return packed;
+}
+
+SkinWeights PackSkinWeights(const uint32_t* boneIndices, const float* weights, uint32_t influenceCount)
+{
+	uint32_t topBones[SKIN_MAX_INFLUENCES];
+	float topWeights[SKIN_MAX_INFLUENCES];
+	uint32_t topCount = 0;
+
+	// Insertion into a descending top 4
+	for (uint32_t i = 0; i < influenceCount; ++i)
+	{
+		if (weights[i] <= 0.0f)
+		{
+			continue;
+		}
+
+		uint32_t slot = topCount < SKIN_MAX_INFLUENCES ? topCount++ : SKIN_MAX_INFLUENCES;
+		if (slot == SKIN_MAX_INFLUENCES)
+		{
+			if (weights[i] <= topWeights[SKIN_MAX_INFLUENCES - 1])
+			{
+				continue;
+			}
+			slot = SKIN_MAX_INFLUENCES - 1;
+		}
+
+		for (; slot > 0 && topWeights[slot - 1] < weights[i]; --slot)
+		{
+			topBones[slot] = topBones[slot - 1];
+			topWeights[slot] = topWeights[slot - 1];
+		}
+		topBones[slot] = boneIndices[i];
+		topWeights[slot] = weights[i];
+	}
+
+	return QuantizeWeights(topBones, topWeights, topCount);
+}
+
+void SkinWeightBuilder::Reset(uint32_t vertexCount)
+{
+	m_Influences.assign(vertexCount, Influences());
+	m_InfluenceCounts.assign(vertexCount, 0);
+	m_TruncatedVertexCount = 0;
+}
+
+void SkinWeightBuilder::AddInfluence(uint32_t vertex, uint32_t boneIndex, float weight)
+{
+	if (weight <= 0.0f || vertex >= m_Influences.size())
+	{
+		return;
+	}
+
+	Influences& influences = m_Influences[vertex];
+	uint8_t& count = m_InfluenceCounts[vertex];
+
+	uint32_t slot = count;
+	if (count == SKIN_MAX_INFLUENCES)
+	{
+		// 0xFF marks a full vertex which already dropped an influence
+		++m_TruncatedVertexCount;
+		count = 0xFF;
+	}
+
+	if (count == 0xFF)
+	{
+		if (weight <= influences.weights[SKIN_MAX_INFLUENCES - 1])
+		{
+			return;
+		}
+		slot = SKIN_MAX_INFLUENCES - 1;
+	}
+	else
+	{
+		++count;
+	}
+
+	for (; slot > 0 && influences.weights[slot - 1] < weight; --slot)
+	{
+		influences.boneIndices[slot] = influences.boneIndices[slot - 1];
+		influences.weights[slot] = influences.weights[slot - 1];
+	}
+	influences.boneIndices[slot] = boneIndex;
+	influences.weights[slot] = weight;
+}
+
+void SkinWeightBuilder::Build(std::vector<SkinWeights>& outWeights) const
+{
+	outWeights.resize(m_Influences.size());
+	for (size_t i = 0; i < m_Influences.size(); ++i)
+	{
+		uint32_t count = m_InfluenceCounts[i] == 0xFF ? SKIN_MAX_INFLUENCES : m_InfluenceCounts[i];
+		outWeights[i] = QuantizeWeights(m_Influences[i].boneIndices, m_Influences[i].weights, count);
+	}
+}
+
+void SkinVertices(const SkinnedMeshStreams& mesh, const Math::Mat4* bones, uint32_t begin, uint32_t end, Math::Vec4* outPositions, Math::Vec4* outNormals)
+{
+	const bool bNormals = mesh.normals && outNormals;
+
+#if MATH_SIMD_AVX2
+	// Columns 0/1 and 2/3 of the blended matrix in one register each.
+	// Unused influences have zero weight, blending them anyway is cheaper than a branch.
+	const __m256 unormScale = _mm256_set1_ps(UNORM8_TO_FLOAT);
+	for (uint32_t v = begin; v < end; ++v)
+	{
+		const SkinWeights& skin = mesh.weights[v];
+
+		const Math::Mat4& bone0 = bones[skin.boneIndices[0]];
+		const Math::Mat4& bone1 = bones[skin.boneIndices[1]];
+		const Math::Mat4& bone2 = bones[skin.boneIndices[2]];
+		const Math::Mat4& bone3 = bones[skin.boneIndices[3]];
+		const __m256 weight0 = _mm256_mul_ps(_mm256_set1_ps(skin.weights[0]), unormScale);
+		const __m256 weight1 = _mm256_mul_ps(_mm256_set1_ps(skin.weights[1]), unormScale);
+		const __m256 weight2 = _mm256_mul_ps(_mm256_set1_ps(skin.weights[2]), unormScale);
+		const __m256 weight3 = _mm256_mul_ps(_mm256_set1_ps(skin.weights[3]), unormScale);
+
+		__m256 col01 = _mm256_mul_ps(_mm256_loadu_ps(&bone0.c[0].x), weight0);
+		__m256 col23 = _mm256_mul_ps(_mm256_loadu_ps(&bone0.c[2].x), weight0);
+		col01 = MulAdd8(_mm256_loadu_ps(&bone1.c[0].x), weight1, col01);
+		col23 = MulAdd8(_mm256_loadu_ps(&bone1.c[2].x), weight1, col23);
+		col01 = MulAdd8(_mm256_loadu_ps(&bone2.c[0].x), weight2, col01);
+		col23 = MulAdd8(_mm256_loadu_ps(&bone2.c[2].x), weight2, col23);
+		col01 = MulAdd8(_mm256_loadu_ps(&bone3.c[0].x), weight3, col01);
+		col23 = MulAdd8(_mm256_loadu_ps(&bone3.c[2].x), weight3, col23);
+
+		// c0 * x + c1 * y in one register, c2 * z + c3 * w in the other, w is 1 for positions
+		const __m128 position = _mm_blend_ps(_mm_load_ps(&mesh.positions[v].x), _mm_set1_ps(1.0f), 0x8);
+		__m256 xy = _mm256_set_m128(Math::Swizzle<1, 1, 1, 1>(position), Math::Swizzle<0, 0, 0, 0>(position));
+		__m256 zw = _mm256_set_m128(Math::Swizzle<3, 3, 3, 3>(position), Math::Swizzle<2, 2, 2, 2>(position));
+		__m256 sum = MulAdd8(col01, xy, _mm256_mul_ps(col23, zw));
+		_mm_store_ps(&outPositions[v].x, _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1)));
+
+		if (bNormals)
+		{
+			const __m128 normal = _mm_blend_ps(_mm_load_ps(&mesh.normals[v].x), _mm_setzero_ps(), 0x8);
+			__m256 nxy = _mm256_set_m128(Math::Swizzle<1, 1, 1, 1>(normal), Math::Swizzle<0, 0, 0, 0>(normal));
+			__m256 nzw = _mm256_set_m128(Math::Swizzle<3, 3, 3, 3>(normal), Math::Swizzle<2, 2, 2, 2>(normal));
+			__m256 nsum = MulAdd8(col01, nxy, _mm256_mul_ps(col23, nzw));
+			__m128 n = _mm_add_ps(_mm256_castps256_ps128(nsum), _mm256_extractf128_ps(nsum, 1));
+
+			// Renormalize, w stays 0
+			__m128 length = _mm_sqrt_ps(_mm_dp_ps(n, n, 0x7F));
+			_mm_store_ps(&outNormals[v].x, _mm_div_ps(n, _mm_max_ps(length, _mm_set1_ps(1e-20f))));
+		}
+	}
+#else
+	for (uint32_t v = begin; v < end; ++v)
+	{
+		const SkinWeights& skin = mesh.weights[v];
+
+		Math::Mat4 blended = {};
+		for (uint32_t i = 0; i < SKIN_MAX_INFLUENCES; ++i)
+		{
+			if (skin.weights[i] == 0)
+			{
+				continue;
+			}
+
+			const Math::Mat4& bone = bones[skin.boneIndices[i]];
+			const float weight = skin.weights[i] * UNORM8_TO_FLOAT;
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				blended.c[c] = blended.c[c] + bone.c[c] * weight;
+			}
+		}
+
+		const Math::Vec4& position = mesh.positions[v];
+		outPositions[v] = Math::TransformPoint(blended, Math::Vec4(position.x, position.y, position.z, 1.0f));
+
+		if (bNormals)
+		{
+			const Math::Vec4& normal = mesh.normals[v];
+			Math::Vec4 n = blended.c[0] * normal.x + blended.c[1] * normal.y + blended.c[2] * normal.z;
+			n.w = 0.0f;
+			float length = Math::Length3(n);
+			outNormals[v] = length > 0.0f ? n * (1.0f / length) : n;
+		}
+	}
+#endif
+}
+
+void SkinInstances(const SkinnedMeshStreams& mesh, const Math::Mat4* palettes, uint32_t boneCount, uint32_t instanceCount, Math::Vec4* outPositions, Math::Vec4* outNormals)
+{
+	if (mesh.vertexCount == 0)
+	{
+		return;
+	}
+
+	// Work items are (instance, vertex chunk) pairs, big meshes split and small ones do not starve workers
+	const uint32_t chunksPerInstance = (mesh.vertexCount + SKINNING_BATCH_SIZE - 1) / SKINNING_BATCH_SIZE;
+	Gear::TaskSystem::Get().ParallelFor(instanceCount * chunksPerInstance, 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t item = begin; item < end; ++item)
+		{
+			const uint32_t instance = item / chunksPerInstance;
+			const uint32_t vertexBegin = (item % chunksPerInstance) * SKINNING_BATCH_SIZE;
+			const uint32_t vertexEnd = std::min(vertexBegin + SKINNING_BATCH_SIZE, mesh.vertexCount);
+
+			const size_t outputOffset = static_cast<size_t>(instance) * mesh.vertexCount;
+			SkinVertices(mesh,
+				palettes + static_cast<size_t>(instance) * boneCount,
+				vertexBegin,
+				vertexEnd,
+				outPositions + outputOffset,
+				outNormals ? outNormals + outputOffset : nullptr);
+		}
+	});
+}
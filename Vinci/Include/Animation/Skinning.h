@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Math/Math.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#define SKIN_MAX_INFLUENCES 4
+
+// 4 bone influences in 8 bytes, same layout as the uvec2 read by Skinning.comp.
+// Weights are unorm8 and always sum up to 255, bone indices address a palette of up to 256 bones.
+struct SkinWeights
+{
+	uint8_t boneIndices[SKIN_MAX_INFLUENCES];
+	uint8_t weights[SKIN_MAX_INFLUENCES];
+};
+
+static_assert(sizeof(SkinWeights) == 8, "[error] Skin weights should be packed in 8 bytes..");
+
+// Strongest 4 of any number of influences, renormalized and quantized
+SkinWeights PackSkinWeights(const uint32_t* boneIndices, const float* weights, uint32_t influenceCount);
+
+// Collects influences per vertex in any order (e.g. cluster by cluster from FBX),
+// keeps the strongest 4 of every vertex on the fly
+class SkinWeightBuilder
+{
+public:
+	void Reset(uint32_t vertexCount);
+	void AddInfluence(uint32_t vertex, uint32_t boneIndex, float weight);
+	void Build(std::vector<SkinWeights>& outWeights) const;
+
+	// Vertices which had more than 4 influences, extra ones are dropped
+	uint32_t GetTruncatedVertexCount() const { return m_TruncatedVertexCount; }
+
+private:
+	struct Influences
+	{
+		uint32_t boneIndices[SKIN_MAX_INFLUENCES];
+		float weights[SKIN_MAX_INFLUENCES];  // descending
+	};
+
+	std::vector<Influences> m_Influences;
+	std::vector<uint8_t> m_InfluenceCounts;
+	uint32_t m_TruncatedVertexCount{ 0 };
+};
+
+// Bind pose mesh streams, normals are optional
+struct SkinnedMeshStreams
+{
+	const Math::Vec4* positions{ nullptr };
+	const Math::Vec4* normals{ nullptr };
+	const SkinWeights* weights{ nullptr };
+	uint32_t vertexCount{ 0 };
+};
+
+// Linear blend skinning of [begin, end) with one bone palette (bone matrix * inverse bind pose),
+// output is indexed the same as input
+void SkinVertices(const SkinnedMeshStreams& mesh, const Math::Mat4* bones, uint32_t begin, uint32_t end, Math::Vec4* outPositions, Math::Vec4* outNormals);
+
+// Push constants of Skinning.comp, dispatch (vertexCount / SKINNING_GROUP_SIZE rounded up, instanceCount, 1)
+#define SKINNING_GROUP_SIZE 64
+
+struct SkinningConstants
+{
+	uint32_t vertexCount;
+	uint32_t boneCount;
+};
+
+// Every instance has its own palette at palettes + instance * boneCount and its own output
+// at outPositions + instance * vertexCount. Split over Gear::TaskSystem, cost grows with
+// instance count only, no matter how instances are drawn later.
+void SkinInstances(const SkinnedMeshStreams& mesh, const Math::Mat4* palettes, uint32_t boneCount, uint32_t instanceCount, Math::Vec4* outPositions, Math::Vec4* outNormals);
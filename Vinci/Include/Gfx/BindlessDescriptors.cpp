@@ -0,0 +1,199 @@
+#include "BindlessDescriptors.h"
+
+#include <array>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+BindlessDescriptors::~BindlessDescriptors()
+{
+	Shutdown();
+}
+
+void BindlessDescriptors::Initialize(VkDevice device, uint32_t maxTextures, uint32_t maxBuffers)
+{
+	m_Device = device;
+	m_Textures = { maxTextures, 0, {} };
+	m_Buffers = { maxBuffers, 0, {} };
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+	bindings[0].binding = BINDLESS_TEXTURE_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = maxTextures;
+	bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+	bindings[1].binding = BINDLESS_BUFFER_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = maxBuffers;
+	bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+	// Slots not in use by a pending command buffer may be rewritten too, e.g. a texture added mid frame
+	const VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+	std::array<VkDescriptorBindingFlags, 2> bindingFlags = { bindingFlag, bindingFlag };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_Layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create bindless descriptor set layout.");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = maxTextures;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = maxBuffers;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_Pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create bindless descriptor pool.");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_Pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_Layout;
+
+	if (vkAllocateDescriptorSets(m_Device, &allocInfo, &m_Set) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate bindless descriptor set.");
+	}
+}
+
+void BindlessDescriptors::Shutdown()
+{
+	if (m_Device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// Set goes with its pool
+	vkDestroyDescriptorPool(m_Device, m_Pool, nullptr);
+	vkDestroyDescriptorSetLayout(m_Device, m_Layout, nullptr);
+
+	m_Device = VK_NULL_HANDLE;
+	m_Layout = VK_NULL_HANDLE;
+	m_Pool = VK_NULL_HANDLE;
+	m_Set = VK_NULL_HANDLE;
+	m_Textures = {};
+	m_Buffers = {};
+}
+
+uint32_t BindlessDescriptors::AddTexture(VkImageView view, VkSampler sampler)
+{
+	const uint32_t slot = AllocateSlot(m_Textures, "texture");
+	WriteTexture(slot, view, sampler);
+	return slot;
+}
+
+void BindlessDescriptors::UpdateTexture(uint32_t slot, VkImageView view, VkSampler sampler)
+{
+	assert(slot < m_Textures.count);
+	WriteTexture(slot, view, sampler);
+}
+
+void BindlessDescriptors::RemoveTexture(uint32_t slot)
+{
+	FreeSlot(m_Textures, slot);
+}
+
+uint32_t BindlessDescriptors::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	const uint32_t slot = AllocateSlot(m_Buffers, "buffer");
+	WriteBuffer(slot, buffer, offset, range);
+	return slot;
+}
+
+void BindlessDescriptors::UpdateBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	assert(slot < m_Buffers.count);
+	WriteBuffer(slot, buffer, offset, range);
+}
+
+void BindlessDescriptors::RemoveBuffer(uint32_t slot)
+{
+	FreeSlot(m_Buffers, slot);
+}
+
+uint32_t BindlessDescriptors::AllocateSlot(SlotArray& slots, const char* name)
+{
+	// Freed slots are reused first, keeps the range shaders index into dense
+	if (!slots.freeSlots.empty())
+	{
+		const uint32_t slot = slots.freeSlots.back();
+		slots.freeSlots.pop_back();
+		return slot;
+	}
+
+	if (slots.count == slots.capacity)
+	{
+		throw std::runtime_error(std::string("Bindless ") + name + " table is full.");
+	}
+
+	return slots.count++;
+}
+
+void BindlessDescriptors::FreeSlot(SlotArray& slots, uint32_t slot)
+{
+	// Stale descriptor stays in the slot, partially bound arrays only need valid descriptors where shaders read
+	assert(slot < slots.count);
+	slots.freeSlots.push_back(slot);
+}
+
+void BindlessDescriptors::WriteTexture(uint32_t slot, VkImageView view, VkSampler sampler)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler;
+	imageInfo.imageView = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_Set;
+	write.dstBinding = BINDLESS_TEXTURE_BINDING;
+	write.dstArrayElement = slot;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+}
+
+void BindlessDescriptors::WriteBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = buffer;
+	bufferInfo.offset = offset;
+	bufferInfo.range = range;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_Set;
+	write.dstBinding = BINDLESS_BUFFER_BINDING;
+	write.dstArrayElement = slot;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.descriptorCount = 1;
+	write.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+}
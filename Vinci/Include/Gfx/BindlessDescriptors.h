@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#define BINDLESS_INVALID UINT32_MAX
+
+// Bindings of the bindless set, same as in shaders
+#define BINDLESS_TEXTURE_BINDING 0
+#define BINDLESS_BUFFER_BINDING 1
+
+// One descriptor set holding large arrays of textures (combined image samplers) and storage buffers,
+// shaders pick their resources by index, e.g. from a material table indexed by material ID.
+//  |- set is bound once per command buffer, no per-draw binds and no pool churn when resources come and go
+//  |- arrays are update-after-bind and partially bound, so slots can be written while command buffers using the
+//     set are recorded, and slots which are never written need no dummy resource
+//  |- freed slots are reused, caller frees a slot only after GPU no longer reads it
+// Needs descriptor indexing (Vulkan 1.2): runtimeDescriptorArray, descriptorBindingPartiallyBound, update-after-bind
+// of sampled images and storage buffers and shaderSampledImageArrayNonUniformIndexing. Not thread safe.
+class BindlessDescriptors
+{
+public:
+	BindlessDescriptors() = default;
+	~BindlessDescriptors();
+
+	BindlessDescriptors(const BindlessDescriptors&) = delete;
+	BindlessDescriptors& operator = (const BindlessDescriptors&) = delete;
+
+	// Capacities have to be within update-after-bind limits of the device. Throws if the set can not be created.
+	void Initialize(VkDevice device, uint32_t maxTextures, uint32_t maxBuffers);
+	void Shutdown();
+
+	VkDescriptorSetLayout GetLayout() const { return m_Layout; }
+	VkDescriptorSet GetSet() const { return m_Set; }
+
+	// Image is expected in shader read only layout. Throws if every slot is taken.
+	uint32_t AddTexture(VkImageView view, VkSampler sampler);
+	void UpdateTexture(uint32_t slot, VkImageView view, VkSampler sampler);
+	void RemoveTexture(uint32_t slot);
+
+	uint32_t AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	void UpdateBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	void RemoveBuffer(uint32_t slot);
+
+	uint32_t GetTextureCount() const { return m_Textures.count - static_cast<uint32_t>(m_Textures.freeSlots.size()); }
+	uint32_t GetBufferCount() const { return m_Buffers.count - static_cast<uint32_t>(m_Buffers.freeSlots.size()); }
+
+private:
+	struct SlotArray
+	{
+		uint32_t capacity;
+		uint32_t count;						// slots ever handed out, freed ones are in freeSlots
+		std::vector<uint32_t> freeSlots;
+	};
+
+	static uint32_t AllocateSlot(SlotArray& slots, const char* name);
+	static void FreeSlot(SlotArray& slots, uint32_t slot);
+
+	void WriteTexture(uint32_t slot, VkImageView view, VkSampler sampler);
+	void WriteBuffer(uint32_t slot, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+private:
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	VkDescriptorSetLayout m_Layout{ VK_NULL_HANDLE };
+	VkDescriptorPool m_Pool{ VK_NULL_HANDLE };
+	VkDescriptorSet m_Set{ VK_NULL_HANDLE };
+
+	SlotArray m_Textures{};
+	SlotArray m_Buffers{};
+};
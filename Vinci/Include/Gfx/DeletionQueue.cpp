@@ -0,0 +1,126 @@
+#include "DeletionQueue.h"
+
+#include <utility>
+
+// Non-dispatchable handles are pointers on 64 bit and integers on 32 bit platforms, C casts work for both
+#define DELETION_QUEUE_HANDLE(handle) ((uint64_t)(handle))
+
+DeletionQueue::~DeletionQueue()
+{
+	Shutdown();
+}
+
+void DeletionQueue::Initialize(VkDevice device)
+{
+	m_Device = device;
+}
+
+void DeletionQueue::Shutdown()
+{
+	Flush();
+	m_Device = VK_NULL_HANDLE;
+}
+
+void DeletionQueue::DestroyBuffer(uint64_t value, VkBuffer buffer)
+{
+	Push(value, VK_OBJECT_TYPE_BUFFER, DELETION_QUEUE_HANDLE(buffer));
+}
+
+void DeletionQueue::DestroyImage(uint64_t value, VkImage image)
+{
+	Push(value, VK_OBJECT_TYPE_IMAGE, DELETION_QUEUE_HANDLE(image));
+}
+
+void DeletionQueue::DestroyImageView(uint64_t value, VkImageView view)
+{
+	Push(value, VK_OBJECT_TYPE_IMAGE_VIEW, DELETION_QUEUE_HANDLE(view));
+}
+
+void DeletionQueue::DestroyFramebuffer(uint64_t value, VkFramebuffer framebuffer)
+{
+	Push(value, VK_OBJECT_TYPE_FRAMEBUFFER, DELETION_QUEUE_HANDLE(framebuffer));
+}
+
+void DeletionQueue::DestroySwapchain(uint64_t value, VkSwapchainKHR swapChain)
+{
+	Push(value, VK_OBJECT_TYPE_SWAPCHAIN_KHR, DELETION_QUEUE_HANDLE(swapChain));
+}
+
+void DeletionQueue::FreeMemory(uint64_t value, VkDeviceMemory memory)
+{
+	Push(value, VK_OBJECT_TYPE_DEVICE_MEMORY, DELETION_QUEUE_HANDLE(memory));
+}
+
+void DeletionQueue::FreeCommandBuffers(uint64_t value, VkCommandPool pool, const std::vector<VkCommandBuffer>& commandBuffers)
+{
+	for (VkCommandBuffer commandBuffer : commandBuffers)
+	{
+		Push(value, VK_OBJECT_TYPE_COMMAND_BUFFER, reinterpret_cast<uintptr_t>(commandBuffer), DELETION_QUEUE_HANDLE(pool));
+	}
+}
+
+void DeletionQueue::Release(uint64_t value, std::function<void()> release)
+{
+	m_Entries.push_back({ value, VK_OBJECT_TYPE_UNKNOWN, 0, 0, std::move(release) });
+}
+
+void DeletionQueue::Collect(uint64_t completedValue)
+{
+	while (!m_Entries.empty() && m_Entries.front().value <= completedValue)
+	{
+		Destroy(m_Entries.front());
+		m_Entries.pop_front();
+	}
+}
+
+void DeletionQueue::Flush()
+{
+	for (Entry& entry : m_Entries)
+	{
+		Destroy(entry);
+	}
+	m_Entries.clear();
+}
+
+void DeletionQueue::Push(uint64_t value, VkObjectType type, uint64_t handle, uint64_t owner)
+{
+	// Null handles are valid to destroy, no need to keep them around
+	if (handle != 0)
+	{
+		m_Entries.push_back({ value, type, handle, owner, {} });
+	}
+}
+
+void DeletionQueue::Destroy(Entry& entry)
+{
+	switch (entry.type)
+	{
+	case VK_OBJECT_TYPE_BUFFER:
+		vkDestroyBuffer(m_Device, (VkBuffer)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE:
+		vkDestroyImage(m_Device, (VkImage)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(m_Device, (VkImageView)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_FRAMEBUFFER:
+		vkDestroyFramebuffer(m_Device, (VkFramebuffer)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+		vkDestroySwapchainKHR(m_Device, (VkSwapchainKHR)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_DEVICE_MEMORY:
+		vkFreeMemory(m_Device, (VkDeviceMemory)entry.handle, nullptr);
+		break;
+	case VK_OBJECT_TYPE_COMMAND_BUFFER:
+	{
+		VkCommandBuffer commandBuffer = reinterpret_cast<VkCommandBuffer>(static_cast<uintptr_t>(entry.handle));
+		vkFreeCommandBuffers(m_Device, (VkCommandPool)entry.owner, 1, &commandBuffer);
+		break;
+	}
+	default:
+		entry.release();
+		break;
+	}
+}
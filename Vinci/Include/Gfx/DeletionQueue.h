@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Destroys GPU objects once the GPU is done with them, instead of waiting for the device to go idle.
+//  |- every entry is keyed by a value the GPU passes when it is done with the object, e.g. the frame which is
+//     submitted next or a timeline semaphore value, Collect() is called with what the GPU completed so far
+//  |- values are expected in increasing order, an entry with a smaller value behind a larger one waits for it
+//  |- entries of the same value are destroyed in order, e.g. views before their images before their memory
+//  |- Release() takes anything which is not a Vulkan object, e.g. a bindless slot
+// Not thread safe.
+class DeletionQueue
+{
+public:
+	DeletionQueue() = default;
+	~DeletionQueue();
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator = (const DeletionQueue&) = delete;
+
+	void Initialize(VkDevice device);
+
+	// Destroys everything still queued, GPU must be idle
+	void Shutdown();
+
+	void DestroyBuffer(uint64_t value, VkBuffer buffer);
+	void DestroyImage(uint64_t value, VkImage image);
+	void DestroyImageView(uint64_t value, VkImageView view);
+	void DestroyFramebuffer(uint64_t value, VkFramebuffer framebuffer);
+	void DestroySwapchain(uint64_t value, VkSwapchainKHR swapChain);
+	void FreeMemory(uint64_t value, VkDeviceMemory memory);
+	void FreeCommandBuffers(uint64_t value, VkCommandPool pool, const std::vector<VkCommandBuffer>& commandBuffers);
+	void Release(uint64_t value, std::function<void()> release);
+
+	// Destroys entries with a value up to completedValue
+	void Collect(uint64_t completedValue);
+
+	// Destroys everything, GPU must be idle
+	void Flush();
+
+	size_t GetPendingCount() const { return m_Entries.size(); }
+
+private:
+	struct Entry
+	{
+		uint64_t value;
+		VkObjectType type;
+		uint64_t handle;
+		uint64_t owner;
+		std::function<void()> release;	// only for VK_OBJECT_TYPE_UNKNOWN
+	};
+
+	void Push(uint64_t value, VkObjectType type, uint64_t handle, uint64_t owner = 0);
+	void Destroy(Entry& entry);
+
+private:
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	std::deque<Entry> m_Entries;
+};
@@ -0,0 +1,232 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// FNV-1a, fed field by field so padding never ends up in the hash
+	template <typename T>
+	void HashValue(uint64_t& hash, const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+	}
+
+	bool IsImageDescriptor(VkDescriptorType type)
+	{
+		return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+			type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	}
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	Shutdown();
+}
+
+void DescriptorAllocator::Initialize(VkDevice device, const std::vector<VkDescriptorPoolSize>& descriptorsPerSet, uint32_t setsPerPool, uint32_t maxSetsPerPool)
+{
+	m_Device = device;
+	m_DescriptorsPerSet = descriptorsPerSet;
+	m_SetsPerPool = setsPerPool;
+	m_MaxSetsPerPool = std::max(setsPerPool, maxSetsPerPool);
+}
+
+void DescriptorAllocator::Shutdown()
+{
+	for (VkDescriptorPool pool : m_UsedPools)
+	{
+		vkDestroyDescriptorPool(m_Device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : m_FreePools)
+	{
+		vkDestroyDescriptorPool(m_Device, pool, nullptr);
+	}
+
+	m_UsedPools.clear();
+	m_FreePools.clear();
+	m_Device = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+	if (m_UsedPools.empty())
+	{
+		m_UsedPools.push_back(AcquirePool());
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_UsedPools.back();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(m_Device, &allocInfo, &set);
+
+	// Current pool is full, the next one takes over. Earlier pools are not tried again, they are as full.
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		m_UsedPools.push_back(AcquirePool());
+		allocInfo.descriptorPool = m_UsedPools.back();
+		result = vkAllocateDescriptorSets(m_Device, &allocInfo, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate descriptor set.");
+	}
+
+	return set;
+}
+
+void DescriptorAllocator::Reset()
+{
+	for (VkDescriptorPool pool : m_UsedPools)
+	{
+		vkResetDescriptorPool(m_Device, pool, 0);
+		m_FreePools.push_back(pool);
+	}
+	m_UsedPools.clear();
+}
+
+VkDescriptorPool DescriptorAllocator::AcquirePool()
+{
+	if (!m_FreePools.empty())
+	{
+		VkDescriptorPool pool = m_FreePools.back();
+		m_FreePools.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes = m_DescriptorsPerSet;
+	for (VkDescriptorPoolSize& poolSize : poolSizes)
+	{
+		poolSize.descriptorCount *= m_SetsPerPool;
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = m_SetsPerPool;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor pool.");
+	}
+
+	// Content keeps growing, fewer and larger pools from now on
+	m_SetsPerPool = std::min(m_SetsPerPool * 2, m_MaxSetsPerPool);
+
+	return pool;
+}
+
+DescriptorBinding DescriptorBinding::Buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	DescriptorBinding result = {};
+	result.binding = binding;
+	result.type = type;
+	result.buffer = { buffer, offset, range };
+	return result;
+}
+
+DescriptorBinding DescriptorBinding::Image(uint32_t binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+	DescriptorBinding result = {};
+	result.binding = binding;
+	result.type = type;
+	result.image = { sampler, view, layout };
+	return result;
+}
+
+void DescriptorSetCache::Initialize(VkDevice device, DescriptorAllocator* allocator)
+{
+	m_Device = device;
+	m_Allocator = allocator;
+}
+
+VkDescriptorSet DescriptorSetCache::Get(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t bindingCount)
+{
+	Key key = { layout, std::vector<DescriptorBinding>(bindings, bindings + bindingCount) };
+
+	auto found = m_Sets.find(key);
+	if (found != m_Sets.end())
+	{
+		return found->second;
+	}
+
+	VkDescriptorSet set = m_Allocator->Allocate(layout);
+
+	std::vector<VkWriteDescriptorSet> writes(bindingCount);
+	for (uint32_t i = 0; i < bindingCount; ++i)
+	{
+		writes[i] = {};
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = bindings[i].binding;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorType = bindings[i].type;
+		writes[i].descriptorCount = 1;
+		if (IsImageDescriptor(bindings[i].type))
+		{
+			writes[i].pImageInfo = &bindings[i].image;
+		}
+		else
+		{
+			writes[i].pBufferInfo = &bindings[i].buffer;
+		}
+	}
+	vkUpdateDescriptorSets(m_Device, bindingCount, writes.data(), 0, nullptr);
+
+	m_Sets.emplace(std::move(key), set);
+	return set;
+}
+
+bool DescriptorSetCache::Key::operator == (const Key& other) const
+{
+	if (layout != other.layout || bindings.size() != other.bindings.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < bindings.size(); ++i)
+	{
+		const DescriptorBinding& a = bindings[i];
+		const DescriptorBinding& b = other.bindings[i];
+		if (a.binding != b.binding || a.type != b.type ||
+			a.buffer.buffer != b.buffer.buffer || a.buffer.offset != b.buffer.offset || a.buffer.range != b.buffer.range ||
+			a.image.sampler != b.image.sampler || a.image.imageView != b.image.imageView || a.image.imageLayout != b.image.imageLayout)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t DescriptorSetCache::KeyHash::operator () (const Key& key) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	HashValue(hash, key.layout);
+	for (const DescriptorBinding& binding : key.bindings)
+	{
+		HashValue(hash, binding.binding);
+		HashValue(hash, binding.type);
+		HashValue(hash, binding.buffer.buffer);
+		HashValue(hash, binding.buffer.offset);
+		HashValue(hash, binding.buffer.range);
+		HashValue(hash, binding.image.sampler);
+		HashValue(hash, binding.image.imageView);
+		HashValue(hash, binding.image.imageLayout);
+	}
+	return static_cast<size_t>(hash);
+}
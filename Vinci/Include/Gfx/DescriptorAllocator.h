@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Hands out descriptor sets from a chain of pools, a new pool is added whenever the current one runs out,
+// so allocation never fails on dynamic content and costs one vkAllocateDescriptorSets call in the common case.
+//  |- pools are sized by descriptors per set times sets per pool, every new pool is twice as large up to a limit
+//  |- sets are not freed one by one, Reset() recycles every pool at once, e.g. per frame once its fence signaled
+//  |- pools emptied by Reset() are reused before new ones are created
+// Not thread safe, use one allocator per thread or frame.
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator() = default;
+	~DescriptorAllocator();
+
+	DescriptorAllocator(const DescriptorAllocator&) = delete;
+	DescriptorAllocator& operator = (const DescriptorAllocator&) = delete;
+
+	// descriptorsPerSet is the average set, descriptorCount of each type is per set
+	void Initialize(VkDevice device, const std::vector<VkDescriptorPoolSize>& descriptorsPerSet, uint32_t setsPerPool = 64, uint32_t maxSetsPerPool = 4096);
+	void Shutdown();
+
+	// Throws if a fresh pool can not hold the set either
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+	// Every set allocated so far becomes invalid, GPU must not use them any more
+	void Reset();
+
+	uint32_t GetPoolCount() const { return static_cast<uint32_t>(m_UsedPools.size() + m_FreePools.size()); }
+
+private:
+	VkDescriptorPool AcquirePool();
+
+private:
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	std::vector<VkDescriptorPoolSize> m_DescriptorsPerSet;
+	uint32_t m_SetsPerPool{ 0 };
+	uint32_t m_MaxSetsPerPool{ 0 };
+
+	// Sets come from the last used pool, free pools were reset and are empty
+	std::vector<VkDescriptorPool> m_UsedPools;
+	std::vector<VkDescriptorPool> m_FreePools;
+};
+
+// One descriptor of a set, buffer or image info depending on type
+struct DescriptorBinding
+{
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+
+	static DescriptorBinding Buffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+	static DescriptorBinding Image(uint32_t binding, VkDescriptorType type, VkImageView view, VkSampler sampler, VkImageLayout layout);
+};
+
+// Sets which are written once and never change, looked up by layout and what is bound. Same request gives the
+// same set, so callers need not keep track of their sets. Sets live as long as the allocator is not reset,
+// Clear() has to come with it and whenever a bound resource is destroyed, its handle may be reused.
+class DescriptorSetCache
+{
+public:
+	void Initialize(VkDevice device, DescriptorAllocator* allocator);
+
+	VkDescriptorSet Get(VkDescriptorSetLayout layout, const DescriptorBinding* bindings, uint32_t bindingCount);
+
+	void Clear() { m_Sets.clear(); }
+
+	uint32_t GetSetCount() const { return static_cast<uint32_t>(m_Sets.size()); }
+
+private:
+	struct Key
+	{
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+
+		bool operator == (const Key& other) const;
+	};
+
+	struct KeyHash
+	{
+		size_t operator () (const Key& key) const;
+	};
+
+private:
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	DescriptorAllocator* m_Allocator{ nullptr };
+	std::unordered_map<Key, VkDescriptorSet, KeyHash> m_Sets;
+};
@@ -0,0 +1,109 @@
+#include "GfxInstanceData.h"
+
+#include <algorithm>
+#include <cstring>
+
+static inline size_t AlignUp(size_t value, size_t alignment)
+{
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+void InstanceDataSoA::Clear()
+{
+	m_Transforms.clear();
+	m_MaterialIndices.clear();
+	m_MeshIndices.clear();
+	m_Batches.clear();
+	m_Built = false;
+}
+
+void InstanceDataSoA::Reserve(size_t count)
+{
+	m_Transforms.reserve(count * 16);
+	m_MaterialIndices.reserve(count);
+	m_MeshIndices.reserve(count);
+}
+
+uint32_t InstanceDataSoA::AddInstance(uint32_t meshIndex, const float* transform, uint32_t materialIndex)
+{
+	m_Transforms.insert(m_Transforms.end(), transform, transform + 16);
+	m_MaterialIndices.push_back(materialIndex);
+	m_MeshIndices.push_back(meshIndex);
+	m_Built = false;
+
+	return static_cast<uint32_t>(m_MeshIndices.size() - 1);
+}
+
+void InstanceDataSoA::Build()
+{
+	m_Batches.clear();
+
+	const size_t count = m_MeshIndices.size();
+	if (count == 0)
+	{
+		m_Built = true;
+		return;
+	}
+
+	// Counting sort by mesh, stable so instance order within a mesh is kept
+	uint32_t meshCount = *std::max_element(m_MeshIndices.begin(), m_MeshIndices.end()) + 1;
+	std::vector<uint32_t> meshOffsets(meshCount + 1, 0);
+	for (uint32_t meshIndex : m_MeshIndices)
+	{
+		++meshOffsets[meshIndex + 1];
+	}
+	for (uint32_t i = 0; i < meshCount; ++i)
+	{
+		meshOffsets[i + 1] += meshOffsets[i];
+	}
+
+	for (uint32_t meshIndex = 0; meshIndex < meshCount; ++meshIndex)
+	{
+		uint32_t instanceCount = meshOffsets[meshIndex + 1] - meshOffsets[meshIndex];
+		if (instanceCount)
+		{
+			m_Batches.push_back({ meshIndex, meshOffsets[meshIndex], instanceCount });
+		}
+	}
+
+	// Already grouped when there is a single mesh
+	if (m_Batches.size() > 1)
+	{
+		std::vector<float> transforms(m_Transforms.size());
+		std::vector<uint32_t> materialIndices(count);
+		std::vector<uint32_t> meshIndices(count);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t dst = meshOffsets[m_MeshIndices[i]]++;
+			memcpy(&transforms[dst * 16], &m_Transforms[i * 16], 16 * sizeof(float));
+			materialIndices[dst] = m_MaterialIndices[i];
+			meshIndices[dst] = m_MeshIndices[i];
+		}
+
+		m_Transforms.swap(transforms);
+		m_MaterialIndices.swap(materialIndices);
+		m_MeshIndices.swap(meshIndices);
+	}
+
+	m_Built = true;
+}
+
+size_t InstanceDataSoA::GetMaterialIndicesOffset(size_t alignment) const
+{
+	return AlignUp(GetTransformsSize(), alignment);
+}
+
+size_t InstanceDataSoA::GetPackedSize(size_t alignment) const
+{
+	assert(m_Built);
+	return GetMaterialIndicesOffset(alignment) + GetMaterialIndicesSize();
+}
+
+void InstanceDataSoA::Pack(void* dst, size_t alignment) const
+{
+	assert(m_Built);
+	uint8_t* bytes = static_cast<uint8_t*>(dst);
+	memcpy(bytes, m_Transforms.data(), GetTransformsSize());
+	memcpy(bytes + GetMaterialIndicesOffset(alignment), m_MaterialIndices.data(), GetMaterialIndicesSize());
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Mesh/MeshLod.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Range of a mesh inside the shared vertex/ index buffers
+struct MeshDrawInfo
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+	uint32_t vertexCount;
+
+	// Bounding sphere in mesh space, used by culling
+	float boundsCenter[3];
+	float boundsRadius;
+
+	// LOD 0 is the range above, coarser LODs index the same vertices
+	uint32_t lodCount;
+	MeshLodLevel lods[MESH_MAX_LODS];
+	MeshLodThresholds lodThresholds;
+
+	// Meshlets partitioning LOD 0, range in the shared meshlet list
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+// One draw call, instances of the same mesh are contiguous in instance data
+struct InstanceDrawBatch
+{
+	uint32_t meshIndex;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+};
+
+// Per-instance data packed as SoA for a storage buffer:
+//  |- transforms, 16 floats (column major 4x4) per instance
+//  |- material indices, one uint per instance
+// Instances are grouped by mesh when built, so every unique mesh costs one instanced draw.
+class InstanceDataSoA
+{
+public:
+	void Clear();
+	void Reserve(size_t count);
+
+	// Returns index of the instance before Build(), order changes after it
+	uint32_t AddInstance(uint32_t meshIndex, const float* transform, uint32_t materialIndex);
+
+	// Group instances by mesh and generate draw batches
+	void Build();
+	bool IsBuilt() const { return m_Built; }
+
+	// Batches, packing and per instance arrays of the grouped order are only valid after Build()
+	const std::vector<InstanceDrawBatch>& GetBatches() const { assert(m_Built); return m_Batches; }
+	uint32_t GetInstanceCount() const { return static_cast<uint32_t>(m_MaterialIndices.size()); }
+
+	const float* GetTransforms() const { return m_Transforms.data(); }
+	const uint32_t* GetMaterialIndices() const { return m_MaterialIndices.data(); }
+	const uint32_t* GetMeshIndices() const { return m_MeshIndices.data(); }
+
+	size_t GetTransformsSize() const { return m_Transforms.size() * sizeof(float); }
+	size_t GetMaterialIndicesSize() const { return m_MaterialIndices.size() * sizeof(uint32_t); }
+
+	// Offsets of each SoA array inside one buffer, second array starts at required alignment
+	size_t GetMaterialIndicesOffset(size_t alignment) const;
+	size_t GetPackedSize(size_t alignment) const;
+	void Pack(void* dst, size_t alignment) const;
+
+private:
+	std::vector<float> m_Transforms;
+	std::vector<uint32_t> m_MaterialIndices;
+	std::vector<uint32_t> m_MeshIndices;
+	std::vector<InstanceDrawBatch> m_Batches;
+	bool m_Built{ false };
+};
@@ -0,0 +1,936 @@
+#include "RenderGraph.h"
+
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	VkImageAspectFlags GetFormatAspect(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	VkImageUsageFlags GetImageUsageFlags(RenderGraphUsage usage)
+	{
+		switch (usage)
+		{
+		case RenderGraphUsage::ColorAttachment:
+			return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case RenderGraphUsage::DepthAttachment:
+			return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case RenderGraphUsage::SampledRead:
+		case RenderGraphUsage::VertexShaderRead:
+			return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case RenderGraphUsage::ComputeRead:
+		case RenderGraphUsage::ComputeWrite:
+			return VK_IMAGE_USAGE_STORAGE_BIT;
+		case RenderGraphUsage::TransferSrc:
+			return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		case RenderGraphUsage::TransferDst:
+			return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		default:
+			return 0;
+		}
+	}
+
+	bool IsOverlapping(uint32_t firstA, uint32_t lastA, uint32_t firstB, uint32_t lastB)
+	{
+		return firstA <= lastB && firstB <= lastA;
+	}
+
+	uint32_t FindMemoryType(const VkPhysicalDeviceMemoryProperties& memoryProperties, uint32_t typeBits, VkMemoryPropertyFlags properties)
+	{
+		uint32_t memoryType = 0;
+		while (memoryType < memoryProperties.memoryTypeCount &&
+			!((typeBits & (1u << memoryType)) && (memoryProperties.memoryTypes[memoryType].propertyFlags & properties) == properties))
+		{
+			++memoryType;
+		}
+		return memoryType;
+	}
+
+	size_t QueueIndex(RenderGraphQueue queue)
+	{
+		return static_cast<size_t>(queue);
+	}
+}
+
+RenderGraph::~RenderGraph()
+{
+	DestroyTransients(nullptr, 0);
+}
+
+void RenderGraph::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2)
+{
+	m_PhysicalDevice = physicalDevice;
+	m_Device = device;
+	m_CmdPipelineBarrier2 = cmdPipelineBarrier2;
+}
+
+void RenderGraph::SetQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily)
+{
+	m_QueueFamilies[QueueIndex(RenderGraphQueue::Graphics)] = graphicsFamily;
+	m_QueueFamilies[QueueIndex(RenderGraphQueue::AsyncCompute)] = asyncComputeFamily;
+}
+
+void RenderGraph::Reset()
+{
+	DestroyTransients(nullptr, 0);
+
+	m_Resources.clear();
+	m_Passes.clear();
+	m_EndBarriers.fill(BarrierBatch());
+	m_WaitStages.fill(0);
+	m_BarrierCount = 0;
+}
+
+void RenderGraph::Reset(DeletionQueue& deletionQueue, uint64_t value)
+{
+	DestroyTransients(&deletionQueue, value);
+
+	m_Resources.clear();
+	m_Passes.clear();
+	m_EndBarriers.fill(BarrierBatch());
+	m_WaitStages.fill(0);
+	m_BarrierCount = 0;
+}
+
+const RenderGraph::UsageInfo& RenderGraph::GetUsageInfo(RenderGraphUsage usage)
+{
+	// Only stages and access bits with the same value in VkPipelineStageFlags/ VkAccessFlags,
+	// so the masks still work for vkCmdPipelineBarrier
+	static const UsageInfo usageInfos[] =
+	{
+		// Undefined
+		{ VK_PIPELINE_STAGE_2_NONE_KHR, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+		// Acquired
+		{ VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+		// ColorAttachment
+		{
+			VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+			VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR,
+			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		},
+		// DepthAttachment
+		{
+			VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR,
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		},
+		// SampledRead
+		{ VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		// VertexShaderRead
+		{ VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		// ComputeRead
+		{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, 0, VK_IMAGE_LAYOUT_GENERAL },
+		// ComputeWrite
+		{ VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR, VK_ACCESS_2_SHADER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_GENERAL },
+		// IndirectRead, buffers only
+		{ VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+		// TransferSrc
+		{ VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+		// TransferDst
+		{ VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, 0, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+		// Present, the semaphore signaled by the submit waits for the transition
+		{ VK_PIPELINE_STAGE_2_NONE_KHR, 0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+	};
+	static_assert(sizeof(usageInfos) / sizeof(usageInfos[0]) == static_cast<size_t>(RenderGraphUsage::Count), "Usage info missing.");
+
+	return usageInfos[static_cast<size_t>(usage)];
+}
+
+uint32_t RenderGraph::ImportImage(const char* name, const std::vector<VkImage>& images, VkFormat format, RenderGraphUsage initialUsage, RenderGraphUsage finalUsage)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.bImage = true;
+	resource.bTransient = false;
+	resource.initialUsage = initialUsage;
+	resource.finalUsage = finalUsage;
+	resource.images = images;
+	resource.format = format;
+	resource.aspect = GetFormatAspect(format);
+	resource.view = VK_NULL_HANDLE;
+
+	m_Resources.push_back(resource);
+	return static_cast<uint32_t>(m_Resources.size() - 1);
+}
+
+uint32_t RenderGraph::ImportBuffer(const char* name, const std::vector<VkBuffer>& buffers)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.bImage = false;
+	resource.bTransient = false;
+	resource.initialUsage = RenderGraphUsage::Undefined;
+	resource.finalUsage = RenderGraphUsage::Undefined;
+	resource.buffers = buffers;
+	resource.view = VK_NULL_HANDLE;
+
+	m_Resources.push_back(resource);
+	return static_cast<uint32_t>(m_Resources.size() - 1);
+}
+
+uint32_t RenderGraph::CreateImage(const char* name, const RenderGraphImageDesc& desc)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.bImage = true;
+	resource.bTransient = true;
+	resource.initialUsage = RenderGraphUsage::Undefined;
+	resource.finalUsage = RenderGraphUsage::Undefined;
+	resource.format = desc.format;
+	resource.aspect = GetFormatAspect(desc.format);
+	resource.desc = desc;
+	resource.view = VK_NULL_HANDLE;
+
+	m_Resources.push_back(resource);
+	return static_cast<uint32_t>(m_Resources.size() - 1);
+}
+
+uint32_t RenderGraph::AddPass(const char* name, PassFunction function, bool bSideEffect, RenderGraphQueue queue)
+{
+	Pass pass = {};
+	pass.name = name;
+	pass.function = std::move(function);
+	pass.bSideEffect = bSideEffect;
+	pass.queue = queue;
+	pass.bAlive = false;
+
+	m_Passes.push_back(std::move(pass));
+	return static_cast<uint32_t>(m_Passes.size() - 1);
+}
+
+void RenderGraph::Read(uint32_t pass, uint32_t resource, RenderGraphUsage usage)
+{
+	AddAccess(pass, resource, usage, false);
+}
+
+void RenderGraph::Write(uint32_t pass, uint32_t resource, RenderGraphUsage usage)
+{
+	AddAccess(pass, resource, usage, true);
+}
+
+void RenderGraph::AddAccess(uint32_t pass, uint32_t resource, RenderGraphUsage usage, bool bWrite)
+{
+	// One barrier per image and pass, so an image can not be in two layouts within a pass
+	for (const Access& access : m_Passes[pass].accesses)
+	{
+		if (access.resource == resource && m_Resources[resource].bImage)
+		{
+			throw std::invalid_argument("Image " + m_Resources[resource].name + " declared twice in pass " + m_Passes[pass].name + ".");
+		}
+	}
+
+	m_Passes[pass].accesses.push_back({ resource, usage, bWrite });
+}
+
+void RenderGraph::Compile()
+{
+	CullPasses();
+	AllocateTransients();
+	PlanBarriers();
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk back from outputs, a pass is needed when a later needed pass reads what it writes
+	std::vector<bool> bNeeded(m_Resources.size(), false);
+	for (size_t resource = 0; resource < m_Resources.size(); ++resource)
+	{
+		bNeeded[resource] = m_Resources[resource].finalUsage != RenderGraphUsage::Undefined;
+	}
+
+	for (size_t passIdx = m_Passes.size(); passIdx-- > 0;)
+	{
+		Pass& pass = m_Passes[passIdx];
+
+		pass.bAlive = pass.bSideEffect;
+		for (const Access& access : pass.accesses)
+		{
+			pass.bAlive = pass.bAlive || (access.bWrite && bNeeded[access.resource]);
+		}
+
+		if (pass.bAlive)
+		{
+			for (const Access& access : pass.accesses)
+			{
+				bNeeded[access.resource] = bNeeded[access.resource] || !access.bWrite;
+			}
+		}
+	}
+
+	for (Resource& resource : m_Resources)
+	{
+		resource.firstPass = RENDER_GRAPH_INVALID;
+		resource.lastPass = RENDER_GRAPH_INVALID;
+		resource.queueMask = 0;
+	}
+
+	for (uint32_t passIdx = 0; passIdx < m_Passes.size(); ++passIdx)
+	{
+		if (!m_Passes[passIdx].bAlive)
+		{
+			continue;
+		}
+
+		for (const Access& access : m_Passes[passIdx].accesses)
+		{
+			Resource& resource = m_Resources[access.resource];
+			resource.firstPass = std::min(resource.firstPass, passIdx);
+			resource.lastPass = resource.lastPass == RENDER_GRAPH_INVALID ? passIdx : std::max(resource.lastPass, passIdx);
+			resource.queueMask |= 1u << QueueIndex(m_Passes[passIdx].queue);
+		}
+	}
+}
+
+void RenderGraph::AllocateTransients()
+{
+	DestroyTransients(nullptr, 0);
+
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memoryProperties);
+
+	std::vector<uint32_t> transients;
+	std::vector<VkMemoryRequirements> requirements(m_Resources.size());
+	std::vector<uint32_t> memoryTypes(m_Resources.size(), 0);
+
+	for (uint32_t resourceIdx = 0; resourceIdx < m_Resources.size(); ++resourceIdx)
+	{
+		Resource& resource = m_Resources[resourceIdx];
+		if (!resource.bTransient || resource.firstPass == RENDER_GRAPH_INVALID)
+		{
+			continue;
+		}
+
+		VkImageUsageFlags usage = resource.desc.extraUsage;
+		for (const Pass& pass : m_Passes)
+		{
+			for (const Access& access : pass.accesses)
+			{
+				usage |= pass.bAlive && access.resource == resourceIdx ? GetImageUsageFlags(access.usage) : 0;
+			}
+		}
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { resource.desc.width, resource.desc.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = resource.desc.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.samples = resource.desc.samples;
+
+		VkImage image;
+		if (vkCreateImage(m_Device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create transient image " + resource.name + ".");
+		}
+		resource.images.assign(1, image);
+
+		vkGetImageMemoryRequirements(m_Device, image, &requirements[resourceIdx]);
+
+		// Transient attachments go to lazily allocated memory where there is one, tile based GPUs keep them in
+		// tile memory and commit nothing. Device local memory otherwise.
+		const uint32_t typeBits = requirements[resourceIdx].memoryTypeBits;
+		uint32_t memoryType = memoryProperties.memoryTypeCount;
+		if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+		{
+			memoryType = FindMemoryType(memoryProperties, typeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		}
+		if (memoryType == memoryProperties.memoryTypeCount)
+		{
+			memoryType = FindMemoryType(memoryProperties, typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+		if (memoryType == memoryProperties.memoryTypeCount)
+		{
+			throw std::runtime_error("Failed to find memory type for transient image " + resource.name + ".");
+		}
+		memoryTypes[resourceIdx] = memoryType;
+
+		transients.push_back(resourceIdx);
+	}
+
+	// Largest first, each goes to the lowest offset of its memory type where nothing alive at the same time lies.
+	// Pass order says nothing about when queues run relative to each other, so queues never share memory.
+	std::sort(transients.begin(), transients.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+	struct MemoryBlock
+	{
+		uint32_t memoryType;
+		VkDeviceSize size;
+		std::vector<uint32_t> resources;
+	};
+	std::vector<MemoryBlock> blocks;
+
+	m_UnaliasedMemorySize = 0;
+	for (uint32_t resourceIdx : transients)
+	{
+		Resource& resource = m_Resources[resourceIdx];
+		const VkMemoryRequirements& requirement = requirements[resourceIdx];
+		m_UnaliasedMemorySize += requirement.size;
+
+		uint32_t blockIdx = 0;
+		while (blockIdx < blocks.size() && blocks[blockIdx].memoryType != memoryTypes[resourceIdx])
+		{
+			++blockIdx;
+		}
+		if (blockIdx == blocks.size())
+		{
+			blocks.push_back({ memoryTypes[resourceIdx], 0, {} });
+		}
+		MemoryBlock& block = blocks[blockIdx];
+
+		// Candidates are the block start and the ends of placed resources
+		std::vector<VkDeviceSize> candidates(1, 0);
+		for (uint32_t placedIdx : block.resources)
+		{
+			const Resource& placed = m_Resources[placedIdx];
+			candidates.push_back(placed.memoryOffset + placed.memorySize);
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		VkDeviceSize offset = 0;
+		for (VkDeviceSize candidate : candidates)
+		{
+			offset = (candidate + requirement.alignment - 1) / requirement.alignment * requirement.alignment;
+
+			bool bFree = true;
+			for (uint32_t placedIdx : block.resources)
+			{
+				const Resource& placed = m_Resources[placedIdx];
+				const bool bConcurrent = resource.queueMask != placed.queueMask ||
+					IsOverlapping(resource.firstPass, resource.lastPass, placed.firstPass, placed.lastPass);
+				bFree = bFree && !(bConcurrent &&
+					offset < placed.memoryOffset + placed.memorySize && placed.memoryOffset < offset + requirement.size);
+			}
+
+			if (bFree)
+			{
+				break;
+			}
+		}
+
+		resource.memoryBlock = blockIdx;
+		resource.memoryOffset = offset;
+		resource.memorySize = requirement.size;
+		block.size = std::max(block.size, offset + requirement.size);
+		block.resources.push_back(resourceIdx);
+	}
+
+	m_TransientMemorySize = 0;
+	m_LazyMemorySize = 0;
+	for (const MemoryBlock& block : blocks)
+	{
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = block.size;
+		allocInfo.memoryTypeIndex = block.memoryType;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(m_Device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate transient image memory.");
+		}
+		m_TransientMemory.push_back(memory);
+		m_TransientMemorySize += block.size;
+		m_LazyMemorySize += (memoryProperties.memoryTypes[block.memoryType].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ? block.size : 0;
+
+		for (uint32_t resourceIdx : block.resources)
+		{
+			Resource& resource = m_Resources[resourceIdx];
+			vkBindImageMemory(m_Device, resource.images[0], memory, resource.memoryOffset);
+
+			// Depth stencil attachments are viewed through depth only
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.images[0];
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.format;
+			viewInfo.subresourceRange.aspectMask = (resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT) : resource.aspect;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			if (vkCreateImageView(m_Device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create transient image view " + resource.name + ".");
+			}
+		}
+	}
+}
+
+void RenderGraph::PlanBarriers()
+{
+	// Queue owning each resource while passes are walked, Count until an alive pass used it
+	std::vector<RenderGraphQueue> firstQueues(m_Resources.size(), RenderGraphQueue::Count);
+	std::vector<RenderGraphQueue> queues(m_Resources.size(), RenderGraphQueue::Count);
+	std::vector<ResourceState> states(m_Resources.size(), ResourceState());
+	BarrierBatch scratch;
+
+	// Dry run from nothing gives the end of frame state and queue, which is where the next execution starts
+	for (const Pass& pass : m_Passes)
+	{
+		if (!pass.bAlive)
+		{
+			continue;
+		}
+
+		for (const Access& access : pass.accesses)
+		{
+			const uint32_t resource = access.resource;
+			if (queues[resource] == RenderGraphQueue::Count)
+			{
+				firstQueues[resource] = pass.queue;
+				queues[resource] = pass.queue;
+			}
+
+			if (queues[resource] != pass.queue)
+			{
+				// Async compute is submitted first, it can not wait for graphics work of its frame
+				if (pass.queue == RenderGraphQueue::AsyncCompute)
+				{
+					throw std::invalid_argument("Async compute pass " + pass.name + " uses " + m_Resources[resource].name + " after graphics in the same frame.");
+				}
+				TransferQueue(resource, states[resource], queues[resource], pass.queue, access.usage, access.bWrite, scratch, scratch);
+				queues[resource] = pass.queue;
+			}
+			else
+			{
+				Transition(resource, states[resource], access.usage, access.bWrite, scratch);
+			}
+		}
+	}
+	const std::vector<ResourceState> endStates = states;
+
+	for (uint32_t resourceIdx = 0; resourceIdx < m_Resources.size(); ++resourceIdx)
+	{
+		const Resource& resource = m_Resources[resourceIdx];
+		ResourceState& state = states[resourceIdx];
+
+		if (resource.finalUsage != RenderGraphUsage::Undefined)
+		{
+			const UsageInfo& info = GetUsageInfo(resource.initialUsage);
+			state = ResourceState();
+			state.writeStages = info.stages;
+			state.writeAccess = info.writeAccess;
+			state.layout = info.layout;
+			queues[resourceIdx] = firstQueues[resourceIdx];
+		}
+		else if (resource.bTransient && !resource.images.empty())
+		{
+			// Discarded every frame, first use waits for everything that used its memory before
+			state = ResourceState();
+			for (uint32_t otherIdx = 0; otherIdx < m_Resources.size(); ++otherIdx)
+			{
+				const Resource& other = m_Resources[otherIdx];
+				if (other.bTransient && !other.images.empty() && other.memoryBlock == resource.memoryBlock &&
+					other.memoryOffset < resource.memoryOffset + resource.memorySize && resource.memoryOffset < other.memoryOffset + other.memorySize)
+				{
+					state.writeStages |= endStates[otherIdx].writeStages;
+					state.writeAccess |= endStates[otherIdx].writeAccess;
+					state.readStages |= endStates[otherIdx].readStages;
+				}
+			}
+			state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			queues[resourceIdx] = firstQueues[resourceIdx];
+		}
+		else
+		{
+			// Nothing released it to its first queue on the first execution (per swap chain image, and again after
+			// the graph is rebuilt), so no queue owns it at the start and its first use acquires nothing. Coming
+			// from the other queue the caller orders it, what that queue did last frame is not waited for here.
+			state = endStates[resourceIdx];
+			if (queues[resourceIdx] != firstQueues[resourceIdx])
+			{
+				state = ResourceState();
+				state.layout = endStates[resourceIdx].layout;
+			}
+			queues[resourceIdx] = RenderGraphQueue::Count;
+		}
+	}
+
+	m_EndBarriers.fill(BarrierBatch());
+	m_WaitStages.fill(0);
+	m_BarrierCount = 0;
+	for (Pass& pass : m_Passes)
+	{
+		pass.barriers = BarrierBatch();
+		if (!pass.bAlive)
+		{
+			continue;
+		}
+
+		for (const Access& access : pass.accesses)
+		{
+			const uint32_t resource = access.resource;
+			if (queues[resource] == RenderGraphQueue::Count)
+			{
+				queues[resource] = pass.queue;
+				Transition(resource, states[resource], access.usage, access.bWrite, pass.barriers);
+			}
+			else if (queues[resource] != pass.queue)
+			{
+				// Within the frame graphics waits on async compute, back to async compute is the caller's job
+				if (pass.queue == RenderGraphQueue::Graphics)
+				{
+					m_WaitStages[QueueIndex(pass.queue)] |= GetUsageInfo(access.usage).stages;
+				}
+				TransferQueue(resource, states[resource], queues[resource], pass.queue, access.usage, access.bWrite, m_EndBarriers[QueueIndex(queues[resource])], pass.barriers);
+				queues[resource] = pass.queue;
+			}
+			else
+			{
+				Transition(resource, states[resource], access.usage, access.bWrite, pass.barriers);
+			}
+		}
+		m_BarrierCount += pass.barriers.IsEmpty() ? 0 : 1;
+	}
+
+	// Final transitions go where the image was used last
+	for (uint32_t resourceIdx = 0; resourceIdx < m_Resources.size(); ++resourceIdx)
+	{
+		if (m_Resources[resourceIdx].finalUsage != RenderGraphUsage::Undefined)
+		{
+			const RenderGraphQueue queue = queues[resourceIdx] != RenderGraphQueue::Count ? queues[resourceIdx] : RenderGraphQueue::Graphics;
+			Transition(resourceIdx, states[resourceIdx], m_Resources[resourceIdx].finalUsage, false, m_EndBarriers[QueueIndex(queue)]);
+		}
+	}
+	for (const BarrierBatch& batch : m_EndBarriers)
+	{
+		m_BarrierCount += batch.IsEmpty() ? 0 : 1;
+	}
+}
+
+void RenderGraph::Transition(uint32_t resource, ResourceState& state, RenderGraphUsage usage, bool bWrite, BarrierBatch& batch) const
+{
+	const bool bImage = m_Resources[resource].bImage;
+	const UsageInfo& info = GetUsageInfo(usage);
+	const VkAccessFlags2KHR dstAccess = info.readAccess | (bWrite ? info.writeAccess : 0);
+	const bool bLayoutChange = bImage && info.layout != state.layout;
+
+	VkPipelineStageFlags2KHR srcStages = 0;
+	VkAccessFlags2KHR srcAccess = 0;
+	bool bBarrier = false;
+
+	if (bWrite || bLayoutChange)
+	{
+		// Write after write or read, and layout transitions, wait for everything since the last write
+		srcStages = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+		bBarrier = bLayoutChange || srcStages != 0;
+
+		state.writeStages = info.stages;
+		state.writeAccess = bWrite ? info.writeAccess : 0;
+		state.readStages = bWrite ? 0 : info.stages;
+		state.visibleStages = info.stages;
+		state.visibleAccess = dstAccess;
+	}
+	else
+	{
+		// Read after write, once per stage and access
+		if (state.writeStages != 0 && ((info.stages & ~state.visibleStages) != 0 || (dstAccess & ~state.visibleAccess) != 0))
+		{
+			srcStages = state.writeStages;
+			srcAccess = state.writeAccess;
+			bBarrier = true;
+
+			state.visibleStages |= info.stages;
+			state.visibleAccess |= dstAccess;
+		}
+		state.readStages |= info.stages;
+	}
+
+	if (!bBarrier)
+	{
+		return;
+	}
+
+	if (bImage)
+	{
+		batch.imageBarriers.push_back({ resource, srcStages, srcAccess, info.stages, dstAccess, state.layout, info.layout, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED });
+		state.layout = info.layout;
+	}
+	else
+	{
+		batch.memorySrcStages |= srcStages;
+		batch.memorySrcAccess |= srcAccess;
+		batch.memoryDstStages |= info.stages;
+		batch.memoryDstAccess |= dstAccess;
+	}
+}
+
+void RenderGraph::TransferQueue(uint32_t resource, ResourceState& state, RenderGraphQueue srcQueue, RenderGraphQueue dstQueue, RenderGraphUsage usage, bool bWrite, BarrierBatch& release, BarrierBatch& acquire) const
+{
+	const Resource& transferred = m_Resources[resource];
+	const uint32_t srcFamily = m_QueueFamilies[QueueIndex(srcQueue)];
+	const uint32_t dstFamily = m_QueueFamilies[QueueIndex(dstQueue)];
+
+	// Same family needs no ownership transfer, the semaphore between the queues already waits for everything
+	if (srcFamily == dstFamily)
+	{
+		const VkImageLayout layout = state.layout;
+		state = ResourceState();
+		state.layout = layout;
+		Transition(resource, state, usage, bWrite, acquire);
+		return;
+	}
+
+	if (!transferred.bImage && transferred.buffers.empty())
+	{
+		throw std::invalid_argument("Buffer " + transferred.name + " changes queue family but was imported without handles.");
+	}
+
+	// Release makes the writes available on the source queue, the acquire repeats the layout transition
+	// and makes them visible. Later uses in the same queue wait for the acquire as for a write.
+	const UsageInfo& info = GetUsageInfo(usage);
+	const VkAccessFlags2KHR dstAccess = info.readAccess | (bWrite ? info.writeAccess : 0);
+	const VkPipelineStageFlags2KHR srcStages = state.writeStages | state.readStages;
+
+	if (transferred.bImage)
+	{
+		release.imageBarriers.push_back({ resource, srcStages, state.writeAccess, VK_PIPELINE_STAGE_2_NONE_KHR, 0, state.layout, info.layout, srcFamily, dstFamily });
+		acquire.imageBarriers.push_back({ resource, VK_PIPELINE_STAGE_2_NONE_KHR, 0, info.stages, dstAccess, state.layout, info.layout, srcFamily, dstFamily });
+	}
+	else
+	{
+		release.bufferBarriers.push_back({ resource, srcStages, state.writeAccess, VK_PIPELINE_STAGE_2_NONE_KHR, 0, srcFamily, dstFamily });
+		acquire.bufferBarriers.push_back({ resource, VK_PIPELINE_STAGE_2_NONE_KHR, 0, info.stages, dstAccess, srcFamily, dstFamily });
+	}
+
+	state = ResourceState();
+	state.writeStages = info.stages;
+	state.writeAccess = bWrite ? info.writeAccess : 0;
+	state.readStages = bWrite ? 0 : info.stages;
+	state.visibleStages = info.stages;
+	state.visibleAccess = dstAccess;
+	state.layout = transferred.bImage ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t imageIdx, RenderGraphQueue queue) const
+{
+	for (const Pass& pass : m_Passes)
+	{
+		if (pass.bAlive && pass.queue == queue)
+		{
+			EmitBarriers(commandBuffer, pass.barriers, imageIdx);
+			pass.function(commandBuffer, imageIdx);
+		}
+	}
+
+	EmitBarriers(commandBuffer, m_EndBarriers[QueueIndex(queue)], imageIdx);
+}
+
+bool RenderGraph::HasPasses(RenderGraphQueue queue) const
+{
+	for (const Pass& pass : m_Passes)
+	{
+		if (pass.bAlive && pass.queue == queue)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderGraph::EmitBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t imageIdx) const
+{
+	if (batch.IsEmpty())
+	{
+		return;
+	}
+
+	const bool bMemoryBarrier = batch.memorySrcStages != 0 || batch.memoryDstStages != 0;
+
+	if (m_CmdPipelineBarrier2)
+	{
+		VkMemoryBarrier2KHR memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+		memoryBarrier.srcStageMask = batch.memorySrcStages;
+		memoryBarrier.srcAccessMask = batch.memorySrcAccess;
+		memoryBarrier.dstStageMask = batch.memoryDstStages;
+		memoryBarrier.dstAccessMask = batch.memoryDstAccess;
+
+		std::vector<VkImageMemoryBarrier2KHR> imageBarriers(batch.imageBarriers.size());
+		for (size_t i = 0; i < batch.imageBarriers.size(); ++i)
+		{
+			const ImageBarrier& barrier = batch.imageBarriers[i];
+			const Resource& resource = m_Resources[barrier.resource];
+
+			imageBarriers[i] = {};
+			imageBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+			imageBarriers[i].srcStageMask = barrier.srcStages;
+			imageBarriers[i].srcAccessMask = barrier.srcAccess;
+			imageBarriers[i].dstStageMask = barrier.dstStages;
+			imageBarriers[i].dstAccessMask = barrier.dstAccess;
+			imageBarriers[i].oldLayout = barrier.oldLayout;
+			imageBarriers[i].newLayout = barrier.newLayout;
+			imageBarriers[i].srcQueueFamilyIndex = barrier.srcFamily;
+			imageBarriers[i].dstQueueFamilyIndex = barrier.dstFamily;
+			imageBarriers[i].image = resource.images[imageIdx % resource.images.size()];
+			imageBarriers[i].subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+		}
+
+		std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers(batch.bufferBarriers.size());
+		for (size_t i = 0; i < batch.bufferBarriers.size(); ++i)
+		{
+			const BufferBarrier& barrier = batch.bufferBarriers[i];
+			const Resource& resource = m_Resources[barrier.resource];
+
+			bufferBarriers[i] = {};
+			bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+			bufferBarriers[i].srcStageMask = barrier.srcStages;
+			bufferBarriers[i].srcAccessMask = barrier.srcAccess;
+			bufferBarriers[i].dstStageMask = barrier.dstStages;
+			bufferBarriers[i].dstAccessMask = barrier.dstAccess;
+			bufferBarriers[i].srcQueueFamilyIndex = barrier.srcFamily;
+			bufferBarriers[i].dstQueueFamilyIndex = barrier.dstFamily;
+			bufferBarriers[i].buffer = resource.buffers[imageIdx % resource.buffers.size()];
+			bufferBarriers[i].offset = 0;
+			bufferBarriers[i].size = VK_WHOLE_SIZE;
+		}
+
+		VkDependencyInfoKHR dependencyInfo = {};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+		dependencyInfo.memoryBarrierCount = bMemoryBarrier ? 1 : 0;
+		dependencyInfo.pMemoryBarriers = &memoryBarrier;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+
+		m_CmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+		return;
+	}
+
+	// One stage mask pair for the whole call without synchronization2
+	VkPipelineStageFlags2KHR srcStages = batch.memorySrcStages;
+	VkPipelineStageFlags2KHR dstStages = batch.memoryDstStages;
+
+	VkMemoryBarrier memoryBarrier = {};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = static_cast<VkAccessFlags>(batch.memorySrcAccess);
+	memoryBarrier.dstAccessMask = static_cast<VkAccessFlags>(batch.memoryDstAccess);
+
+	std::vector<VkImageMemoryBarrier> imageBarriers(batch.imageBarriers.size());
+	for (size_t i = 0; i < batch.imageBarriers.size(); ++i)
+	{
+		const ImageBarrier& barrier = batch.imageBarriers[i];
+		const Resource& resource = m_Resources[barrier.resource];
+		srcStages |= barrier.srcStages;
+		dstStages |= barrier.dstStages;
+
+		imageBarriers[i] = {};
+		imageBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarriers[i].srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccess);
+		imageBarriers[i].dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccess);
+		imageBarriers[i].oldLayout = barrier.oldLayout;
+		imageBarriers[i].newLayout = barrier.newLayout;
+		imageBarriers[i].srcQueueFamilyIndex = barrier.srcFamily;
+		imageBarriers[i].dstQueueFamilyIndex = barrier.dstFamily;
+		imageBarriers[i].image = resource.images[imageIdx % resource.images.size()];
+		imageBarriers[i].subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+	}
+
+	std::vector<VkBufferMemoryBarrier> bufferBarriers(batch.bufferBarriers.size());
+	for (size_t i = 0; i < batch.bufferBarriers.size(); ++i)
+	{
+		const BufferBarrier& barrier = batch.bufferBarriers[i];
+		const Resource& resource = m_Resources[barrier.resource];
+		srcStages |= barrier.srcStages;
+		dstStages |= barrier.dstStages;
+
+		bufferBarriers[i] = {};
+		bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarriers[i].srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccess);
+		bufferBarriers[i].dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccess);
+		bufferBarriers[i].srcQueueFamilyIndex = barrier.srcFamily;
+		bufferBarriers[i].dstQueueFamilyIndex = barrier.dstFamily;
+		bufferBarriers[i].buffer = resource.buffers[imageIdx % resource.buffers.size()];
+		bufferBarriers[i].offset = 0;
+		bufferBarriers[i].size = VK_WHOLE_SIZE;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		srcStages != 0 ? static_cast<VkPipelineStageFlags>(srcStages) : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+		dstStages != 0 ? static_cast<VkPipelineStageFlags>(dstStages) : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+		0,
+		bMemoryBarrier ? 1 : 0, &memoryBarrier,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::DestroyTransients(DeletionQueue* deletionQueue, uint64_t value)
+{
+	// Views before images before the memory they are bound to
+	for (Resource& resource : m_Resources)
+	{
+		if (!resource.bTransient)
+		{
+			continue;
+		}
+
+		if (resource.view != VK_NULL_HANDLE)
+		{
+			if (deletionQueue)
+			{
+				deletionQueue->DestroyImageView(value, resource.view);
+			}
+			else
+			{
+				vkDestroyImageView(m_Device, resource.view, nullptr);
+			}
+			resource.view = VK_NULL_HANDLE;
+		}
+
+		for (VkImage image : resource.images)
+		{
+			if (deletionQueue)
+			{
+				deletionQueue->DestroyImage(value, image);
+			}
+			else
+			{
+				vkDestroyImage(m_Device, image, nullptr);
+			}
+		}
+		resource.images.clear();
+	}
+
+	for (VkDeviceMemory memory : m_TransientMemory)
+	{
+		if (deletionQueue)
+		{
+			deletionQueue->FreeMemory(value, memory);
+		}
+		else
+		{
+			vkFreeMemory(m_Device, memory, nullptr);
+		}
+	}
+	m_TransientMemory.clear();
+	m_TransientMemorySize = 0;
+	m_UnaliasedMemorySize = 0;
+	m_LazyMemorySize = 0;
+}
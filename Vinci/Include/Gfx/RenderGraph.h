@@ -0,0 +1,268 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class DeletionQueue;
+
+#define RENDER_GRAPH_INVALID UINT32_MAX
+
+// How a pass touches a resource, decides stages, access and image layout of the barriers around the pass
+enum class RenderGraphUsage : uint8_t
+{
+	Undefined,			// content is discarded
+	Acquired,			// swap chain image right after acquire, waited for at color attachment output
+	ColorAttachment,	// render target or resolve target
+	DepthAttachment,
+	SampledRead,		// fragment shader
+	VertexShaderRead,	// storage buffer
+	ComputeRead,
+	ComputeWrite,		// storage read write
+	IndirectRead,		// indirect draw arguments and draw count
+	TransferSrc,
+	TransferDst,
+	Present,
+	Count
+};
+
+// Queue a pass is recorded for, Execute() records the passes of one queue into its own command buffer
+enum class RenderGraphQueue : uint8_t
+{
+	Graphics,
+	AsyncCompute,		// submitted ahead of graphics, which waits for it at GetWaitStages()
+	Count
+};
+
+// Transient image, created by the graph and only valid within a frame
+struct RenderGraphImageDesc
+{
+	uint32_t width;
+	uint32_t height;
+	VkFormat format;
+	VkSampleCountFlagBits samples;
+	VkImageUsageFlags extraUsage;	// on top of what the declared usages need, e.g. transient attachment
+};
+
+// Frame render graph, passes declare what they read and write and the graph takes care of synchronization:
+//  |- passes nothing reads back from are culled, working back from imported resources with a final usage
+//  |- barriers are derived from declared usages, every pass gets at most one batched vkCmdPipelineBarrier2
+//     (vkCmdPipelineBarrier on devices without synchronization2), buffers share one global memory barrier
+//  |- transient images whose lifetimes do not overlap are placed into the same memory, transient attachments
+//     (VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT in extraUsage) into lazily allocated memory where available
+//  |- async compute passes overlap with graphics work of the previous frame, a resource moving to the other queue
+//     is released and acquired when the queue families differ, buffers need their handles imported for that.
+//     Async compute can not use what graphics touched earlier in the same frame. Moving back to async compute at
+//     the start of the next frame is not waited for on GPU, the caller orders it, e.g. per swap chain image
+//     resources whose last frame completed. It is no ownership transfer either, imported resources start every
+//     execution owned by no queue, so content they carry over to another queue family is undefined there unless
+//     they are shared concurrently. Their first use on that queue should overwrite them.
+// Commands are recorded once and replayed every frame, so resources without a final usage carry their end of
+// frame state over to the next execution and their first use waits on their last one. Transient images start
+// undefined every frame. Passes run in the order they were added.
+class RenderGraph
+{
+public:
+	// imageIdx given to Execute(), commands of every swap chain image are recorded from the same compiled graph
+	typedef std::function<void(VkCommandBuffer, uint32_t)> PassFunction;
+
+	RenderGraph() = default;
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator = (const RenderGraph&) = delete;
+
+	// cmdPipelineBarrier2 is vkCmdPipelineBarrier2(KHR), null falls back to vkCmdPipelineBarrier
+	void Initialize(VkPhysicalDevice physicalDevice, VkDevice device, PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2);
+
+	// Destroys transient images, graph has to be rebuilt afterwards. GPU must not use them any more.
+	void Reset();
+
+	// Same as Reset() but transient images go to the deletion queue with the given value, GPU may still use them
+	void Reset(DeletionQueue& deletionQueue, uint64_t value);
+
+	// One image per swap chain image picked by imageIdx, or a single one for all of them.
+	// Final usage Undefined means the image is no output and keeps its state across frames.
+	uint32_t ImportImage(const char* name, const std::vector<VkImage>& images, VkFormat format, RenderGraphUsage initialUsage, RenderGraphUsage finalUsage);
+
+	// Queue families of the command buffers given to Execute(), both ignored by default, i.e. the same family
+	void SetQueueFamilies(uint32_t graphicsFamily, uint32_t asyncComputeFamily);
+
+	// Buffers are synchronized by global memory barriers within a queue, handles (one per swap chain image or one
+	// for all) are only needed when a buffer changes queue family
+	uint32_t ImportBuffer(const char* name, const std::vector<VkBuffer>& buffers = {});
+
+	uint32_t CreateImage(const char* name, const RenderGraphImageDesc& desc);
+
+	// Pass with a side effect is never culled
+	uint32_t AddPass(const char* name, PassFunction function, bool bSideEffect = false, RenderGraphQueue queue = RenderGraphQueue::Graphics);
+
+	// An image is touched with one usage per pass, a buffer may be declared several times
+	void Read(uint32_t pass, uint32_t resource, RenderGraphUsage usage);
+	void Write(uint32_t pass, uint32_t resource, RenderGraphUsage usage);
+
+	// Culls passes, allocates transient images and plans barriers. Throws if an image can not be created or
+	// async compute depends on graphics work of the same frame.
+	void Compile();
+
+	void Execute(VkCommandBuffer commandBuffer, uint32_t imageIdx, RenderGraphQueue queue = RenderGraphQueue::Graphics) const;
+
+	bool HasPasses(RenderGraphQueue queue) const;
+
+	// Stages where the queue's semaphore wait on the other queue goes, none when nothing moves to it within a frame
+	VkPipelineStageFlags2KHR GetWaitStages(RenderGraphQueue queue) const { return m_WaitStages[static_cast<size_t>(queue)]; }
+
+	// Transient images after Compile(), null if every pass using it was culled
+	VkImage GetImage(uint32_t resource) const { return m_Resources[resource].images.empty() ? VK_NULL_HANDLE : m_Resources[resource].images[0]; }
+	VkImageView GetImageView(uint32_t resource) const { return m_Resources[resource].view; }
+
+	bool IsPassCulled(uint32_t pass) const { return !m_Passes[pass].bAlive; }
+	uint32_t GetBarrierCount() const { return m_BarrierCount; }
+
+	// Memory of all transient images with and without aliasing, lazy part of it is only committed if needed
+	VkDeviceSize GetTransientMemorySize() const { return m_TransientMemorySize; }
+	VkDeviceSize GetUnaliasedMemorySize() const { return m_UnaliasedMemorySize; }
+	VkDeviceSize GetLazyMemorySize() const { return m_LazyMemorySize; }
+
+private:
+	struct UsageInfo
+	{
+		VkPipelineStageFlags2KHR stages;
+		VkAccessFlags2KHR readAccess;
+		VkAccessFlags2KHR writeAccess;
+		VkImageLayout layout;
+	};
+
+	static const UsageInfo& GetUsageInfo(RenderGraphUsage usage);
+
+	// Synchronization state of a resource while passes are walked in order
+	struct ResourceState
+	{
+		VkPipelineStageFlags2KHR writeStages;	// last write, a layout transition counts as one
+		VkAccessFlags2KHR writeAccess;
+		VkPipelineStageFlags2KHR readStages;	// reads since the last write
+		VkPipelineStageFlags2KHR visibleStages;	// synchronized with the last write
+		VkAccessFlags2KHR visibleAccess;
+		VkImageLayout layout;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool bImage;
+		bool bTransient;
+		RenderGraphUsage initialUsage;
+		RenderGraphUsage finalUsage;
+
+		std::vector<VkImage> images;
+		std::vector<VkBuffer> buffers;
+		VkFormat format;
+		VkImageAspectFlags aspect;
+		RenderGraphImageDesc desc;
+		VkImageView view;
+
+		// Alive passes using it and their queues as bit mask, transient memory placement
+		uint32_t firstPass;
+		uint32_t lastPass;
+		uint32_t queueMask;
+		uint32_t memoryBlock;
+		VkDeviceSize memoryOffset;
+		VkDeviceSize memorySize;
+	};
+
+	struct Access
+	{
+		uint32_t resource;
+		RenderGraphUsage usage;
+		bool bWrite;
+	};
+
+	struct ImageBarrier
+	{
+		uint32_t resource;
+		VkPipelineStageFlags2KHR srcStages;
+		VkAccessFlags2KHR srcAccess;
+		VkPipelineStageFlags2KHR dstStages;
+		VkAccessFlags2KHR dstAccess;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		uint32_t srcFamily;
+		uint32_t dstFamily;
+	};
+
+	// Only for queue family ownership transfers, buffers share the global memory barrier otherwise
+	struct BufferBarrier
+	{
+		uint32_t resource;
+		VkPipelineStageFlags2KHR srcStages;
+		VkAccessFlags2KHR srcAccess;
+		VkPipelineStageFlags2KHR dstStages;
+		VkAccessFlags2KHR dstAccess;
+		uint32_t srcFamily;
+		uint32_t dstFamily;
+	};
+
+	// Everything a pass waits for, emitted as one barrier call
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags2KHR memorySrcStages;
+		VkAccessFlags2KHR memorySrcAccess;
+		VkPipelineStageFlags2KHR memoryDstStages;
+		VkAccessFlags2KHR memoryDstAccess;
+		std::vector<ImageBarrier> imageBarriers;
+		std::vector<BufferBarrier> bufferBarriers;
+
+		bool IsEmpty() const { return memorySrcStages == 0 && memoryDstStages == 0 && imageBarriers.empty() && bufferBarriers.empty(); }
+	};
+
+	struct Pass
+	{
+		std::string name;
+		PassFunction function;
+		bool bSideEffect;
+		RenderGraphQueue queue;
+		bool bAlive;
+		std::vector<Access> accesses;
+		BarrierBatch barriers;
+	};
+
+	void AddAccess(uint32_t pass, uint32_t resource, RenderGraphUsage usage, bool bWrite);
+
+	void CullPasses();
+	void AllocateTransients();
+	void PlanBarriers();
+
+	// Adds the transition of a resource from its state to the usage to the batch, updates the state
+	void Transition(uint32_t resource, ResourceState& state, RenderGraphUsage usage, bool bWrite, BarrierBatch& batch) const;
+
+	// Same for the first use on dstQueue after srcQueue, release goes to the end of srcQueue's commands
+	void TransferQueue(uint32_t resource, ResourceState& state, RenderGraphQueue srcQueue, RenderGraphQueue dstQueue, RenderGraphUsage usage, bool bWrite, BarrierBatch& release, BarrierBatch& acquire) const;
+
+	void EmitBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t imageIdx) const;
+
+	void DestroyTransients(DeletionQueue* deletionQueue, uint64_t value);
+
+private:
+	VkPhysicalDevice m_PhysicalDevice{ VK_NULL_HANDLE };
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	PFN_vkCmdPipelineBarrier2KHR m_CmdPipelineBarrier2{ nullptr };
+
+	std::array<uint32_t, static_cast<size_t>(RenderGraphQueue::Count)> m_QueueFamilies{ { VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED } };
+
+	std::vector<Resource> m_Resources;
+	std::vector<Pass> m_Passes;
+
+	// Final transitions of imported images and queue releases, after the last pass of each queue
+	std::array<BarrierBatch, static_cast<size_t>(RenderGraphQueue::Count)> m_EndBarriers;
+	std::array<VkPipelineStageFlags2KHR, static_cast<size_t>(RenderGraphQueue::Count)> m_WaitStages{};
+	uint32_t m_BarrierCount{ 0 };
+
+	std::vector<VkDeviceMemory> m_TransientMemory;
+	VkDeviceSize m_TransientMemorySize{ 0 };
+	VkDeviceSize m_UnaliasedMemorySize{ 0 };
+	VkDeviceSize m_LazyMemorySize{ 0 };
+};
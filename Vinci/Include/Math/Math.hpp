@@ -0,0 +1,707 @@
+#pragma once
+
+// SIMD math for hot loops (transforms, bounds, culling).
+// Column major like glm/ GLSL, so matrices can be copied to GPU buffers or from glm as they are.
+// AVX2 and SSE4 paths are picked at compile time, define MATH_FORCE_SCALAR to use plain C++.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(MATH_FORCE_SCALAR) && defined(__AVX2__)
+#define MATH_SIMD_AVX2 1
+#else
+#define MATH_SIMD_AVX2 0
+#endif
+
+#if !defined(MATH_FORCE_SCALAR) && (defined(__SSE4_1__) || defined(__AVX__))
+#define MATH_SIMD_SSE4 1
+#else
+#define MATH_SIMD_SSE4 0
+#endif
+
+#if MATH_SIMD_SSE4 || MATH_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+// MSVC does not define __FMA__, FMA comes with every AVX2 cpu though
+#if MATH_SIMD_AVX2 && (defined(__FMA__) || defined(_MSC_VER))
+#define MATH_HAS_FMA 1
+#else
+#define MATH_HAS_FMA 0
+#endif
+
+#if defined(_MSC_VER)
+#define MATH_INLINE __forceinline
+#else
+#define MATH_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace Math
+{
+	struct alignas(16) Vec4
+	{
+		float x, y, z, w;
+
+		Vec4() = default;
+		constexpr Vec4(float inX, float inY, float inZ, float inW) : x(inX), y(inY), z(inZ), w(inW) {}
+		explicit constexpr Vec4(float value) : x(value), y(value), z(value), w(value) {}
+
+		float& operator [] (size_t index) { return (&x)[index]; }
+		float operator [] (size_t index) const { return (&x)[index]; }
+	};
+
+	struct alignas(16) Quat
+	{
+		float x, y, z, w;
+
+		Quat() = default;
+		constexpr Quat(float inX, float inY, float inZ, float inW) : x(inX), y(inY), z(inZ), w(inW) {}
+
+		static constexpr Quat Identity() { return Quat(0.0f, 0.0f, 0.0f, 1.0f); }
+	};
+
+	// Columns, m.c[column][row]
+	struct alignas(16) Mat4
+	{
+		Vec4 c[4];
+
+		Vec4& operator [] (size_t column) { return c[column]; }
+		const Vec4& operator [] (size_t column) const { return c[column]; }
+
+		static Mat4 Identity()
+		{
+			Mat4 m;
+			m.c[0] = Vec4(1.0f, 0.0f, 0.0f, 0.0f);
+			m.c[1] = Vec4(0.0f, 1.0f, 0.0f, 0.0f);
+			m.c[2] = Vec4(0.0f, 0.0f, 1.0f, 0.0f);
+			m.c[3] = Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			return m;
+		}
+
+		static Mat4 Translation(float x, float y, float z)
+		{
+			Mat4 m = Identity();
+			m.c[3] = Vec4(x, y, z, 1.0f);
+			return m;
+		}
+
+		static Mat4 Scale(float x, float y, float z)
+		{
+			Mat4 m = Identity();
+			m.c[0].x = x;
+			m.c[1].y = y;
+			m.c[2].z = z;
+			return m;
+		}
+	};
+
+	struct alignas(16) AABB
+	{
+		Vec4 min;
+		Vec4 max;
+	};
+
+	//// Load/ store helpers
+#if MATH_SIMD_SSE4
+	MATH_INLINE __m128 Load(const Vec4& v) { return _mm_load_ps(&v.x); }
+	MATH_INLINE __m128 Load(const Quat& q) { return _mm_load_ps(&q.x); }
+	MATH_INLINE Vec4 StoreVec4(__m128 v) { Vec4 r; _mm_store_ps(&r.x, v); return r; }
+	MATH_INLINE Quat StoreQuat(__m128 v) { Quat r; _mm_store_ps(&r.x, v); return r; }
+
+	template<int X, int Y, int Z, int W>
+	MATH_INLINE __m128 Swizzle(__m128 v)
+	{
+		return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+	}
+
+	MATH_INLINE __m128 MulAdd(__m128 a, __m128 b, __m128 c)
+	{
+#if MATH_HAS_FMA
+		return _mm_fmadd_ps(a, b, c);
+#else
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+	}
+
+#if MATH_SIMD_AVX2
+	// AVX2 does not imply FMA, it is a separate extension
+	MATH_INLINE __m256 MulAdd(__m256 a, __m256 b, __m256 c)
+	{
+#if MATH_HAS_FMA
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+#endif
+
+	MATH_INLINE __m128 Abs(__m128 v)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+	}
+
+	// m * v, v is a column vector
+	MATH_INLINE __m128 Transform(const Mat4& m, __m128 v)
+	{
+		__m128 r = _mm_mul_ps(Load(m.c[0]), Swizzle<0, 0, 0, 0>(v));
+		r = MulAdd(Load(m.c[1]), Swizzle<1, 1, 1, 1>(v), r);
+		r = MulAdd(Load(m.c[2]), Swizzle<2, 2, 2, 2>(v), r);
+		r = MulAdd(Load(m.c[3]), Swizzle<3, 3, 3, 3>(v), r);
+		return r;
+	}
+#endif
+
+	//// Vec4
+	MATH_INLINE Vec4 operator + (const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_add_ps(Load(a), Load(b)));
+#else
+		return Vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+#endif
+	}
+
+	MATH_INLINE Vec4 operator - (const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_sub_ps(Load(a), Load(b)));
+#else
+		return Vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w);
+#endif
+	}
+
+	MATH_INLINE Vec4 operator * (const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_mul_ps(Load(a), Load(b)));
+#else
+		return Vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w);
+#endif
+	}
+
+	MATH_INLINE Vec4 operator * (const Vec4& a, float s)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_mul_ps(Load(a), _mm_set1_ps(s)));
+#else
+		return Vec4(a.x * s, a.y * s, a.z * s, a.w * s);
+#endif
+	}
+
+	MATH_INLINE Vec4 operator * (float s, const Vec4& a) { return a * s; }
+	MATH_INLINE Vec4 operator / (const Vec4& a, float s) { return a * (1.0f / s); }
+	MATH_INLINE Vec4 operator - (const Vec4& a) { return a * -1.0f; }
+
+	MATH_INLINE Vec4 Min(const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_min_ps(Load(a), Load(b)));
+#else
+		return Vec4(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z), fminf(a.w, b.w));
+#endif
+	}
+
+	MATH_INLINE Vec4 Max(const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(_mm_max_ps(Load(a), Load(b)));
+#else
+		return Vec4(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z), fmaxf(a.w, b.w));
+#endif
+	}
+
+	MATH_INLINE float Dot(const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return _mm_cvtss_f32(_mm_dp_ps(Load(a), Load(b), 0xF1));
+#else
+		return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+#endif
+	}
+
+	// xyz only
+	MATH_INLINE float Dot3(const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		return _mm_cvtss_f32(_mm_dp_ps(Load(a), Load(b), 0x71));
+#else
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+#endif
+	}
+
+	// xyz only, w of result is 0
+	MATH_INLINE Vec4 Cross3(const Vec4& a, const Vec4& b)
+	{
+#if MATH_SIMD_SSE4
+		__m128 va = Load(a);
+		__m128 vb = Load(b);
+		__m128 r = _mm_sub_ps(_mm_mul_ps(va, Swizzle<1, 2, 0, 3>(vb)), _mm_mul_ps(Swizzle<1, 2, 0, 3>(va), vb));
+		return StoreVec4(_mm_blend_ps(Swizzle<1, 2, 0, 3>(r), _mm_setzero_ps(), 0x8));
+#else
+		return Vec4(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x, 0.0f);
+#endif
+	}
+
+	MATH_INLINE float Length(const Vec4& v) { return sqrtf(Dot(v, v)); }
+	MATH_INLINE float Length3(const Vec4& v) { return sqrtf(Dot3(v, v)); }
+	MATH_INLINE Vec4 Normalize(const Vec4& v) { return v * (1.0f / Length(v)); }
+
+	//// Mat4
+	MATH_INLINE Mat4 Transpose(const Mat4& m)
+	{
+#if MATH_SIMD_SSE4
+		__m128 c0 = Load(m.c[0]);
+		__m128 c1 = Load(m.c[1]);
+		__m128 c2 = Load(m.c[2]);
+		__m128 c3 = Load(m.c[3]);
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+		Mat4 r;
+		r.c[0] = StoreVec4(c0);
+		r.c[1] = StoreVec4(c1);
+		r.c[2] = StoreVec4(c2);
+		r.c[3] = StoreVec4(c3);
+		return r;
+#else
+		Mat4 r;
+		for (int col = 0; col < 4; ++col)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				r.c[col][row] = m.c[row][col];
+			}
+		}
+		return r;
+#endif
+	}
+
+	MATH_INLINE Vec4 operator * (const Mat4& m, const Vec4& v)
+	{
+#if MATH_SIMD_SSE4
+		return StoreVec4(Transform(m, Load(v)));
+#else
+		return m.c[0] * v.x + m.c[1] * v.y + m.c[2] * v.z + m.c[3] * v.w;
+#endif
+	}
+
+	MATH_INLINE Mat4 operator * (const Mat4& a, const Mat4& b)
+	{
+		Mat4 r;
+#if MATH_SIMD_AVX2
+		// Two result columns per iteration, columns of a are duplicated in both lanes
+		__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.c[0]));
+		__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.c[1]));
+		__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.c[2]));
+		__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.c[3]));
+
+		for (int col = 0; col < 4; col += 2)
+		{
+			__m256 bc = _mm256_loadu_ps(&b.c[col].x);
+			__m256 rc = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, 0x00));
+			rc = MulAdd(a1, _mm256_shuffle_ps(bc, bc, 0x55), rc);
+			rc = MulAdd(a2, _mm256_shuffle_ps(bc, bc, 0xAA), rc);
+			rc = MulAdd(a3, _mm256_shuffle_ps(bc, bc, 0xFF), rc);
+			_mm256_storeu_ps(&r.c[col].x, rc);
+		}
+#elif MATH_SIMD_SSE4
+		for (int col = 0; col < 4; ++col)
+		{
+			_mm_store_ps(&r.c[col].x, Transform(a, Load(b.c[col])));
+		}
+#else
+		for (int col = 0; col < 4; ++col)
+		{
+			r.c[col] = a * b.c[col];
+		}
+#endif
+		return r;
+	}
+
+#if MATH_SIMD_SSE4
+	namespace Detail
+	{
+		// 2x2 blocks stored as (m00, m01, m10, m11)
+		MATH_INLINE __m128 Mat2Mul(__m128 a, __m128 b)
+		{
+			return _mm_add_ps(_mm_mul_ps(a, Swizzle<0, 3, 0, 3>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+		}
+
+		// adj(a) * b
+		MATH_INLINE __m128 Mat2AdjMul(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(Swizzle<3, 3, 0, 0>(a), b), _mm_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+		}
+
+		// a * adj(b)
+		MATH_INLINE __m128 Mat2MulAdj(__m128 a, __m128 b)
+		{
+			return _mm_sub_ps(_mm_mul_ps(a, Swizzle<3, 0, 3, 0>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+		}
+	}
+#endif
+
+	// General inverse, result is undefined for singular matrices.
+	// inverse(transpose(m)) == transpose(inverse(m)), so storage order does not matter to the block method.
+	inline Mat4 Inverse(const Mat4& m)
+	{
+		Mat4 r;
+#if MATH_SIMD_SSE4
+		__m128 c0 = Load(m.c[0]);
+		__m128 c1 = Load(m.c[1]);
+		__m128 c2 = Load(m.c[2]);
+		__m128 c3 = Load(m.c[3]);
+
+		// 2x2 blocks
+		__m128 A = _mm_movelh_ps(c0, c1);
+		__m128 B = _mm_movehl_ps(c1, c0);
+		__m128 C = _mm_movelh_ps(c2, c3);
+		__m128 D = _mm_movehl_ps(c3, c2);
+
+		// (|A|, |B|, |C|, |D|)
+		__m128 detSub = _mm_sub_ps(
+			_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+			_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+		__m128 detA = Swizzle<0, 0, 0, 0>(detSub);
+		__m128 detB = Swizzle<1, 1, 1, 1>(detSub);
+		__m128 detC = Swizzle<2, 2, 2, 2>(detSub);
+		__m128 detD = Swizzle<3, 3, 3, 3>(detSub);
+
+		__m128 D_C = Detail::Mat2AdjMul(D, C);
+		__m128 A_B = Detail::Mat2AdjMul(A, B);
+		__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Detail::Mat2Mul(B, D_C));
+		__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Detail::Mat2Mul(C, A_B));
+		__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Detail::Mat2MulAdj(D, A_B));
+		__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Detail::Mat2MulAdj(A, D_C));
+
+		// |M| = |A||D| + |B||C| - tr(A#B D#C)
+		__m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+		__m128 tr = _mm_mul_ps(A_B, Swizzle<0, 2, 1, 3>(D_C));
+		tr = _mm_hadd_ps(tr, tr);
+		tr = _mm_hadd_ps(tr, tr);
+		detM = _mm_sub_ps(detM, tr);
+
+		__m128 rcpDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+		X_ = _mm_mul_ps(X_, rcpDetM);
+		Y_ = _mm_mul_ps(Y_, rcpDetM);
+		Z_ = _mm_mul_ps(Z_, rcpDetM);
+		W_ = _mm_mul_ps(W_, rcpDetM);
+
+		// Adjugate shuffle merged with store
+		_mm_store_ps(&r.c[0].x, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_store_ps(&r.c[1].x, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2)));
+		_mm_store_ps(&r.c[2].x, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3)));
+		_mm_store_ps(&r.c[3].x, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)));
+#else
+		const float* a = &m.c[0].x;
+
+		// 2x2 determinants of the lower and upper halves
+		float s0 = a[0] * a[5] - a[4] * a[1];
+		float s1 = a[0] * a[6] - a[4] * a[2];
+		float s2 = a[0] * a[7] - a[4] * a[3];
+		float s3 = a[1] * a[6] - a[5] * a[2];
+		float s4 = a[1] * a[7] - a[5] * a[3];
+		float s5 = a[2] * a[7] - a[6] * a[3];
+
+		float c5 = a[10] * a[15] - a[14] * a[11];
+		float c4 = a[9] * a[15] - a[13] * a[11];
+		float c3 = a[9] * a[14] - a[13] * a[10];
+		float c2 = a[8] * a[15] - a[12] * a[11];
+		float c1 = a[8] * a[14] - a[12] * a[10];
+		float c0 = a[8] * a[13] - a[12] * a[9];
+
+		float rcpDet = 1.0f / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+		float* o = &r.c[0].x;
+		o[0] = ( a[5] * c5 - a[6] * c4 + a[7] * c3) * rcpDet;
+		o[1] = (-a[1] * c5 + a[2] * c4 - a[3] * c3) * rcpDet;
+		o[2] = ( a[13] * s5 - a[14] * s4 + a[15] * s3) * rcpDet;
+		o[3] = (-a[9] * s5 + a[10] * s4 - a[11] * s3) * rcpDet;
+
+		o[4] = (-a[4] * c5 + a[6] * c2 - a[7] * c1) * rcpDet;
+		o[5] = ( a[0] * c5 - a[2] * c2 + a[3] * c1) * rcpDet;
+		o[6] = (-a[12] * s5 + a[14] * s2 - a[15] * s1) * rcpDet;
+		o[7] = ( a[8] * s5 - a[10] * s2 + a[11] * s1) * rcpDet;
+
+		o[8] = ( a[4] * c4 - a[5] * c2 + a[7] * c0) * rcpDet;
+		o[9] = (-a[0] * c4 + a[1] * c2 - a[3] * c0) * rcpDet;
+		o[10] = ( a[12] * s4 - a[13] * s2 + a[15] * s0) * rcpDet;
+		o[11] = (-a[8] * s4 + a[9] * s2 - a[11] * s0) * rcpDet;
+
+		o[12] = (-a[4] * c3 + a[5] * c1 - a[6] * c0) * rcpDet;
+		o[13] = ( a[0] * c3 - a[1] * c1 + a[2] * c0) * rcpDet;
+		o[14] = (-a[12] * s3 + a[13] * s1 - a[14] * s0) * rcpDet;
+		o[15] = ( a[8] * s3 - a[9] * s1 + a[10] * s0) * rcpDet;
+#endif
+		return r;
+	}
+
+	// Point transform, w is taken as 1
+	MATH_INLINE Vec4 TransformPoint(const Mat4& m, const Vec4& p)
+	{
+#if MATH_SIMD_SSE4
+		__m128 v = Load(p);
+		__m128 r = MulAdd(Load(m.c[0]), Swizzle<0, 0, 0, 0>(v), Load(m.c[3]));
+		r = MulAdd(Load(m.c[1]), Swizzle<1, 1, 1, 1>(v), r);
+		r = MulAdd(Load(m.c[2]), Swizzle<2, 2, 2, 2>(v), r);
+		return StoreVec4(r);
+#else
+		return m.c[0] * p.x + m.c[1] * p.y + m.c[2] * p.z + m.c[3];
+#endif
+	}
+
+	//// Quat
+	MATH_INLINE Quat operator * (const Quat& a, const Quat& b)
+	{
+#if MATH_SIMD_SSE4
+		// (a.w * b.xyz + b.w * a.xyz + a.xyz x b.xyz, a.w * b.w - a.xyz . b.xyz)
+		__m128 va = Load(a);
+		__m128 vb = Load(b);
+		__m128 r = _mm_mul_ps(Swizzle<3, 3, 3, 3>(va), vb);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(Swizzle<0, 1, 2, 0>(va), Swizzle<3, 3, 3, 0>(vb)), _mm_setr_ps(1.0f, 1.0f, 1.0f, -1.0f)));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(Swizzle<1, 2, 0, 1>(va), Swizzle<2, 0, 1, 1>(vb)), _mm_setr_ps(1.0f, 1.0f, 1.0f, -1.0f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(Swizzle<2, 0, 1, 2>(va), Swizzle<1, 2, 0, 2>(vb)));
+		return StoreQuat(r);
+#else
+		return Quat(
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z,
+			a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x,
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+#endif
+	}
+
+	MATH_INLINE Quat Conjugate(const Quat& q) { return Quat(-q.x, -q.y, -q.z, q.w); }
+
+	MATH_INLINE float Dot(const Quat& a, const Quat& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	}
+
+	MATH_INLINE Quat Normalize(const Quat& q)
+	{
+		float s = 1.0f / sqrtf(Dot(q, q));
+		return Quat(q.x * s, q.y * s, q.z * s, q.w * s);
+	}
+
+	// Axis should be normalized
+	inline Quat QuatFromAxisAngle(const Vec4& axis, float radians)
+	{
+		float s = sinf(radians * 0.5f);
+		return Quat(axis.x * s, axis.y * s, axis.z * s, cosf(radians * 0.5f));
+	}
+
+	// v + 2w (q x v) + 2 q x (q x v)
+	MATH_INLINE Vec4 Rotate(const Quat& q, const Vec4& v)
+	{
+		Vec4 qv(q.x, q.y, q.z, 0.0f);
+		Vec4 t = Cross3(qv, v) * 2.0f;
+		Vec4 r = v + t * q.w + Cross3(qv, t);
+		r.w = v.w;
+		return r;
+	}
+
+	inline Quat Slerp(const Quat& a, const Quat& b, float t)
+	{
+		// Shortest path
+		float cosTheta = Dot(a, b);
+		Quat end = cosTheta < 0.0f ? Quat(-b.x, -b.y, -b.z, -b.w) : b;
+		cosTheta = fabsf(cosTheta);
+
+		float wa = 1.0f - t;
+		float wb = t;
+
+		// Nearly parallel, nlerp avoids dividing by sin(theta) ~ 0
+		if (cosTheta < 0.9995f)
+		{
+			float theta = acosf(cosTheta);
+			float rcpSin = 1.0f / sinf(theta);
+			wa = sinf((1.0f - t) * theta) * rcpSin;
+			wb = sinf(t * theta) * rcpSin;
+		}
+
+		Quat r(a.x * wa + end.x * wb, a.y * wa + end.y * wb, a.z * wa + end.z * wb, a.w * wa + end.w * wb);
+		return cosTheta < 0.9995f ? r : Normalize(r);
+	}
+
+	inline Mat4 QuatToMat4(const Quat& q)
+	{
+		float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+		Mat4 m;
+		m.c[0] = Vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f);
+		m.c[1] = Vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f);
+		m.c[2] = Vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f);
+		m.c[3] = Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		return m;
+	}
+
+	// T * R * S
+	inline Mat4 ComposeTransform(const Vec4& translation, const Quat& rotation, const Vec4& scale)
+	{
+		Mat4 m = QuatToMat4(rotation);
+		m.c[0] = m.c[0] * scale.x;
+		m.c[1] = m.c[1] * scale.y;
+		m.c[2] = m.c[2] * scale.z;
+		m.c[3] = Vec4(translation.x, translation.y, translation.z, 1.0f);
+		return m;
+	}
+
+	//// Bounds
+
+	// Arvo's method on center/ extent, result encloses the transformed box
+	MATH_INLINE AABB TransformAABB(const Mat4& m, const AABB& box)
+	{
+		AABB r;
+#if MATH_SIMD_SSE4
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 center = _mm_mul_ps(_mm_add_ps(Load(box.max), Load(box.min)), half);
+		__m128 extent = _mm_mul_ps(_mm_sub_ps(Load(box.max), Load(box.min)), half);
+
+		__m128 c0 = Load(m.c[0]);
+		__m128 c1 = Load(m.c[1]);
+		__m128 c2 = Load(m.c[2]);
+
+		__m128 newCenter = MulAdd(c0, Swizzle<0, 0, 0, 0>(center), Load(m.c[3]));
+		newCenter = MulAdd(c1, Swizzle<1, 1, 1, 1>(center), newCenter);
+		newCenter = MulAdd(c2, Swizzle<2, 2, 2, 2>(center), newCenter);
+
+		__m128 newExtent = _mm_mul_ps(Abs(c0), Swizzle<0, 0, 0, 0>(extent));
+		newExtent = MulAdd(Abs(c1), Swizzle<1, 1, 1, 1>(extent), newExtent);
+		newExtent = MulAdd(Abs(c2), Swizzle<2, 2, 2, 2>(extent), newExtent);
+
+		_mm_store_ps(&r.min.x, _mm_sub_ps(newCenter, newExtent));
+		_mm_store_ps(&r.max.x, _mm_add_ps(newCenter, newExtent));
+#else
+		Vec4 center = (box.max + box.min) * 0.5f;
+		Vec4 extent = (box.max - box.min) * 0.5f;
+
+		Vec4 newCenter = TransformPoint(m, center);
+		Vec4 newExtent(0.0f);
+		for (int col = 0; col < 3; ++col)
+		{
+			for (int row = 0; row < 4; ++row)
+			{
+				newExtent[row] += fabsf(m.c[col][row]) * extent[col];
+			}
+		}
+
+		r.min = newCenter - newExtent;
+		r.max = newCenter + newExtent;
+#endif
+		return r;
+	}
+
+	//// Batches
+
+	// AoS points, w of input is ignored and taken as 1
+	inline void TransformPoints(const Mat4& m, const Vec4* points, Vec4* outPoints, size_t count)
+	{
+#if MATH_SIMD_SSE4
+		__m128 c0 = Load(m.c[0]);
+		__m128 c1 = Load(m.c[1]);
+		__m128 c2 = Load(m.c[2]);
+		__m128 c3 = Load(m.c[3]);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			__m128 v = Load(points[i]);
+			__m128 r = MulAdd(c0, Swizzle<0, 0, 0, 0>(v), c3);
+			r = MulAdd(c1, Swizzle<1, 1, 1, 1>(v), r);
+			r = MulAdd(c2, Swizzle<2, 2, 2, 2>(v), r);
+			_mm_store_ps(&outPoints[i].x, r);
+		}
+#else
+		for (size_t i = 0; i < count; ++i)
+		{
+			outPoints[i] = TransformPoint(m, points[i]);
+		}
+#endif
+	}
+
+	// SoA points, 8 per iteration with AVX2, in/ out arrays may alias
+	inline void TransformPointsSoA(const Mat4& m,
+		const float* xs, const float* ys, const float* zs,
+		float* outXs, float* outYs, float* outZs,
+		size_t count)
+	{
+		size_t i = 0;
+#if MATH_SIMD_AVX2
+		const __m256 m00 = _mm256_set1_ps(m.c[0].x), m01 = _mm256_set1_ps(m.c[0].y), m02 = _mm256_set1_ps(m.c[0].z);
+		const __m256 m10 = _mm256_set1_ps(m.c[1].x), m11 = _mm256_set1_ps(m.c[1].y), m12 = _mm256_set1_ps(m.c[1].z);
+		const __m256 m20 = _mm256_set1_ps(m.c[2].x), m21 = _mm256_set1_ps(m.c[2].y), m22 = _mm256_set1_ps(m.c[2].z);
+		const __m256 m30 = _mm256_set1_ps(m.c[3].x), m31 = _mm256_set1_ps(m.c[3].y), m32 = _mm256_set1_ps(m.c[3].z);
+
+		for (; count - i >= 8; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(xs + i);
+			__m256 y = _mm256_loadu_ps(ys + i);
+			__m256 z = _mm256_loadu_ps(zs + i);
+
+			__m256 rx = MulAdd(m20, z, MulAdd(m10, y, MulAdd(m00, x, m30)));
+			__m256 ry = MulAdd(m21, z, MulAdd(m11, y, MulAdd(m01, x, m31)));
+			__m256 rz = MulAdd(m22, z, MulAdd(m12, y, MulAdd(m02, x, m32)));
+
+			_mm256_storeu_ps(outXs + i, rx);
+			_mm256_storeu_ps(outYs + i, ry);
+			_mm256_storeu_ps(outZs + i, rz);
+		}
+#elif MATH_SIMD_SSE4
+		const __m128 m00 = _mm_set1_ps(m.c[0].x), m01 = _mm_set1_ps(m.c[0].y), m02 = _mm_set1_ps(m.c[0].z);
+		const __m128 m10 = _mm_set1_ps(m.c[1].x), m11 = _mm_set1_ps(m.c[1].y), m12 = _mm_set1_ps(m.c[1].z);
+		const __m128 m20 = _mm_set1_ps(m.c[2].x), m21 = _mm_set1_ps(m.c[2].y), m22 = _mm_set1_ps(m.c[2].z);
+		const __m128 m30 = _mm_set1_ps(m.c[3].x), m31 = _mm_set1_ps(m.c[3].y), m32 = _mm_set1_ps(m.c[3].z);
+
+		for (; count - i >= 4; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(xs + i);
+			__m128 y = _mm_loadu_ps(ys + i);
+			__m128 z = _mm_loadu_ps(zs + i);
+
+			__m128 rx = MulAdd(m20, z, MulAdd(m10, y, MulAdd(m00, x, m30)));
+			__m128 ry = MulAdd(m21, z, MulAdd(m11, y, MulAdd(m01, x, m31)));
+			__m128 rz = MulAdd(m22, z, MulAdd(m12, y, MulAdd(m02, x, m32)));
+
+			_mm_storeu_ps(outXs + i, rx);
+			_mm_storeu_ps(outYs + i, ry);
+			_mm_storeu_ps(outZs + i, rz);
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			float x = xs[i], y = ys[i], z = zs[i];
+			outXs[i] = m.c[0].x * x + m.c[1].x * y + m.c[2].x * z + m.c[3].x;
+			outYs[i] = m.c[0].y * x + m.c[1].y * y + m.c[2].y * z + m.c[3].y;
+			outZs[i] = m.c[0].z * x + m.c[1].z * y + m.c[2].z * z + m.c[3].z;
+		}
+	}
+
+	// Same transform for every box
+	inline void TransformAABBs(const Mat4& m, const AABB* boxes, AABB* outBoxes, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			outBoxes[i] = TransformAABB(m, boxes[i]);
+		}
+	}
+
+	// One transform per box, e.g. local bounds to world with world matrices
+	inline void TransformAABBs(const Mat4* matrices, const AABB* boxes, AABB* outBoxes, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			outBoxes[i] = TransformAABB(matrices[i], boxes[i]);
+		}
+	}
+
+	// Multiply every matrix by the same parent, e.g. local to world
+	inline void MultiplyMatrices(const Mat4& parent, const Mat4* matrices, Mat4* outMatrices, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			outMatrices[i] = parent * matrices[i];
+		}
+	}
+}
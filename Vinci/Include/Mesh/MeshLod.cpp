@@ -0,0 +1,167 @@
+#include "MeshLod.h"
+
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdio>
+
+void BuildMeshLodChain(const MeshSimplifyDesc& desc, float boundsRadius, const MeshLodSettings& settings, MeshLodChain& outChain)
+{
+	outChain.indices.assign(desc.indices, desc.indices + desc.indexCount);
+	std::fill_n(outChain.levels, MESH_MAX_LODS, MeshLodLevel{});
+	outChain.levels[0] = { 0, desc.indexCount, 0.0f };
+	outChain.lodCount = 1;
+
+	const uint32_t maxLodCount = std::min<uint32_t>(settings.maxLodCount, MESH_MAX_LODS);
+	const float maxError = settings.maxErrorRatio * boundsRadius;
+
+	MeshSimplifyDesc lodDesc = desc;
+	std::vector<uint32_t> previous(outChain.indices);
+	std::vector<uint32_t> simplified;
+	float error = 0.0f;
+
+	while (outChain.lodCount < maxLodCount)
+	{
+		const uint32_t previousTriangles = static_cast<uint32_t>(previous.size() / 3);
+		if (previousTriangles <= settings.minTriangleCount || error >= maxError)
+		{
+			break;
+		}
+
+		const uint32_t targetTriangles = std::max(static_cast<uint32_t>(previousTriangles * settings.reductionRatio), settings.minTriangleCount);
+		lodDesc.indices = previous.data();
+		lodDesc.indexCount = static_cast<uint32_t>(previous.size());
+
+		// Remaining budget, errors of the chain add up
+		const float lodError = SimplifyMesh(lodDesc, targetTriangles * 3, maxError - error, simplified);
+		if (simplified.empty() || simplified.size() > previous.size() * settings.minReductionRatio)
+		{
+			break;
+		}
+
+		error += lodError;
+		outChain.levels[outChain.lodCount] = { static_cast<uint32_t>(outChain.indices.size()), static_cast<uint32_t>(simplified.size()), error };
+		outChain.indices.insert(outChain.indices.end(), simplified.begin(), simplified.end());
+		++outChain.lodCount;
+
+		previous.swap(simplified);
+	}
+}
+
+void BuildMeshLodChains(const std::vector<MeshSimplifyDesc>& descs, const std::vector<float>& boundsRadii, const MeshLodSettings& settings, std::vector<MeshLodChain>& outChains)
+{
+	outChains.resize(descs.size());
+
+	Gear::TaskSystem::Get().ParallelFor(static_cast<uint32_t>(descs.size()), 1, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			BuildMeshLodChain(descs[i], boundsRadii[i], settings, outChains[i]);
+		}
+	});
+}
+
+MeshLodThresholds ComputeMeshLodThresholds(const MeshLodLevel* levels, uint32_t lodCount, float boundsRadius, float pixelError)
+{
+	MeshLodThresholds thresholds = {};
+	thresholds.lodCount = std::max(std::min<uint32_t>(lodCount, MESH_MAX_LODS), 1u);
+	thresholds.screenRadius[0] = FLT_MAX;
+
+	// error * projectedRadius / boundsRadius <= pixelError
+	for (uint32_t lod = 1; lod < thresholds.lodCount; ++lod)
+	{
+		float screenRadius = levels[lod].error > 0.0f ? pixelError * boundsRadius / levels[lod].error : FLT_MAX;
+		thresholds.screenRadius[lod] = std::min(screenRadius, thresholds.screenRadius[lod - 1]);
+	}
+	return thresholds;
+}
+
+uint32_t SelectMeshLod(const MeshLodThresholds& thresholds, float projectedRadius, uint32_t currentLod, float hysteresis)
+{
+	uint32_t lod = std::min(currentLod, thresholds.lodCount - 1);
+
+	while (lod > 0 && projectedRadius > thresholds.screenRadius[lod])
+	{
+		--lod;
+	}
+
+	while (lod + 1 < thresholds.lodCount && projectedRadius <= thresholds.screenRadius[lod + 1] * (1.0f - hysteresis))
+	{
+		++lod;
+	}
+
+	return lod;
+}
+
+uint64_t HashCookSource(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool SaveCookedMeshes(const char* fileName, const std::vector<CookedMeshSource>& meshes, uint64_t sourceHash)
+{
+	Gear::FastLoadWriter writer;
+	const uint64_t fileOffset = writer.Allocate<CookedMeshFile>();
+	const uint64_t meshesOffset = meshes.empty() ? 0 : writer.Allocate<CookedMesh>(meshes.size());
+
+	for (size_t meshIdx = 0; meshIdx < meshes.size(); ++meshIdx)
+	{
+		const CookedMeshSource& source = meshes[meshIdx];
+		const uint64_t meshOffset = meshesOffset + meshIdx * sizeof(CookedMesh);
+
+		const size_t vertexSize = size_t(source.vertexCount) * source.vertexStride;
+		const size_t indexSize = source.lods->indices.size() * sizeof(uint32_t);
+		const uint64_t verticesOffset = vertexSize ? writer.Write(source.vertices, vertexSize) : 0;
+		const uint64_t indicesOffset = indexSize ? writer.Write(source.lods->indices.data(), indexSize) : 0;
+		const uint32_t meshletCount = source.meshlets ? static_cast<uint32_t>(source.meshlets->size()) : 0;
+		const uint64_t meshletsOffset = meshletCount ? writer.Write(source.meshlets->data(), meshletCount * sizeof(Meshlet)) : 0;
+
+		CookedMesh* cooked = writer.Resolve<CookedMesh>(meshOffset);
+		cooked->vertexCount = source.vertexCount;
+		cooked->vertexStride = source.vertexStride;
+		cooked->indexCount = static_cast<uint32_t>(source.lods->indices.size());
+		cooked->lodCount = source.lods->lodCount;
+		std::copy(source.boundsCenter, source.boundsCenter + 3, cooked->boundsCenter);
+		cooked->boundsRadius = source.boundsRadius;
+		std::copy(source.lods->levels, source.lods->levels + MESH_MAX_LODS, cooked->levels);
+		cooked->meshletCount = meshletCount;
+
+		writer.Link(meshOffset + offsetof(CookedMesh, vertices), verticesOffset);
+		writer.Link(meshOffset + offsetof(CookedMesh, indices), indicesOffset);
+		writer.Link(meshOffset + offsetof(CookedMesh, meshlets), meshletsOffset);
+	}
+
+	CookedMeshFile* file = writer.Resolve<CookedMeshFile>(fileOffset);
+	file->version = COOKED_MESH_VERSION;
+	file->meshCount = static_cast<uint32_t>(meshes.size());
+	file->sourceHash = sourceHash;
+	writer.Link(fileOffset + offsetof(CookedMeshFile, meshes), meshesOffset);
+	writer.SetRoot(fileOffset);
+
+	return writer.SaveToFile(fileName);
+}
+
+const CookedMeshFile* LoadCookedMeshes(const char* fileName, Gear::FastLoadImage& outImage, uint64_t sourceHash, bool bLooseOnly)
+{
+	if (!outImage.LoadIfExists(fileName, bLooseOnly))
+	{
+		return nullptr;
+	}
+
+	const CookedMeshFile* file = outImage.GetRoot<CookedMeshFile>();
+	if (!file || file->version != COOKED_MESH_VERSION || (sourceHash != 0 && file->sourceHash != sourceHash))
+	{
+		outImage.Release();
+		return nullptr;
+	}
+	return file;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Mesh/Meshlet.h"
+#include "Mesh/MeshSimplifier.h"
+#include "Base/Archive.h"
+
+#include <cstdint>
+#include <vector>
+
+#define MESH_MAX_LODS 4
+#define COOKED_MESH_VERSION 3
+
+// Index range of one LOD, every LOD indexes the same vertices
+struct MeshLodLevel
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;	// deviation from LOD 0 in mesh units, accumulated over the chain
+};
+
+struct MeshLodSettings
+{
+	uint32_t maxLodCount{ MESH_MAX_LODS };
+	float reductionRatio{ 0.5f };		// triangles of a LOD against the previous one
+	float minReductionRatio{ 0.85f };	// chain stops when a LOD keeps more than this of the previous one
+	float maxErrorRatio{ 0.05f };		// of the bounding radius
+	uint32_t minTriangleCount{ 32 };
+};
+
+struct MeshLodChain
+{
+	std::vector<uint32_t> indices;	// LOD 0 first, LODs back to back
+	MeshLodLevel levels[MESH_MAX_LODS]{};	// past lodCount zeroed, they are cooked too
+	uint32_t lodCount{ 0 };
+};
+
+// Each LOD is simplified from the previous one, so its error adds up along the chain
+void BuildMeshLodChain(const MeshSimplifyDesc& desc, float boundsRadius, const MeshLodSettings& settings, MeshLodChain& outChain);
+
+// One mesh per task, meshes differ a lot in cost
+void BuildMeshLodChains(const std::vector<MeshSimplifyDesc>& descs, const std::vector<float>& boundsRadii, const MeshLodSettings& settings, std::vector<MeshLodChain>& outChains);
+
+// Screen size selection:
+// LOD i is allowed while the projected bounding radius in pixels stays under screenRadius[i],
+// i.e. while its error projects under pixelError. LOD 0 is always allowed.
+struct MeshLodThresholds
+{
+	float screenRadius[MESH_MAX_LODS];
+	uint32_t lodCount;
+};
+
+MeshLodThresholds ComputeMeshLodThresholds(const MeshLodLevel* levels, uint32_t lodCount, float boundsRadius, float pixelError);
+
+// projectionScale is proj[1][1] * viewport height / 2, camera inside the sphere always gets LOD 0
+inline float ProjectSphereRadius(float radius, float distance, float projectionScale)
+{
+	return distance > radius ? radius * projectionScale / distance : 3.402823466e+38f;
+}
+
+// Moves to a finer LOD as soon as the current one exceeds the error budget, but only to a coarser one
+// once the screen size is hysteresis (fraction) below its threshold, so LODs do not pop back and forth
+uint32_t SelectMeshLod(const MeshLodThresholds& thresholds, float projectedRadius, uint32_t currentLod, float hysteresis);
+
+// Cooked asset, a fast-load image holding vertices, all LOD indices, LOD 0 meshlets and bounds of every mesh
+struct CookedMesh
+{
+	uint32_t vertexCount;
+	uint32_t vertexStride;	// bytes
+	uint32_t indexCount;
+	uint32_t lodCount;
+	float boundsCenter[3];
+	float boundsRadius;
+	MeshLodLevel levels[MESH_MAX_LODS];
+	uint32_t meshletCount;
+	uint32_t padding;
+	Gear::FastLoadPtr<const uint8_t> vertices;
+	Gear::FastLoadPtr<const uint32_t> indices;
+	Gear::FastLoadPtr<const Meshlet> meshlets;	// partition LOD 0 in index order
+};
+
+struct CookedMeshFile
+{
+	uint32_t version;
+	uint32_t meshCount;
+	uint64_t sourceHash;	// of the source asset, cooked again once it changes
+	Gear::FastLoadPtr<const CookedMesh> meshes;
+};
+
+struct CookedMeshSource
+{
+	const void* vertices;
+	uint32_t vertexCount;
+	uint32_t vertexStride;
+	float boundsCenter[3];
+	float boundsRadius;
+	const MeshLodChain* lods;
+	const std::vector<Meshlet>* meshlets;	// optional
+};
+
+// FNV-1a of the bytes of a source asset
+uint64_t HashCookSource(const void* data, size_t size);
+
+bool SaveCookedMeshes(const char* fileName, const std::vector<CookedMeshSource>& meshes, uint64_t sourceHash);
+
+// Null if file is missing, was cooked by an older version or from another source, fileName is a path in
+// Gear::FileSystem. Source hash 0 skips the check, e.g. when only cooked assets are shipped.
+// bLooseOnly reads the loose file, see Gear::FastLoadImage::LoadIfExists().
+const CookedMeshFile* LoadCookedMeshes(const char* fileName, Gear::FastLoadImage& outImage, uint64_t sourceHash, bool bLooseOnly = false);
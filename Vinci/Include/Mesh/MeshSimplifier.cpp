@@ -0,0 +1,716 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+// Border quadrics against area weighted face quadrics, keeps open borders in place
+#define MESH_SIMPLIFY_BORDER_WEIGHT 10.0
+// cos(75 deg)^2
+#define MESH_SIMPLIFY_FLIP_COS_SQ 0.067
+
+namespace
+{
+	// Sum of weighted squared distances to planes: p.A.p + 2 b.p + c
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	// Squared error of an attribute s against linear fits s(p) = g.p + d of every triangle around
+	// a wedge, expands to fit(p) - 2 s (g.p + d) + s^2 weight with sums kept apart
+	struct AttributeQuadric
+	{
+		Quadric fit;
+		double g0, g1, g2;
+		double d;
+	};
+
+	enum VertexKind : uint8_t
+	{
+		VK_Manifold,	// collapses to any neighbor
+		VK_Border,		// on one open border, collapses along it
+		VK_Seam,		// two wedges, collapses along the seam
+		VK_Locked		// corners, non-manifold, seams meeting borders
+	};
+
+	struct Collapse
+	{
+		uint32_t source;
+		uint32_t target;
+		double cost;
+	};
+
+	// Directed edges of the current triangles, sorted for lookup
+	class EdgeSet
+	{
+	public:
+		void Clear() { m_Keys.clear(); }
+		void Add(uint32_t a, uint32_t b) { m_Keys.push_back(Key(a, b)); }
+		void Build() { std::sort(m_Keys.begin(), m_Keys.end()); }
+		bool Contains(uint32_t a, uint32_t b) const { return std::binary_search(m_Keys.begin(), m_Keys.end(), Key(a, b)); }
+
+	private:
+		static uint64_t Key(uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; }
+
+		std::vector<uint64_t> m_Keys;
+	};
+
+	void AddPlane(Quadric& q, const double* n, double d, double weight)
+	{
+		q.a00 += weight * n[0] * n[0];
+		q.a11 += weight * n[1] * n[1];
+		q.a22 += weight * n[2] * n[2];
+		q.a01 += weight * n[0] * n[1];
+		q.a02 += weight * n[0] * n[2];
+		q.a12 += weight * n[1] * n[2];
+		q.b0 += weight * n[0] * d;
+		q.b1 += weight * n[1] * d;
+		q.b2 += weight * n[2] * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& other)
+	{
+		q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+		q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+		q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	void AddAttributeQuadric(AttributeQuadric& q, const AttributeQuadric& other)
+	{
+		AddQuadric(q.fit, other.fit);
+		q.g0 += other.g0; q.g1 += other.g1; q.g2 += other.g2;
+		q.d += other.d;
+	}
+
+	double EvaluateQuadric(const Quadric& q, const float* p)
+	{
+		const double x = p[0], y = p[1], z = p[2];
+		double error =
+			q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+			2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+			2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) +
+			q.c;
+		return std::max(error, 0.0);
+	}
+
+	double EvaluateAttributeQuadric(const AttributeQuadric& q, const float* p, float s)
+	{
+		double error = EvaluateQuadric(q.fit, p) - 2.0 * s * (q.g0 * p[0] + q.g1 * p[1] + q.g2 * p[2] + q.d) + static_cast<double>(s) * s * q.fit.weight;
+		return std::max(error, 0.0);
+	}
+
+	void Cross(const double* a, const double* b, double* out)
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	double Dot(const double* a, const double* b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	void TriangleNormal(const float* p0, const float* p1, const float* p2, double* out)
+	{
+		const double e1[3] = { double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2] };
+		const double e2[3] = { double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2] };
+		Cross(e1, e2, out);
+	}
+
+	// Lowest vertex index of every group of bitwise equal positions
+	std::vector<uint32_t> BuildPositionRemap(const std::vector<float>& positions, uint32_t vertexCount)
+	{
+		std::vector<uint32_t> order(vertexCount);
+		std::iota(order.begin(), order.end(), 0);
+
+		auto less = [&positions](uint32_t a, uint32_t b)
+		{
+			const float* pa = &positions[a * 3];
+			const float* pb = &positions[b * 3];
+			return std::lexicographical_compare(pa, pa + 3, pb, pb + 3) || (std::equal(pa, pa + 3, pb) && a < b);
+		};
+		std::sort(order.begin(), order.end(), less);
+
+		std::vector<uint32_t> remap(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			const bool bSameAsPrevious = i > 0 && std::equal(&positions[order[i] * 3], &positions[order[i] * 3] + 3, &positions[order[i - 1] * 3]);
+			remap[order[i]] = bSameAsPrevious ? remap[order[i - 1]] : order[i];
+		}
+		return remap;
+	}
+
+	// Compressed lists of items per vertex
+	void BuildLists(uint32_t vertexCount, const std::vector<uint32_t>& keys, const std::vector<uint32_t>& items, std::vector<uint32_t>& outOffsets, std::vector<uint32_t>& outItems)
+	{
+		outOffsets.assign(vertexCount + 1, 0);
+		for (uint32_t key : keys)
+		{
+			++outOffsets[key + 1];
+		}
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			outOffsets[v + 1] += outOffsets[v];
+		}
+
+		outItems.resize(items.size());
+		std::vector<uint32_t> cursors(outOffsets.begin(), outOffsets.end() - 1);
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			outItems[cursors[keys[i]]++] = items[i];
+		}
+	}
+
+	struct SimplifyState
+	{
+		uint32_t vertexCount;
+		uint32_t attributeCount;
+		std::vector<float> positions;	// normalized
+		std::vector<float> attributes;	// weighted
+		std::vector<uint32_t> remap;	// vertex -> canonical vertex of its position
+
+		std::vector<Quadric> quadrics;					// per canonical vertex
+		std::vector<AttributeQuadric> attributeQuadrics;	// per vertex and component
+
+		// Rebuilt every pass from current triangles
+		EdgeSet positionEdges;
+		EdgeSet wedgeEdges;
+		std::vector<uint32_t> wedgeOffsets, wedges;			// canonical -> referenced vertices
+		std::vector<uint32_t> triangleOffsets, triangles;	// canonical -> triangles
+		std::vector<uint8_t> kinds;
+
+		// Per pass collapses
+		std::vector<uint32_t> collapseTarget;	// canonical -> canonical
+		std::vector<uint32_t> wedgeTarget;		// vertex -> vertex
+		std::vector<uint8_t> collapseLocked;
+
+		const float* Position(uint32_t v) const { return &positions[v * 3]; }
+	};
+
+	void BuildQuadrics(SimplifyState& state, const std::vector<uint32_t>& indices)
+	{
+		state.quadrics.assign(state.vertexCount, Quadric{});
+		state.attributeQuadrics.assign(state.vertexCount * state.attributeCount, AttributeQuadric{});
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			const uint32_t v[3] = { indices[i], indices[i + 1], indices[i + 2] };
+
+			double normal[3];
+			TriangleNormal(state.Position(v[0]), state.Position(v[1]), state.Position(v[2]), normal);
+			const double length = std::sqrt(Dot(normal, normal));
+			if (length <= 0.0)
+			{
+				continue;
+			}
+
+			const double p0[3] = { state.Position(v[0])[0], state.Position(v[0])[1], state.Position(v[0])[2] };
+
+			const double unitNormal[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+			const double area = length * 0.5;
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				AddPlane(state.quadrics[state.remap[v[corner]]], unitNormal, -Dot(unitNormal, p0), area);
+			}
+
+			// Gradient of each attribute over the triangle plane: g.e1 = s1 - s0, g.e2 = s2 - s0, g.n = 0
+			if (state.attributeCount)
+			{
+				const float* q1 = state.Position(v[1]);
+				const float* q2 = state.Position(v[2]);
+				const double e1[3] = { q1[0] - p0[0], q1[1] - p0[1], q1[2] - p0[2] };
+				const double e2[3] = { q2[0] - p0[0], q2[1] - p0[1], q2[2] - p0[2] };
+				double e2xn[3], nxe1[3];
+				Cross(e2, normal, e2xn);
+				Cross(normal, e1, nxe1);
+				const double invLengthSq = 1.0 / (length * length);
+
+				for (uint32_t j = 0; j < state.attributeCount; ++j)
+				{
+					const double s0 = state.attributes[v[0] * state.attributeCount + j];
+					const double ds1 = state.attributes[v[1] * state.attributeCount + j] - s0;
+					const double ds2 = state.attributes[v[2] * state.attributeCount + j] - s0;
+
+					const double g[3] =
+					{
+						(ds1 * e2xn[0] + ds2 * nxe1[0]) * invLengthSq,
+						(ds1 * e2xn[1] + ds2 * nxe1[1]) * invLengthSq,
+						(ds1 * e2xn[2] + ds2 * nxe1[2]) * invLengthSq
+					};
+					const double d = s0 - Dot(g, p0);
+
+					for (uint32_t corner = 0; corner < 3; ++corner)
+					{
+						AttributeQuadric& q = state.attributeQuadrics[v[corner] * state.attributeCount + j];
+						AddPlane(q.fit, g, d, area);
+						q.g0 += area * g[0];
+						q.g1 += area * g[1];
+						q.g2 += area * g[2];
+						q.d += area * d;
+					}
+				}
+			}
+		}
+
+		// Planes through open edges, perpendicular to their face
+		state.positionEdges.Clear();
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				state.positionEdges.Add(state.remap[indices[i + corner]], state.remap[indices[i + (corner + 1) % 3]]);
+			}
+		}
+		state.positionEdges.Build();
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			double normal[3];
+			TriangleNormal(state.Position(indices[i]), state.Position(indices[i + 1]), state.Position(indices[i + 2]), normal);
+
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = state.remap[indices[i + corner]];
+				const uint32_t b = state.remap[indices[i + (corner + 1) % 3]];
+				if (a == b || state.positionEdges.Contains(b, a))
+				{
+					continue;
+				}
+
+				const float* pa = state.Position(a);
+				const float* pb = state.Position(b);
+				const double edge[3] = { double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2] };
+				double plane[3];
+				Cross(edge, normal, plane);
+				const double length = std::sqrt(Dot(plane, plane));
+				if (length <= 0.0)
+				{
+					continue;
+				}
+
+				const double unitPlane[3] = { plane[0] / length, plane[1] / length, plane[2] / length };
+				const double origin[3] = { pa[0], pa[1], pa[2] };
+				const double weight = Dot(edge, edge) * MESH_SIMPLIFY_BORDER_WEIGHT;
+				AddPlane(state.quadrics[a], unitPlane, -Dot(unitPlane, origin), weight);
+				AddPlane(state.quadrics[b], unitPlane, -Dot(unitPlane, origin), weight);
+			}
+		}
+	}
+
+	void BuildTopology(SimplifyState& state, const std::vector<uint32_t>& indices)
+	{
+		const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+		state.positionEdges.Clear();
+		state.wedgeEdges.Clear();
+
+		std::vector<uint32_t> keys, items;
+		keys.reserve(indices.size());
+		items.reserve(indices.size());
+
+		std::vector<uint8_t> referenced(state.vertexCount, 0);
+		for (uint32_t tri = 0; tri < triangleCount; ++tri)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = indices[tri * 3 + corner];
+				const uint32_t b = indices[tri * 3 + (corner + 1) % 3];
+				state.positionEdges.Add(state.remap[a], state.remap[b]);
+				state.wedgeEdges.Add(a, b);
+				referenced[a] = 1;
+
+				keys.push_back(state.remap[a]);
+				items.push_back(tri);
+			}
+		}
+		state.positionEdges.Build();
+		state.wedgeEdges.Build();
+		BuildLists(state.vertexCount, keys, items, state.triangleOffsets, state.triangles);
+
+		keys.clear();
+		items.clear();
+		for (uint32_t v = 0; v < state.vertexCount; ++v)
+		{
+			if (referenced[v])
+			{
+				keys.push_back(state.remap[v]);
+				items.push_back(v);
+			}
+		}
+		BuildLists(state.vertexCount, keys, items, state.wedgeOffsets, state.wedges);
+
+		// Open edges in position space are borders
+		std::vector<uint32_t> openEdgeCounts(state.vertexCount, 0);
+		for (uint32_t tri = 0; tri < triangleCount; ++tri)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = state.remap[indices[tri * 3 + corner]];
+				const uint32_t b = state.remap[indices[tri * 3 + (corner + 1) % 3]];
+				if (a != b && !state.positionEdges.Contains(b, a))
+				{
+					++openEdgeCounts[a];
+					++openEdgeCounts[b];
+				}
+			}
+		}
+
+		state.kinds.assign(state.vertexCount, VK_Locked);
+		for (uint32_t v = 0; v < state.vertexCount; ++v)
+		{
+			const uint32_t wedgeCount = state.wedgeOffsets[v + 1] - state.wedgeOffsets[v];
+			if (wedgeCount == 1 && openEdgeCounts[v] == 0)
+			{
+				state.kinds[v] = VK_Manifold;
+			}
+			else if (wedgeCount == 1 && openEdgeCounts[v] == 2)
+			{
+				state.kinds[v] = VK_Border;
+			}
+			else if (wedgeCount == 2 && openEdgeCounts[v] == 0)
+			{
+				state.kinds[v] = VK_Seam;
+			}
+		}
+	}
+
+	// Wedge of target sharing an edge with every wedge of source, so attributes stay continuous
+	bool MapWedges(const SimplifyState& state, uint32_t source, uint32_t target, uint32_t* outTargets)
+	{
+		for (uint32_t i = state.wedgeOffsets[source]; i < state.wedgeOffsets[source + 1]; ++i)
+		{
+			const uint32_t w = state.wedges[i];
+
+			bool bFound = false;
+			for (uint32_t j = state.wedgeOffsets[target]; j < state.wedgeOffsets[target + 1] && !bFound; ++j)
+			{
+				const uint32_t u = state.wedges[j];
+				if (state.wedgeEdges.Contains(w, u) || state.wedgeEdges.Contains(u, w))
+				{
+					outTargets[i - state.wedgeOffsets[source]] = u;
+					bFound = true;
+				}
+			}
+
+			if (!bFound)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool CanCollapse(const SimplifyState& state, uint32_t source, uint32_t target)
+	{
+		const uint8_t sourceKind = state.kinds[source];
+		const uint8_t targetKind = state.kinds[target];
+
+		switch (sourceKind)
+		{
+		case VK_Manifold:
+			return true;
+
+		case VK_Border:
+			return (targetKind == VK_Border || targetKind == VK_Locked) &&
+				(!state.positionEdges.Contains(source, target) || !state.positionEdges.Contains(target, source));
+
+		case VK_Seam:
+		{
+			if (targetKind != VK_Seam && targetKind != VK_Locked)
+			{
+				return false;
+			}
+
+			// Some wedge edge is open while position edge is not
+			for (uint32_t i = state.wedgeOffsets[source]; i < state.wedgeOffsets[source + 1]; ++i)
+			{
+				for (uint32_t j = state.wedgeOffsets[target]; j < state.wedgeOffsets[target + 1]; ++j)
+				{
+					const uint32_t w = state.wedges[i];
+					const uint32_t u = state.wedges[j];
+					if (state.wedgeEdges.Contains(w, u) != state.wedgeEdges.Contains(u, w))
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	double CollapseCost(const SimplifyState& state, uint32_t source, uint32_t target, const uint32_t* wedgeTargets)
+	{
+		const float* p = state.Position(target);
+
+		const Quadric& q = state.quadrics[source];
+		double cost = EvaluateQuadric(q, p) / std::max(q.weight, DBL_MIN);
+
+		for (uint32_t i = state.wedgeOffsets[source]; i < state.wedgeOffsets[source + 1]; ++i)
+		{
+			const uint32_t w = state.wedges[i];
+			const uint32_t u = wedgeTargets[i - state.wedgeOffsets[source]];
+			for (uint32_t j = 0; j < state.attributeCount; ++j)
+			{
+				const AttributeQuadric& aq = state.attributeQuadrics[w * state.attributeCount + j];
+				cost += EvaluateAttributeQuadric(aq, p, state.attributes[u * state.attributeCount + j]) / std::max(aq.fit.weight, DBL_MIN);
+			}
+		}
+		return cost;
+	}
+
+	// Triangles around source that stay after the collapse must keep facing the same side.
+	// Degenerate ones (from earlier collapses) are compared against the source vertex normal.
+	bool HasFlips(const SimplifyState& state, const std::vector<uint32_t>& indices, uint32_t source, uint32_t target, uint32_t& outRemovedTriangles)
+	{
+		auto getCorners = [&state, &indices](uint32_t tri, uint32_t* outCorners)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				outCorners[corner] = state.collapseTarget[state.remap[indices[tri * 3 + corner]]];
+			}
+		};
+
+		double vertexNormal[3] = { 0.0, 0.0, 0.0 };
+		for (uint32_t i = state.triangleOffsets[source]; i < state.triangleOffsets[source + 1]; ++i)
+		{
+			uint32_t corners[3];
+			getCorners(state.triangles[i], corners);
+
+			double normal[3];
+			TriangleNormal(state.Position(corners[0]), state.Position(corners[1]), state.Position(corners[2]), normal);
+			vertexNormal[0] += normal[0];
+			vertexNormal[1] += normal[1];
+			vertexNormal[2] += normal[2];
+		}
+
+		outRemovedTriangles = 0;
+		for (uint32_t i = state.triangleOffsets[source]; i < state.triangleOffsets[source + 1]; ++i)
+		{
+			uint32_t corners[3];
+			getCorners(state.triangles[i], corners);
+
+			if (corners[0] == target || corners[1] == target || corners[2] == target)
+			{
+				++outRemovedTriangles;
+				continue;
+			}
+
+			double before[3], after[3];
+			TriangleNormal(state.Position(corners[0]), state.Position(corners[1]), state.Position(corners[2]), before);
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				corners[corner] = corners[corner] == source ? target : corners[corner];
+			}
+			TriangleNormal(state.Position(corners[0]), state.Position(corners[1]), state.Position(corners[2]), after);
+
+			// Turning by more than ~75 degrees counts as a flip, folds on curved surfaces stay out
+			const double* reference = Dot(before, before) > Dot(after, after) * 1e-6 ? before : vertexNormal;
+			const double cosAngle = Dot(reference, after);
+			if (cosAngle <= 0.0 || cosAngle * cosAngle < MESH_SIMPLIFY_FLIP_COS_SQ * Dot(reference, reference) * Dot(after, after))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+float SimplifyMesh(const MeshSimplifyDesc& desc, uint32_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices)
+{
+	outIndices.assign(desc.indices, desc.indices + desc.indexCount);
+	outIndices.resize(outIndices.size() / 3 * 3);
+	if (outIndices.size() <= targetIndexCount || desc.vertexCount == 0)
+	{
+		return 0.0f;
+	}
+
+	SimplifyState state;
+	state.vertexCount = desc.vertexCount;
+	state.attributeCount = desc.attributes ? std::min<uint32_t>(desc.attributeCount, MESH_SIMPLIFY_MAX_ATTRIBUTES) : 0;
+
+	// Positions normalized to unit extent, error thresholds and attribute weights do not depend on mesh scale
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (uint32_t v = 0; v < state.vertexCount; ++v)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(desc.positions) + size_t(v) * desc.positionStride);
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			boundsMin[i] = std::min(boundsMin[i], p[i]);
+			boundsMax[i] = std::max(boundsMax[i], p[i]);
+		}
+	}
+	float extent = std::max({ boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2] });
+	extent = extent > 0.0f ? extent : 1.0f;
+	const float scale = 1.0f / extent;
+
+	state.positions.resize(size_t(state.vertexCount) * 3);
+	state.attributes.resize(size_t(state.vertexCount) * state.attributeCount);
+	for (uint32_t v = 0; v < state.vertexCount; ++v)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(desc.positions) + size_t(v) * desc.positionStride);
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			state.positions[v * 3 + i] = (p[i] - boundsMin[i]) * scale;
+		}
+
+		const float* a = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(desc.attributes) + size_t(v) * desc.attributeStride);
+		for (uint32_t j = 0; j < state.attributeCount; ++j)
+		{
+			state.attributes[v * state.attributeCount + j] = a[j] * desc.attributeWeights[j];
+		}
+	}
+
+	state.remap = BuildPositionRemap(state.positions, state.vertexCount);
+	BuildQuadrics(state, outIndices);
+
+	state.collapseTarget.resize(state.vertexCount);
+	state.wedgeTarget.resize(state.vertexCount);
+	state.collapseLocked.resize(state.vertexCount);
+
+	const double costLimit = static_cast<double>(targetError) * targetError * scale * scale;
+	double maxCost = 0.0;
+
+	std::vector<Collapse> collapses;
+	std::vector<uint64_t> edges;
+	std::vector<uint32_t> wedgeTargets, reverseWedgeTargets;
+
+	// Each pass collapses the cheapest edges not touching each other, then topology is rebuilt
+	while (outIndices.size() > targetIndexCount)
+	{
+		BuildTopology(state, outIndices);
+
+		edges.clear();
+		for (size_t i = 0; i < outIndices.size(); i += 3)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = state.remap[outIndices[i + corner]];
+				const uint32_t b = state.remap[outIndices[i + (corner + 1) % 3]];
+				if (a != b)
+				{
+					edges.push_back((static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+				}
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		// Cheaper direction of every edge
+		collapses.clear();
+		for (uint64_t edge : edges)
+		{
+			const uint32_t a = static_cast<uint32_t>(edge >> 32);
+			const uint32_t b = static_cast<uint32_t>(edge);
+
+			Collapse collapse = { 0, 0, DBL_MAX };
+			const uint32_t directions[2][2] = { { a, b }, { b, a } };
+			for (const auto& direction : directions)
+			{
+				const uint32_t source = direction[0];
+				const uint32_t target = direction[1];
+				wedgeTargets.resize(state.wedgeOffsets[source + 1] - state.wedgeOffsets[source]);
+				if (!CanCollapse(state, source, target) || !MapWedges(state, source, target, wedgeTargets.data()))
+				{
+					continue;
+				}
+
+				const double cost = CollapseCost(state, source, target, wedgeTargets.data());
+				if (cost < collapse.cost)
+				{
+					collapse = { source, target, cost };
+				}
+			}
+
+			if (collapse.cost <= costLimit)
+			{
+				collapses.push_back(collapse);
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		std::iota(state.collapseTarget.begin(), state.collapseTarget.end(), 0);
+		std::iota(state.wedgeTarget.begin(), state.wedgeTarget.end(), 0);
+		std::fill(state.collapseLocked.begin(), state.collapseLocked.end(), 0);
+
+		uint32_t triangleCount = static_cast<uint32_t>(outIndices.size() / 3);
+		uint32_t collapseCount = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (triangleCount * 3 <= targetIndexCount)
+			{
+				break;
+			}
+			if (state.collapseLocked[collapse.source] || state.collapseLocked[collapse.target])
+			{
+				continue;
+			}
+
+			uint32_t removedTriangles = 0;
+			if (HasFlips(state, outIndices, collapse.source, collapse.target, removedTriangles))
+			{
+				continue;
+			}
+
+			wedgeTargets.resize(state.wedgeOffsets[collapse.source + 1] - state.wedgeOffsets[collapse.source]);
+			MapWedges(state, collapse.source, collapse.target, wedgeTargets.data());
+			for (uint32_t i = state.wedgeOffsets[collapse.source]; i < state.wedgeOffsets[collapse.source + 1]; ++i)
+			{
+				const uint32_t w = state.wedges[i];
+				const uint32_t u = wedgeTargets[i - state.wedgeOffsets[collapse.source]];
+				state.wedgeTarget[w] = u;
+				for (uint32_t j = 0; j < state.attributeCount; ++j)
+				{
+					AddAttributeQuadric(state.attributeQuadrics[u * state.attributeCount + j], state.attributeQuadrics[w * state.attributeCount + j]);
+				}
+			}
+
+			AddQuadric(state.quadrics[collapse.target], state.quadrics[collapse.source]);
+			state.collapseTarget[collapse.source] = collapse.target;
+			state.collapseLocked[collapse.source] = 1;
+			state.collapseLocked[collapse.target] = 1;
+
+			triangleCount -= std::min(removedTriangles, triangleCount);
+			maxCost = std::max(maxCost, collapse.cost);
+			++collapseCount;
+		}
+
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Apply collapses, drop triangles that became degenerate
+		size_t writeIdx = 0;
+		for (size_t i = 0; i < outIndices.size(); i += 3)
+		{
+			const uint32_t a = state.wedgeTarget[outIndices[i]];
+			const uint32_t b = state.wedgeTarget[outIndices[i + 1]];
+			const uint32_t c = state.wedgeTarget[outIndices[i + 2]];
+			if (state.remap[a] != state.remap[b] && state.remap[b] != state.remap[c] && state.remap[a] != state.remap[c])
+			{
+				outIndices[writeIdx++] = a;
+				outIndices[writeIdx++] = b;
+				outIndices[writeIdx++] = c;
+			}
+		}
+		outIndices.resize(writeIdx);
+	}
+
+	return static_cast<float>(std::sqrt(maxCost)) * extent;
+}
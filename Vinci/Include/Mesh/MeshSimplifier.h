@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define MESH_SIMPLIFY_MAX_ATTRIBUTES 4
+
+// Indexed triangle list to simplify, positions and attributes are read with byte strides
+struct MeshSimplifyDesc
+{
+	const float* positions{ nullptr };
+	uint32_t positionStride{ 0 };
+	uint32_t vertexCount{ 0 };
+
+	// Optional per vertex attributes (e.g. uv), error of each component is scaled by its weight.
+	// Weights are relative to positions normalized to unit extent.
+	const float* attributes{ nullptr };
+	uint32_t attributeStride{ 0 };
+	uint32_t attributeCount{ 0 };
+	float attributeWeights[MESH_SIMPLIFY_MAX_ATTRIBUTES]{ 0.5f, 0.5f, 0.5f, 0.5f };
+
+	const uint32_t* indices{ nullptr };
+	uint32_t indexCount{ 0 };
+};
+
+// Quadric error metric simplification by half edge collapse.
+//  |- kept vertices do not move, result indexes the input vertex buffer so every LOD can share it
+//  |- open borders only collapse along themselves and are held by border quadrics
+//  |- attribute seams (same position, different attributes) only collapse along the seam
+//  |- collapses that would flip a triangle are rejected
+// Stops at targetIndexCount or when the next collapse costs more than targetError (mesh units).
+// Returns the error reached, in mesh units.
+float SimplifyMesh(const MeshSimplifyDesc& desc, uint32_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices);
@@ -0,0 +1,263 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	// Normal alignment against new vertices when growing a meshlet, a new vertex costs 1
+	const float MESHLET_CONE_WEIGHT = 0.25f;
+
+	// Below this cosine the cone would open wider than ~84 degrees and never cull anything
+	const float MESHLET_MIN_CONE_DOT = 0.1f;
+
+	struct Vec3
+	{
+		float x, y, z;
+	};
+
+	inline Vec3 operator-(const Vec3& a, const Vec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	inline float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	inline Vec3 Cross(const Vec3& a, const Vec3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+
+	inline Vec3 ReadPosition(const float* positions, uint32_t positionStride, uint32_t vertex)
+	{
+		const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + size_t(vertex) * positionStride);
+		return { p[0], p[1], p[2] };
+	}
+
+	void ComputeMeshletBounds(const std::vector<Vec3>& triangleNormals, const Vec3* positions, const uint32_t* indices, Meshlet& meshlet)
+	{
+		const uint32_t* meshletIndices = indices + meshlet.firstIndex;
+
+		Vec3 boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		Vec3 boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+		{
+			const Vec3& p = positions[meshletIndices[i]];
+			boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+			boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+		}
+
+		const Vec3 center = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+		float radiusSq = 0.0f;
+		for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+		{
+			const Vec3 d = positions[meshletIndices[i]] - center;
+			radiusSq = std::max(radiusSq, Dot(d, d));
+		}
+
+		meshlet.center[0] = center.x;
+		meshlet.center[1] = center.y;
+		meshlet.center[2] = center.z;
+		meshlet.radius = sqrtf(radiusSq);
+
+		// Axis is the mean of triangle normals, cutoff from the widest of them
+		Vec3 axis = { 0.0f, 0.0f, 0.0f };
+		const uint32_t firstTriangle = meshlet.firstIndex / 3;
+		const uint32_t triangleCount = meshlet.indexCount / 3;
+		for (uint32_t t = 0; t < triangleCount; ++t)
+		{
+			const Vec3& n = triangleNormals[firstTriangle + t];
+			axis = { axis.x + n.x, axis.y + n.y, axis.z + n.z };
+		}
+
+		const float axisLength = sqrtf(Dot(axis, axis));
+		float minDot = -1.0f;
+		if (axisLength > 1e-6f)
+		{
+			axis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+
+			minDot = 1.0f;
+			for (uint32_t t = 0; t < triangleCount; ++t)
+			{
+				const Vec3& n = triangleNormals[firstTriangle + t];
+				if (Dot(n, n) > 0.0f)
+				{
+					minDot = std::min(minDot, Dot(n, axis));
+				}
+			}
+		}
+
+		if (minDot <= MESHLET_MIN_CONE_DOT)
+		{
+			meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+			meshlet.coneCutoff = 1.0f;
+			return;
+		}
+
+		// Sine of the cone half angle, test is against the view vector so it is the complement
+		meshlet.coneAxis[0] = axis.x;
+		meshlet.coneAxis[1] = axis.y;
+		meshlet.coneAxis[2] = axis.z;
+		meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+}
+
+void BuildMeshlets(const float* positions, uint32_t positionStride, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount, std::vector<Meshlet>& outMeshlets)
+{
+	outMeshlets.clear();
+
+	const uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	std::vector<Vec3> vertexPositions(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		vertexPositions[v] = ReadPosition(positions, positionStride, v);
+	}
+
+	// Unit normals, zero for degenerate triangles
+	std::vector<Vec3> triangleNormals(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const Vec3& a = vertexPositions[indices[t * 3 + 0]];
+		const Vec3 n = Cross(vertexPositions[indices[t * 3 + 1]] - a, vertexPositions[indices[t * 3 + 2]] - a);
+		const float length = sqrtf(Dot(n, n));
+		triangleNormals[t] = length > 0.0f ? Vec3{ n.x / length, n.y / length, n.z / length } : Vec3{ 0.0f, 0.0f, 0.0f };
+	}
+
+	// Triangles around every vertex
+	std::vector<uint32_t> vertexTriangleOffsets(vertexCount + 1, 0);
+	for (uint32_t i = 0; i < triangleCount * 3; ++i)
+	{
+		++vertexTriangleOffsets[indices[i] + 1];
+	}
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		vertexTriangleOffsets[v + 1] += vertexTriangleOffsets[v];
+	}
+
+	std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+	{
+		std::vector<uint32_t> fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+		for (uint32_t i = 0; i < triangleCount * 3; ++i)
+		{
+			vertexTriangles[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<bool> triangleUsed(triangleCount, false);
+	std::vector<uint32_t> vertexMeshlet(vertexCount, UINT32_MAX);	// last meshlet the vertex was added to
+	std::vector<uint32_t> orderedTriangles;
+	orderedTriangles.reserve(triangleCount);
+
+	std::vector<uint32_t> meshletVertices;
+	meshletVertices.reserve(MESHLET_MAX_VERTICES);
+
+	uint32_t nextSeed = 0;
+	while (orderedTriangles.size() < triangleCount)
+	{
+		const uint32_t meshletIdx = static_cast<uint32_t>(outMeshlets.size());
+		const uint32_t meshletFirstTriangle = static_cast<uint32_t>(orderedTriangles.size());
+		meshletVertices.clear();
+		Vec3 normalSum = { 0.0f, 0.0f, 0.0f };
+
+		auto countNewVertices = [&](uint32_t triangle)
+		{
+			uint32_t count = 0;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				count += vertexMeshlet[indices[triangle * 3 + k]] != meshletIdx ? 1 : 0;
+			}
+			return count;
+		};
+
+		auto addTriangle = [&](uint32_t triangle)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				const uint32_t vertex = indices[triangle * 3 + k];
+				if (vertexMeshlet[vertex] != meshletIdx)
+				{
+					vertexMeshlet[vertex] = meshletIdx;
+					meshletVertices.push_back(vertex);
+				}
+			}
+			const Vec3& n = triangleNormals[triangle];
+			normalSum = { normalSum.x + n.x, normalSum.y + n.y, normalSum.z + n.z };
+			triangleUsed[triangle] = true;
+			orderedTriangles.push_back(triangle);
+		};
+
+		while (triangleUsed[nextSeed])
+		{
+			++nextSeed;
+		}
+		addTriangle(nextSeed);
+
+		while (orderedTriangles.size() - meshletFirstTriangle < MESHLET_MAX_TRIANGLES)
+		{
+			const float normalLength = sqrtf(Dot(normalSum, normalSum));
+			const Vec3 meshletNormal = normalLength > 0.0f ? Vec3{ normalSum.x / normalLength, normalSum.y / normalLength, normalSum.z / normalLength } : normalSum;
+
+			// Best triangle touching the meshlet, new vertices first then normal alignment
+			uint32_t bestTriangle = UINT32_MAX;
+			float bestCost = FLT_MAX;
+			for (uint32_t vertex : meshletVertices)
+			{
+				for (uint32_t i = vertexTriangleOffsets[vertex]; i < vertexTriangleOffsets[vertex + 1]; ++i)
+				{
+					const uint32_t triangle = vertexTriangles[i];
+					if (triangleUsed[triangle])
+					{
+						continue;
+					}
+
+					const uint32_t newVertices = countNewVertices(triangle);
+					if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES)
+					{
+						continue;
+					}
+
+					const float cost = newVertices + MESHLET_CONE_WEIGHT * (1.0f - Dot(triangleNormals[triangle], meshletNormal));
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestTriangle = triangle;
+					}
+				}
+			}
+
+			// Disconnected piece, continue with the next triangle in input order which is usually close by
+			if (bestTriangle == UINT32_MAX)
+			{
+				while (nextSeed < triangleCount && triangleUsed[nextSeed])
+				{
+					++nextSeed;
+				}
+				if (nextSeed == triangleCount || meshletVertices.size() + countNewVertices(nextSeed) > MESHLET_MAX_VERTICES)
+				{
+					break;
+				}
+				bestTriangle = nextSeed;
+			}
+
+			addTriangle(bestTriangle);
+		}
+
+		Meshlet meshlet = {};
+		meshlet.firstIndex = meshletFirstTriangle * 3;
+		meshlet.indexCount = (static_cast<uint32_t>(orderedTriangles.size()) - meshletFirstTriangle) * 3;
+		meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+		outMeshlets.push_back(meshlet);
+	}
+
+	// Write triangles back in meshlet order, normals follow so bounds can index them by meshlet range
+	std::vector<uint32_t> sourceIndices(indices, indices + triangleCount * 3);
+	std::vector<Vec3> orderedNormals(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t source = orderedTriangles[t];
+		std::copy(sourceIndices.begin() + source * 3, sourceIndices.begin() + source * 3 + 3, indices + t * 3);
+		orderedNormals[t] = triangleNormals[source];
+	}
+
+	for (Meshlet& meshlet : outMeshlets)
+	{
+		ComputeMeshletBounds(orderedNormals, vertexPositions.data(), indices, meshlet);
+	}
+}
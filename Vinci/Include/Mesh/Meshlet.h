@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// Cluster of triangles, a contiguous range of the mesh index buffer so it draws as a regular indexed draw.
+// Same layout as Meshlet in ClusterCull.comp.
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+	uint32_t padding;
+
+	// Bounding sphere in mesh space
+	float center[3];
+	float radius;
+
+	// Normal cone, every triangle faces away from a camera where
+	// dot(center - camera, coneAxis) >= coneCutoff * length(center - camera) + radius.
+	// Zero axis and cutoff 1 when normals spread too much to ever cull.
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+// Partitions indices (triangle list) into meshlets of at most MESHLET_MAX_VERTICES unique vertices and
+// MESHLET_MAX_TRIANGLES triangles. Triangles are grown into a meshlet through shared vertices, preferring
+// ones that add no new vertex and face the same way, so clusters stay compact and their cones narrow.
+// Indices are reordered in place so every meshlet is contiguous, firstIndex is relative to indices.
+void BuildMeshlets(const float* positions, uint32_t positionStride, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount, std::vector<Meshlet>& outMeshlets);
+
+// Conservative backface test of a whole meshlet, camera and meshlet in the same space
+inline bool IsMeshletBackfacing(const Meshlet& meshlet, const float* cameraPosition)
+{
+	const float toCenter[3] = { meshlet.center[0] - cameraPosition[0], meshlet.center[1] - cameraPosition[1], meshlet.center[2] - cameraPosition[2] };
+	const float distance = sqrtf(toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] + toCenter[2] * toCenter[2]);
+	const float projected = toCenter[0] * meshlet.coneAxis[0] + toCenter[1] * meshlet.coneAxis[1] + toCenter[2] * meshlet.coneAxis[2];
+	return projected >= meshlet.coneCutoff * distance + meshlet.radius;
+}
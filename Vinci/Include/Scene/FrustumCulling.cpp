@@ -0,0 +1,310 @@
+#include "FrustumCulling.h"
+
+#include "Base/TaskSystem.h"
+
+#include <cfloat>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Objects tested per SIMD iteration
+static const uint32_t CULL_GROUP_SIZE = 8;
+
+// Padding objects, min(radius, box radius) is -FLT_MAX so every plane rejects them
+static const float CULL_PADDING_RADIUS = -FLT_MAX;
+
+static uint32_t PadToGroup(uint32_t count)
+{
+	return (count + CULL_GROUP_SIZE - 1) & ~(CULL_GROUP_SIZE - 1);
+}
+
+Frustum Frustum::FromMatrix(const Math::Mat4& viewProjection)
+{
+	// Gribb/ Hartmann, rows of column major matrix
+	const Math::Mat4 m = Math::Transpose(viewProjection);
+	const Math::Vec4& row0 = m.c[0];
+	const Math::Vec4& row1 = m.c[1];
+	const Math::Vec4& row2 = m.c[2];
+	const Math::Vec4& row3 = m.c[3];
+
+	Frustum frustum;
+	frustum.Planes[FP_Left] = row3 + row0;
+	frustum.Planes[FP_Right] = row3 - row0;
+	frustum.Planes[FP_Bottom] = row3 + row1;
+	frustum.Planes[FP_Top] = row3 - row1;
+	frustum.Planes[FP_Near] = row2;
+	frustum.Planes[FP_Far] = row3 - row2;
+
+	for (Math::Vec4& plane : frustum.Planes)
+	{
+		plane = plane * (1.0f / Math::Length3(plane));
+	}
+
+	return frustum;
+}
+
+void FrustumCuller::Clear()
+{
+	Resize(0);
+}
+
+void FrustumCuller::Reserve(uint32_t objectCount)
+{
+	const uint32_t paddedCount = PadToGroup(objectCount);
+	for (std::vector<float>* values : { &m_CenterX, &m_CenterY, &m_CenterZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ, &m_Radius })
+	{
+		values->reserve(paddedCount);
+	}
+}
+
+void FrustumCuller::Resize(uint32_t objectCount)
+{
+	const uint32_t paddedCount = PadToGroup(objectCount);
+	for (std::vector<float>* values : { &m_CenterX, &m_CenterY, &m_CenterZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ })
+	{
+		values->resize(paddedCount, 0.0f);
+	}
+	m_Radius.resize(paddedCount, CULL_PADDING_RADIUS);
+
+	// New padding slots after shrink or grow
+	for (uint32_t i = objectCount; i < paddedCount; ++i)
+	{
+		m_CenterX[i] = m_CenterY[i] = m_CenterZ[i] = 0.0f;
+		m_ExtentX[i] = m_ExtentY[i] = m_ExtentZ[i] = 0.0f;
+		m_Radius[i] = CULL_PADDING_RADIUS;
+	}
+
+	m_ObjectCount = objectCount;
+}
+
+uint32_t FrustumCuller::AddObject(const Math::Vec4& center, const Math::Vec4& extents, float radius)
+{
+	const uint32_t index = m_ObjectCount;
+	Resize(m_ObjectCount + 1);
+	SetObject(index, center, extents, radius);
+	return index;
+}
+
+uint32_t FrustumCuller::AddSphere(const Math::Vec4& center, float radius)
+{
+	return AddObject(center, Math::Vec4(radius, radius, radius, 0.0f), radius);
+}
+
+uint32_t FrustumCuller::AddAABB(const Math::AABB& box)
+{
+	Math::Vec4 center = (box.min + box.max) * 0.5f;
+	Math::Vec4 extents = (box.max - box.min) * 0.5f;
+	return AddObject(center, extents, Math::Length3(extents));
+}
+
+void FrustumCuller::SetObject(uint32_t index, const Math::Vec4& center, const Math::Vec4& extents, float radius)
+{
+	m_CenterX[index] = center.x;
+	m_CenterY[index] = center.y;
+	m_CenterZ[index] = center.z;
+	m_ExtentX[index] = extents.x;
+	m_ExtentY[index] = extents.y;
+	m_ExtentZ[index] = extents.z;
+	m_Radius[index] = radius;
+}
+
+#if MATH_SIMD_AVX2
+// Lane indices of set bits packed to the front, for every 8 bit visibility mask
+struct CompactTable
+{
+	CompactTable()
+	{
+		for (uint32_t mask = 0; mask < 256; ++mask)
+		{
+			uint32_t count = 0;
+			for (uint32_t lane = 0; lane < CULL_GROUP_SIZE; ++lane)
+			{
+				if (mask & (1u << lane))
+				{
+					Lanes[mask][count++] = lane;
+				}
+			}
+			for (; count < CULL_GROUP_SIZE; ++count)
+			{
+				Lanes[mask][count] = 0;
+			}
+		}
+	}
+
+	alignas(32) uint32_t Lanes[256][CULL_GROUP_SIZE];
+};
+
+static const CompactTable CompactLanes;
+
+static inline uint32_t PopCount8(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	return __popcnt(mask);
+#else
+	return static_cast<uint32_t>(__builtin_popcount(mask));
+#endif
+}
+
+static inline __m256 MulAdd8(__m256 a, __m256 b, __m256 c)
+{
+#if MATH_HAS_FMA
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#elif MATH_SIMD_SSE4
+static inline uint32_t CountTrailingZeros(uint32_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+uint32_t FrustumCuller::CullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* outVisible) const
+{
+	uint32_t visibleCount = 0;
+
+#if MATH_SIMD_AVX2
+	__m256 planeX[Frustum::FP_Count], planeY[Frustum::FP_Count], planeZ[Frustum::FP_Count], planeW[Frustum::FP_Count];
+	__m256 absPlaneX[Frustum::FP_Count], absPlaneY[Frustum::FP_Count], absPlaneZ[Frustum::FP_Count];
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	for (uint32_t p = 0; p < Frustum::FP_Count; ++p)
+	{
+		planeX[p] = _mm256_set1_ps(frustum.Planes[p].x);
+		planeY[p] = _mm256_set1_ps(frustum.Planes[p].y);
+		planeZ[p] = _mm256_set1_ps(frustum.Planes[p].z);
+		planeW[p] = _mm256_set1_ps(frustum.Planes[p].w);
+		absPlaneX[p] = _mm256_andnot_ps(signMask, planeX[p]);
+		absPlaneY[p] = _mm256_andnot_ps(signMask, planeY[p]);
+		absPlaneZ[p] = _mm256_andnot_ps(signMask, planeZ[p]);
+	}
+
+	for (uint32_t i = begin; i < end; i += CULL_GROUP_SIZE)
+	{
+		const __m256 cx = _mm256_loadu_ps(&m_CenterX[i]);
+		const __m256 cy = _mm256_loadu_ps(&m_CenterY[i]);
+		const __m256 cz = _mm256_loadu_ps(&m_CenterZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&m_ExtentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&m_ExtentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&m_ExtentZ[i]);
+		const __m256 radius = _mm256_loadu_ps(&m_Radius[i]);
+
+		__m256 outside = _mm256_setzero_ps();
+		for (uint32_t p = 0; p < Frustum::FP_Count; ++p)
+		{
+			// Signed distance of center, box projected radius |n|.e, tighter of box and sphere wins
+			__m256 distance = MulAdd8(planeX[p], cx, MulAdd8(planeY[p], cy, MulAdd8(planeZ[p], cz, planeW[p])));
+			__m256 boxRadius = MulAdd8(absPlaneX[p], ex, MulAdd8(absPlaneY[p], ey, _mm256_mul_ps(absPlaneZ[p], ez)));
+			__m256 reach = _mm256_add_ps(distance, _mm256_min_ps(radius, boxRadius));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(reach, _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+
+		// Shuffle indices of visible lanes to front, store all 8 and advance by visible count
+		const uint32_t visibleMask = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xFF;
+		__m256i lanes = _mm256_load_si256(reinterpret_cast<const __m256i*>(CompactLanes.Lanes[visibleMask]));
+		__m256i indices = _mm256_add_epi32(lanes, _mm256_set1_epi32(static_cast<int>(i)));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(outVisible + visibleCount), indices);
+		visibleCount += PopCount8(visibleMask);
+	}
+#elif MATH_SIMD_SSE4
+	for (uint32_t i = begin; i < end; i += 4)
+	{
+		const __m128 cx = _mm_loadu_ps(&m_CenterX[i]);
+		const __m128 cy = _mm_loadu_ps(&m_CenterY[i]);
+		const __m128 cz = _mm_loadu_ps(&m_CenterZ[i]);
+		const __m128 ex = _mm_loadu_ps(&m_ExtentX[i]);
+		const __m128 ey = _mm_loadu_ps(&m_ExtentY[i]);
+		const __m128 ez = _mm_loadu_ps(&m_ExtentZ[i]);
+		const __m128 radius = _mm_loadu_ps(&m_Radius[i]);
+
+		__m128 outside = _mm_setzero_ps();
+		for (uint32_t p = 0; p < Frustum::FP_Count; ++p)
+		{
+			const Math::Vec4& plane = frustum.Planes[p];
+			__m128 distance = Math::MulAdd(_mm_set1_ps(plane.x), cx, Math::MulAdd(_mm_set1_ps(plane.y), cy, Math::MulAdd(_mm_set1_ps(plane.z), cz, _mm_set1_ps(plane.w))));
+			__m128 boxRadius = Math::MulAdd(_mm_set1_ps(fabsf(plane.x)), ex, Math::MulAdd(_mm_set1_ps(fabsf(plane.y)), ey, _mm_mul_ps(_mm_set1_ps(fabsf(plane.z)), ez)));
+			__m128 reach = _mm_add_ps(distance, _mm_min_ps(radius, boxRadius));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, _mm_setzero_ps()));
+		}
+
+		for (uint32_t visibleMask = ~static_cast<uint32_t>(_mm_movemask_ps(outside)) & 0xF; visibleMask; visibleMask &= visibleMask - 1)
+		{
+			outVisible[visibleCount++] = i + CountTrailingZeros(visibleMask);
+		}
+	}
+#else
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		bool bVisible = true;
+		for (uint32_t p = 0; p < Frustum::FP_Count && bVisible; ++p)
+		{
+			const Math::Vec4& plane = frustum.Planes[p];
+			float distance = plane.x * m_CenterX[i] + plane.y * m_CenterY[i] + plane.z * m_CenterZ[i] + plane.w;
+			float boxRadius = fabsf(plane.x) * m_ExtentX[i] + fabsf(plane.y) * m_ExtentY[i] + fabsf(plane.z) * m_ExtentZ[i];
+			bVisible = distance + (m_Radius[i] < boxRadius ? m_Radius[i] : boxRadius) >= 0.0f;
+		}
+
+		if (bVisible)
+		{
+			outVisible[visibleCount++] = i;
+		}
+	}
+#endif
+
+	return visibleCount;
+}
+
+uint32_t FrustumCuller::Cull(const Frustum& frustum, std::vector<uint32_t>& outVisible) const
+{
+	// Room for a full group store at the end
+	const uint32_t paddedCount = static_cast<uint32_t>(m_Radius.size());
+	outVisible.resize(paddedCount);
+
+	uint32_t visibleCount = paddedCount ? CullRange(frustum, 0, paddedCount, outVisible.data()) : 0;
+	outVisible.resize(visibleCount);
+
+	return visibleCount;
+}
+
+uint32_t FrustumCuller::CullParallel(const Frustum& frustum, std::vector<uint32_t>& outVisible, uint32_t minBatchSize)
+{
+	const uint32_t paddedCount = static_cast<uint32_t>(m_Radius.size());
+	const uint32_t groupCount = paddedCount / CULL_GROUP_SIZE;
+
+	outVisible.resize(paddedCount);
+	m_RangeVisibleCounts.resize(groupCount);
+	m_RangeEnds.resize(groupCount);
+
+	// Every range compacts into its own slice of output first...
+	uint32_t* visible = outVisible.data();
+	Gear::TaskSystem::Get().ParallelFor(groupCount, PadToGroup(minBatchSize) / CULL_GROUP_SIZE, [&](uint32_t beginGroup, uint32_t endGroup)
+	{
+		const uint32_t begin = beginGroup * CULL_GROUP_SIZE;
+		m_RangeVisibleCounts[beginGroup] = CullRange(frustum, begin, endGroup * CULL_GROUP_SIZE, visible + begin);
+		m_RangeEnds[beginGroup] = endGroup;
+	});
+
+	// ...then slices are moved together, destination never passes source
+	uint32_t visibleCount = 0;
+	for (uint32_t group = 0; group < groupCount; group = m_RangeEnds[group])
+	{
+		const uint32_t rangeCount = m_RangeVisibleCounts[group];
+		const uint32_t rangeBegin = group * CULL_GROUP_SIZE;
+		if (rangeBegin != visibleCount)
+		{
+			memmove(visible + visibleCount, visible + rangeBegin, rangeCount * sizeof(uint32_t));
+		}
+		visibleCount += rangeCount;
+	}
+	outVisible.resize(visibleCount);
+
+	return visibleCount;
+}
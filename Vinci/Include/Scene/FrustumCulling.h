@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Math/Math.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// View frustum as 6 normalized planes (xyz normal pointing inside, w distance)
+struct Frustum
+{
+	enum PlaneIndex
+	{
+		FP_Left,
+		FP_Right,
+		FP_Bottom,
+		FP_Top,
+		FP_Near,
+		FP_Far,
+		FP_Count
+	};
+
+	Math::Vec4 Planes[FP_Count];
+
+	// Planes of clip space volume of a vulkan projection (depth 0..1),
+	// pass projection * view (* model) to get planes in that space
+	static Frustum FromMatrix(const Math::Mat4& viewProjection);
+};
+
+// Bounding volumes of cullable objects in SoA layout, 8 objects per AVX2 iteration.
+// Every object has a box (center/ extents) and a sphere (center/ radius) sharing the center,
+// an object is culled if either of them is outside of a plane.
+// Visible lists are compact and sorted by object index.
+class FrustumCuller
+{
+public:
+	void Clear();
+	void Reserve(uint32_t objectCount);
+
+	uint32_t AddObject(const Math::Vec4& center, const Math::Vec4& extents, float radius);
+	uint32_t AddSphere(const Math::Vec4& center, float radius);
+	uint32_t AddAABB(const Math::AABB& box);
+
+	void SetObject(uint32_t index, const Math::Vec4& center, const Math::Vec4& extents, float radius);
+
+	uint32_t GetObjectCount() const { return m_ObjectCount; }
+
+	// Single threaded, returns visible count
+	uint32_t Cull(const Frustum& frustum, std::vector<uint32_t>& outVisible) const;
+
+	// Split over Gear::TaskSystem, worth it from some ten thousands objects on
+	uint32_t CullParallel(const Frustum& frustum, std::vector<uint32_t>& outVisible, uint32_t minBatchSize = 4096);
+
+private:
+	uint32_t CullRange(const Frustum& frustum, uint32_t begin, uint32_t end, uint32_t* outVisible) const;
+
+	void Resize(uint32_t objectCount);
+
+private:
+	// Padded to multiple of 8 with objects which never pass, so SIMD loop needs no tail
+	std::vector<float> m_CenterX;
+	std::vector<float> m_CenterY;
+	std::vector<float> m_CenterZ;
+	std::vector<float> m_ExtentX;
+	std::vector<float> m_ExtentY;
+	std::vector<float> m_ExtentZ;
+	std::vector<float> m_Radius;
+
+	uint32_t m_ObjectCount{ 0 };
+
+	// Per parallel range, indexed by first group of range
+	std::vector<uint32_t> m_RangeVisibleCounts;
+	std::vector<uint32_t> m_RangeEnds;
+};
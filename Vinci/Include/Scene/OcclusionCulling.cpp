@@ -0,0 +1,737 @@
+#include "OcclusionCulling.h"
+
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <stdexcept>
+
+// Vertices transformed per SIMD iteration
+static const uint32_t OCCLUSION_GROUP_SIZE = 8;
+
+// Screen tiles are rasterized by one task each, blocks keep the farthest depth of their pixels.
+// Both are multiples of 8 pixels, so SIMD spans never cross a tile.
+static const uint32_t OCCLUSION_TILE_SIZE = 32;
+static const uint32_t OCCLUSION_BLOCK_SIZE = 8;
+
+// Clip space planes, inside is dot >= 0. No far plane, depth beyond 1 never passes the cleared buffer.
+// Side planes are twice the screen away, so the guard ring around the screen (see ToPixel()) is drawn too.
+static const Math::Vec4 CLIP_PLANES[] =
+{
+	Math::Vec4(0.0f, 0.0f, 1.0f, 0.0f),		// near, vulkan depth 0..1
+	Math::Vec4(1.0f, 0.0f, 0.0f, 2.0f),		// left
+	Math::Vec4(-1.0f, 0.0f, 0.0f, 2.0f),	// right
+	Math::Vec4(0.0f, 1.0f, 0.0f, 2.0f),		// bottom
+	Math::Vec4(0.0f, -1.0f, 0.0f, 2.0f),	// top
+};
+static const uint32_t CLIP_PLANE_COUNT = sizeof(CLIP_PLANES) / sizeof(CLIP_PLANES[0]);
+
+// Every plane adds at most one vertex to a clipped triangle
+static const uint32_t CLIP_MAX_VERTICES = 3 + CLIP_PLANE_COUNT;
+
+static uint32_t PadToGroup(uint32_t count)
+{
+	return (count + OCCLUSION_GROUP_SIZE - 1) & ~(OCCLUSION_GROUP_SIZE - 1);
+}
+
+static uint32_t RoundUpToTile(uint32_t size)
+{
+	return (size + OCCLUSION_TILE_SIZE - 1) / OCCLUSION_TILE_SIZE * OCCLUSION_TILE_SIZE;
+}
+
+// Screen (ndc -1..1) maps to pixels 1..size-1, the outer ring of pixels is off screen. Tests look at one
+// pixel around objects, so a pixel on the screen border has its outside neighbour rasterized as well.
+static float ToPixel(float ndc, uint32_t size)
+{
+	return ndc * 0.5f * (size - 2) + 0.5f * size;
+}
+
+static uint32_t GetClipCode(const Math::Vec4& vertex)
+{
+	uint32_t code = 0;
+	for (uint32_t p = 0; p < CLIP_PLANE_COUNT; ++p)
+	{
+		code |= Math::Dot(CLIP_PLANES[p], vertex) < 0.0f ? 1u << p : 0u;
+	}
+	return code;
+}
+
+// Sutherland-Hodgman against planes of clipCode, polygon needs room for CLIP_MAX_VERTICES, returns new vertex count
+static uint32_t ClipPolygon(Math::Vec4* polygon, uint32_t vertexCount, uint32_t clipCode)
+{
+	Math::Vec4 clipped[CLIP_MAX_VERTICES];
+	for (uint32_t p = 0; p < CLIP_PLANE_COUNT && vertexCount >= 3; ++p)
+	{
+		if ((clipCode & (1u << p)) == 0)
+		{
+			continue;
+		}
+
+		uint32_t clippedCount = 0;
+		for (uint32_t i = 0; i < vertexCount; ++i)
+		{
+			const Math::Vec4& a = polygon[i];
+			const Math::Vec4& b = polygon[(i + 1) % vertexCount];
+			const float distanceA = Math::Dot(CLIP_PLANES[p], a);
+			const float distanceB = Math::Dot(CLIP_PLANES[p], b);
+
+			if (distanceA >= 0.0f)
+			{
+				clipped[clippedCount++] = a;
+			}
+			if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+			{
+				clipped[clippedCount++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+			}
+		}
+
+		memcpy(polygon, clipped, clippedCount * sizeof(Math::Vec4));
+		vertexCount = clippedCount;
+	}
+
+	return vertexCount >= 3 ? vertexCount : 0;
+}
+
+#if MATH_SIMD_AVX2
+static inline __m256 MulAdd8(__m256 a, __m256 b, __m256 c)
+{
+#if MATH_HAS_FMA
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+static inline float HorizontalMin8(__m256 v)
+{
+	__m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+	return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+
+static inline float HorizontalMax8(__m256 v)
+{
+	__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+#elif MATH_SIMD_SSE4
+static inline float HorizontalMin4(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+	return _mm_cvtss_f32(_mm_min_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+
+static inline float HorizontalMax4(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	return _mm_cvtss_f32(_mm_max_ss(v, _mm_shuffle_ps(v, v, 1)));
+}
+#endif
+
+void OcclusionCuller::Initialize(uint32_t width, uint32_t height)
+{
+	m_Width = RoundUpToTile(std::max(width, 1u));
+	m_Height = RoundUpToTile(std::max(height, 1u));
+	m_TilesX = m_Width / OCCLUSION_TILE_SIZE;
+	m_TilesY = m_Height / OCCLUSION_TILE_SIZE;
+
+	m_Depth.assign(m_Width * m_Height, 1.0f);
+	m_BlockDepth.assign((m_Width / OCCLUSION_BLOCK_SIZE) * (m_Height / OCCLUSION_BLOCK_SIZE), 1.0f);
+	m_Bins.clear();
+	m_ChunkCount = 0;
+	m_Rendered = false;
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	m_VertexX.clear();
+	m_VertexY.clear();
+	m_VertexZ.clear();
+	m_Indices.clear();
+	m_VertexCount = 0;
+	m_TriangleCount = 0;
+}
+
+void OcclusionCuller::ReserveOccluders(uint32_t vertexCount, uint32_t triangleCount)
+{
+	const uint32_t paddedCount = PadToGroup(vertexCount);
+	for (std::vector<float>* values : { &m_VertexX, &m_VertexY, &m_VertexZ })
+	{
+		values->reserve(paddedCount);
+	}
+	m_Indices.reserve(triangleCount * 3);
+}
+
+uint32_t OcclusionCuller::AddOccluder(const Math::Mat4& transform, const float* positions, uint32_t vertexCount, uint32_t vertexStride, const uint32_t* indices, uint32_t indexCount)
+{
+	const uint32_t firstVertex = m_VertexCount;
+	m_VertexCount += vertexCount;
+
+	const uint32_t paddedCount = PadToGroup(m_VertexCount);
+	for (std::vector<float>* values : { &m_VertexX, &m_VertexY, &m_VertexZ })
+	{
+		values->resize(paddedCount, 0.0f);
+	}
+
+	const uint8_t* position = reinterpret_cast<const uint8_t*>(positions);
+	for (uint32_t i = 0; i < vertexCount; ++i, position += vertexStride)
+	{
+		const float* xyz = reinterpret_cast<const float*>(position);
+		const Math::Vec4 world = Math::TransformPoint(transform, Math::Vec4(xyz[0], xyz[1], xyz[2], 1.0f));
+		m_VertexX[firstVertex + i] = world.x;
+		m_VertexY[firstVertex + i] = world.y;
+		m_VertexZ[firstVertex + i] = world.z;
+	}
+
+	if (indices != nullptr)
+	{
+		AddOccluderTriangles(firstVertex, indices, indexCount);
+	}
+	return firstVertex;
+}
+
+void OcclusionCuller::ClearOccluderTriangles()
+{
+	m_Indices.clear();
+	m_TriangleCount = 0;
+}
+
+void OcclusionCuller::AddOccluderTriangles(uint32_t firstVertex, const uint32_t* indices, uint32_t indexCount)
+{
+	const uint32_t triangleIndexCount = indexCount / 3 * 3;
+	for (uint32_t i = 0; i < triangleIndexCount; ++i)
+	{
+		m_Indices.push_back(firstVertex + indices[i]);
+	}
+	m_TriangleCount += triangleIndexCount / 3;
+}
+
+void OcclusionCuller::TransformVertices(const Math::Mat4& viewProjection, uint32_t begin, uint32_t end)
+{
+	const Math::Mat4& m = viewProjection;
+
+#if MATH_SIMD_AVX2
+	__m256 column[4][4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		for (uint32_t r = 0; r < 4; ++r)
+		{
+			column[c][r] = _mm256_set1_ps(m.c[c][r]);
+		}
+	}
+
+	for (uint32_t i = begin; i < end; i += OCCLUSION_GROUP_SIZE)
+	{
+		const __m256 x = _mm256_loadu_ps(&m_VertexX[i]);
+		const __m256 y = _mm256_loadu_ps(&m_VertexY[i]);
+		const __m256 z = _mm256_loadu_ps(&m_VertexZ[i]);
+		float* outputs[4] = { &m_ClipX[i], &m_ClipY[i], &m_ClipZ[i], &m_ClipW[i] };
+		for (uint32_t r = 0; r < 4; ++r)
+		{
+			_mm256_storeu_ps(outputs[r], MulAdd8(column[0][r], x, MulAdd8(column[1][r], y, MulAdd8(column[2][r], z, column[3][r]))));
+		}
+	}
+#elif MATH_SIMD_SSE4
+	for (uint32_t i = begin; i < end; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&m_VertexX[i]);
+		const __m128 y = _mm_loadu_ps(&m_VertexY[i]);
+		const __m128 z = _mm_loadu_ps(&m_VertexZ[i]);
+		float* outputs[4] = { &m_ClipX[i], &m_ClipY[i], &m_ClipZ[i], &m_ClipW[i] };
+		for (uint32_t r = 0; r < 4; ++r)
+		{
+			_mm_storeu_ps(outputs[r], Math::MulAdd(_mm_set1_ps(m.c[0][r]), x, Math::MulAdd(_mm_set1_ps(m.c[1][r]), y, Math::MulAdd(_mm_set1_ps(m.c[2][r]), z, _mm_set1_ps(m.c[3][r])))));
+		}
+	}
+#else
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const Math::Vec4 clip = m * Math::Vec4(m_VertexX[i], m_VertexY[i], m_VertexZ[i], 1.0f);
+		m_ClipX[i] = clip.x;
+		m_ClipY[i] = clip.y;
+		m_ClipZ[i] = clip.z;
+		m_ClipW[i] = clip.w;
+	}
+#endif
+}
+
+void OcclusionCuller::AddTriangle(uint32_t chunk, const Math::Vec4* clipVertices)
+{
+	float x[3], y[3], z[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		const float invW = 1.0f / clipVertices[i].w;
+		x[i] = ToPixel(clipVertices[i].x * invW, m_Width);
+		y[i] = ToPixel(clipVertices[i].y * invW, m_Height);
+		z[i] = clipVertices[i].z * invW;
+	}
+
+	// Both windings are occluders, flipped to positive area so covered pixels have positive edges
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (!(fabsf(area) > 0.0f))
+	{
+		return;
+	}
+	if (area < 0.0f)
+	{
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+		area = -area;
+	}
+
+	// Pixel centers inside the bounds, nothing to draw for slivers between centers
+	Triangle triangle;
+	triangle.MinX = std::max(static_cast<int32_t>(ceilf(std::min({ x[0], x[1], x[2] }) - 0.5f)), 0);
+	triangle.MinY = std::max(static_cast<int32_t>(ceilf(std::min({ y[0], y[1], y[2] }) - 0.5f)), 0);
+	triangle.MaxX = std::min(static_cast<int32_t>(floorf(std::max({ x[0], x[1], x[2] }) - 0.5f)), static_cast<int32_t>(m_Width) - 1);
+	triangle.MaxY = std::min(static_cast<int32_t>(floorf(std::max({ y[0], y[1], y[2] }) - 0.5f)), static_cast<int32_t>(m_Height) - 1);
+	if (triangle.MinX > triangle.MaxX || triangle.MinY > triangle.MaxY)
+	{
+		return;
+	}
+
+	// Edge from a to b is (b - a) x (p - a). Every term flips its sign exactly when a and b swap, so triangles
+	// sharing an edge get exactly negated edge functions and pixel centers on it can not fall through the crack.
+	// Products of the constant are exact in double, a contracted FMA would round them asymmetrically.
+	for (uint32_t a = 0; a < 3; ++a)
+	{
+		const uint32_t b = (a + 1) % 3;
+		triangle.EdgeA[a] = y[a] - y[b];
+		triangle.EdgeB[a] = x[b] - x[a];
+		triangle.EdgeC[a] = static_cast<float>(static_cast<double>(x[a]) * y[b] - static_cast<double>(y[a]) * x[b]);
+	}
+
+	// Interpolation is clamped to the nearest vertex, so thin triangles never extrapolate in front of themselves
+	const float invArea = 1.0f / area;
+	triangle.DepthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+	triangle.DepthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) * invArea;
+	triangle.DepthC = z[0] - triangle.DepthA * x[0] - triangle.DepthB * y[0];
+
+	// Pixels keep the farthest depth the plane has over their whole square, not the one at their center
+	triangle.DepthC += 0.5f * (fabsf(triangle.DepthA) + fabsf(triangle.DepthB));
+	triangle.MinDepth = std::min({ z[0], z[1], z[2] });
+
+	std::vector<Triangle>& triangles = m_ChunkTriangles[chunk];
+	const uint32_t triangleIdx = static_cast<uint32_t>(triangles.size());
+	triangles.push_back(triangle);
+
+	const uint32_t tileCount = m_TilesX * m_TilesY;
+	for (uint32_t tileY = triangle.MinY / OCCLUSION_TILE_SIZE; tileY <= triangle.MaxY / OCCLUSION_TILE_SIZE; ++tileY)
+	{
+		for (uint32_t tileX = triangle.MinX / OCCLUSION_TILE_SIZE; tileX <= triangle.MaxX / OCCLUSION_TILE_SIZE; ++tileX)
+		{
+			m_Bins[chunk * tileCount + tileY * m_TilesX + tileX].push_back(triangleIdx);
+		}
+	}
+}
+
+void OcclusionCuller::SetupTriangles(uint32_t chunk, uint32_t begin, uint32_t end)
+{
+	const uint32_t tileCount = m_TilesX * m_TilesY;
+	m_ChunkTriangles[chunk].clear();
+	for (uint32_t tile = 0; tile < tileCount; ++tile)
+	{
+		m_Bins[chunk * tileCount + tile].clear();
+	}
+
+	Math::Vec4 polygon[CLIP_MAX_VERTICES];
+	for (uint32_t triangleIdx = begin; triangleIdx < end; ++triangleIdx)
+	{
+		uint32_t clipCodeAnd = ~0u;
+		uint32_t clipCodeOr = 0;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const uint32_t vertex = m_Indices[triangleIdx * 3 + i];
+			polygon[i] = Math::Vec4(m_ClipX[vertex], m_ClipY[vertex], m_ClipZ[vertex], m_ClipW[vertex]);
+
+			const uint32_t clipCode = GetClipCode(polygon[i]);
+			clipCodeAnd &= clipCode;
+			clipCodeOr |= clipCode;
+		}
+
+		// Outside of one plane, inside of all or clipped to a fan
+		if (clipCodeAnd != 0)
+		{
+			continue;
+		}
+
+		const uint32_t vertexCount = clipCodeOr == 0 ? 3 : ClipPolygon(polygon, 3, clipCodeOr);
+		for (uint32_t i = 1; i + 1 < vertexCount; ++i)
+		{
+			const Math::Vec4 fan[3] = { polygon[0], polygon[i], polygon[i + 1] };
+			AddTriangle(chunk, fan);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeTile(uint32_t tile)
+{
+	const int32_t tileMinX = static_cast<int32_t>((tile % m_TilesX) * OCCLUSION_TILE_SIZE);
+	const int32_t tileMinY = static_cast<int32_t>((tile / m_TilesX) * OCCLUSION_TILE_SIZE);
+	const int32_t tileMaxX = tileMinX + OCCLUSION_TILE_SIZE - 1;
+	const int32_t tileMaxY = tileMinY + OCCLUSION_TILE_SIZE - 1;
+
+	for (int32_t y = tileMinY; y <= tileMaxY; ++y)
+	{
+		std::fill_n(&m_Depth[y * m_Width + tileMinX], OCCLUSION_TILE_SIZE, 1.0f);
+	}
+
+	// Chunks in order, nearest depth wins whatever the order is though
+	const uint32_t tileCount = m_TilesX * m_TilesY;
+	for (uint32_t chunk = 0; chunk < m_ChunkCount; ++chunk)
+	{
+		const std::vector<Triangle>& triangles = m_ChunkTriangles[chunk];
+		for (uint32_t triangleIdx : m_Bins[chunk * tileCount + tile])
+		{
+			const Triangle& triangle = triangles[triangleIdx];
+			const int32_t minX = std::max(triangle.MinX, tileMinX);
+			const int32_t maxX = std::min(triangle.MaxX, tileMaxX);
+			const int32_t minY = std::max(triangle.MinY, tileMinY);
+			const int32_t maxY = std::min(triangle.MaxY, tileMaxY);
+
+#if MATH_SIMD_AVX2
+			// Spans start at multiples of 8, lanes outside of the triangle fail its edges
+			const __m256 laneX = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+			const __m256 edgeA0 = _mm256_set1_ps(triangle.EdgeA[0]);
+			const __m256 edgeA1 = _mm256_set1_ps(triangle.EdgeA[1]);
+			const __m256 edgeA2 = _mm256_set1_ps(triangle.EdgeA[2]);
+			const __m256 depthA = _mm256_set1_ps(triangle.DepthA);
+			const __m256 minDepth = _mm256_set1_ps(triangle.MinDepth);
+			const int32_t spanMinX = minX & ~static_cast<int32_t>(7);
+
+			for (int32_t y = minY; y <= maxY; ++y)
+			{
+				const float rowY = y + 0.5f;
+				const __m256 edgeRow0 = _mm256_set1_ps(triangle.EdgeB[0] * rowY + triangle.EdgeC[0]);
+				const __m256 edgeRow1 = _mm256_set1_ps(triangle.EdgeB[1] * rowY + triangle.EdgeC[1]);
+				const __m256 edgeRow2 = _mm256_set1_ps(triangle.EdgeB[2] * rowY + triangle.EdgeC[2]);
+				const __m256 depthRow = _mm256_set1_ps(triangle.DepthB * rowY + triangle.DepthC);
+				float* row = &m_Depth[y * m_Width];
+
+				for (int32_t x = spanMinX; x <= maxX; x += 8)
+				{
+					const __m256 pixelX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneX);
+					const __m256 edge0 = MulAdd8(edgeA0, pixelX, edgeRow0);
+					const __m256 edge1 = MulAdd8(edgeA1, pixelX, edgeRow1);
+					const __m256 edge2 = MulAdd8(edgeA2, pixelX, edgeRow2);
+					const __m256 covered = _mm256_cmp_ps(_mm256_min_ps(edge0, _mm256_min_ps(edge1, edge2)), _mm256_setzero_ps(), _CMP_GE_OQ);
+
+					const __m256 depth = _mm256_max_ps(MulAdd8(depthA, pixelX, depthRow), minDepth);
+					const __m256 previous = _mm256_loadu_ps(row + x);
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(previous, _mm256_min_ps(previous, depth), covered));
+				}
+			}
+#elif MATH_SIMD_SSE4
+			const __m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 edgeA0 = _mm_set1_ps(triangle.EdgeA[0]);
+			const __m128 edgeA1 = _mm_set1_ps(triangle.EdgeA[1]);
+			const __m128 edgeA2 = _mm_set1_ps(triangle.EdgeA[2]);
+			const __m128 depthA = _mm_set1_ps(triangle.DepthA);
+			const __m128 minDepth = _mm_set1_ps(triangle.MinDepth);
+			const int32_t spanMinX = minX & ~static_cast<int32_t>(3);
+
+			for (int32_t y = minY; y <= maxY; ++y)
+			{
+				const float rowY = y + 0.5f;
+				const __m128 edgeRow0 = _mm_set1_ps(triangle.EdgeB[0] * rowY + triangle.EdgeC[0]);
+				const __m128 edgeRow1 = _mm_set1_ps(triangle.EdgeB[1] * rowY + triangle.EdgeC[1]);
+				const __m128 edgeRow2 = _mm_set1_ps(triangle.EdgeB[2] * rowY + triangle.EdgeC[2]);
+				const __m128 depthRow = _mm_set1_ps(triangle.DepthB * rowY + triangle.DepthC);
+				float* row = &m_Depth[y * m_Width];
+
+				for (int32_t x = spanMinX; x <= maxX; x += 4)
+				{
+					const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneX);
+					const __m128 edge0 = Math::MulAdd(edgeA0, pixelX, edgeRow0);
+					const __m128 edge1 = Math::MulAdd(edgeA1, pixelX, edgeRow1);
+					const __m128 edge2 = Math::MulAdd(edgeA2, pixelX, edgeRow2);
+					const __m128 covered = _mm_cmpge_ps(_mm_min_ps(edge0, _mm_min_ps(edge1, edge2)), _mm_setzero_ps());
+
+					const __m128 depth = _mm_max_ps(Math::MulAdd(depthA, pixelX, depthRow), minDepth);
+					const __m128 previous = _mm_loadu_ps(row + x);
+					_mm_storeu_ps(row + x, _mm_blendv_ps(previous, _mm_min_ps(previous, depth), covered));
+				}
+			}
+#else
+			for (int32_t y = minY; y <= maxY; ++y)
+			{
+				const float rowY = y + 0.5f;
+				float* row = &m_Depth[y * m_Width];
+
+				for (int32_t x = minX; x <= maxX; ++x)
+				{
+					const float pixelX = x + 0.5f;
+					bool bCovered = true;
+					for (uint32_t edge = 0; edge < 3; ++edge)
+					{
+						bCovered = bCovered && triangle.EdgeA[edge] * pixelX + triangle.EdgeB[edge] * rowY + triangle.EdgeC[edge] >= 0.0f;
+					}
+
+					if (bCovered)
+					{
+						const float depth = std::max(triangle.DepthA * pixelX + triangle.DepthB * rowY + triangle.DepthC, triangle.MinDepth);
+						row[x] = std::min(row[x], depth);
+					}
+				}
+			}
+#endif
+		}
+	}
+
+	// Farthest depth of every block in the tile
+	const uint32_t blocksX = m_Width / OCCLUSION_BLOCK_SIZE;
+	for (int32_t blockY = tileMinY; blockY <= tileMaxY; blockY += OCCLUSION_BLOCK_SIZE)
+	{
+		for (int32_t blockX = tileMinX; blockX <= tileMaxX; blockX += OCCLUSION_BLOCK_SIZE)
+		{
+			const float* block = &m_Depth[blockY * m_Width + blockX];
+
+#if MATH_SIMD_AVX2
+			__m256 farthest = _mm256_loadu_ps(block);
+			for (uint32_t y = 1; y < OCCLUSION_BLOCK_SIZE; ++y)
+			{
+				farthest = _mm256_max_ps(farthest, _mm256_loadu_ps(block + y * m_Width));
+			}
+			const float blockDepth = HorizontalMax8(farthest);
+#elif MATH_SIMD_SSE4
+			__m128 farthest = _mm_max_ps(_mm_loadu_ps(block), _mm_loadu_ps(block + 4));
+			for (uint32_t y = 1; y < OCCLUSION_BLOCK_SIZE; ++y)
+			{
+				farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(block + y * m_Width), _mm_loadu_ps(block + y * m_Width + 4)));
+			}
+			const float blockDepth = HorizontalMax4(farthest);
+#else
+			float blockDepth = 0.0f;
+			for (uint32_t y = 0; y < OCCLUSION_BLOCK_SIZE; ++y)
+			{
+				for (uint32_t x = 0; x < OCCLUSION_BLOCK_SIZE; ++x)
+				{
+					blockDepth = std::max(blockDepth, block[y * m_Width + x]);
+				}
+			}
+#endif
+
+			m_BlockDepth[(blockY / OCCLUSION_BLOCK_SIZE) * blocksX + blockX / OCCLUSION_BLOCK_SIZE] = blockDepth;
+		}
+	}
+}
+
+void OcclusionCuller::Render(const Math::Mat4& viewProjection, uint32_t minBatchSize)
+{
+	if (m_Width == 0)
+	{
+		throw std::runtime_error("Occlusion culler is not initialized.");
+	}
+
+	Gear::TaskSystem& taskSystem = Gear::TaskSystem::Get();
+	minBatchSize = std::max(minBatchSize, 1u);
+
+	const uint32_t paddedCount = static_cast<uint32_t>(m_VertexX.size());
+	for (std::vector<float>* values : { &m_ClipX, &m_ClipY, &m_ClipZ, &m_ClipW })
+	{
+		values->resize(paddedCount);
+	}
+
+	taskSystem.ParallelFor(paddedCount / OCCLUSION_GROUP_SIZE, PadToGroup(minBatchSize) / OCCLUSION_GROUP_SIZE, [&](uint32_t beginGroup, uint32_t endGroup)
+	{
+		TransformVertices(viewProjection, beginGroup * OCCLUSION_GROUP_SIZE, endGroup * OCCLUSION_GROUP_SIZE);
+	});
+
+	// Fixed chunks instead of ParallelFor batches, so bins of a chunk are the same whichever thread fills them
+	const uint32_t tileCount = m_TilesX * m_TilesY;
+	m_ChunkCount = std::max(std::min(taskSystem.GetConcurrency(), (m_TriangleCount + minBatchSize - 1) / minBatchSize), 1u);
+	m_ChunkTriangles.resize(std::max<size_t>(m_ChunkTriangles.size(), m_ChunkCount));
+	m_Bins.resize(std::max<size_t>(m_Bins.size(), m_ChunkCount * tileCount));
+
+	const uint32_t chunkTriangleCount = (m_TriangleCount + m_ChunkCount - 1) / m_ChunkCount;
+	taskSystem.ParallelFor(m_ChunkCount, 1, [&](uint32_t beginChunk, uint32_t endChunk)
+	{
+		for (uint32_t chunk = beginChunk; chunk < endChunk; ++chunk)
+		{
+			const uint32_t begin = std::min(chunk * chunkTriangleCount, m_TriangleCount);
+			SetupTriangles(chunk, begin, std::min(begin + chunkTriangleCount, m_TriangleCount));
+		}
+	});
+
+	taskSystem.ParallelFor(tileCount, 1, [&](uint32_t beginTile, uint32_t endTile)
+	{
+		for (uint32_t tile = beginTile; tile < endTile; ++tile)
+		{
+			RasterizeTile(tile);
+		}
+	});
+
+	m_ViewProjection = viewProjection;
+	m_Rendered = true;
+}
+
+bool OcclusionCuller::TestRect(float minX, float maxX, float minY, float maxY, float minDepth) const
+{
+	// Pixels the rect touches and one more around them, clamped to the screen. A pixel partly covered by an
+	// occluder has its center sampled, so an edge crossing it leaves the pixel next to it uncovered and the
+	// object visible. Rects fully off screen are left to frustum culling.
+	const float pixelMinX = std::max(ToPixel(minX, m_Width) - 1.0f, 0.0f);
+	const float pixelMaxX = std::min(ToPixel(maxX, m_Width) + 1.0f, m_Width - 1.0f);
+	const float pixelMinY = std::max(ToPixel(minY, m_Height) - 1.0f, 0.0f);
+	const float pixelMaxY = std::min(ToPixel(maxY, m_Height) + 1.0f, m_Height - 1.0f);
+	if (!(pixelMinX <= pixelMaxX && pixelMinY <= pixelMaxY))
+	{
+		return true;
+	}
+
+	const uint32_t blocksX = m_Width / OCCLUSION_BLOCK_SIZE;
+	const uint32_t blockMinX = static_cast<uint32_t>(pixelMinX) / OCCLUSION_BLOCK_SIZE;
+	const uint32_t blockMaxX = static_cast<uint32_t>(pixelMaxX) / OCCLUSION_BLOCK_SIZE;
+	const uint32_t blockMinY = static_cast<uint32_t>(pixelMinY) / OCCLUSION_BLOCK_SIZE;
+	const uint32_t blockMaxY = static_cast<uint32_t>(pixelMaxY) / OCCLUSION_BLOCK_SIZE;
+
+	for (uint32_t blockY = blockMinY; blockY <= blockMaxY; ++blockY)
+	{
+		for (uint32_t blockX = blockMinX; blockX <= blockMaxX; ++blockX)
+		{
+			if (m_BlockDepth[blockY * blocksX + blockX] >= minDepth)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool OcclusionCuller::TestAABB(const Math::AABB& box) const
+{
+	if (!m_Rendered)
+	{
+		return true;
+	}
+
+	const Math::Mat4& m = m_ViewProjection;
+	float minX, maxX, minY, maxY, minDepth;
+
+#if MATH_SIMD_AVX2
+	// All 8 corners at once, corner i takes max of axis k if bit k of i is set
+	const __m256 x = _mm256_blend_ps(_mm256_set1_ps(box.min.x), _mm256_set1_ps(box.max.x), 0xAA);
+	const __m256 y = _mm256_blend_ps(_mm256_set1_ps(box.min.y), _mm256_set1_ps(box.max.y), 0xCC);
+	const __m256 z = _mm256_blend_ps(_mm256_set1_ps(box.min.z), _mm256_set1_ps(box.max.z), 0xF0);
+
+	__m256 clip[4];
+	for (uint32_t r = 0; r < 4; ++r)
+	{
+		clip[r] = MulAdd8(_mm256_set1_ps(m.c[0][r]), x, MulAdd8(_mm256_set1_ps(m.c[1][r]), y, MulAdd8(_mm256_set1_ps(m.c[2][r]), z, _mm256_set1_ps(m.c[3][r]))));
+	}
+
+	// A corner before the near plane, box may cover any part of the screen
+	if (_mm256_movemask_ps(_mm256_cmp_ps(clip[2], _mm256_setzero_ps(), _CMP_LT_OQ)) != 0)
+	{
+		return true;
+	}
+
+	const __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.0f), clip[3]);
+	const __m256 ndcX = _mm256_mul_ps(clip[0], invW);
+	const __m256 ndcY = _mm256_mul_ps(clip[1], invW);
+	minX = HorizontalMin8(ndcX);
+	maxX = HorizontalMax8(ndcX);
+	minY = HorizontalMin8(ndcY);
+	maxY = HorizontalMax8(ndcY);
+	minDepth = HorizontalMin8(_mm256_mul_ps(clip[2], invW));
+#elif MATH_SIMD_SSE4
+	// Corners at min z, then at max z
+	const __m128 x = _mm_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x);
+	const __m128 y = _mm_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y);
+	__m128 minNdcX = _mm_set1_ps(FLT_MAX), maxNdcX = _mm_set1_ps(-FLT_MAX);
+	__m128 minNdcY = _mm_set1_ps(FLT_MAX), maxNdcY = _mm_set1_ps(-FLT_MAX);
+	__m128 minNdcZ = _mm_set1_ps(FLT_MAX);
+
+	for (float cornerZ : { box.min.z, box.max.z })
+	{
+		const __m128 z = _mm_set1_ps(cornerZ);
+		__m128 clip[4];
+		for (uint32_t r = 0; r < 4; ++r)
+		{
+			clip[r] = Math::MulAdd(_mm_set1_ps(m.c[0][r]), x, Math::MulAdd(_mm_set1_ps(m.c[1][r]), y, Math::MulAdd(_mm_set1_ps(m.c[2][r]), z, _mm_set1_ps(m.c[3][r]))));
+		}
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(clip[2], _mm_setzero_ps())) != 0)
+		{
+			return true;
+		}
+
+		const __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+		const __m128 ndcX = _mm_mul_ps(clip[0], invW);
+		const __m128 ndcY = _mm_mul_ps(clip[1], invW);
+		minNdcX = _mm_min_ps(minNdcX, ndcX);
+		maxNdcX = _mm_max_ps(maxNdcX, ndcX);
+		minNdcY = _mm_min_ps(minNdcY, ndcY);
+		maxNdcY = _mm_max_ps(maxNdcY, ndcY);
+		minNdcZ = _mm_min_ps(minNdcZ, _mm_mul_ps(clip[2], invW));
+	}
+
+	minX = HorizontalMin4(minNdcX);
+	maxX = HorizontalMax4(maxNdcX);
+	minY = HorizontalMin4(minNdcY);
+	maxY = HorizontalMax4(maxNdcY);
+	minDepth = HorizontalMin4(minNdcZ);
+#else
+	minX = minY = minDepth = FLT_MAX;
+	maxX = maxY = -FLT_MAX;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		const Math::Vec4 position((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z, 1.0f);
+		const Math::Vec4 clip = m * position;
+		if (clip.z < 0.0f)
+		{
+			return true;
+		}
+
+		const float invW = 1.0f / clip.w;
+		minX = std::min(minX, clip.x * invW);
+		maxX = std::max(maxX, clip.x * invW);
+		minY = std::min(minY, clip.y * invW);
+		maxY = std::max(maxY, clip.y * invW);
+		minDepth = std::min(minDepth, clip.z * invW);
+	}
+#endif
+
+	return TestRect(minX, maxX, minY, maxY, minDepth);
+}
+
+bool OcclusionCuller::TestSphere(const Math::Vec4& sphere) const
+{
+	const Math::Vec4 radius(sphere.w, sphere.w, sphere.w, 0.0f);
+	const Math::Vec4 center(sphere.x, sphere.y, sphere.z, 0.0f);
+
+	Math::AABB box;
+	box.min = center - radius;
+	box.max = center + radius;
+	return TestAABB(box);
+}
+
+uint32_t OcclusionCuller::CullSpheres(const Math::Vec4* spheres, std::vector<uint32_t>& inOutVisible, uint32_t minBatchSize)
+{
+	const uint32_t count = static_cast<uint32_t>(inOutVisible.size());
+	m_SphereVisible.resize(count);
+
+	Gear::TaskSystem::Get().ParallelFor(count, minBatchSize, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			m_SphereVisible[i] = TestSphere(spheres[inOutVisible[i]]) ? 1 : 0;
+		}
+	});
+
+	uint32_t visibleCount = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (m_SphereVisible[i])
+		{
+			inOutVisible[visibleCount++] = inOutVisible[i];
+		}
+	}
+	inOutVisible.resize(visibleCount);
+
+	return visibleCount;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Math/Math.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Software occlusion culling, occluder meshes are rasterized on CPU into a small depth buffer which object
+// bounds are tested against, so hidden objects are dropped before their draws are issued.
+//  |- occluders are static world space vertices, ClearOccluders() and add them again when they move. Their
+//     triangles can be swapped every frame, e.g. for the LOD drawn, all LODs of a mesh share its vertices
+//  |- Render() transforms 8 vertices per AVX2 iteration, clips triangles to a guard band and bins them into
+//     screen tiles by chunks of triangles, then rasterizes every tile on its own, both split over Gear::TaskSystem
+//  |- depth is vulkan style (0..1, cleared to 1), pixels are sampled at their centers and keep the farthest depth
+//     their nearest occluder has over the pixel, every 8x8 block of pixels keeps its farthest pixel
+//  |- tests are conservative, an object is hidden only if it is behind every block its screen rect grown by one
+//     pixel touches, so parts of it in a pixel an occluder covers partly are never hidden by that occluder.
+//     Only gaps between separate occluders narrower than a pixel count as covered. Objects crossing the
+//     near plane, off screen or tested before the first Render() are visible.
+// Not thread safe, except tests which only read the depth buffer.
+class OcclusionCuller
+{
+public:
+	// Size of the depth buffer in pixels, rounded up to whole tiles
+	void Initialize(uint32_t width, uint32_t height);
+
+	void ClearOccluders();
+	void ReserveOccluders(uint32_t vertexCount, uint32_t triangleCount);
+
+	// Positions are xyz floats vertexStride bytes apart, indices are local to the mesh, 3 per triangle.
+	// Returns first vertex of the occluder, indices can be null to add its triangles later.
+	uint32_t AddOccluder(const Math::Mat4& transform, const float* positions, uint32_t vertexCount, uint32_t vertexStride, const uint32_t* indices, uint32_t indexCount);
+
+	// Drops triangles of all occluders, their vertices stay
+	void ClearOccluderTriangles();
+	void AddOccluderTriangles(uint32_t firstVertex, const uint32_t* indices, uint32_t indexCount);
+
+	uint32_t GetOccluderTriangleCount() const { return m_TriangleCount; }
+
+	// Rasterizes all occluders, pass projection * view (vulkan depth 0..1) of the space of occluders.
+	// minBatchSize is vertices or triangles per task.
+	void Render(const Math::Mat4& viewProjection, uint32_t minBatchSize = 1024);
+
+	// True if the box or sphere (xyz center, w radius) may be visible, in the space of occluders
+	bool TestAABB(const Math::AABB& box) const;
+	bool TestSphere(const Math::Vec4& sphere) const;
+
+	// Drops indices of hidden spheres from inOutVisible, order is kept. Split over Gear::TaskSystem, returns visible count
+	uint32_t CullSpheres(const Math::Vec4* spheres, std::vector<uint32_t>& inOutVisible, uint32_t minBatchSize = 1024);
+
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+
+	// Row major, top row first, e.g. to show it for debugging. Outer ring of pixels is just off screen.
+	const float* GetDepth() const { return m_Depth.data(); }
+
+private:
+	// Edge functions and depth plane in pixels, evaluated at pixel centers (x + 0.5, y + 0.5).
+	// Pixels with all edges >= 0 are covered, bounds are inclusive and clamped to the screen.
+	struct Triangle
+	{
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+		float DepthA;
+		float DepthB;
+		float DepthC;
+		float MinDepth;
+		int32_t MinX;
+		int32_t MinY;
+		int32_t MaxX;
+		int32_t MaxY;
+	};
+
+	void TransformVertices(const Math::Mat4& viewProjection, uint32_t begin, uint32_t end);
+	void SetupTriangles(uint32_t chunk, uint32_t begin, uint32_t end);
+	void AddTriangle(uint32_t chunk, const Math::Vec4* clipVertices);
+	void RasterizeTile(uint32_t tile);
+
+	bool TestRect(float minX, float maxX, float minY, float maxY, float minDepth) const;
+
+private:
+	uint32_t m_Width{ 0 };
+	uint32_t m_Height{ 0 };
+	uint32_t m_TilesX{ 0 };
+	uint32_t m_TilesY{ 0 };
+
+	// World space positions, padded to multiple of 8 so SIMD loop needs no tail
+	std::vector<float> m_VertexX;
+	std::vector<float> m_VertexY;
+	std::vector<float> m_VertexZ;
+	std::vector<uint32_t> m_Indices;
+	uint32_t m_VertexCount{ 0 };
+	uint32_t m_TriangleCount{ 0 };
+
+	// Clip space positions of last Render()
+	std::vector<float> m_ClipX;
+	std::vector<float> m_ClipY;
+	std::vector<float> m_ClipZ;
+	std::vector<float> m_ClipW;
+
+	// Every chunk of occluder triangles sets up its own triangles and bins them per tile,
+	// bins are indexed by chunk * tile count + tile and hold indices into triangles of the chunk
+	std::vector<std::vector<Triangle>> m_ChunkTriangles;
+	std::vector<std::vector<uint32_t>> m_Bins;
+	uint32_t m_ChunkCount{ 0 };
+
+	std::vector<float> m_Depth;
+	std::vector<float> m_BlockDepth;
+	Math::Mat4 m_ViewProjection;
+	bool m_Rendered{ false };
+
+	std::vector<uint8_t> m_SphereVisible;
+};
@@ -0,0 +1,334 @@
+#include "TransformHierarchy.h"
+
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Nodes per parallel batch, composing one matrix is cheap
+static const uint32_t TRANSFORM_BATCH_SIZE = 256;
+
+TransformHierarchy::NodeHandle TransformHierarchy::CreateNode(NodeHandle parent)
+{
+	return CreateNode(parent, Math::Vec4(0.0f, 0.0f, 0.0f, 1.0f), Math::Quat::Identity(), Math::Vec4(1.0f, 1.0f, 1.0f, 0.0f));
+}
+
+TransformHierarchy::NodeHandle TransformHierarchy::CreateNode(NodeHandle parent, const Math::Vec4& translation, const Math::Quat& rotation, const Math::Vec4& scale)
+{
+	uint32_t slot = static_cast<uint32_t>(m_SlotToHandle.size());
+	uint32_t parentSlot = parent == INVALID_INDEX ? INVALID_INDEX : m_HandleToSlot[parent];
+
+	NodeHandle handle;
+	if (m_FreeHandles.empty())
+	{
+		handle = static_cast<NodeHandle>(m_HandleToSlot.size());
+		m_HandleToSlot.push_back(slot);
+	}
+	else
+	{
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+		m_HandleToSlot[handle] = slot;
+	}
+
+	// Appended at the end, put in place by next SortByDepth()
+	m_LocalTranslations.push_back(translation);
+	m_LocalRotations.push_back(rotation);
+	m_LocalScales.push_back(scale);
+	m_WorldMatrices.push_back(Math::Mat4::Identity());
+	m_ParentSlots.push_back(parentSlot);
+	m_FirstChildSlots.push_back(INVALID_INDEX);
+	m_ChildCounts.push_back(0);
+	m_Depths.push_back(parentSlot == INVALID_INDEX ? 0 : m_Depths[parentSlot] + 1);
+	m_Flags.push_back(NF_None);
+	m_SlotToHandle.push_back(handle);
+
+	m_LayoutDirty = true;
+	MarkDirty(slot);
+
+	return handle;
+}
+
+void TransformHierarchy::SetParent(NodeHandle node, NodeHandle parent)
+{
+	uint32_t slot = m_HandleToSlot[node];
+	uint32_t parentSlot = parent == INVALID_INDEX ? INVALID_INDEX : m_HandleToSlot[parent];
+
+	for (uint32_t ancestor = parentSlot; ancestor != INVALID_INDEX; ancestor = m_ParentSlots[ancestor])
+	{
+		if (ancestor == slot)
+		{
+			throw std::invalid_argument("Node can not be parented to its own subtree.");
+		}
+	}
+
+	// Depths and child ranges are rebuilt by next SortByDepth()
+	m_ParentSlots[slot] = parentSlot;
+	m_LayoutDirty = true;
+	MarkDirty(slot);
+}
+
+TransformHierarchy::NodeHandle TransformHierarchy::GetParent(NodeHandle node) const
+{
+	uint32_t parentSlot = m_ParentSlots[m_HandleToSlot[node]];
+	return parentSlot == INVALID_INDEX ? INVALID_INDEX : m_SlotToHandle[parentSlot];
+}
+
+void TransformHierarchy::DestroyNode(NodeHandle node)
+{
+	m_Flags[m_HandleToSlot[node]] |= NF_Destroyed;
+	m_LayoutDirty = true;
+}
+
+void TransformHierarchy::SetLocalTranslation(NodeHandle node, const Math::Vec4& translation)
+{
+	uint32_t slot = m_HandleToSlot[node];
+	m_LocalTranslations[slot] = translation;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalRotation(NodeHandle node, const Math::Quat& rotation)
+{
+	uint32_t slot = m_HandleToSlot[node];
+	m_LocalRotations[slot] = rotation;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalScale(NodeHandle node, const Math::Vec4& scale)
+{
+	uint32_t slot = m_HandleToSlot[node];
+	m_LocalScales[slot] = scale;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocalTransform(NodeHandle node, const Math::Vec4& translation, const Math::Quat& rotation, const Math::Vec4& scale)
+{
+	uint32_t slot = m_HandleToSlot[node];
+	m_LocalTranslations[slot] = translation;
+	m_LocalRotations[slot] = rotation;
+	m_LocalScales[slot] = scale;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::MarkDirty(uint32_t slot)
+{
+	if (!(m_Flags[slot] & NF_Dirty))
+	{
+		m_Flags[slot] |= NF_Dirty;
+		m_DirtySlots.push_back(slot);
+	}
+}
+
+// Slots missing from newToOld are dropped
+template<typename T>
+static void PermuteArray(std::vector<T>& values, const std::vector<uint32_t>& newToOld)
+{
+	std::vector<T> permuted(newToOld.size());
+	for (size_t i = 0; i < newToOld.size(); ++i)
+	{
+		permuted[i] = values[newToOld[i]];
+	}
+	values.swap(permuted);
+}
+
+void TransformHierarchy::SortByDepth()
+{
+	const uint32_t nodeCount = static_cast<uint32_t>(m_SlotToHandle.size());
+
+	// Child lists in old slot order, counting sort on parent. Destroyed nodes are left out, which drops
+	// their subtrees as nothing below them is reached.
+	std::vector<uint32_t> childOffsets(nodeCount + 1, 0);
+	std::vector<uint32_t> roots;
+	for (uint32_t slot = 0; slot < nodeCount; ++slot)
+	{
+		if (m_Flags[slot] & NF_Destroyed)
+		{
+			continue;
+		}
+		if (m_ParentSlots[slot] == INVALID_INDEX)
+		{
+			roots.push_back(slot);
+		}
+		else
+		{
+			++childOffsets[m_ParentSlots[slot] + 1];
+		}
+	}
+	for (uint32_t slot = 0; slot < nodeCount; ++slot)
+	{
+		childOffsets[slot + 1] += childOffsets[slot];
+	}
+
+	std::vector<uint32_t> children(childOffsets[nodeCount]);
+	{
+		std::vector<uint32_t> cursor(childOffsets.begin(), childOffsets.end() - 1);
+		for (uint32_t slot = 0; slot < nodeCount; ++slot)
+		{
+			if (m_ParentSlots[slot] != INVALID_INDEX && !(m_Flags[slot] & NF_Destroyed))
+			{
+				children[cursor[m_ParentSlots[slot]]++] = slot;
+			}
+		}
+	}
+
+	// Breadth first, children of one parent end up next to each other
+	std::vector<uint32_t> newToOld;
+	newToOld.reserve(nodeCount);
+	newToOld.insert(newToOld.end(), roots.begin(), roots.end());
+
+	std::vector<uint32_t> oldToNew(nodeCount, INVALID_INDEX);
+	std::vector<uint32_t> firstChildSlots(nodeCount, INVALID_INDEX);
+	std::vector<uint32_t> childCounts(nodeCount, 0);
+
+	m_LevelOffsets.clear();
+	m_LevelOffsets.push_back(0);
+
+	uint32_t levelBegin = 0;
+	while (levelBegin < newToOld.size())
+	{
+		uint32_t levelEnd = static_cast<uint32_t>(newToOld.size());
+		m_LevelOffsets.push_back(levelEnd);
+
+		for (uint32_t newSlot = levelBegin; newSlot < levelEnd; ++newSlot)
+		{
+			uint32_t oldSlot = newToOld[newSlot];
+			oldToNew[oldSlot] = newSlot;
+			m_Depths[oldSlot] = static_cast<uint32_t>(m_LevelOffsets.size() - 2);
+
+			uint32_t childCount = childOffsets[oldSlot + 1] - childOffsets[oldSlot];
+			if (childCount)
+			{
+				firstChildSlots[newSlot] = static_cast<uint32_t>(newToOld.size());
+				childCounts[newSlot] = childCount;
+				newToOld.insert(newToOld.end(), children.begin() + childOffsets[oldSlot], children.begin() + childOffsets[oldSlot + 1]);
+			}
+		}
+		levelBegin = levelEnd;
+	}
+
+	// Handles of dropped nodes are free for reuse
+	for (uint32_t slot = 0; slot < nodeCount; ++slot)
+	{
+		if (oldToNew[slot] == INVALID_INDEX)
+		{
+			m_HandleToSlot[m_SlotToHandle[slot]] = INVALID_INDEX;
+			m_FreeHandles.push_back(m_SlotToHandle[slot]);
+		}
+	}
+
+	PermuteArray(m_LocalTranslations, newToOld);
+	PermuteArray(m_LocalRotations, newToOld);
+	PermuteArray(m_LocalScales, newToOld);
+	PermuteArray(m_WorldMatrices, newToOld);
+	PermuteArray(m_ParentSlots, newToOld);
+	PermuteArray(m_Depths, newToOld);
+	PermuteArray(m_Flags, newToOld);
+	PermuteArray(m_SlotToHandle, newToOld);
+
+	for (uint32_t slot = 0; slot < newToOld.size(); ++slot)
+	{
+		if (m_ParentSlots[slot] != INVALID_INDEX)
+		{
+			m_ParentSlots[slot] = oldToNew[m_ParentSlots[slot]];
+		}
+		m_HandleToSlot[m_SlotToHandle[slot]] = slot;
+	}
+
+	for (uint32_t& dirtySlot : m_DirtySlots)
+	{
+		dirtySlot = oldToNew[dirtySlot];
+	}
+	m_DirtySlots.erase(std::remove(m_DirtySlots.begin(), m_DirtySlots.end(), INVALID_INDEX), m_DirtySlots.end());
+
+	firstChildSlots.resize(newToOld.size());
+	childCounts.resize(newToOld.size());
+	m_FirstChildSlots.swap(firstChildSlots);
+	m_ChildCounts.swap(childCounts);
+	m_LayoutDirty = false;
+}
+
+void TransformHierarchy::UpdateLevel(const std::vector<uint32_t>& slots)
+{
+	Gear::TaskSystem::Get().ParallelFor(static_cast<uint32_t>(slots.size()), TRANSFORM_BATCH_SIZE, [this, &slots](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			uint32_t slot = slots[i];
+			uint32_t parentSlot = m_ParentSlots[slot];
+
+			Math::Mat4 local = Math::ComposeTransform(m_LocalTranslations[slot], m_LocalRotations[slot], m_LocalScales[slot]);
+			m_WorldMatrices[slot] = parentSlot == INVALID_INDEX ? local : m_WorldMatrices[parentSlot] * local;
+			m_Flags[slot] = NF_Updated;
+		}
+	});
+}
+
+void TransformHierarchy::Update()
+{
+	m_LastUpdatedCount = 0;
+
+	if (m_DirtySlots.empty() && !m_LayoutDirty)
+	{
+		return;
+	}
+
+	if (m_LayoutDirty)
+	{
+		SortByDepth();
+	}
+
+	const uint32_t levelCount = GetLevelCount();
+	m_LevelWorkLists.resize(levelCount);
+	for (std::vector<uint32_t>& workList : m_LevelWorkLists)
+	{
+		workList.clear();
+	}
+
+	for (uint32_t slot : m_DirtySlots)
+	{
+		m_LevelWorkLists[m_Depths[slot]].push_back(slot);
+	}
+	m_DirtySlots.clear();
+
+	// Level by level, work list of next level is the children of updated nodes plus
+	// nodes marked dirty themselves whose parent did not get updated (otherwise they are in already)
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		std::vector<uint32_t>& workList = m_LevelWorkLists[level];
+		if (workList.empty())
+		{
+			continue;
+		}
+
+		UpdateLevel(workList);
+		m_LastUpdatedCount += static_cast<uint32_t>(workList.size());
+
+		if (level + 1 == levelCount)
+		{
+			break;
+		}
+
+		std::vector<uint32_t>& nextWorkList = m_LevelWorkLists[level + 1];
+		nextWorkList.erase(std::remove_if(nextWorkList.begin(), nextWorkList.end(), [this](uint32_t slot)
+		{
+			return (m_Flags[m_ParentSlots[slot]] & NF_Updated) != 0;
+		}), nextWorkList.end());
+
+		for (uint32_t slot : workList)
+		{
+			for (uint32_t child = m_FirstChildSlots[slot]; child < m_FirstChildSlots[slot] + m_ChildCounts[slot]; ++child)
+			{
+				nextWorkList.push_back(child);
+			}
+		}
+	}
+
+	// Flags of updated nodes only, never touch the whole hierarchy
+	for (const std::vector<uint32_t>& workList : m_LevelWorkLists)
+	{
+		for (uint32_t slot : workList)
+		{
+			m_Flags[slot] = NF_None;
+		}
+	}
+}
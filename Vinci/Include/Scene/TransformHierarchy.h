@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Math/Math.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Scene graph transforms in SoA arrays, ordered breadth first so that
+//  |- every level (depth) is one contiguous range, parents always come before children
+//  |- children of a node are contiguous in the next level
+// Only nodes touched since last Update() and their subtrees are recomputed, one level at a time,
+// nodes inside a level are independent and updated in parallel.
+// Nodes are referenced by stable handles, slots move whenever the hierarchy is re-sorted.
+// Reparenting and destroying nodes only re-sort on next Update(), handles of destroyed nodes are reused after it.
+class TransformHierarchy
+{
+public:
+	typedef uint32_t NodeHandle;
+	static constexpr uint32_t INVALID_INDEX = ~0u;
+
+	NodeHandle CreateNode(NodeHandle parent = INVALID_INDEX);
+	NodeHandle CreateNode(NodeHandle parent, const Math::Vec4& translation, const Math::Quat& rotation, const Math::Vec4& scale);
+
+	// Keeps the local transform, so the subtree moves with its new parent. Throws if parent is inside the subtree.
+	void SetParent(NodeHandle node, NodeHandle parent);
+	NodeHandle GetParent(NodeHandle node) const;
+
+	// Destroys the whole subtree on next Update(), including children created under it until then
+	void DestroyNode(NodeHandle node);
+	bool IsValid(NodeHandle node) const { return node < m_HandleToSlot.size() && m_HandleToSlot[node] != INVALID_INDEX; }
+
+	void SetLocalTranslation(NodeHandle node, const Math::Vec4& translation);
+	void SetLocalRotation(NodeHandle node, const Math::Quat& rotation);
+	void SetLocalScale(NodeHandle node, const Math::Vec4& scale);
+	void SetLocalTransform(NodeHandle node, const Math::Vec4& translation, const Math::Quat& rotation, const Math::Vec4& scale);
+
+	const Math::Vec4& GetLocalTranslation(NodeHandle node) const { return m_LocalTranslations[m_HandleToSlot[node]]; }
+	const Math::Quat& GetLocalRotation(NodeHandle node) const { return m_LocalRotations[m_HandleToSlot[node]]; }
+	const Math::Vec4& GetLocalScale(NodeHandle node) const { return m_LocalScales[m_HandleToSlot[node]]; }
+
+	// Valid after Update()
+	const Math::Mat4& GetWorldMatrix(NodeHandle node) const { return m_WorldMatrices[m_HandleToSlot[node]]; }
+
+	// Recompute world matrices of dirty subtrees
+	void Update();
+
+	// Destroyed nodes count until next Update()
+	uint32_t GetNodeCount() const { return static_cast<uint32_t>(m_SlotToHandle.size()); }
+	uint32_t GetLevelCount() const { return m_LevelOffsets.empty() ? 0 : static_cast<uint32_t>(m_LevelOffsets.size() - 1); }
+	uint32_t GetLastUpdatedCount() const { return m_LastUpdatedCount; }
+
+	// Slot order access for batch consumers (culling, instance upload)
+	uint32_t GetSlot(NodeHandle node) const { return m_HandleToSlot[node]; }
+	NodeHandle GetHandle(uint32_t slot) const { return m_SlotToHandle[slot]; }
+	const Math::Mat4* GetWorldMatrices() const { return m_WorldMatrices.data(); }
+
+private:
+	enum NodeFlags : uint8_t
+	{
+		NF_None      = 0,
+		NF_Dirty     = 1 << 0,  // local transform changed, queued for update
+		NF_Updated   = 1 << 1,  // world matrix recomputed in current update
+		NF_Destroyed = 1 << 2,  // dropped with its subtree by next SortByDepth()
+	};
+
+	void MarkDirty(uint32_t slot);
+	void SortByDepth();
+	void UpdateLevel(const std::vector<uint32_t>& slots);
+
+private:
+	// Per slot
+	std::vector<Math::Vec4> m_LocalTranslations;
+	std::vector<Math::Quat> m_LocalRotations;
+	std::vector<Math::Vec4> m_LocalScales;
+	std::vector<Math::Mat4> m_WorldMatrices;
+	std::vector<uint32_t> m_ParentSlots;
+	std::vector<uint32_t> m_FirstChildSlots;
+	std::vector<uint32_t> m_ChildCounts;
+	std::vector<uint32_t> m_Depths;
+	std::vector<uint8_t> m_Flags;
+	std::vector<NodeHandle> m_SlotToHandle;
+
+	// Per handle, INVALID_INDEX for destroyed ones which are free for reuse
+	std::vector<uint32_t> m_HandleToSlot;
+	std::vector<NodeHandle> m_FreeHandles;
+
+	// Slot range of each level, [m_LevelOffsets[d], m_LevelOffsets[d + 1])
+	std::vector<uint32_t> m_LevelOffsets;
+
+	// Dirty slots in order they were touched, bucketed by level in Update()
+	std::vector<uint32_t> m_DirtySlots;
+	std::vector<std::vector<uint32_t>> m_LevelWorkLists;
+
+	bool m_LayoutDirty{ false };
+	uint32_t m_LastUpdatedCount{ 0 };
+};
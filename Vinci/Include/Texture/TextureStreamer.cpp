@@ -0,0 +1,396 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+namespace
+{
+	float SrgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	uint8_t LinearToSrgb8(float value)
+	{
+		value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+		return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+}
+
+void BuildTextureMips(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<std::vector<uint8_t>>& outMips)
+{
+	float toLinear[256];
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		toLinear[i] = SrgbToLinear(i / 255.0f);
+	}
+
+	outMips.clear();
+	outMips.emplace_back(pixels, pixels + size_t(width) * height * 4);
+
+	while ((width > 1 || height > 1) && outMips.size() < TEXTURE_MAX_MIPS)
+	{
+		const uint32_t mipWidth = std::max(width / 2, 1u);
+		const uint32_t mipHeight = std::max(height / 2, 1u);
+		const std::vector<uint8_t>& source = outMips.back();
+		std::vector<uint8_t> mip(size_t(mipWidth) * mipHeight * 4);
+
+		for (uint32_t y = 0; y < mipHeight; ++y)
+		{
+			const uint32_t y0 = std::min(y * 2, height - 1);
+			const uint32_t y1 = std::min(y * 2 + 1, height - 1);
+			for (uint32_t x = 0; x < mipWidth; ++x)
+			{
+				const uint32_t x0 = std::min(x * 2, width - 1);
+				const uint32_t x1 = std::min(x * 2 + 1, width - 1);
+				const uint8_t* texels[4] = {
+					&source[(size_t(y0) * width + x0) * 4],
+					&source[(size_t(y0) * width + x1) * 4],
+					&source[(size_t(y1) * width + x0) * 4],
+					&source[(size_t(y1) * width + x1) * 4]
+				};
+
+				uint8_t* target = &mip[(size_t(y) * mipWidth + x) * 4];
+				for (uint32_t channel = 0; channel < 3; ++channel)
+				{
+					const float sum = toLinear[texels[0][channel]] + toLinear[texels[1][channel]] + toLinear[texels[2][channel]] + toLinear[texels[3][channel]];
+					target[channel] = LinearToSrgb8(sum * 0.25f);
+				}
+				target[3] = static_cast<uint8_t>((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+			}
+		}
+
+		outMips.push_back(std::move(mip));
+		width = mipWidth;
+		height = mipHeight;
+	}
+}
+
+bool SaveCookedTexture(const char* fileName, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips)
+{
+	if (mips.empty() || mips.size() > TEXTURE_MAX_MIPS)
+	{
+		return false;
+	}
+
+	Gear::FastLoadWriter writer;
+	const uint64_t textureOffset = writer.Allocate<CookedTexture>();
+
+	uint64_t mipOffsets[TEXTURE_MAX_MIPS] = {};
+	for (size_t mip = 0; mip < mips.size(); ++mip)
+	{
+		mipOffsets[mip] = writer.Write(mips[mip].data(), mips[mip].size());
+	}
+
+	CookedTexture* texture = writer.Resolve<CookedTexture>(textureOffset);
+	texture->version = COOKED_TEXTURE_VERSION;
+	texture->width = width;
+	texture->height = height;
+	texture->mipCount = static_cast<uint32_t>(mips.size());
+	for (uint32_t mip = 0; mip < texture->mipCount; ++mip)
+	{
+		texture->mips[mip].width = std::max(width >> mip, 1u);
+		texture->mips[mip].height = std::max(height >> mip, 1u);
+		texture->mips[mip].size = static_cast<uint32_t>(mips[mip].size());
+	}
+
+	for (size_t mip = 0; mip < mips.size(); ++mip)
+	{
+		writer.Link(textureOffset + offsetof(CookedTexture, mips) + mip * sizeof(CookedTextureMip) + offsetof(CookedTextureMip, pixels), mipOffsets[mip]);
+	}
+	writer.SetRoot(textureOffset);
+
+	return writer.SaveToFile(fileName);
+}
+
+const CookedTexture* LoadCookedTexture(const char* fileName, Gear::FastLoadImage& outImage, bool bLooseOnly)
+{
+	if (!outImage.LoadIfExists(fileName, bLooseOnly))
+	{
+		return nullptr;
+	}
+
+	const CookedTexture* texture = outImage.GetRoot<CookedTexture>();
+	if (!texture || texture->version != COOKED_TEXTURE_VERSION)
+	{
+		outImage.Release();
+		return nullptr;
+	}
+	return texture;
+}
+
+uint32_t ComputeStreamingMip(const CookedTexture& texture, float projectedSize)
+{
+	// One texel per pixel, rounded to the finer mip
+	const float texelsPerPixel = std::max(texture.width, texture.height) / std::max(projectedSize, 1.0f);
+	const int32_t mip = texelsPerPixel > 1.0f ? static_cast<int32_t>(std::floor(std::log2(texelsPerPixel))) : 0;
+	return static_cast<uint32_t>(std::min(mip, static_cast<int32_t>(texture.mipCount) - 1));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	Shutdown();
+}
+
+void TextureStreamer::Initialize(const TextureStreamingSettings& settings)
+{
+	Shutdown();
+
+	m_Settings = settings;
+	m_Shutdown = false;
+	m_Loader = std::thread(&TextureStreamer::LoaderMain, this);
+}
+
+void TextureStreamer::Shutdown()
+{
+	if (m_Loader.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Shutdown = true;
+		}
+		m_WakeCondition.notify_all();
+		m_Loader.join();
+	}
+
+	m_PendingLoads.clear();
+	m_FinishedLoads.clear();
+	m_ActiveLoads = 0;
+	m_Textures.clear();
+	m_ResidentBytes = 0;
+	m_InFlightBytes = 0;
+}
+
+uint32_t TextureStreamer::AddTexture(const CookedTexture* texture)
+{
+	TextureState state = {};
+	state.texture = texture;
+
+	// First mip which fits the tail size, the last one if none does
+	state.tailMip = texture->mipCount - 1;
+	for (uint32_t mip = 0; mip < texture->mipCount; ++mip)
+	{
+		if (std::max(texture->mips[mip].width, texture->mips[mip].height) <= m_Settings.tailSize)
+		{
+			state.tailMip = mip;
+			break;
+		}
+	}
+
+	state.residentMip = state.tailMip;
+	state.wantedMip = state.tailMip;
+	state.requestedMip = texture->mipCount;
+	state.lastUsedFrame = m_Frame;
+
+	for (uint32_t mip = state.tailMip; mip < texture->mipCount; ++mip)
+	{
+		m_ResidentBytes += GetMipSize(state, mip);
+	}
+
+	m_Textures.push_back(state);
+	return static_cast<uint32_t>(m_Textures.size() - 1);
+}
+
+void TextureStreamer::RequestMip(uint32_t texture, uint32_t mip)
+{
+	TextureState& state = m_Textures[texture];
+	state.requestedMip = std::min(state.requestedMip, mip);
+}
+
+void TextureStreamer::Update(std::vector<TextureResidencyChange>& outChanges)
+{
+	outChanges.clear();
+	++m_Frame;
+
+	std::vector<LoadRequest> finishedLoads;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		finishedLoads.swap(m_FinishedLoads);
+	}
+
+	// Loaded textures are never evicted, so a load is always the next finer mip
+	for (LoadRequest& load : finishedLoads)
+	{
+		TextureState& state = m_Textures[load.texture];
+		const uint64_t size = GetMipSize(state, load.mip);
+
+		TextureResidencyChange change;
+		change.texture = load.texture;
+		change.oldResidentMip = state.residentMip;
+		change.newResidentMip = load.mip;
+		change.loadedPixels = std::move(load.pixels);
+		outChanges.push_back(std::move(change));
+
+		state.residentMip = load.mip;
+		state.bLoading = false;
+		m_InFlightBytes -= size;
+		m_ResidentBytes += size;
+	}
+
+	std::vector<uint32_t> candidates;
+	for (uint32_t texture = 0; texture < m_Textures.size(); ++texture)
+	{
+		TextureState& state = m_Textures[texture];
+		const uint32_t mipCount = state.texture->mipCount;
+
+		if (state.requestedMip < mipCount)
+		{
+			state.wantedMip = std::min(state.requestedMip, state.tailMip);
+			state.lastUsedFrame = m_Frame;
+		}
+		else if (m_Frame - state.lastUsedFrame > m_Settings.evictDelayFrames)
+		{
+			state.wantedMip = state.tailMip;
+		}
+		state.requestedMip = mipCount;
+
+		if (!state.bLoading && state.wantedMip < state.residentMip)
+		{
+			candidates.push_back(texture);
+		}
+	}
+
+	// Largest deficit first, ties to the most recently used
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+	{
+		const TextureState& stateA = m_Textures[a];
+		const TextureState& stateB = m_Textures[b];
+		const uint32_t deficitA = stateA.residentMip - stateA.wantedMip;
+		const uint32_t deficitB = stateB.residentMip - stateB.wantedMip;
+		if (deficitA != deficitB)
+		{
+			return deficitA > deficitB;
+		}
+		return stateA.lastUsedFrame > stateB.lastUsedFrame;
+	});
+
+	std::vector<LoadRequest> newLoads;
+	for (uint32_t texture : candidates)
+	{
+		TextureState& state = m_Textures[texture];
+		const uint32_t mip = state.residentMip - 1;
+		const uint64_t size = GetMipSize(state, mip);
+
+		// A single mip larger than the in flight limit still goes when nothing else is in flight
+		if (m_InFlightBytes > 0 && m_InFlightBytes + size > m_Settings.maxInFlightBytes)
+		{
+			break;
+		}
+
+		if (m_ResidentBytes + m_InFlightBytes + size > m_Settings.budgetBytes && !EvictFor(size, texture, outChanges))
+		{
+			continue;
+		}
+
+		state.bLoading = true;
+		m_InFlightBytes += size;
+		newLoads.push_back({ texture, mip, state.texture->mips[mip].pixels.Get(), state.texture->mips[mip].size, {} });
+	}
+
+	if (!newLoads.empty())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (LoadRequest& load : newLoads)
+			{
+				m_PendingLoads.push_back(std::move(load));
+			}
+		}
+		m_WakeCondition.notify_one();
+	}
+}
+
+bool TextureStreamer::EvictFor(uint64_t bytes, uint32_t requester, std::vector<TextureResidencyChange>& outChanges)
+{
+	const uint64_t needed = m_ResidentBytes + m_InFlightBytes + bytes - m_Settings.budgetBytes;
+
+	// Only mips finer than wanted can go, least recently used textures first
+	std::vector<uint32_t> victims;
+	uint64_t available = 0;
+	for (uint32_t texture = 0; texture < m_Textures.size(); ++texture)
+	{
+		const TextureState& state = m_Textures[texture];
+		if (texture == requester || state.bLoading || state.residentMip >= state.wantedMip)
+		{
+			continue;
+		}
+
+		victims.push_back(texture);
+		for (uint32_t mip = state.residentMip; mip < state.wantedMip; ++mip)
+		{
+			available += GetMipSize(state, mip);
+		}
+	}
+
+	// Nothing is evicted for a load which would not fit anyway
+	if (available < needed)
+	{
+		return false;
+	}
+
+	std::sort(victims.begin(), victims.end(), [this](uint32_t a, uint32_t b)
+	{
+		return m_Textures[a].lastUsedFrame < m_Textures[b].lastUsedFrame;
+	});
+
+	uint64_t freed = 0;
+	for (uint32_t texture : victims)
+	{
+		TextureState& state = m_Textures[texture];
+
+		TextureResidencyChange change;
+		change.texture = texture;
+		change.oldResidentMip = state.residentMip;
+
+		while (state.residentMip < state.wantedMip && freed < needed)
+		{
+			freed += GetMipSize(state, state.residentMip);
+			++state.residentMip;
+		}
+
+		change.newResidentMip = state.residentMip;
+		outChanges.push_back(std::move(change));
+
+		if (freed >= needed)
+		{
+			break;
+		}
+	}
+
+	m_ResidentBytes -= freed;
+	return true;
+}
+
+void TextureStreamer::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_IdleCondition.wait(lock, [this]() { return m_PendingLoads.empty() && m_ActiveLoads == 0; });
+}
+
+void TextureStreamer::LoaderMain()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_WakeCondition.wait(lock, [this]() { return m_Shutdown || !m_PendingLoads.empty(); });
+		if (m_Shutdown)
+		{
+			break;
+		}
+
+		LoadRequest load = std::move(m_PendingLoads.front());
+		m_PendingLoads.pop_front();
+		++m_ActiveLoads;
+		lock.unlock();
+
+		// Reading the mapped mip is where the file is actually paged in
+		load.pixels.assign(load.source, load.source + load.size);
+
+		lock.lock();
+		m_FinishedLoads.push_back(std::move(load));
+		--m_ActiveLoads;
+		m_IdleCondition.notify_all();
+	}
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Base/Archive.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define TEXTURE_MAX_MIPS 16
+#define COOKED_TEXTURE_VERSION 1
+
+// Cooked asset, a fast-load image holding every mip of an 8 bit RGBA texture separately,
+// so a mapped file only pages in the mips which are streamed
+struct CookedTextureMip
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;	// bytes
+	uint32_t padding;
+	Gear::FastLoadPtr<const uint8_t> pixels;
+};
+
+struct CookedTexture
+{
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+	CookedTextureMip mips[TEXTURE_MAX_MIPS];
+};
+
+// Box filtered chain down to 1x1, mip 0 is the source. Color channels are averaged in linear space (sRGB source).
+void BuildTextureMips(const uint8_t* pixels, uint32_t width, uint32_t height, std::vector<std::vector<uint8_t>>& outMips);
+
+bool SaveCookedTexture(const char* fileName, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& mips);
+
+// Null if file is missing or was cooked by an older version, fileName is a path in Gear::FileSystem.
+// A texture cooked again is loaded with bLooseOnly, older ones in mounted paks would come first.
+const CookedTexture* LoadCookedTexture(const char* fileName, Gear::FastLoadImage& outImage, bool bLooseOnly = false);
+
+// Finest mip worth sampling when the texture spans projectedSize pixels on screen
+uint32_t ComputeStreamingMip(const CookedTexture& texture, float projectedSize);
+
+struct TextureStreamingSettings
+{
+	uint64_t budgetBytes{ 64ull << 20 };			// resident mips of all textures, loads in flight included
+	uint64_t maxInFlightBytes{ 16ull << 20 };		// loads issued but not yet picked up by Update()
+	uint32_t tailSize{ 64 };						// mips this size and smaller are always resident
+	uint32_t evictDelayFrames{ 120 };				// unused textures drop to their tail after this many frames
+};
+
+// Mip residency of a texture changed, its GPU image has to hold mips [newResidentMip, mipCount) now.
+// Loads bring exactly one finer mip, pixels of newResidentMip are in loadedPixels. Evictions have no pixels.
+struct TextureResidencyChange
+{
+	uint32_t texture;
+	uint32_t oldResidentMip;
+	uint32_t newResidentMip;
+	std::vector<uint8_t> loadedPixels;
+};
+
+// Keeps a resident mip tail [residentMip, mipCount) per texture under a memory budget.
+//  |- usage is reported per frame as the finest mip a texture is wanted at, e.g. from ComputeStreamingMip()
+//  |- textures below their wanted mip load one mip per step, coarse to fine, largest deficit first
+//  |- mips are read from the cooked (mapped) image on a loader thread, so page faults never hit the caller
+//  |- when the budget is full, mips nobody wants any more are evicted to make room, finest first
+// Not thread safe apart from the loader, AddTexture()/ RequestMip()/ Update() belong to one thread.
+class TextureStreamer
+{
+public:
+	TextureStreamer() = default;
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator = (const TextureStreamer&) = delete;
+
+	void Initialize(const TextureStreamingSettings& settings);
+	void Shutdown();
+
+	// Texture must stay valid until Shutdown(), its tail counts as resident right away and is uploaded by caller
+	uint32_t AddTexture(const CookedTexture* texture);
+
+	uint32_t GetTailMip(uint32_t texture) const { return m_Textures[texture].tailMip; }
+	uint32_t GetResidentMip(uint32_t texture) const { return m_Textures[texture].residentMip; }
+
+	// Keeps the finest mip requested within a frame
+	void RequestMip(uint32_t texture, uint32_t mip);
+
+	// Once per frame: picks up finished loads, evicts and issues new loads. Changes are in application order.
+	void Update(std::vector<TextureResidencyChange>& outChanges);
+
+	uint64_t GetResidentBytes() const { return m_ResidentBytes; }
+	uint64_t GetInFlightBytes() const { return m_InFlightBytes; }
+
+	// Blocks until no load is in flight, mostly for tests and shutdown
+	void Flush();
+
+private:
+	struct TextureState
+	{
+		const CookedTexture* texture;
+		uint32_t tailMip;
+		uint32_t residentMip;
+		uint32_t wantedMip;			// finest mip wanted, sticks until the texture goes unused
+		uint32_t requestedMip;		// finest mip requested this frame, mipCount if none
+		uint64_t lastUsedFrame;
+		bool bLoading;
+	};
+
+	// Source is resolved when issued, loader never touches texture states
+	struct LoadRequest
+	{
+		uint32_t texture;
+		uint32_t mip;
+		const uint8_t* source;
+		uint32_t size;
+		std::vector<uint8_t> pixels;
+	};
+
+	uint64_t GetMipSize(const TextureState& state, uint32_t mip) const { return state.texture->mips[mip].size; }
+
+	bool EvictFor(uint64_t bytes, uint32_t requester, std::vector<TextureResidencyChange>& outChanges);
+
+	void LoaderMain();
+
+private:
+	TextureStreamingSettings m_Settings;
+	std::vector<TextureState> m_Textures;
+	uint64_t m_Frame{ 0 };
+	uint64_t m_ResidentBytes{ 0 };
+	uint64_t m_InFlightBytes{ 0 };
+
+	// Loader thread, requests in and finished loads out are guarded by m_Mutex
+	std::thread m_Loader;
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_IdleCondition;
+	std::deque<LoadRequest> m_PendingLoads;
+	std::vector<LoadRequest> m_FinishedLoads;
+	uint32_t m_ActiveLoads{ 0 };
+	bool m_Shutdown{ false };
+};
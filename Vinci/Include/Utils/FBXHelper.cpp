@@ -1,6 +1,11 @@
 #include "FBXHelper.h"
 #include "meshes.h"
 
+#include "Base/TaskSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
 FBXHelper* FBXHelper::m_Instance = nullptr;
 
 FBXHelper::~FBXHelper()
@@ -47,6 +52,37 @@ bool FBXHelper::Initialize()
 }
 
 bool FBXHelper::LoadFBX(const char * fbxFileName, Meshes* meshes)
+{
+	std::vector<FBXMeshData> meshData;
+	if (!LoadFBX(fbxFileName, meshData))
+	{
+		return false;
+	}
+
+	for (const FBXMeshData& data : meshData)
+	{
+		for (const Vec4& vertex : data.vertices)
+		{
+			meshes->AddVertex(vertex);
+		}
+		for (const Vec3& normal : data.normals)
+		{
+			meshes->AddNormal(normal);
+		}
+		for (const Vec2& uv : data.uvs)
+		{
+			meshes->AddUV(uv);
+		}
+		for (uint32_t index : data.indices)
+		{
+			meshes->AddIndex(index);
+		}
+	}
+
+	return true;
+}
+
+bool FBXHelper::ImportScene(const char* fbxFileName)
 {
 	// Fbx importer
 	m_Importer = FbxImporter::Create(m_FbxMgr, "");
@@ -68,162 +104,353 @@ bool FBXHelper::LoadFBX(const char * fbxFileName, Meshes* meshes)
 		return false;
 	}
 
-	ProcessNode(m_SceneRoot->GetRootNode(), meshes);
-  
 	return true;
 }
 
-void FBXHelper::ProcessNode(FbxNode* node, Meshes* meshes)
+bool FBXHelper::LoadFBX(const char* fbxFileName, std::vector<FBXMeshData>& outMeshes)
 {
-	FbxMesh* mesh = node->GetMesh();
+	if (!ImportScene(fbxFileName))
+	{
+		return false;
+	}
 
-	FbxNodeAttribute* nodeAttribute = node->GetNodeAttribute();
-	if(nodeAttribute)
+	std::vector<FbxMesh*> fbxMeshes;
+	CollectMeshes(m_SceneRoot->GetRootNode(), fbxMeshes);
+
+	outMeshes.clear();
+	outMeshes.resize(fbxMeshes.size());
+
+	// Meshes differ a lot in size, one mesh per batch keeps workers busy
+	Gear::TaskSystem::Get().ParallelFor(static_cast<uint32_t>(fbxMeshes.size()), 1, [&](uint32_t begin, uint32_t end)
 	{
-		switch (node->GetNodeAttribute()->GetAttributeType())
+		for (uint32_t i = begin; i < end; ++i)
 		{
-		case FbxNodeAttribute::eMesh:
-			ProcessMesh(node->GetMesh(), meshes);
-			break;
-		default:
-			break;
+			ExtractMesh(fbxMeshes[i], outMeshes[i]);
 		}
+	});
+
+	return true;
+}
+
+bool FBXHelper::LoadAnimations(const char* fbxFileName, std::vector<RawAnimationClip>& outClips, float sampleRate)
+{
+	if (!ImportScene(fbxFileName))
+	{
+		return false;
 	}
 
-	for (int i = 0; i< node->GetChildCount(); ++i)
+	std::vector<FbxNode*> boneNodes;
+	CollectSkeletonNodes(m_SceneRoot->GetRootNode(), boneNodes);
+
+	outClips.clear();
+	if (boneNodes.empty())
+	{
+		return true;
+	}
+
+	// Evaluator caches per anim stack, sampling stays serial
+	const int stackCount = m_SceneRoot->GetSrcObjectCount<FbxAnimStack>();
+	for (int stackIdx = 0; stackIdx < stackCount; ++stackIdx)
 	{
-		ProcessNode(node->GetChild(i), meshes);
+		FbxAnimStack* stack = m_SceneRoot->GetSrcObject<FbxAnimStack>(stackIdx);
+		m_SceneRoot->SetCurrentAnimationStack(stack);
+
+		const FbxTimeSpan span = stack->GetLocalTimeSpan();
+		const double duration = std::max(span.GetDuration().GetSecondDouble(), 0.0);
+
+		RawAnimationClip clip;
+		clip.name = stack->GetName();
+		clip.sampleRate = sampleRate;
+		clip.frameCount = static_cast<uint32_t>(std::floor(duration * sampleRate + 0.5)) + 1;
+		clip.tracks.resize(boneNodes.size());
+
+		for (size_t boneIdx = 0; boneIdx < boneNodes.size(); ++boneIdx)
+		{
+			RawAnimationClip::BoneTrack& track = clip.tracks[boneIdx];
+			track.boneName = boneNodes[boneIdx]->GetName();
+			track.translations.resize(clip.frameCount);
+			track.rotations.resize(clip.frameCount);
+			track.scales.resize(clip.frameCount);
+		}
+
+		for (uint32_t frame = 0; frame < clip.frameCount; ++frame)
+		{
+			FbxTime time = span.GetStart();
+			time.SetSecondDouble(span.GetStart().GetSecondDouble() + frame / static_cast<double>(sampleRate));
+
+			for (size_t boneIdx = 0; boneIdx < boneNodes.size(); ++boneIdx)
+			{
+				const FbxAMatrix& local = boneNodes[boneIdx]->EvaluateLocalTransform(time);
+				const FbxVector4 t = local.GetT();
+				const FbxQuaternion q = local.GetQ();
+				const FbxVector4 s = local.GetS();
+
+				RawAnimationClip::BoneTrack& track = clip.tracks[boneIdx];
+				track.translations[frame] = Math::Vec4(static_cast<float>(t[0]), static_cast<float>(t[1]), static_cast<float>(t[2]), 1.0f);
+				track.rotations[frame] = Math::Quat(static_cast<float>(q[0]), static_cast<float>(q[1]), static_cast<float>(q[2]), static_cast<float>(q[3]));
+				track.scales[frame] = Math::Vec4(static_cast<float>(s[0]), static_cast<float>(s[1]), static_cast<float>(s[2]), 0.0f);
+			}
+		}
+
+		outClips.push_back(std::move(clip));
 	}
+
+	return true;
 }
 
-void FBXHelper::ProcessMesh(FbxMesh* mesh, Meshes* meshes)
+void FBXHelper::CollectSkeletonNodes(FbxNode* node, std::vector<FbxNode*>& outNodes)
 {
-	if (!mesh->GetNode())
-		return;
+	FbxNodeAttribute* nodeAttribute = node->GetNodeAttribute();
+	if (nodeAttribute && nodeAttribute->GetAttributeType() == FbxNodeAttribute::eSkeleton)
+	{
+		outNodes.push_back(node);
+	}
 
-	const int polygonCount = mesh->GetPolygonCount();
+	for (int i = 0; i < node->GetChildCount(); ++i)
+	{
+		CollectSkeletonNodes(node->GetChild(i), outNodes);
+	}
+}
 
-	// Congregate all the data of a mesh to be cached in VBOs.
-	// If normal or UV is by polygon vertex, record all vertex attributes by polygon vertex.
-	bool hasNormal = mesh->GetElementNormalCount() > 0;
-	bool hasUV = mesh->GetElementUVCount() > 0;
-	FbxGeometryElement::EMappingMode normalMappingMode = FbxGeometryElement::eNone;
-	FbxGeometryElement::EMappingMode uvMappingMode = FbxGeometryElement::eNone;
-	bool allByControlPoint = true;
-	if (hasNormal)
-	{
-		normalMappingMode = mesh->GetElementNormal(0)->GetMappingMode();
-		if (normalMappingMode == FbxGeometryElement::eNone)
+void FBXHelper::CollectMeshes(FbxNode* node, std::vector<FbxMesh*>& outMeshes)
+{
+	FbxNodeAttribute* nodeAttribute = node->GetNodeAttribute();
+	if (nodeAttribute && nodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh)
+	{
+		FbxMesh* mesh = node->GetMesh();
+		if (mesh && !mesh->IsTriangleMesh())
 		{
-			hasNormal = false;
+			// Extraction indexes polygon vertices as triangles
+			FbxGeometryConverter converter(m_FbxMgr);
+			mesh = static_cast<FbxMesh*>(converter.Triangulate(mesh, true));
 		}
-		if (hasNormal && normalMappingMode != FbxGeometryElement::eByControlPoint)
+
+		if (mesh && mesh->GetNode())
 		{
-			allByControlPoint = false;
+			outMeshes.push_back(mesh);
 		}
 	}
-	if (hasUV)
+
+	for (int i = 0; i< node->GetChildCount(); ++i)
+	{
+		CollectMeshes(node->GetChild(i), outMeshes);
+	}
+}
+
+// Raw access to a layer array, released when out of scope
+template<typename T>
+class FBXArrayReadLock
+{
+public:
+	explicit FBXArrayReadLock(FbxLayerElementArrayTemplate<T>& array) :
+		m_Array(array),
+		m_Data(array.GetLocked(static_cast<T*>(nullptr), FbxLayerElementArray::eReadLock))
+	{}
+
+	~FBXArrayReadLock()
 	{
-		uvMappingMode = mesh->GetElementUV(0)->GetMappingMode();
-		if (uvMappingMode == FbxGeometryElement::eNone)
+		if (m_Data)
 		{
-			hasUV = false;
+			m_Array.Release(&m_Data, static_cast<T*>(nullptr));
 		}
-		if (hasUV && uvMappingMode != FbxGeometryElement::eByControlPoint)
+	}
+
+	const T* GetData() const { return m_Data; }
+
+private:
+	FbxLayerElementArrayTemplate<T>& m_Array;
+	T* m_Data;
+};
+
+// Resolve mapping and reference mode of a layer element for every output vertex in one pass.
+// Output vertices are control points if byControlPoint, polygon vertices otherwise.
+template<typename TData, typename TOut, typename TConvert>
+static void ExtractLayer(FbxLayerElementTemplate<TData>* element, const int* polygonVertices, int outCount, bool byControlPoint, TOut* out, TConvert convert)
+{
+	FBXArrayReadLock<TData> direct(element->GetDirectArray());
+	if (!direct.GetData())
+	{
+		return;
+	}
+
+	const bool indexToDirect = element->GetReferenceMode() != FbxLayerElement::eDirect;
+	FBXArrayReadLock<int> index(element->GetIndexArray());
+	const int* indices = indexToDirect ? index.GetData() : nullptr;
+	if (indexToDirect && !indices)
+	{
+		return;
+	}
+
+	const FbxGeometryElement::EMappingMode mappingMode = element->GetMappingMode();
+	for (int i = 0; i < outCount; ++i)
+	{
+		int mapped = i;
+		switch (mappingMode)
 		{
-			allByControlPoint = false;
+		case FbxGeometryElement::eByControlPoint:
+			mapped = byControlPoint ? i : polygonVertices[i];
+			break;
+		case FbxGeometryElement::eByPolygon:
+			mapped = i / TRIANGLE_VERTEX_COUNT;
+			break;
+		case FbxGeometryElement::eAllSame:
+			mapped = 0;
+			break;
+		default:
+			break;
 		}
+
+		out[i] = convert(direct.GetData()[indexToDirect ? indices[mapped] : mapped]);
 	}
+}
+
+void FBXHelper::ExtractMesh(FbxMesh* mesh, FBXMeshData& outData)
+{
+	const int polygonCount = mesh->GetPolygonCount();
+	const int polygonVertexCount = polygonCount * TRIANGLE_VERTEX_COUNT;
+	const int controlPointCount = mesh->GetControlPointsCount();
+	const int* polygonVertices = mesh->GetPolygonVertices();
+	const FbxVector4* controlPoints = mesh->GetControlPoints();
 
-	// Allocate the array memory, by control point or by polygon vertex.
-	int polygonVertexCount = mesh->GetControlPointsCount();
-	if (!allByControlPoint)
+	// If normal or UV is by polygon vertex, record all vertex attributes by polygon vertex.
+	FbxGeometryElementNormal* normalElement = mesh->GetElementNormalCount() > 0 ? mesh->GetElementNormal(0) : nullptr;
+	FbxGeometryElementUV* uvElement = mesh->GetElementUVCount() > 0 ? mesh->GetElementUV(0) : nullptr;
+	if (normalElement && normalElement->GetMappingMode() == FbxGeometryElement::eNone)
+	{
+		normalElement = nullptr;
+	}
+	if (uvElement && uvElement->GetMappingMode() == FbxGeometryElement::eNone)
 	{
-		polygonVertexCount = polygonCount * TRIANGLE_VERTEX_COUNT;
+		uvElement = nullptr;
 	}
 
-	// Populate the array with vertex attribute, if by control point.
-	const FbxVector4 * controlPoints = mesh->GetControlPoints();
-	FbxVector4 currentVertex;
-	FbxVector4 currentNormal;
-	FbxVector2 currentUV;
+	const bool allByControlPoint =
+		(!normalElement || normalElement->GetMappingMode() == FbxGeometryElement::eByControlPoint) &&
+		(!uvElement || uvElement->GetMappingMode() == FbxGeometryElement::eByControlPoint);
+
+	const int vertexCount = allByControlPoint ? controlPointCount : polygonVertexCount;
+
+	// Sized once, filled by index below
+	outData.vertices.resize(vertexCount);
+	outData.normals.resize(normalElement ? vertexCount : 0);
+	outData.uvs.resize(uvElement ? vertexCount : 0);
+	outData.indices.resize(polygonVertexCount);
+
 	if (allByControlPoint)
 	{
-		const FbxGeometryElementNormal * normalElement = NULL;
-		const FbxGeometryElementUV * uvElement = NULL;
-		if (hasNormal)
+		for (int i = 0; i < vertexCount; ++i)
 		{
-			normalElement = mesh->GetElementNormal(0);
+			const FbxVector4& point = controlPoints[i];
+			outData.vertices[i] = Vec4(point[0], point[1], point[2], 1.0f);
 		}
-		if (hasUV)
+		for (int i = 0; i < polygonVertexCount; ++i)
 		{
-			uvElement = mesh->GetElementUV(0);
+			outData.indices[i] = static_cast<uint32_t>(polygonVertices[i]);
 		}
-		for (int index = 0; index < polygonVertexCount; ++index)
+	}
+	else
+	{
+		for (int i = 0; i < vertexCount; ++i)
 		{
-			// Save the vertex position.
-			currentVertex = controlPoints[index];
-			meshes->AddVertex(Vec4(currentVertex[0], currentVertex[1], currentVertex[2], 1.0f));
-			// Save the normal.
-			if (hasNormal)
-			{
-				int normalIndex = index;
-				if (normalElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
-				{
-					normalIndex = normalElement->GetIndexArray().GetAt(index);
-				}
-				currentNormal = normalElement->GetDirectArray().GetAt(normalIndex);
-				meshes->AddNormal(Vec3(currentNormal[0], currentNormal[1], currentNormal[2]));
-			}
-
-			// Save the UV.
-			if (hasUV)
-			{
-				int uvIndex = index;
-				if (uvElement->GetReferenceMode() == FbxLayerElement::eIndexToDirect)
-				{
-					uvIndex = uvElement->GetIndexArray().GetAt(index);
-				}
-				currentUV = uvElement->GetDirectArray().GetAt(uvIndex);
-				meshes->AddUV(Vec2(currentUV[0], currentUV[1]));
-			}
+			const FbxVector4& point = controlPoints[polygonVertices[i]];
+			outData.vertices[i] = Vec4(point[0], point[1], point[2], 1.0f);
+			outData.indices[i] = static_cast<uint32_t>(i);
 		}
+	}
+
+	if (normalElement)
+	{
+		ExtractLayer(normalElement, polygonVertices, vertexCount, allByControlPoint, outData.normals.data(),
+			[](const FbxVector4& normal) { return Vec3(normal[0], normal[1], normal[2]); });
+	}
+
+	if (uvElement)
+	{
+		ExtractLayer(uvElement, polygonVertices, vertexCount, allByControlPoint, outData.uvs.data(),
+			[](const FbxVector2& uv) { return Vec2(uv[0], uv[1]); });
+	}
 
+	ExtractSkin(mesh, allByControlPoint, outData);
+}
+
+void FBXHelper::ExtractSkin(FbxMesh* mesh, bool byControlPoint, FBXMeshData& outData)
+{
+	const int skinCount = mesh->GetDeformerCount(FbxDeformer::eSkin);
+	if (skinCount == 0)
+	{
+		return;
 	}
 
-	int vertexCount = 0;
-	for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex)
+	const int controlPointCount = mesh->GetControlPointsCount();
+
+	// Weights are stored per cluster (bone), gather them per control point
+	SkinWeightBuilder builder;
+	builder.Reset(static_cast<uint32_t>(controlPointCount));
+
+	for (int skinIdx = 0; skinIdx < skinCount; ++skinIdx)
 	{
-		for (int verticeIndex = 0; verticeIndex < TRIANGLE_VERTEX_COUNT; ++verticeIndex)
+		FbxSkin* skin = static_cast<FbxSkin*>(mesh->GetDeformer(skinIdx, FbxDeformer::eSkin));
+		for (int clusterIdx = 0; clusterIdx < skin->GetClusterCount(); ++clusterIdx)
 		{
-			const int controlPointIndex = mesh->GetPolygonVertex(polygonIndex, verticeIndex);
+			FbxCluster* cluster = skin->GetCluster(clusterIdx);
+			// Packed bone indices are 8 bit
+			if (!cluster->GetLink() || outData.bones.size() > UINT8_MAX)
+			{
+				continue;
+			}
+
+			const uint32_t boneIndex = static_cast<uint32_t>(outData.bones.size());
 
-			if (allByControlPoint)
+			FbxAMatrix meshBindPose;
+			FbxAMatrix boneBindPose;
+			cluster->GetTransformMatrix(meshBindPose);
+			cluster->GetTransformLinkMatrix(boneBindPose);
+			const FbxAMatrix inverseBindPose = boneBindPose.Inverse() * meshBindPose;
+
+			// FbxAMatrix rows are our columns (translation in row 3)
+			FBXBone bone;
+			bone.name = cluster->GetLink()->GetName();
+			for (int c = 0; c < 4; ++c)
 			{
-				meshes->AddIndex(controlPointIndex);
+				bone.inverseBindPose.c[c] = Math::Vec4(
+					static_cast<float>(inverseBindPose[c][0]),
+					static_cast<float>(inverseBindPose[c][1]),
+					static_cast<float>(inverseBindPose[c][2]),
+					static_cast<float>(inverseBindPose[c][3]));
 			}
-			// Populate the array with vertex attribute, if by polygon vertex.
-			else
+			outData.bones.push_back(bone);
+
+			const int influenceCount = cluster->GetControlPointIndicesCount();
+			const int* controlPoints = cluster->GetControlPointIndices();
+			const double* weights = cluster->GetControlPointWeights();
+			for (int i = 0; i < influenceCount; ++i)
 			{
-				currentVertex = controlPoints[controlPointIndex];
-
-				meshes->AddIndex(vertexCount);
-				meshes->AddVertex(Vec4(currentVertex[0], currentVertex[1], currentVertex[2], 1.0f));
-
-				if (hasNormal)
-				{
-					mesh->GetPolygonVertexNormal(polygonIndex, verticeIndex, currentNormal);				
-					meshes->AddNormal(Vec3(currentNormal[0], currentNormal[1], currentNormal[2]));
-				}
-
-				if (hasUV)
-				{
-					bool unmappedUV;
-					mesh->GetPolygonVertexUV(polygonIndex, verticeIndex, "", currentUV, unmappedUV);
-					meshes->AddUV(Vec2(currentUV[0], currentUV[1]));
-				}
+				builder.AddInfluence(static_cast<uint32_t>(controlPoints[i]), boneIndex, static_cast<float>(weights[i]));
 			}
-			++vertexCount;
+		}
+	}
+
+	if (outData.bones.empty())
+	{
+		return;
+	}
+
+	outData.truncatedInfluenceCount = builder.GetTruncatedVertexCount();
+
+	if (byControlPoint)
+	{
+		builder.Build(outData.skinWeights);
+	}
+	else
+	{
+		std::vector<SkinWeights> controlPointWeights;
+		builder.Build(controlPointWeights);
+
+		const int* polygonVertices = mesh->GetPolygonVertices();
+		outData.skinWeights.resize(outData.vertices.size());
+		for (size_t i = 0; i < outData.skinWeights.size(); ++i)
+		{
+			outData.skinWeights[i] = controlPointWeights[polygonVertices[i]];
 		}
 	}
 }
@@ -3,8 +3,36 @@
 #include "fbxsdk.h"
 #include "Globals.h"
 
+#include "Animation/AnimationClip.h"
+#include "Animation/Skinning.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
 class Meshes;
 
+// Skin cluster link, skinWeights index bones in the order they appear here
+struct FBXBone
+{
+	std::string name;
+	Math::Mat4 inverseBindPose;  // mesh bind space to bone space
+};
+
+// Attributes of one mesh in contiguous arrays, by control point or by polygon vertex
+struct FBXMeshData
+{
+	std::vector<Vec4> vertices;
+	std::vector<Vec3> normals;
+	std::vector<Vec2> uvs;
+	std::vector<uint32_t> indices;
+
+	// Empty if mesh has no skin deformer
+	std::vector<SkinWeights> skinWeights;
+	std::vector<FBXBone> bones;
+	uint32_t truncatedInfluenceCount{ 0 };  // vertices with more than 4 influences
+};
+
 class FBXHelper
 {
 public:
@@ -16,9 +44,21 @@ public:
 	bool Initialize();
 	bool LoadFBX(const char* fbxFileName, Meshes* meshes);
 
+	// One entry per mesh node in scene order, meshes are extracted in parallel
+	bool LoadFBX(const char* fbxFileName, std::vector<FBXMeshData>& outMeshes);
+
+	// One clip per take (anim stack), local transforms of every skeleton node sampled at a fixed rate
+	bool LoadAnimations(const char* fbxFileName, std::vector<RawAnimationClip>& outClips, float sampleRate = 30.0f);
+
 protected:    
-	void ProcessNode(FbxNode* node, Meshes* meshes);
-	void ProcessMesh(FbxMesh* mesh, Meshes* meshes);
+	bool ImportScene(const char* fbxFileName);
+
+	// Gather mesh nodes first (serial, scene graph access), triangulated if needed
+	void CollectMeshes(FbxNode* node, std::vector<FbxMesh*>& outMeshes);
+	// Only reads its own mesh, safe to run for different meshes at once
+	static void ExtractMesh(FbxMesh* mesh, FBXMeshData& outData);
+	static void ExtractSkin(FbxMesh* mesh, bool byControlPoint, FBXMeshData& outData);
+	void CollectSkeletonNodes(FbxNode* node, std::vector<FbxNode*>& outNodes);
 
 	void ReadVertex(FbxMesh* mesh, int ctrlPointIndex, Vec3* vertex);
 	void ReadNormal(FbxMesh* mesh, int ctrlPointIndex, int vertexCounter, Vec3* normal);
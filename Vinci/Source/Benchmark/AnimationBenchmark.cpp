@@ -0,0 +1,114 @@
+// AnimationClip compression round trip on a synthetic clip, root bone travels +-100 units.
+// Fails if a sampled frame is off its raw transform by more than the compression settings allow.
+
+#include "Animation/AnimationClip.h"
+#include "Base/TaskSystem.h"
+#include "Base/Timer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static const uint32_t BONE_COUNT = 67;
+static const uint32_t FRAME_COUNT = 300;
+static const float SAMPLE_RATE = 30.0f;
+static const float ROOT_TRAVEL = 100.0f;
+
+static RawAnimationClip MakeClip()
+{
+	RawAnimationClip clip;
+	clip.name = "Synthetic";
+	clip.sampleRate = SAMPLE_RATE;
+	clip.frameCount = FRAME_COUNT;
+	clip.tracks.resize(BONE_COUNT);
+
+	for (uint32_t bone = 0; bone < BONE_COUNT; ++bone)
+	{
+		RawAnimationClip::BoneTrack& track = clip.tracks[bone];
+		track.boneName = "Bone" + std::to_string(bone);
+
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			const float t = frame / SAMPLE_RATE;
+			const float phase = 0.37f * bone;
+
+			// Root sweeps the whole range, other bones stay close to their parent
+			Math::Vec4 translation = bone == 0 ?
+				Math::Vec4(ROOT_TRAVEL * sinf(t * 0.7f), 0.5f * ROOT_TRAVEL * cosf(t * 1.3f), -ROOT_TRAVEL + 2.0f * ROOT_TRAVEL * frame / (FRAME_COUNT - 1), 1.0f) :
+				Math::Vec4(0.1f * sinf(t + phase), 0.25f + 0.02f * cosf(2.0f * t + phase), 0.0f, 1.0f);
+			track.translations.push_back(translation);
+
+			const float halfAngle = 0.5f * sinf(1.5f * t + phase);
+			const float axisLength = sqrtf(1.0f + 0.25f + 0.09f);
+			track.rotations.push_back(Math::Quat(sinf(halfAngle) / axisLength, 0.5f * sinf(halfAngle) / axisLength, 0.3f * sinf(halfAngle) / axisLength, cosf(halfAngle)));
+
+			const float scale = bone % 8 == 0 ? 1.0f + 0.2f * sinf(t + phase) : 1.0f;
+			track.scales.push_back(Math::Vec4(scale, scale, scale, 0.0f));
+		}
+	}
+	return clip;
+}
+
+static float VectorError(float x, float y, float z, const Math::Vec4& raw)
+{
+	return std::max(std::max(fabsf(x - raw.x), fabsf(y - raw.y)), fabsf(z - raw.z));
+}
+
+// Same chord based angle the compressor measures with
+static float RotationError(float x, float y, float z, float w, const Math::Quat& raw)
+{
+	const double sign = x * raw.x + y * raw.y + z * raw.z + w * raw.w < 0.0f ? -1.0 : 1.0;
+	const double dx = x - raw.x * sign, dy = y - raw.y * sign, dz = z - raw.z * sign, dw = w - raw.w * sign;
+	return static_cast<float>(4.0 * asin(std::min(sqrt(dx * dx + dy * dy + dz * dz + dw * dw) * 0.5, 1.0)));
+}
+
+int main()
+{
+	Gear::Timer::Initialize();
+	Gear::TaskSystem::Get().Initialize();
+
+	printf("[AnimationBenchmark] %u bones, %u frames, AVX2: %d, SSE4: %d\n", BONE_COUNT, FRAME_COUNT, MATH_SIMD_AVX2, MATH_SIMD_SSE4);
+
+	const RawAnimationClip raw = MakeClip();
+	const AnimationCompressionSettings settings;
+
+	AnimationClip clip;
+	clip.Compress(raw, settings);
+
+	// Every raw frame, played forward like a character would
+	float maxTranslationError = 0.0f, maxRotationError = 0.0f, maxScaleError = 0.0f;
+	AnimationPose pose;
+	for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		clip.SamplePose(frame / SAMPLE_RATE, pose);
+		for (uint32_t bone = 0; bone < BONE_COUNT; ++bone)
+		{
+			const RawAnimationClip::BoneTrack& track = raw.tracks[bone];
+			maxTranslationError = std::max(maxTranslationError, VectorError(pose.translationX[bone], pose.translationY[bone], pose.translationZ[bone], track.translations[frame]));
+			maxRotationError = std::max(maxRotationError, RotationError(pose.rotationX[bone], pose.rotationY[bone], pose.rotationZ[bone], pose.rotationW[bone], Math::Normalize(track.rotations[frame])));
+			maxScaleError = std::max(maxScaleError, VectorError(pose.scaleX[bone], pose.scaleY[bone], pose.scaleZ[bone], track.scales[frame]));
+		}
+	}
+
+	const double sampleMs = Benchmark::Measure([&]()
+	{
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			clip.SamplePose((frame + 0.5f) / SAMPLE_RATE, pose);
+		}
+	});
+
+	const size_t rawSize = size_t(BONE_COUNT) * FRAME_COUNT * (sizeof(Math::Vec4) * 2 + sizeof(Math::Quat));
+	const bool bWithinBudget = maxTranslationError <= settings.translationError && maxRotationError <= settings.rotationError && maxScaleError <= settings.scaleError;
+	printf("keys %u, memory %zu KB (raw %zu KB), max error T %.2e R %.2e S %.2e, results %s\n",
+		clip.GetKeyCount(), clip.GetMemorySize() / 1024, rawSize / 1024, maxTranslationError, maxRotationError, maxScaleError,
+		bWithinBudget ? "within budget" : "OVER BUDGET");
+	printf("%-28s %8.1f ns per bone\n", "AnimationClip::SamplePose", sampleMs * 1e6 / (double(FRAME_COUNT) * BONE_COUNT));
+
+	Gear::TaskSystem::Get().Shutdown();
+
+	return bWithinBudget ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Base/Timer.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Timing and command line helpers of the benchmarks, Gear::Timer must be initialized
+namespace Benchmark
+{
+	static const int REPEAT_COUNT = 50;
+
+	// Best of repeatCount runs in milliseconds, one run before them warms up caches
+	template<typename TFunc>
+	double Measure(TFunc&& func, int repeatCount = REPEAT_COUNT)
+	{
+		func();
+
+		double best = 1e30;
+		for (int i = 0; i < repeatCount; ++i)
+		{
+			uint64_t begin = Gear::Timer::GetCycles();
+			func();
+			best = std::min(best, Gear::Timer::CyclesToMilliseconds(Gear::Timer::GetCycles() - begin));
+		}
+		return best;
+	}
+
+	// Object count given as first argument, defaultCount if there is none or it is not positive
+	template<typename TCount>
+	TCount ParseCount(int argc, char** argv, TCount defaultCount)
+	{
+		return argc > 1 && atoi(argv[1]) > 0 ? static_cast<TCount>(atoi(argv[1])) : defaultCount;
+	}
+}
@@ -0,0 +1,92 @@
+// FrustumCuller against a plain per object loop, budget is 0.5 ms for 100k objects.
+
+#include "Scene/FrustumCulling.h"
+#include "Base/TaskSystem.h"
+#include "Base/Timer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static uint32_t OBJECT_COUNT = 100000;
+static const double CULL_BUDGET_MILLISECONDS = 0.5;
+
+int main(int argc, char** argv)
+{
+	Gear::Timer::Initialize();
+	Gear::TaskSystem::Get().Initialize();
+
+	OBJECT_COUNT = Benchmark::ParseCount(argc, argv, OBJECT_COUNT);
+
+	printf("[CullingBenchmark] %u objects, %u threads, AVX2: %d, SSE4: %d\n", OBJECT_COUNT, Gear::TaskSystem::Get().GetConcurrency(), MATH_SIMD_AVX2, MATH_SIMD_SSE4);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.1f, 4.0f);
+
+	FrustumCuller culler;
+	culler.Reserve(OBJECT_COUNT);
+
+	std::vector<Math::Vec4> centers(OBJECT_COUNT);
+	std::vector<float> radii(OBJECT_COUNT);
+	for (uint32_t i = 0; i < OBJECT_COUNT; ++i)
+	{
+		centers[i] = Math::Vec4(position(rng), position(rng), position(rng), 1.0f);
+		radii[i] = size(rng);
+		culler.AddSphere(centers[i], radii[i]);
+	}
+
+	// Vulkan style projection (depth 0..1, y flipped) * look at
+	const float fovY = 0.8f, aspect = 1.6f, zNear = 0.1f, zFar = 150.0f;
+	const float focal = 1.0f / tanf(fovY * 0.5f);
+	Math::Mat4 projection = {};
+	projection.c[0] = Math::Vec4(focal / aspect, 0.0f, 0.0f, 0.0f);
+	projection.c[1] = Math::Vec4(0.0f, -focal, 0.0f, 0.0f);
+	projection.c[2] = Math::Vec4(0.0f, 0.0f, zFar / (zNear - zFar), -1.0f);
+	projection.c[3] = Math::Vec4(0.0f, 0.0f, zNear * zFar / (zNear - zFar), 0.0f);
+
+	// Camera at origin looking down -z, rotated a bit around y
+	Math::Mat4 view = Math::QuatToMat4(Math::QuatFromAxisAngle(Math::Vec4(0.0f, 1.0f, 0.0f, 0.0f), 0.3f));
+	Frustum frustum = Frustum::FromMatrix(projection * view);
+
+	std::vector<uint32_t> reference;
+	double scalarMs = Benchmark::Measure([&]()
+	{
+		reference.clear();
+		for (uint32_t i = 0; i < OBJECT_COUNT; ++i)
+		{
+			bool bVisible = true;
+			for (const Math::Vec4& plane : frustum.Planes)
+			{
+				bVisible = bVisible && Math::Dot3(plane, centers[i]) + plane.w >= -radii[i];
+			}
+			if (bVisible)
+			{
+				reference.push_back(i);
+			}
+		}
+	});
+
+	std::vector<uint32_t> visible;
+	double simdMs = Benchmark::Measure([&]() { culler.Cull(frustum, visible); });
+	bool bMatch = visible == reference;
+
+	double parallelMs = Benchmark::Measure([&]() { culler.CullParallel(frustum, visible); });
+	bMatch = bMatch && visible == reference;
+
+	printf("visible %zu, results %s\n", reference.size(), bMatch ? "match" : "MISMATCH");
+	printf("%-28s %8.3f ms\n", "scalar", scalarMs);
+	printf("%-28s %8.3f ms  x%.2f\n", "FrustumCuller::Cull", simdMs, scalarMs / simdMs);
+	printf("%-28s %8.3f ms  x%.2f\n", "FrustumCuller::CullParallel", parallelMs, scalarMs / parallelMs);
+
+	const double bestMs = std::min(simdMs, parallelMs);
+	printf("budget %.1f ms: %s\n", CULL_BUDGET_MILLISECONDS, bestMs <= CULL_BUDGET_MILLISECONDS ? "ok" : "EXCEEDED");
+
+	Gear::TaskSystem::Get().Shutdown();
+
+	return bMatch ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// Math.hpp against glm on the loops we care about, run with the same compiler flags as Vinci.
+// Fails if a result differs from glm beyond tolerance, so every SIMD path is checked where it is built.
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "Math/Math.hpp"
+#include "Base/Timer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+static size_t OBJECT_COUNT = 64 * 1024;
+
+// Relative to the larger magnitude, absolute below 1. FMA and operation order move the last bits only.
+static const float TOLERANCE = 1e-4f;
+
+// Keep results alive so loops are not optimized away
+static volatile float gSink = 0.0f;
+static uint32_t gMismatchCount = 0;
+
+static void Report(const char* name, double glmMs, double mathMs)
+{
+	printf("%-28s glm: %8.3f ms  Math: %8.3f ms  x%.2f\n", name, glmMs, mathMs, glmMs / mathMs);
+}
+
+// Values are compared one by one, stride floats apart in Math results so AoS and SoA share it
+static void Verify(const char* name, const float* glmValues, const float* mathValues, size_t count, size_t mathStride = 1)
+{
+	uint32_t mismatches = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float expected = glmValues[i];
+		const float actual = mathValues[i * mathStride];
+		const float scale = std::max({ 1.0f, fabsf(expected), fabsf(actual) });
+		if (!(fabsf(expected - actual) <= TOLERANCE * scale))
+		{
+			if (mismatches == 0)
+			{
+				printf("%s: value %zu is %g, glm has %g\n", name, i, actual, expected);
+			}
+			++mismatches;
+		}
+	}
+
+	if (mismatches > 0)
+	{
+		printf("%s: %u values MISMATCH glm\n", name, mismatches);
+		gMismatchCount += mismatches;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Gear::Timer::Initialize();
+
+	OBJECT_COUNT = Benchmark::ParseCount(argc, argv, OBJECT_COUNT);
+
+	printf("[MathBenchmark] %zu objects, AVX2: %d, SSE4: %d\n", OBJECT_COUNT, MATH_SIMD_AVX2, MATH_SIMD_SSE4);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+
+	std::vector<glm::mat4> glmMatrices(OBJECT_COUNT);
+	std::vector<Math::Mat4> mathMatrices(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; ++i)
+	{
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(dist(rng), dist(rng), dist(rng)));
+		m = glm::rotate(m, dist(rng), glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)) + glm::vec3(0.0f, 0.0f, 20.0f)));
+		m = glm::scale(m, glm::vec3(1.0f + dist(rng) * 0.05f));
+
+		glmMatrices[i] = m;
+		memcpy(&mathMatrices[i], &m, sizeof(m));
+	}
+
+	glm::mat4 glmParent = glm::perspective(0.8f, 1.6f, 0.1f, 100.0f) * glm::lookAt(glm::vec3(20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	Math::Mat4 mathParent;
+	memcpy(&mathParent, &glmParent, sizeof(glmParent));
+
+	std::vector<glm::mat4> glmOut(OBJECT_COUNT);
+	std::vector<Math::Mat4> mathOut(OBJECT_COUNT);
+
+	// 4x4 multiply
+	{
+		double glmMs = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				glmOut[i] = glmParent * glmMatrices[i];
+			}
+			gSink = gSink + glmOut[OBJECT_COUNT / 2][1][1];
+		});
+		double mathMs = Benchmark::Measure([&]()
+		{
+			Math::MultiplyMatrices(mathParent, mathMatrices.data(), mathOut.data(), OBJECT_COUNT);
+			gSink = gSink + mathOut[OBJECT_COUNT / 2][1][1];
+		});
+		Report("Mat4 multiply", glmMs, mathMs);
+		Verify("Mat4 multiply", &glmOut[0][0][0], &mathOut[0].c[0].x, OBJECT_COUNT * 16);
+	}
+
+	// 4x4 inverse
+	{
+		double glmMs = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				glmOut[i] = glm::inverse(glmMatrices[i]);
+			}
+			gSink = gSink + glmOut[OBJECT_COUNT / 2][1][1];
+		});
+		double mathMs = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				mathOut[i] = Math::Inverse(mathMatrices[i]);
+			}
+			gSink = gSink + mathOut[OBJECT_COUNT / 2][1][1];
+		});
+		Report("Mat4 inverse", glmMs, mathMs);
+		Verify("Mat4 inverse", &glmOut[0][0][0], &mathOut[0].c[0].x, OBJECT_COUNT * 16);
+	}
+
+	// Points, glm AoS against Math AoS and SoA
+	{
+		std::vector<glm::vec4> glmPoints(OBJECT_COUNT);
+		std::vector<Math::Vec4> mathPoints(OBJECT_COUNT);
+		std::vector<float> xs(OBJECT_COUNT), ys(OBJECT_COUNT), zs(OBJECT_COUNT);
+		for (size_t i = 0; i < OBJECT_COUNT; ++i)
+		{
+			glmPoints[i] = glm::vec4(dist(rng), dist(rng), dist(rng), 1.0f);
+			mathPoints[i] = Math::Vec4(glmPoints[i].x, glmPoints[i].y, glmPoints[i].z, 1.0f);
+			xs[i] = glmPoints[i].x;
+			ys[i] = glmPoints[i].y;
+			zs[i] = glmPoints[i].z;
+		}
+
+		std::vector<glm::vec4> glmPointsOut(OBJECT_COUNT);
+		std::vector<Math::Vec4> mathPointsOut(OBJECT_COUNT);
+		std::vector<float> outXs(OBJECT_COUNT), outYs(OBJECT_COUNT), outZs(OBJECT_COUNT);
+
+		double glmMs = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				glmPointsOut[i] = glmParent * glmPoints[i];
+			}
+			gSink = gSink + glmPointsOut[OBJECT_COUNT / 2].x;
+		});
+		double mathMs = Benchmark::Measure([&]()
+		{
+			Math::TransformPoints(mathParent, mathPoints.data(), mathPointsOut.data(), OBJECT_COUNT);
+			gSink = gSink + mathPointsOut[OBJECT_COUNT / 2].x;
+		});
+		double mathSoAMs = Benchmark::Measure([&]()
+		{
+			Math::TransformPointsSoA(mathParent, xs.data(), ys.data(), zs.data(), outXs.data(), outYs.data(), outZs.data(), OBJECT_COUNT);
+			gSink = gSink + outXs[OBJECT_COUNT / 2];
+		});
+		Report("Transform points (AoS)", glmMs, mathMs);
+		Report("Transform points (SoA)", glmMs, mathSoAMs);
+
+		Verify("Transform points (AoS)", &glmPointsOut[0].x, &mathPointsOut[0].x, OBJECT_COUNT * 4);
+
+		// w is 1 for affine transforms only, SoA drops it, glm values are picked out per component
+		std::vector<float> glmComponent(OBJECT_COUNT);
+		const float* mathComponents[] = { outXs.data(), outYs.data(), outZs.data() };
+		for (int component = 0; component < 3; ++component)
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				glmComponent[i] = glmPointsOut[i][component];
+			}
+			Verify("Transform points (SoA)", glmComponent.data(), mathComponents[component], OBJECT_COUNT);
+		}
+	}
+
+	// AABBs, glm transforms 8 corners which is what callers did without a dedicated helper
+	{
+		std::vector<Math::AABB> boxes(OBJECT_COUNT);
+		for (size_t i = 0; i < OBJECT_COUNT; ++i)
+		{
+			Math::Vec4 center(dist(rng), dist(rng), dist(rng), 1.0f);
+			Math::Vec4 extent(1.0f, 2.0f, 0.5f, 0.0f);
+			boxes[i].min = center - extent;
+			boxes[i].max = center + extent;
+		}
+
+		std::vector<Math::AABB> glmBoxes(OBJECT_COUNT);
+		std::vector<Math::AABB> outBoxes(OBJECT_COUNT);
+
+		double glmMs = Benchmark::Measure([&]()
+		{
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				const Math::AABB& box = boxes[i];
+				glm::vec3 boxMin(1e30f);
+				glm::vec3 boxMax(-1e30f);
+				for (int corner = 0; corner < 8; ++corner)
+				{
+					glm::vec4 p((corner & 1) ? box.max.x : box.min.x,
+						(corner & 2) ? box.max.y : box.min.y,
+						(corner & 4) ? box.max.z : box.min.z,
+						1.0f);
+					glm::vec3 world = glm::vec3(glmMatrices[i] * p);
+					boxMin = glm::min(boxMin, world);
+					boxMax = glm::max(boxMax, world);
+				}
+				glmBoxes[i].min = Math::Vec4(boxMin.x, boxMin.y, boxMin.z, 1.0f);
+				glmBoxes[i].max = Math::Vec4(boxMax.x, boxMax.y, boxMax.z, 1.0f);
+			}
+			gSink = gSink + glmBoxes[OBJECT_COUNT / 2].max.x;
+		});
+		double mathMs = Benchmark::Measure([&]()
+		{
+			Math::TransformAABBs(mathMatrices.data(), boxes.data(), outBoxes.data(), OBJECT_COUNT);
+			gSink = gSink + outBoxes[OBJECT_COUNT / 2].max.x;
+		});
+		Report("Transform AABBs", glmMs, mathMs);
+
+		// w of transformed boxes is left to the implementation, xyz of both corners are compared
+		for (int component = 0; component < 3; ++component)
+		{
+			std::vector<float> glmCorner(OBJECT_COUNT * 2);
+			for (size_t i = 0; i < OBJECT_COUNT; ++i)
+			{
+				glmCorner[i * 2] = (&glmBoxes[i].min.x)[component];
+				glmCorner[i * 2 + 1] = (&glmBoxes[i].max.x)[component];
+			}
+			Verify("Transform AABBs", glmCorner.data(), &outBoxes[0].min.x + component, OBJECT_COUNT * 2, 4);
+		}
+	}
+
+	printf("results %s\n", gMismatchCount == 0 ? "match glm" : "MISMATCH glm");
+	return gMismatchCount == 0 ? 0 : 1;
+}
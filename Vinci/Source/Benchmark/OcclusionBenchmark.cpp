@@ -0,0 +1,163 @@
+// OcclusionCuller on a tessellated wall in front of random spheres, runs on CPU only.
+// Fails if a sphere with a point in front of the wall or outside of its silhouette is culled,
+// reports how many spheres behind it are.
+
+#include "Scene/OcclusionCulling.h"
+#include "Base/TaskSystem.h"
+#include "Base/Timer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static uint32_t OBJECT_COUNT = 100000;
+
+static const uint32_t DEPTH_WIDTH = 256;
+static const uint32_t DEPTH_HEIGHT = 128;
+
+// Wall at z = WALL_Z, WALL_QUADS x WALL_QUADS quads so there is something to bin. Turned around
+// the view axis so its edges cross pixels at any offset.
+static const float WALL_Z = -30.0f;
+static const float WALL_HALF_SIZE = 15.0f;
+static const float WALL_ANGLE = 0.3f;
+static const uint32_t WALL_QUADS = 96;
+
+// Position in the plane of the wall, axes along its edges
+static void ToWallAxes(float x, float y, float& outU, float& outV)
+{
+	outU = x * cosf(WALL_ANGLE) + y * sinf(WALL_ANGLE);
+	outV = -x * sinf(WALL_ANGLE) + y * cosf(WALL_ANGLE);
+}
+
+int main(int argc, char** argv)
+{
+	Gear::Timer::Initialize();
+	Gear::TaskSystem::Get().Initialize();
+
+	OBJECT_COUNT = Benchmark::ParseCount(argc, argv, OBJECT_COUNT);
+
+	printf("[OcclusionBenchmark] %u objects, %u threads, AVX2: %d, SSE4: %d\n", OBJECT_COUNT, Gear::TaskSystem::Get().GetConcurrency(), MATH_SIMD_AVX2, MATH_SIMD_SSE4);
+
+	std::vector<float> positions;
+	std::vector<uint32_t> indices;
+	for (uint32_t y = 0; y <= WALL_QUADS; ++y)
+	{
+		for (uint32_t x = 0; x <= WALL_QUADS; ++x)
+		{
+			const float u = -WALL_HALF_SIZE + 2.0f * WALL_HALF_SIZE * x / WALL_QUADS;
+			const float v = -WALL_HALF_SIZE + 2.0f * WALL_HALF_SIZE * y / WALL_QUADS;
+			positions.push_back(u * cosf(WALL_ANGLE) - v * sinf(WALL_ANGLE));
+			positions.push_back(u * sinf(WALL_ANGLE) + v * cosf(WALL_ANGLE));
+			positions.push_back(WALL_Z);
+		}
+	}
+	for (uint32_t y = 0; y < WALL_QUADS; ++y)
+	{
+		for (uint32_t x = 0; x < WALL_QUADS; ++x)
+		{
+			const uint32_t corner = y * (WALL_QUADS + 1) + x;
+			indices.insert(indices.end(), { corner, corner + 1, corner + WALL_QUADS + 2, corner, corner + WALL_QUADS + 2, corner + WALL_QUADS + 1 });
+		}
+	}
+
+	OcclusionCuller culler;
+	culler.Initialize(DEPTH_WIDTH, DEPTH_HEIGHT);
+	culler.AddOccluder(Math::Mat4::Identity(), positions.data(), static_cast<uint32_t>(positions.size() / 3), 3 * sizeof(float), indices.data(), static_cast<uint32_t>(indices.size()));
+
+	// Vulkan style projection (depth 0..1, y flipped), camera at origin looking down -z
+	const float fovY = 0.8f, aspect = 2.0f, zNear = 0.1f, zFar = 150.0f;
+	const float focal = 1.0f / tanf(fovY * 0.5f);
+	Math::Mat4 projection = {};
+	projection.c[0] = Math::Vec4(focal / aspect, 0.0f, 0.0f, 0.0f);
+	projection.c[1] = Math::Vec4(0.0f, -focal, 0.0f, 0.0f);
+	projection.c[2] = Math::Vec4(0.0f, 0.0f, zFar / (zNear - zFar), -1.0f);
+	projection.c[3] = Math::Vec4(0.0f, 0.0f, zNear * zFar / (zNear - zFar), 0.0f);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> lateral(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> depth(-80.0f, -5.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	std::vector<Math::Vec4> spheres(OBJECT_COUNT);
+	for (Math::Vec4& sphere : spheres)
+	{
+		sphere = Math::Vec4(lateral(rng), lateral(rng), depth(rng), size(rng));
+	}
+
+	std::vector<uint32_t> visible;
+	double renderMs = Benchmark::Measure([&]() { culler.Render(projection); });
+	double testMs = Benchmark::Measure([&]()
+	{
+		visible.resize(OBJECT_COUNT);
+		for (uint32_t i = 0; i < OBJECT_COUNT; ++i)
+		{
+			visible[i] = i;
+		}
+		culler.CullSpheres(spheres.data(), visible);
+	});
+
+	// A point on screen is seen if it is in front of the wall or its ray passes beside the wall
+	auto isPointSeen = [&](float x, float y, float z)
+	{
+		if (!(-z > zNear && fabsf(x) * focal / aspect < -z && fabsf(y) * focal < -z))
+		{
+			return false;
+		}
+
+		float u, v;
+		ToWallAxes(x, y, u, v);
+		const float scale = WALL_Z / z;
+		return z > WALL_Z || fabsf(u) * scale >= WALL_HALF_SIZE || fabsf(v) * scale >= WALL_HALF_SIZE;
+	};
+
+	// Spheres with a seen point on their axes must stay, even if it is in a pixel the wall partly covers.
+	// Spheres fully behind the wall and inside of its silhouette (wall shrunk by the sphere radius at wall
+	// depth, by similar triangles) should go.
+	uint32_t wronglyCulled = 0, behindCount = 0, behindCulled = 0;
+	for (uint32_t i = 0, visibleIdx = 0; i < OBJECT_COUNT; ++i)
+	{
+		const Math::Vec4& sphere = spheres[i];
+		const bool bCulled = visibleIdx >= visible.size() || visible[visibleIdx] != i;
+		visibleIdx += bCulled ? 0 : 1;
+
+		bool bSeen = isPointSeen(sphere.x, sphere.y, sphere.z);
+		for (uint32_t axis = 0; axis < 3 && !bSeen; ++axis)
+		{
+			for (float sign : { -1.0f, 1.0f })
+			{
+				float point[3] = { sphere.x, sphere.y, sphere.z };
+				point[axis] += sign * sphere.w;
+				bSeen = bSeen || isPointSeen(point[0], point[1], point[2]);
+			}
+		}
+
+		if (bSeen)
+		{
+			wronglyCulled += bCulled ? 1 : 0;
+		}
+		else if (sphere.z + sphere.w < WALL_Z)
+		{
+			float u, v;
+			ToWallAxes(sphere.x, sphere.y, u, v);
+			const float scale = WALL_Z / (sphere.z + sphere.w);
+			if ((fabsf(u) + sphere.w) * scale < WALL_HALF_SIZE && (fabsf(v) + sphere.w) * scale < WALL_HALF_SIZE)
+			{
+				++behindCount;
+				behindCulled += bCulled ? 1 : 0;
+			}
+		}
+	}
+
+	const bool bConservative = wronglyCulled == 0;
+	printf("occluder triangles %u, visible %zu, wrongly culled %u, hidden behind wall culled %u/ %u, results %s\n", culler.GetOccluderTriangleCount(), visible.size(), wronglyCulled, behindCulled, behindCount, bConservative ? "conservative" : "WRONGLY CULLED");
+	printf("%-28s %8.3f ms\n", "OcclusionCuller::Render", renderMs);
+	printf("%-28s %8.3f ms\n", "OcclusionCuller::CullSpheres", testMs);
+
+	Gear::TaskSystem::Get().Shutdown();
+
+	return bConservative ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+// TransformHierarchy against a naive recursive evaluation, over frames that move, reparent, create and destroy nodes.
+// Fails if a world matrix differs from the recursive one or a destroyed node stays valid.
+
+#include "Scene/TransformHierarchy.h"
+#include "Base/TaskSystem.h"
+#include "Base/Timer.h"
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+static uint32_t NODE_COUNT = 100000;
+static const uint32_t ROOT_COUNT = 100;
+static const uint32_t MAX_DEPTH = 12;
+static const int FRAME_COUNT = 20;
+
+// Per frame, fractions of the node count
+static const float MOVE_RATIO = 0.02f;
+static const float REPARENT_RATIO = 0.0005f;
+static const float DESTROY_RATIO = 0.0002f;
+
+// Same operations in the same order on both sides, so only the last bits may move
+static const float TOLERANCE = 1e-4f;
+
+// What the hierarchy should hold, indexed by handle
+struct ReferenceNode
+{
+	TransformHierarchy::NodeHandle parent;
+	Math::Vec4 translation;
+	Math::Quat rotation;
+	Math::Vec4 scale;
+	bool bAlive;
+};
+
+static Math::Mat4 EvaluateWorld(const std::vector<ReferenceNode>& nodes, TransformHierarchy::NodeHandle node)
+{
+	const ReferenceNode& reference = nodes[node];
+	Math::Mat4 local = Math::ComposeTransform(reference.translation, reference.rotation, reference.scale);
+	return reference.parent == TransformHierarchy::INVALID_INDEX ? local : EvaluateWorld(nodes, reference.parent) * local;
+}
+
+static uint32_t GetDepth(const std::vector<ReferenceNode>& nodes, TransformHierarchy::NodeHandle node)
+{
+	uint32_t depth = 0;
+	for (TransformHierarchy::NodeHandle parent = nodes[node].parent; parent != TransformHierarchy::INVALID_INDEX; parent = nodes[parent].parent)
+	{
+		++depth;
+	}
+	return depth;
+}
+
+static bool IsInSubtree(const std::vector<ReferenceNode>& nodes, TransformHierarchy::NodeHandle node, TransformHierarchy::NodeHandle subtreeRoot)
+{
+	for (; node != TransformHierarchy::INVALID_INDEX; node = nodes[node].parent)
+	{
+		if (node == subtreeRoot)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	Gear::Timer::Initialize();
+	Gear::TaskSystem::Get().Initialize();
+
+	NODE_COUNT = Benchmark::ParseCount(argc, argv, NODE_COUNT);
+
+	printf("[TransformBenchmark] %u nodes, %u threads, AVX2: %d, SSE4: %d\n", NODE_COUNT, Gear::TaskSystem::Get().GetConcurrency(), MATH_SIMD_AVX2, MATH_SIMD_SSE4);
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> angle(-3.14159265f, 3.14159265f);
+	std::uniform_real_distribution<float> size(0.5f, 1.5f);
+
+	auto randomRotation = [&]()
+	{
+		const float halfAngle = angle(rng) * 0.5f;
+		Math::Vec4 axis = Math::Vec4(position(rng), position(rng), position(rng) + 20.0f, 0.0f);
+		const float invLength = 1.0f / Math::Length3(axis);
+		return Math::Quat(axis.x * invLength * sinf(halfAngle), axis.y * invLength * sinf(halfAngle), axis.z * invLength * sinf(halfAngle), cosf(halfAngle));
+	};
+
+	TransformHierarchy hierarchy;
+	std::vector<ReferenceNode> reference;
+	std::vector<TransformHierarchy::NodeHandle> alive;
+
+	auto createNode = [&](TransformHierarchy::NodeHandle parent)
+	{
+		ReferenceNode node = { parent, Math::Vec4(position(rng), position(rng), position(rng), 1.0f), randomRotation(), Math::Vec4(size(rng), size(rng), size(rng), 0.0f), true };
+		TransformHierarchy::NodeHandle handle = hierarchy.CreateNode(parent, node.translation, node.rotation, node.scale);
+
+		reference.resize(std::max<size_t>(reference.size(), handle + 1));
+		reference[handle] = node;
+		alive.push_back(handle);
+	};
+
+	// Random parents among earlier nodes, deep chains are cut at MAX_DEPTH
+	auto pickParent = [&]()
+	{
+		TransformHierarchy::NodeHandle parent = alive[rng() % alive.size()];
+		return GetDepth(reference, parent) + 1 < MAX_DEPTH ? parent : TransformHierarchy::INVALID_INDEX;
+	};
+
+	for (uint32_t i = 0; i < NODE_COUNT; ++i)
+	{
+		createNode(i < ROOT_COUNT ? TransformHierarchy::INVALID_INDEX : pickParent());
+	}
+
+	uint64_t begin = Gear::Timer::GetCycles();
+	hierarchy.Update();
+	const double fullUpdateMs = Gear::Timer::CyclesToMilliseconds(Gear::Timer::GetCycles() - begin);
+
+	uint32_t mismatchCount = 0;
+	uint32_t staleHandleCount = 0;
+	double frameUpdateMs = 0.0;
+	double naiveMs = 0.0;
+	uint64_t updatedCount = 0;
+
+	for (int frame = 0; frame <= FRAME_COUNT; ++frame)
+	{
+		// First round checks the initial build only
+		std::vector<TransformHierarchy::NodeHandle> destroyed;
+		if (frame > 0)
+		{
+			const uint32_t nodeCount = static_cast<uint32_t>(alive.size());
+			for (uint32_t i = 0; i < static_cast<uint32_t>(nodeCount * MOVE_RATIO); ++i)
+			{
+				TransformHierarchy::NodeHandle node = alive[rng() % nodeCount];
+				reference[node].translation = Math::Vec4(position(rng), position(rng), position(rng), 1.0f);
+				reference[node].rotation = randomRotation();
+				hierarchy.SetLocalTransform(node, reference[node].translation, reference[node].rotation, reference[node].scale);
+			}
+
+			// Roots too, parents inside the moved subtree are rejected
+			for (uint32_t i = 0; i < static_cast<uint32_t>(nodeCount * REPARENT_RATIO); ++i)
+			{
+				TransformHierarchy::NodeHandle node = alive[rng() % nodeCount];
+				TransformHierarchy::NodeHandle parent = (i % 4 == 0) ? TransformHierarchy::INVALID_INDEX : alive[rng() % nodeCount];
+
+				bool bRejected = false;
+				try
+				{
+					hierarchy.SetParent(node, parent);
+				}
+				catch (const std::invalid_argument&)
+				{
+					bRejected = true;
+				}
+
+				const bool bCycle = parent != TransformHierarchy::INVALID_INDEX && IsInSubtree(reference, parent, node);
+				if (bRejected != bCycle)
+				{
+					printf("frame %d: SetParent(%u, %u) %s\n", frame, node, parent, bRejected ? "rejected a valid parent" : "accepted a cycle");
+					++mismatchCount;
+				}
+				if (!bCycle)
+				{
+					reference[node].parent = parent;
+				}
+			}
+
+			// Whole subtrees go, children created under a destroyed node until Update() go with it
+			for (uint32_t i = 0; i < std::max(static_cast<uint32_t>(nodeCount * DESTROY_RATIO), 1u); ++i)
+			{
+				TransformHierarchy::NodeHandle node = alive[rng() % nodeCount];
+				hierarchy.DestroyNode(node);
+				destroyed.push_back(node);
+			}
+			createNode(destroyed[0]);
+
+			// Replace what is gone, new nodes reuse handles freed by last Update()
+			for (TransformHierarchy::NodeHandle node : alive)
+			{
+				for (TransformHierarchy::NodeHandle root : destroyed)
+				{
+					if (IsInSubtree(reference, node, root))
+					{
+						reference[node].bAlive = false;
+						break;
+					}
+				}
+			}
+			alive.erase(std::remove_if(alive.begin(), alive.end(), [&](TransformHierarchy::NodeHandle node) { return !reference[node].bAlive; }), alive.end());
+
+			while (alive.size() < nodeCount)
+			{
+				createNode(pickParent());
+			}
+
+			begin = Gear::Timer::GetCycles();
+			hierarchy.Update();
+			frameUpdateMs += Gear::Timer::CyclesToMilliseconds(Gear::Timer::GetCycles() - begin);
+			updatedCount += hierarchy.GetLastUpdatedCount();
+		}
+
+		if (hierarchy.GetNodeCount() != alive.size())
+		{
+			printf("frame %d: %u nodes, %zu expected\n", frame, hierarchy.GetNodeCount(), alive.size());
+			++mismatchCount;
+		}
+
+		for (TransformHierarchy::NodeHandle node = 0; node < reference.size(); ++node)
+		{
+			if (!reference[node].bAlive && hierarchy.IsValid(node))
+			{
+				++staleHandleCount;
+			}
+		}
+
+		begin = Gear::Timer::GetCycles();
+		for (TransformHierarchy::NodeHandle node : alive)
+		{
+			const Math::Mat4 expected = EvaluateWorld(reference, node);
+			const Math::Mat4& actual = hierarchy.GetWorldMatrix(node);
+
+			bool bMatch = hierarchy.GetParent(node) == reference[node].parent;
+			for (int i = 0; i < 16 && bMatch; ++i)
+			{
+				const float e = (&expected.c[0].x)[i];
+				const float a = (&actual.c[0].x)[i];
+				bMatch = fabsf(e - a) <= TOLERANCE * std::max({ 1.0f, fabsf(e), fabsf(a) });
+			}
+
+			if (!bMatch)
+			{
+				if (mismatchCount == 0)
+				{
+					printf("frame %d: node %u differs from recursive evaluation\n", frame, node);
+				}
+				++mismatchCount;
+			}
+		}
+		naiveMs += Gear::Timer::CyclesToMilliseconds(Gear::Timer::GetCycles() - begin);
+	}
+
+	const bool bPassed = mismatchCount == 0 && staleHandleCount == 0;
+	printf("levels %u, nodes updated per frame %.0f (%.1f%%), mismatches %u, stale handles %u, results %s\n",
+		hierarchy.GetLevelCount(), double(updatedCount) / FRAME_COUNT, 100.0 * updatedCount / FRAME_COUNT / NODE_COUNT,
+		mismatchCount, staleHandleCount, bPassed ? "match" : "MISMATCH");
+	printf("%-32s %8.3f ms\n", "Update (all nodes)", fullUpdateMs);
+	printf("%-32s %8.3f ms\n", "Update (per frame)", frameUpdateMs / FRAME_COUNT);
+	printf("%-32s %8.3f ms\n", "Recursive evaluation (per frame)", naiveMs / (FRAME_COUNT + 1));
+
+	Gear::TaskSystem::Get().Shutdown();
+
+	return bPassed ? 0 : 1;
+}
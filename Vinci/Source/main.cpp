@@ -14,14 +14,35 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <set>
-#include <fstream>
 #include <algorithm>
 #include <array>
-
-#include <chrono>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <sstream>
+#include <map>
+
+#include "Base/Timer.h"
+#include "Base/Command.hpp"
+#include "Base/FileSystem.h"
+#include "Base/TaskSystem.h"
+
+#include "Gfx/BindlessDescriptors.h"
+#include "Gfx/DeletionQueue.h"
+#include "Gfx/DescriptorAllocator.h"
+#include "Gfx/GfxInstanceData.h"
+#include "Gfx/RenderGraph.h"
+#include "Mesh/MeshLod.h"
+#include "Texture/TextureStreamer.h"
+#include "Scene/TransformHierarchy.h"
+#include "Scene/FrustumCulling.h"
+#include "Scene/OcclusionCulling.h"
 
 //// TODO: use glm as math library for now, this lib may be replaced or re-implement later.
 typedef glm::vec2 Vector2;
@@ -34,13 +55,85 @@ const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 const char* APPNAME = "VINCI";
 
-const char* DUMMY_VERTEX_SHADER   = "../Assets/Shader/vert.spv";
-const char* DUMMY_FRAGMENT_SHADER = "../Assets/Shader/frag.spv";
-const char* DUMMY_MESH            = "../Assets/Mesh/TheRocket.obj";
-const char* DUMMY_MESH_DIFFUSE    = "../Assets/Mesh/T_TheRocket_D.png";
-const char* PLACEHOLDER_TEXTURE   = "../Assets/Texture/placeholder.jpg";
+// Assets are read from ASSET_PAK when it exists, loose files under ASSET_ROOT fill in the rest during development.
+// Run with --pak once everything is cooked to pack ASSET_ROOT, asset paths below are relative to it.
+const char* ASSET_ROOT            = "../Assets/";
+const char* ASSET_PAK             = "../Assets.pak";
+
+const char* DUMMY_VERTEX_SHADER   = "Shader/vert.spv";
+const char* DUMMY_FRAGMENT_SHADER = "Shader/frag.spv";
+const char* BINDLESS_FRAGMENT_SHADER = "Shader/bindless_frag.spv";
+const char* CULL_INSTANCES_SHADER = "Shader/cull.spv";
+const char* COMPACT_DRAWS_SHADER  = "Shader/compact.spv";
+const char* CLUSTER_CULL_SHADER   = "Shader/clustercull.spv";
+const char* DUMMY_MESH            = "Mesh/TheRocket.obj";
+const char* DUMMY_MESH_COOKED     = "Mesh/TheRocket.lod";
+const char* DUMMY_MESH_DIFFUSE    = "Mesh/T_TheRocket_D.png";
+const char* DUMMY_MESH_DIFFUSE_COOKED = "Mesh/T_TheRocket_D.tex";
+const char* PLACEHOLDER_TEXTURE   = "Texture/placeholder.jpg";
+
+// Frames are paced by one timeline semaphore, it counts completed frames. CPU records and submits up to
+// framesInFlight (--frames-in-flight 1..4) frames ahead of GPU, more overlap costs a frame of input latency each.
+//  |- Throughput: GPU may queue every frame in flight, CPU and GPU never wait for each other while there is room
+//  |- LowLatency (--low-latency): frame is prepared while GPU renders the previous one but only submitted once
+//     that one completed, GPU never queues more than one frame
+// Late latching (--late-latching) makes the game thread wait for the previous frame's GPU completion before it
+// samples input, so input is as fresh as possible when the frame starts, at the cost of CPU/ GPU overlap.
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+enum class FramePacing
+{
+	Throughput,
+	LowLatency,
+};
 
-const int MAX_FRAMES_IN_SWAPCHAIN = 2;
+// Headless mode (--headless) renders a fixed number of frames into offscreen images, no window, surface or present.
+// Runs on machines without display or GPU (lavapipe), e.g. for frame time benchmarks. Scene advances by a fixed
+// step per frame instead of wall time, so the captured last frame is the same on every run.
+const uint32_t HEADLESS_DEFAULT_FRAMES = 600;
+const double HEADLESS_FRAME_SECONDS = 1.0 / 60.0;
+
+// Dummy mesh is instanced on a N x N grid, every instance is fetched from storage buffer by gl_InstanceIndex
+const uint32_t INSTANCE_COUNT_PER_AXIS = 1;
+const float INSTANCE_SPACING = 2.0f;
+
+// LOD of every instance is picked from its projected size, so its simplification error stays under
+// LOD_PIXEL_ERROR pixels. Coarser LOD is only taken LOD_HYSTERESIS below its threshold to avoid popping.
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_HYSTERESIS = 0.1f;
+
+// Textures keep their small mips resident and stream finer ones by projected size of their instances,
+// resident mips of all textures stay under the budget
+const uint64_t TEXTURE_STREAMING_BUDGET = 64ull << 20;
+
+// Cull instances and build indirect draws on GPU, draw submission cost does not grow with the scene.
+// Needs drawIndirectCount (Vulkan 1.2) and multiDrawIndirect, falls back to CPU recorded draws otherwise.
+const bool ENABLE_GPU_DRIVEN_CULLING = true;
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// CPU culling rasterizes the largest instances into a small depth buffer and drops instances hidden behind them
+// before their draws are written. Occluders are picked by bounding radius until the triangle budget is spent.
+const bool ENABLE_OCCLUSION_CULLING = true;
+const uint32_t OCCLUSION_BUFFER_WIDTH = 256;
+const uint32_t OCCLUSION_BUFFER_HEIGHT = 128;
+const uint32_t OCCLUDER_TRIANGLE_BUDGET = 64 * 1024;
+
+// Culling goes to a compute only queue family where there is one, so it overlaps with graphics of the previous
+// frame. Graphics waits for it by a timeline semaphore, per swap chain image buffers change queue family in between.
+const bool ENABLE_ASYNC_COMPUTE = true;
+
+// Textures and buffers are picked by index from one update-after-bind set, fragment shader reads them through the
+// material table by material ID. Needs descriptor indexing (Vulkan 1.2), falls back to one sampler per set otherwise.
+// Capacities are clamped to the update-after-bind limits of the device.
+const bool ENABLE_BINDLESS = true;
+const uint32_t BINDLESS_MAX_TEXTURES = 4096;
+const uint32_t BINDLESS_MAX_BUFFERS = 256;
+const uint32_t MATERIAL_TABLE_BUFFER = 0;
+
+// Submit from a dedicated render thread, game thread only records render commands.
+// Commands are executed inline on the game thread if disabled, which is handy for debugging.
+const bool ENABLE_RENDER_THREAD = true;
 
 const std::vector<const char*> DEVICE_EXTENSIONS = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
@@ -105,6 +198,10 @@ struct QueueFamilyIndices
 	int graphicsFamily = -1;
 	int presentFamily = -1;
 
+	// Dedicated families, -1 if the device has none. Transfer family is found but not used yet.
+	int computeFamily = -1;		// compute without graphics
+	int transferFamily = -1;	// transfer without graphics and compute
+
 	bool IsComplete()
 	{
 		return graphicsFamily >= 0 && presentFamily >= 0;
@@ -125,6 +222,54 @@ struct UniformBuffer
     Matrix4 projection;
 };
 
+// Same layout as CullBatch in CullInstances.comp/ CompactDraws.comp/ ClusterCull.comp
+struct CullBatch
+{
+	uint32_t lodCount;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+	uint32_t meshletCount;	// LOD 0 of meshes with meshlets draws per cluster
+	Vector4 boundingSphere;
+	uint32_t lodFirstIndex[MESH_MAX_LODS];
+	uint32_t lodIndexCount[MESH_MAX_LODS];
+	float lodScreenRadius[MESH_MAX_LODS];
+	uint32_t firstMeshlet;
+	uint32_t firstClusterInstance;	// visible list region of the first meshlet, see GetClusterFirstInstance()
+	uint32_t instanceCount;
+	uint32_t padding;
+};
+
+// Camera comes from uniform buffer, these only change with swap chain
+struct CullConstants
+{
+	uint32_t instanceCount;
+	uint32_t batchCount;
+	float viewportHalfHeight;
+	float lodHysteresis;
+};
+
+// Same layout as Material in BindlessPixelShader.frag, indexed by instance material index
+struct MaterialData
+{
+	uint32_t albedoTexture;		// bindless texture slot
+	uint32_t padding[3];
+	Vector4 baseColor;
+};
+
+// Visible instances of (batch, lod) start at lod * instance count + batch first instance,
+// so every LOD of a batch has room for all its instances and draws as one instanced call.
+static inline uint32_t GetLodFirstInstance(uint32_t lod, uint32_t instanceCount, uint32_t batchFirstInstance)
+{
+	return lod * instanceCount + batchFirstInstance;
+}
+
+// Cluster regions follow the LOD regions, every meshlet of a batch has room for all instances of the batch
+// and draws as one instanced call over the LOD 0 instances it survived culling for.
+static inline uint32_t GetClusterFirstInstance(uint32_t meshletIdx, uint32_t batchInstanceCount, uint32_t batchFirstClusterInstance)
+{
+	return batchFirstClusterInstance + meshletIdx * batchInstanceCount;
+}
+
 // interleaving vertex attributes
 std::vector<Vertex> DummyVertices = {
 	//{{-0.5f, -0.5f, 0.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
@@ -145,6 +290,12 @@ std::vector<uint32_t> DummyIndices = {
 	//4, 5, 6, 6, 7, 4
 };
 
+// Ranges of every loaded mesh inside DummyVertices/ DummyIndices
+std::vector<MeshDrawInfo> DummyMeshes;
+
+// Meshlets of all meshes, firstIndex into DummyIndices
+std::vector<Meshlet> DummyMeshlets;
+
 #ifdef _DEBUG
 /// Validation Layer should be abstracted, but leave it here for learning usage
 /// We can learn how to make validation configuration by vk_layer_settings.txt
@@ -208,25 +359,45 @@ void destroyDebugUtilsMessengerEXT(VkInstance instance,
 }
 #endif
 
-static std::vector<char> ReadFile(const std::string& filename)
+// Stored pak entries come back without a copy, see Gear::FileSystem
+static Gear::FileData ReadFile(const char* filename)
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	Gear::FileData file = Gear::FileSystem::Get().Read(filename);
 
-	if (!file.is_open())
+	if (!file)
 	{
 		throw std::runtime_error("failed to open file..");
 	}
 
-	size_t fileSize = static_cast<size_t>(file.tellg());
-	std::vector<char> readBuffer(fileSize);
+	return file;
+}
 
-	file.seekg(0);
-	file.read(readBuffer.data(), fileSize);
+// Materials referenced by an obj are looked up next to it in the file system
+class ObjMaterialReader : public tinyobj::MaterialReader
+{
+public:
+	explicit ObjMaterialReader(const std::string& directory) : m_Directory(directory) {}
 
-	file.close();
+	bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* matMap, std::string* warn, std::string* err) override
+	{
+		Gear::FileData file = Gear::FileSystem::Get().Read((m_Directory + matId).c_str());
+		if (!file)
+		{
+			if (warn)
+			{
+				*warn += "Material file [ " + matId + " ] not found.\n";
+			}
+			return false;
+		}
 
-	return readBuffer;
-}
+		std::istringstream stream(std::string(reinterpret_cast<const char*>(file.GetData()), file.GetSize()));
+		tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+		return true;
+	}
+
+private:
+	std::string m_Directory;
+};
 
 std::vector<const char*> getRequiredExts(const uint32_t& glfwExtCount, const char** glfwExtensions)
 {
@@ -241,12 +412,37 @@ class HelloTriangleApplication {
 public:
 	void run() 
 	{
-		initWindow();
+		Gear::Timer::Initialize();
+		Gear::TaskSystem::Get().Initialize();
+
+		Gear::FileSystem::Get().SetLooseRoot(ASSET_ROOT);
+		Gear::FileSystem::Get().Mount(ASSET_PAK);
+
+		if (!bHeadless)
+		{
+			initWindow();
+		}
 		initVulkan();
 		mainLoop();
 		cleanup();
 	}
 
+	// Has to be set before run(), captureFile (binary PPM) is left empty to skip reading back the last frame
+	void setHeadless(uint32_t frameCount, const std::string& captureFile)
+	{
+		bHeadless = true;
+		headlessFrameCount = frameCount;
+		headlessCaptureFile = captureFile;
+	}
+
+	// Has to be set before run(), frame count is clamped to 1..MAX_FRAMES_IN_FLIGHT
+	void setFramePacing(uint32_t inFramesInFlight, FramePacing pacing, bool bInLateLatching)
+	{
+		framesInFlight = std::min(std::max(inFramesInFlight, 1u), MAX_FRAMES_IN_FLIGHT);
+		framePacing = pacing;
+		bLateLatching = bInLateLatching;
+	}
+
 	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	bool hasStencilComponent(VkFormat format);
 
@@ -255,6 +451,8 @@ public:
 
 	void genMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t miplevels);
 	void loadMesh();
+	void cookMesh(const char* sourceFile, const Gear::FileData& source, const char* cookedFile);
+	void cookTexture(const char* sourceFile, const char* cookedFile);
 
 	VkSampleCountFlagBits getSupportedSampleCounts();
 
@@ -266,30 +464,43 @@ protected:
 	// Refactor later
 	void createVulkanInstance(const uint32_t& glfwExtCount, const char** glfwExtensions);
 	void createSwapChain();
+	void createOffscreenImages();
 	void createSwapChainImageView();
 	void createRenderPass();
     void createDescriptorSetLayout();
+	void createBindlessDescriptors();
 	void createGraphicsPipeline();
 	void createFrameBuffers();
 	void createCommandPool();
 	void createTextureImage();
-	void createTextureImageView();
+	void rebuildTextureImage(uint32_t residentMip, const std::vector<TextureResidencyChange>& changes);
+	void updateTextureStreaming(const UniformBuffer& ubo);
 	void createTextureSampler();
 	void createVertexBuffer();
 	void createIndexBuffer();
+	void createInstanceBuffer();
+	void createMaterials();
+	void createCullingBuffers();
+	void createFrameCullingBuffers();
+	void createCullingPipeline();
 	void createUniformBuffer();
-	void createDescriptorPool();
+	void createDescriptorAllocators();
 	void createDescriptorSet();
 	void createCommandBuffers();
 	void createSyncObjects();
 
-	void createDepthResource();
-	void createColorResource();
+	void createFrameGraph();
+
+	void captureImage(VkImage image, const char* fileName);
 
 	void recreateSwapChain();
 	void cleanupSwapChain();
+	void destroyFrameResources(size_t imageCount);
+	uint64_t getDeletionValue() const;
 
-	void createBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperty, VkBuffer& buffer);
+	// Shared buffers are read by async compute and graphics alike, concurrent when their queue families differ
+	void createBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperty, VkBuffer& buffer, bool bShared = false);
+	void createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceMemory& bufferMemory, VkBuffer& buffer, bool bShared = false);
 	void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
 
 	void createImage(uint32_t width, uint32_t height, uint32_t miplevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkDeviceMemory& memory, VkImage& image, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
@@ -297,16 +508,26 @@ protected:
 
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
-
-	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout preLayout, VkImageLayout targetLayout, uint32_t miplevels = 1);
+	void submitSingleTimeCommands(VkCommandBuffer commandBuffer);
 
 	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT, uint32_t miplevels = 1);
 
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	VkShaderModule createShaderModule(const Gear::FileData& code);
+
+	void bindCulling(VkCommandBuffer commandBuffer, size_t imageIdx);
+	void recordMainPass(VkCommandBuffer commandBuffer, size_t imageIdx);
+	void cullInstances(uint32_t imageIdx, const UniformBuffer& ubo);
 
-	void updateUniformBuffer(uint32_t imageIdx);
+	UniformBuffer updateScene(float aspectRatio);
+	void updateUniformBuffer(uint32_t imageIdx, const UniformBuffer& ubo);
 
-	void draw();
+	void draw(const UniformBuffer& ubo, bool bResized);
+
+	void startRenderThread();
+	void stopRenderThread();
+	void waitForFrame(uint64_t frame);
+	void waitForLastFrame();
+	void renderThreadMain();
 
 	void createSurface()
 	{
@@ -325,25 +546,40 @@ protected:
 		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+		// Every family is looked at for the dedicated ones, first match wins
 		int i = 0;
 		for (const VkQueueFamilyProperties& queueFamily : queueFamilies)
 		{
-			if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && indices.graphicsFamily < 0)
 			{
 				indices.graphicsFamily = i;
 			}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			const VkQueueFlags computeFlags = queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+			if (queueFamily.queueCount > 0 && computeFlags == VK_QUEUE_COMPUTE_BIT && indices.computeFamily < 0)
+			{
+				indices.computeFamily = i;
+			}
 
-			if (presentSupport)
+			if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && computeFlags == 0 && indices.transferFamily < 0)
 			{
-				indices.presentFamily = i;
+				indices.transferFamily = i;
 			}
 
-			if (indices.IsComplete())
+			// Nothing is presented in headless mode, graphics queue stands in for the present queue
+			VkBool32 presentSupport = false;
+			if (bHeadless)
 			{
-				break;
+				presentSupport = queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			}
+			else
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+			}
+
+			if (presentSupport && indices.presentFamily < 0)
+			{
+				indices.presentFamily = i;
 			}
 
 			++i;
@@ -471,6 +707,11 @@ protected:
 		vkGetPhysicalDeviceFeatures(device, &deviceFeature);
 
 		QueueFamilyIndices indices = findQueueFamilies(device);
+		if (bHeadless)
+		{
+			return indices.IsComplete();
+		}
+
 		bool extSupport = checkDeviceExtensionSupport(device);
 		bool swapChainAdequate = false;
 		if (extSupport)
@@ -503,15 +744,115 @@ protected:
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		// GPU driven culling relies on indirect count draws, bindless on descriptor indexing and frame pacing on
+		// timeline semaphores, all core since 1.2
+		VkPhysicalDeviceProperties deviceProperty;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperty);
+
+		VkPhysicalDeviceVulkan12Features vulkan12Feature = {};
+		vulkan12Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		// Frame graph batches its barriers through vkCmdPipelineBarrier2 where synchronization2 is supported
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+		VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Feature = {};
+		synchronization2Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+		for (const VkExtensionProperties& ext : availableExtensions)
+		{
+			if (strcmp(ext.extensionName, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME) == 0)
+			{
+				vulkan12Feature.pNext = &synchronization2Feature;
+			}
+		}
+
+		VkPhysicalDeviceFeatures2 supportedFeature = {};
+		supportedFeature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeature.pNext = &vulkan12Feature;
+
+		if (deviceProperty.apiVersion >= VK_API_VERSION_1_2)
+		{
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeature);
+		}
+
+		// Indirect draws written by compute start at the slot of their (batch, lod) in the visible list, so firstInstance
+		// must be honored. CPU culling pushes the slot instead.
+		bGpuDrivenCulling = ENABLE_GPU_DRIVEN_CULLING &&
+			vulkan12Feature.drawIndirectCount &&
+			supportedFeature.features.multiDrawIndirect &&
+			supportedFeature.features.drawIndirectFirstInstance;
+
+		// Culling is all the compute work there is, nothing to overlap without it
+		bAsyncCompute = ENABLE_ASYNC_COMPUTE && bGpuDrivenCulling && indices.computeFamily >= 0;
+		if (bAsyncCompute)
+		{
+			VkDeviceQueueCreateInfo queueCreateInfo = {};
+			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfo.queueFamilyIndex = indices.computeFamily;
+			queueCreateInfo.queueCount = 1;
+			queueCreateInfo.pQueuePriorities = &queuePriority;
+
+			queueCreateInfos.push_back(queueCreateInfo);
+		}
+
+		bBindless = ENABLE_BINDLESS &&
+			vulkan12Feature.runtimeDescriptorArray &&
+			vulkan12Feature.descriptorBindingPartiallyBound &&
+			vulkan12Feature.descriptorBindingSampledImageUpdateAfterBind &&
+			vulkan12Feature.descriptorBindingStorageBufferUpdateAfterBind &&
+			vulkan12Feature.descriptorBindingUpdateUnusedWhilePending &&
+			vulkan12Feature.shaderSampledImageArrayNonUniformIndexing;
+
+		const bool bSynchronization2 = synchronization2Feature.synchronization2 == VK_TRUE;
+
+		// Frame pacing is built on it
+		if (!vulkan12Feature.timelineSemaphore)
+		{
+			throw std::runtime_error("Timeline semaphores are not supported.");
+		}
+
 		// Or use VkPhysicalDeviceFeatures2 to link other extensions, same as VkDeviceCreateInfo.pNext
 		VkPhysicalDeviceFeatures deviceFeature = {};
 		deviceFeature.samplerAnisotropy = VK_TRUE;
+		deviceFeature.multiDrawIndirect = bGpuDrivenCulling ? VK_TRUE : VK_FALSE;
+		deviceFeature.drawIndirectFirstInstance = bGpuDrivenCulling ? VK_TRUE : VK_FALSE;
+
+		VkPhysicalDeviceVulkan12Features enableVulkan12Feature = {};
+		enableVulkan12Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		enableVulkan12Feature.drawIndirectCount = bGpuDrivenCulling ? VK_TRUE : VK_FALSE;
+		enableVulkan12Feature.timelineSemaphore = VK_TRUE;
+		if (bBindless)
+		{
+			enableVulkan12Feature.runtimeDescriptorArray = VK_TRUE;
+			enableVulkan12Feature.descriptorBindingPartiallyBound = VK_TRUE;
+			enableVulkan12Feature.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			enableVulkan12Feature.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+			enableVulkan12Feature.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+			enableVulkan12Feature.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+		}
+
+		VkPhysicalDeviceSynchronization2FeaturesKHR enableSynchronization2Feature = {};
+		enableSynchronization2Feature.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+		enableSynchronization2Feature.synchronization2 = VK_TRUE;
+
+		// No swap chain in headless mode
+		std::vector<const char*> enabledExtensions;
+		if (!bHeadless)
+		{
+			enabledExtensions = DEVICE_EXTENSIONS;
+		}
+		if (bSynchronization2)
+		{
+			enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+		}
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		createInfo.pEnabledFeatures = &deviceFeature;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(DEVICE_EXTENSIONS.size());
-		createInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS.data();
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -524,6 +865,9 @@ protected:
 		};
 		createInfo.pNext = &enableUINT8Index;
 
+		enableUINT8Index.pNext = &enableVulkan12Feature;
+		enableVulkan12Feature.pNext = bSynchronization2 ? &enableSynchronization2Feature : nullptr;
+
 #ifdef _DEBUG
 		createInfo.enabledLayerCount = static_cast<uint32_t>(VALIDATION_LAYERS.size());
 		createInfo.ppEnabledLayerNames = VALIDATION_LAYERS.data();
@@ -537,6 +881,19 @@ protected:
 
 		vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+
+		deletionQueue.Initialize(device);
+
+		frameGraph.Initialize(physicalDevice,
+			device,
+			bSynchronization2 ? reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2KHR")) : nullptr);
+
+		if (bAsyncCompute)
+		{
+			vkGetDeviceQueue(device, indices.computeFamily, 0, &asyncComputeQueue);
+			frameGraph.SetQueueFamilies(indices.graphicsFamily, indices.computeFamily);
+			sharedQueueFamilies = { static_cast<uint32_t>(indices.graphicsFamily), static_cast<uint32_t>(indices.computeFamily) };
+		}
 	}
 
 	SwapChainSupportDetail querySwapChainSupport(VkPhysicalDevice device)
@@ -616,9 +973,13 @@ protected:
 
 private:
 	GLFWwindow* window;
+	int windowedX = 0;
+	int windowedY = 0;
+	int windowedWidth = WIDTH;
+	int windowedHeight = HEIGHT;
 	VkInstance vulkanInstance;
-	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
@@ -630,15 +991,69 @@ private:
 
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+
+	// Async compute, culling passes of the frame graph are recorded into their own command buffers
+	bool bAsyncCompute = false;
+	VkQueue asyncComputeQueue = VK_NULL_HANDLE;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> computeCommandBuffers;
+	std::vector<uint32_t> sharedQueueFamilies;		// buffers used by both queues without ownership transfers
 	
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 
-	// For synchronrization
+	// Frame timing, time since start drives the animation
+	Gear::FrameTimeTracker frameTimeTracker;
+	double startSeconds = 0.0;
+
+	// Headless mode, swapChainImages are offscreen images then, one per frame in flight
+	bool bHeadless = false;
+	uint32_t headlessFrameCount = 0;
+	std::string headlessCaptureFile;
+	std::vector<VkDeviceMemory> offscreenImageMemory;
+	uint64_t frameIndex = 0;		// frames recorded by game thread
+	uint32_t lastImageIdx = 0;		// image rendered by the last submitted frame
+
+	// Render commands recorded by game thread, executed one frame behind on render thread
+	struct DrawFrameCommand
+	{
+		DrawFrameCommand(const UniformBuffer& inUbo, bool bInResized) :
+			ubo(inUbo),
+			bResized(bInResized)
+		{
+		}
+
+		void Execute(HelloTriangleApplication& app)
+		{
+			app.draw(ubo, bResized);
+		}
+
+		UniformBuffer ubo;
+		bool bResized;
+	};
+
+	Gear::TCommandRing<HelloTriangleApplication> renderCommands;
+	std::thread renderThread;
+	std::exception_ptr renderThreadException;
+	std::atomic<bool> bRenderThreadFailed{ false };
+
+	// For synchronrization, binary semaphores per frame in flight are only for acquire and present
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	FramePacing framePacing = FramePacing::Throughput;
+	bool bLateLatching = false;
 	size_t currentFrame = 0;
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishSemaphores;
-	std::vector<VkFence> presentFences;
+
+	// Frames are numbered from 1 in submit order, timeline semaphore is signaled with the number once a frame
+	// completed, which covers everything submitted before. Objects the GPU may still use are handed to the
+	// deletion queue keyed by frame number, see getDeletionValue().
+	VkSemaphore frameTimeline = VK_NULL_HANDLE;
+	std::atomic<uint64_t> submittedFrameCount{ 0 };
+	std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameSubmitCounts = {};
+	std::vector<uint64_t> imageSubmitCounts;		// last frame per swap chain image, images may be fewer than frames
+	VkSemaphore computeTimeline = VK_NULL_HANDLE;	// culling of a frame completed, same numbering
+	DeletionQueue deletionQueue;
 
 	std::vector<VkImage> swapChainImages;
 	std::vector<VkImageView> swapChainImageViews;
@@ -652,32 +1067,98 @@ private:
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
 
+	// Per-instance data, SoA arrays in one storage buffer
+	InstanceDataSoA instanceData;
+	TransformHierarchy sceneTransforms;
+	VkBuffer instanceBuffer;
+	VkDeviceMemory instanceBufferMemory;
+	VkDeviceSize instanceMaterialOffset = 0;
+
+	// GPU driven culling, compute pass writes indirect draws and the draw count
+	bool bGpuDrivenCulling = false;
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullInstancesPipeline;
+	VkPipeline compactDrawsPipeline;
+	VkPipeline clusterCullPipeline;
+	std::vector<VkDescriptorSet> cullDescriptorSets;
+
+	VkBuffer cullBatchBuffer;
+	VkDeviceMemory cullBatchBufferMemory;
+	VkBuffer instanceBatchBuffer;
+	VkDeviceMemory instanceBatchBufferMemory;
+	// Current LOD of every instance, kept across frames for hysteresis
+	VkBuffer instanceLodBuffer;
+	VkDeviceMemory instanceLodBufferMemory;
+	VkBuffer meshletBuffer;
+	VkDeviceMemory meshletBufferMemory;
+
+	// One instanced draw per meshlet of every batch, draws follow the (batch, lod) ones. Each has a visible
+	// list region as large as its batch after the LOD regions.
+	uint32_t maxClusterDraws = 0;
+	uint32_t maxClusterInstances = 0;
+	uint32_t maxBatchMeshletCount = 0;
+
+	// Frustum culling on CPU when GPU driven culling is not supported, bounds in instance order
+	FrustumCuller instanceCuller;
+	std::vector<uint32_t> visibleInstances;
+	std::vector<Math::Vec4> instanceSpheres;	// xyz: world center, w: radius, kept for texture streaming too
+	std::vector<uint8_t> instanceLods;
+	std::vector<uint32_t> drawFirstInstances;	// visible slot of every draw, pushed per draw
+	OcclusionCuller occlusionCuller;
+	std::vector<uint32_t> occluderInstances;
+	std::vector<uint32_t> occluderFirstVertices;	// of every occluder instance in occlusionCuller
+
+	// Per swap chain image, written every frame by compute pass or by cullInstances() (host visible then).
+	std::vector<VkBuffer> cullCounterBuffer;
+	std::vector<VkDeviceMemory> cullCounterBufferMemory;
+	std::vector<VkBuffer> drawCommandBuffer;
+	std::vector<VkDeviceMemory> drawCommandBufferMemory;
+	std::vector<VkBuffer> visibleInstanceBuffer;
+	std::vector<VkDeviceMemory> visibleInstanceBufferMemory;
+
 	std::vector<VkBuffer> uniformBuffer;
 	std::vector<VkDeviceMemory> uniformBufferMemory;
 
-	VkImage image;
-	VkDeviceMemory imageMemory;
-	VkImageView imageView;
+	// Streamed diffuse texture, image holds mips [textureResidentMip, mipLevels) of the cooked texture
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory imageMemory = VK_NULL_HANDLE;
+	VkImageView imageView = VK_NULL_HANDLE;
 	VkSampler defaultSampler;
 
-	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
-	VkImageView depthImageView;
+	TextureStreamer textureStreamer;
+	Gear::FastLoadImage cookedTextureImage;
+	const CookedTexture* cookedTexture = nullptr;
+	uint32_t diffuseTexture = 0;
+	uint32_t textureResidentMip = 0;
+	std::vector<TextureResidencyChange> textureChanges;
 
 	// mipmaps
 	uint32_t mipLevels;
 	VkImage textureImage;
 
-	VkDescriptorPool descriptorPool;
+	// Sets living as long as the swap chain are written once and come from the cache, pools grow on demand.
+	// No per frame allocators, every set is baked into the prerecorded command buffers of a swap chain image.
+	// Recording per frame would take one allocator per frame in flight, Reset() after waitForFrame().
+	DescriptorAllocator descriptorAllocator;
+	DescriptorSetCache descriptorSetCache;
 	std::vector<VkDescriptorSet> descriptorSets;
 
+	// Bindless set, bound as set 1 of the graphics pipeline next to the per swap chain image set.
+	// Streamed texture moves to a new slot through the material table, prerecorded command buffers stay valid.
+	bool bBindless = false;
+	BindlessDescriptors bindlessDescriptors;
+	uint32_t diffuseTextureSlot = BINDLESS_INVALID;
+	VkBuffer materialBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory materialBufferMemory = VK_NULL_HANDLE;
+
 	// 4x msaa
 	VkSampleCountFlagBits msaaSamplePoints = VK_SAMPLE_COUNT_1_BIT;
 
-	// off-screen color buffer used for MSAA
-	VkImage colorImage;
-	VkDeviceMemory colorImageMemory;
-	VkImageView colorImageView;
+	// Frame passes and their synchronization, multisampled color/ depth are transient images of it
+	RenderGraph frameGraph;
+	uint32_t msaaColorTarget = RENDER_GRAPH_INVALID;
+	uint32_t depthTarget = RENDER_GRAPH_INVALID;
 
 #ifdef _DEBUG
 	VkDebugUtilsMessengerEXT debugMessenger;
@@ -688,7 +1169,7 @@ private:
 		glfwInit();
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
 		glfwSetWindowUserPointer(window, this);
@@ -705,39 +1186,76 @@ private:
 			}
 		});
 		//glfwSetFramebufferSizeCallback(window, OnFrameBufferResized);
+
+		// F11 switches to fullscreen and back, the swap chain follows through the framebuffer size callback
+		glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int mods)
+		{
+			if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+			{
+				reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->toggleFullscreen();
+			}
+		});
+	}
+
+	void toggleFullscreen()
+	{
+		if (glfwGetWindowMonitor(window))
+		{
+			glfwSetWindowMonitor(window, nullptr, windowedX, windowedY, windowedWidth, windowedHeight, GLFW_DONT_CARE);
+			return;
+		}
+
+		// Kept to put the window back where it was
+		glfwGetWindowPos(window, &windowedX, &windowedY);
+		glfwGetWindowSize(window, &windowedWidth, &windowedHeight);
+
+		GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+		const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+		glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
 	}
 
 	void initVulkan()
 	{
 		uint32_t glfwExtCount = 0;
-		const char** glfwExtensions;
+		const char** glfwExtensions = nullptr;
 
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtCount);
+		// Offscreen rendering needs no surface extensions
+		if (!bHeadless)
+		{
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtCount);
+		}
 
 		createVulkanInstance(glfwExtCount, glfwExtensions);
 #ifdef _DEBUG
 		SetupDebugInfo();
 #endif
-		createSurface();
+		if (!bHeadless)
+		{
+			createSurface();
+		}
 		enumPhysicalDevice();
 		createLogicalDevice();
 		createSwapChain();
 		createSwapChainImageView();
 		createRenderPass();
 		createDescriptorSetLayout();
+		createBindlessDescriptors();
 		createGraphicsPipeline();
+		createCullingPipeline();
 		createCommandPool();
-		createColorResource();
-		createDepthResource();
-		createFrameBuffers();
 		createTextureImage();
-		createTextureImageView();
 		createTextureSampler();
 		loadMesh();
 		createVertexBuffer();
 		createIndexBuffer();
+		createInstanceBuffer();
+		createMaterials();
+		createCullingBuffers();
 		createUniformBuffer();
-		createDescriptorPool();
+		createFrameCullingBuffers();
+		createFrameGraph();		// imports the per image buffers
+		createFrameBuffers();
+		createDescriptorAllocators();
 		createDescriptorSet();
 		createCommandBuffers();
 		createSyncObjects();
@@ -745,10 +1263,70 @@ private:
 
 	void mainLoop()
 	{
-		while (!glfwWindowShouldClose(window))
+		startSeconds = Gear::Timer::GetSeconds();
+		startRenderThread();
+
+		while (!bRenderThreadFailed && (bHeadless ? frameIndex < headlessFrameCount : !glfwWindowShouldClose(window)))
+		{
+			frameTimeTracker.Tick();
+
+			int width = WIDTH;
+			int height = HEIGHT;
+			if (!bHeadless)
+			{
+				glfwPollEvents();
+
+				// Nothing to render while minimized
+				glfwGetFramebufferSize(window, &width, &height);
+				if (width == 0 || height == 0)
+				{
+					glfwWaitEvents();
+					continue;
+				}
+			}
+
+			// Blocks here if render thread is still one frame behind
+			Gear::TCommandList<HelloTriangleApplication>* commandList = renderCommands.BeginFrame();
+			if (!commandList)
+			{
+				break;
+			}
+
+			// Input is sampled again once the previous frame is on screen, scene below is built from it
+			if (bLateLatching)
+			{
+				waitForLastFrame();
+				if (!bHeadless)
+				{
+					glfwPollEvents();
+				}
+			}
+
+			commandList->Enqueue<DrawFrameCommand>(updateScene(width / (float)height), bFrameBufferResized);
+			bFrameBufferResized = false;
+			++frameIndex;
+
+			renderCommands.EndFrame();
+
+			if (!ENABLE_RENDER_THREAD)
+			{
+				renderCommands.ExecuteFrame(*this);
+			}
+		}
+
+		stopRenderThread();
+		vkDeviceWaitIdle(device);
+
+		Gear::FrameTimeStats stats = frameTimeTracker.GetStats();
+		std::cout << "[FrameTime] frames: " << frameTimeTracker.GetFrameCount()
+			<< " min: " << stats.MinMilliseconds << " ms"
+			<< " avg: " << stats.AvgMilliseconds << " ms"
+			<< " p99: " << stats.P99Milliseconds << " ms"
+			<< " hitches: " << stats.HitchCount << std::endl;
+
+		if (bHeadless && frameIndex > 0 && !headlessCaptureFile.empty())
 		{
-			glfwPollEvents();
-			draw();
+			captureImage(swapChainImages[lastImageIdx], headlessCaptureFile.c_str());
 		}
 
 		//
@@ -760,19 +1338,35 @@ private:
 #ifdef _DEBUG
 		destroyDebugUtilsMessengerEXT(vulkanInstance, debugMessenger, nullptr);
 #endif
+		// Bindless slots are released to the set, has to go first
+		deletionQueue.Shutdown();
 		cleanupSwapChain();
 
 		vkDestroySampler(device, defaultSampler, nullptr);
 		vkDestroyImageView(device, imageView, nullptr);
 
+		textureStreamer.Shutdown();
+		cookedTextureImage.Release();
+
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		for (size_t i = 0; i< MAX_FRAMES_IN_SWAPCHAIN; ++i)
+		descriptorAllocator.Shutdown();
+
+		if (bBindless)
+		{
+			bindlessDescriptors.Shutdown();
+
+			vkDestroyBuffer(device, materialBuffer, nullptr);
+			vkFreeMemory(device, materialBufferMemory, nullptr);
+		}
+
+		for (size_t i = 0; i < framesInFlight; ++i)
 		{
 			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 			vkDestroySemaphore(device, renderFinishSemaphores[i], nullptr);
-			vkDestroyFence(device, presentFences[i], nullptr);
 		}
+		vkDestroySemaphore(device, frameTimeline, nullptr);
+		vkDestroySemaphore(device, computeTimeline, nullptr);
 
 		//
 		vkDestroyBuffer(device, vertexBuffer, nullptr);
@@ -781,23 +1375,109 @@ private:
 		vkDestroyBuffer(device, indexBuffer, nullptr);
 		vkFreeMemory(device, indexBufferMemory, nullptr);
 
+		vkDestroyBuffer(device, instanceBuffer, nullptr);
+		vkFreeMemory(device, instanceBufferMemory, nullptr);
+
+		if (bGpuDrivenCulling)
+		{
+			vkDestroyBuffer(device, cullBatchBuffer, nullptr);
+			vkFreeMemory(device, cullBatchBufferMemory, nullptr);
+
+			vkDestroyBuffer(device, instanceBatchBuffer, nullptr);
+			vkFreeMemory(device, instanceBatchBufferMemory, nullptr);
+
+			vkDestroyBuffer(device, instanceLodBuffer, nullptr);
+			vkFreeMemory(device, instanceLodBufferMemory, nullptr);
+
+			vkDestroyBuffer(device, meshletBuffer, nullptr);
+			vkFreeMemory(device, meshletBufferMemory, nullptr);
+
+			vkDestroyPipeline(device, cullInstancesPipeline, nullptr);
+			vkDestroyPipeline(device, compactDrawsPipeline, nullptr);
+			vkDestroyPipeline(device, clusterCullPipeline, nullptr);
+			vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, cullDescriptorSetLayout, nullptr);
+		}
+
 		vkDestroyImage(device, image, nullptr);
 		vkFreeMemory(device, imageMemory, nullptr);
 
 		vkDestroyCommandPool(device, commandPool, nullptr);
+		vkDestroyCommandPool(device, computeCommandPool, nullptr);
 
 		vkDestroyDevice(device, nullptr);
 		vkDestroySurfaceKHR(vulkanInstance, surface, nullptr);
 		vkDestroyInstance(vulkanInstance, nullptr);
 
-		glfwDestroyWindow(window);
-		glfwTerminate();
+		if (!bHeadless)
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+		}
+
+		Gear::TaskSystem::Get().Shutdown();
 	}
 };
 
-int main() {
+// Streamed textures page in one mip at a time from the mapping, compressing them would load them whole
+static bool ShouldCompressAsset(const char* path)
+{
+	const size_t length = strlen(path);
+	return length < 4 || strcmp(path + length - 4, ".tex") != 0;
+}
+
+static int BuildAssetPak()
+{
+	Gear::PakWriter writer;
+	const uint32_t fileCount = writer.AddDirectory(ASSET_ROOT, ShouldCompressAsset);
+	if (fileCount == 0 || !writer.SaveToFile(ASSET_PAK))
+	{
+		std::cerr << "Failed to build " << ASSET_PAK << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Packed " << fileCount << " files into " << ASSET_PAK << std::endl;
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && strcmp(argv[1], "--pak") == 0)
+	{
+		return BuildAssetPak();
+	}
+
 	HelloTriangleApplication app;
 
+	// --headless [frame count] [capture.ppm]
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+	{
+		const bool bFrameCount = argc > 2 && argv[2][0] != '-';
+		const bool bCaptureFile = bFrameCount && argc > 3 && argv[3][0] != '-';
+		const uint32_t frameCount = bFrameCount ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)) : HEADLESS_DEFAULT_FRAMES;
+		app.setHeadless(frameCount, bCaptureFile ? argv[3] : "");
+	}
+
+	// [--frames-in-flight 1..4] [--low-latency] [--late-latching], anywhere after the mode
+	uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	FramePacing framePacing = FramePacing::Throughput;
+	bool bLateLatching = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+		{
+			framesInFlight = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--low-latency") == 0)
+		{
+			framePacing = FramePacing::LowLatency;
+		}
+		else if (strcmp(argv[i], "--late-latching") == 0)
+		{
+			bLateLatching = true;
+		}
+	}
+	app.setFramePacing(framesInFlight, framePacing, bLateLatching);
+
 	try {
 		app.run();
 	}
@@ -919,51 +1599,147 @@ void HelloTriangleApplication::genMipmaps(VkImage image, VkFormat format, uint32
 			           &blit,
 			           VK_FILTER_LINEAR);
 
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(cmdBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			0, 0, nullptr, 0, nullptr, 1, &barrier);
-
 		if (mipWidth > 1)  mipWidth /= 2;
 		if (mipHeight > 1)  mipHeight /= 2;
 
 	}
 
-	barrier.subresourceRange.baseMipLevel = miplevels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
+	// Every level goes to shader read at once, sources from transfer read and the last level from transfer write
+	VkImageMemoryBarrier finalBarriers[2] = { barrier, barrier };
+	finalBarriers[0].subresourceRange.baseMipLevel = 0;
+	finalBarriers[0].subresourceRange.levelCount = miplevels - 1;
+	finalBarriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	finalBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	finalBarriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	finalBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	finalBarriers[1].subresourceRange.baseMipLevel = miplevels - 1;
+	finalBarriers[1].subresourceRange.levelCount = 1;
+	finalBarriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	finalBarriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	finalBarriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	finalBarriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	const uint32_t finalBarrierCount = miplevels > 1 ? 2 : 1;
 	vkCmdPipelineBarrier(cmdBuffer,
 		VK_PIPELINE_STAGE_TRANSFER_BIT,
 		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-		0, 0, nullptr, 0, nullptr, 1, &barrier);
+		0, 0, nullptr, 0, nullptr, finalBarrierCount, &finalBarriers[2 - finalBarrierCount]);
 
 	endSingleTimeCommands(cmdBuffer);
 }
 
 void HelloTriangleApplication::loadMesh()
+{
+	// Cooked once, later runs map the image and skip obj parsing and simplification. Cooked again once the
+	// source changes, shipped builds may leave the source out and take the cooked mesh as it is.
+	Gear::FileData source;
+	uint64_t sourceHash = 0;
+	if (Gear::FileSystem::Get().Exists(DUMMY_MESH))
+	{
+		source = ReadFile(DUMMY_MESH);
+		sourceHash = HashCookSource(source.GetData(), source.GetSize());
+	}
+
+	// A pak copy cooked from an older source shadows the loose one, which an earlier run may have cooked again
+	Gear::FastLoadImage cookedImage;
+	const CookedMeshFile* cooked = LoadCookedMeshes(DUMMY_MESH_COOKED, cookedImage, sourceHash);
+	if (!cooked && source)
+	{
+		cooked = LoadCookedMeshes(DUMMY_MESH_COOKED, cookedImage, sourceHash, true);
+	}
+	if (!cooked && source)
+	{
+		cookMesh(DUMMY_MESH, source, DUMMY_MESH_COOKED);
+		cooked = LoadCookedMeshes(DUMMY_MESH_COOKED, cookedImage, sourceHash, true);
+	}
+
+	if (!cooked)
+	{
+		throw std::runtime_error("Failed to load cooked mesh..");
+	}
+
+	for (uint32_t meshIdx = 0; meshIdx < cooked->meshCount; ++meshIdx)
+	{
+		const CookedMesh& mesh = cooked->meshes[meshIdx];
+		if (mesh.vertexStride != sizeof(Vertex))
+		{
+			throw std::runtime_error("Cooked mesh vertex layout mismatch, delete it to cook again..");
+		}
+
+		// Indices are local to the mesh, every LOD shares its vertices
+		MeshDrawInfo meshInfo = {};
+		meshInfo.firstIndex = static_cast<uint32_t>(DummyIndices.size());
+		meshInfo.indexCount = mesh.levels[0].indexCount;
+		meshInfo.vertexOffset = static_cast<int32_t>(DummyVertices.size());
+		meshInfo.vertexCount = mesh.vertexCount;
+		std::copy(mesh.boundsCenter, mesh.boundsCenter + 3, meshInfo.boundsCenter);
+		meshInfo.boundsRadius = mesh.boundsRadius;
+
+		meshInfo.lodCount = mesh.lodCount;
+		for (uint32_t lod = 0; lod < mesh.lodCount; ++lod)
+		{
+			meshInfo.lods[lod] = mesh.levels[lod];
+			meshInfo.lods[lod].firstIndex += meshInfo.firstIndex;
+		}
+		meshInfo.lodThresholds = ComputeMeshLodThresholds(mesh.levels, mesh.lodCount, mesh.boundsRadius, LOD_PIXEL_ERROR);
+
+		meshInfo.firstMeshlet = static_cast<uint32_t>(DummyMeshlets.size());
+		meshInfo.meshletCount = mesh.meshletCount;
+		for (uint32_t meshletIdx = 0; meshletIdx < mesh.meshletCount; ++meshletIdx)
+		{
+			Meshlet meshlet = mesh.meshlets[meshletIdx];
+			meshlet.firstIndex += meshInfo.firstIndex;
+			DummyMeshlets.push_back(meshlet);
+		}
+
+		const Vertex* vertices = reinterpret_cast<const Vertex*>(mesh.vertices.Get());
+		DummyVertices.insert(DummyVertices.end(), vertices, vertices + mesh.vertexCount);
+		DummyIndices.insert(DummyIndices.end(), mesh.indices.Get(), mesh.indices.Get() + mesh.indexCount);
+		DummyMeshes.push_back(meshInfo);
+	}
+}
+
+void HelloTriangleApplication::cookMesh(const char* sourceFile, const Gear::FileData& source, const char* cookedFile)
 {
 	tinyobj::attrib_t attribute;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string err, warn;
 
-	if (!tinyobj::LoadObj(&attribute, &shapes, &materials, &warn, &err, DUMMY_MESH))
+	std::istringstream stream(std::string(reinterpret_cast<const char*>(source.GetData()), source.GetSize()));
+
+	const std::string sourcePath = sourceFile;
+	ObjMaterialReader materialReader(sourcePath.substr(0, sourcePath.find_last_of("/\\") + 1));
+
+	if (!tinyobj::LoadObj(&attribute, &shapes, &materials, &warn, &err, &stream, &materialReader))
 	{
 		throw std::runtime_error(err);
 	}
 
-	for (const auto& shape: shapes)
+	std::vector<std::vector<Vertex>> shapeVertices(shapes.size());
+	std::vector<std::vector<uint32_t>> shapeIndices(shapes.size());
+	std::vector<MeshSimplifyDesc> descs(shapes.size());
+	std::vector<CookedMeshSource> sources(shapes.size());
+	std::vector<float> boundsRadii(shapes.size());
+
+	for (size_t shapeIdx = 0; shapeIdx < shapes.size(); ++shapeIdx)
 	{
-		for (const auto& index: shape.mesh.indices)
+		std::vector<Vertex>& vertices = shapeVertices[shapeIdx];
+		std::vector<uint32_t>& indices = shapeIndices[shapeIdx];
+
+		// Weld corners sharing position and uv, simplification needs the connectivity
+		std::unordered_map<uint64_t, uint32_t> uniqueVertices;
+		for (const auto& index: shapes[shapeIdx].mesh.indices)
 		{
+			const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(index.vertex_index)) << 32) | static_cast<uint32_t>(index.texcoord_index);
+			auto found = uniqueVertices.find(key);
+			if (found != uniqueVertices.end())
+			{
+				indices.push_back(found->second);
+				continue;
+			}
+
 			Vertex vert = {};
 
 			// index
@@ -985,17 +1761,73 @@ void HelloTriangleApplication::loadMesh()
 
 			vert.color = { 1.0f, 1.0f, 1.0f };
 
-			// Bind to render resources
-			DummyVertices.push_back(vert);
-			DummyIndices.push_back(DummyIndices.size());
+			uniqueVertices.emplace(key, static_cast<uint32_t>(vertices.size()));
+			indices.push_back(static_cast<uint32_t>(vertices.size()));
+			vertices.push_back(vert);
+		}
+
+		// Bounding sphere around the box of this shape
+		Vector3 boundsMin(std::numeric_limits<float>::max());
+		Vector3 boundsMax(-std::numeric_limits<float>::max());
+		for (const Vertex& vertex : vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.position);
+			boundsMax = glm::max(boundsMax, vertex.position);
+		}
+
+		Vector3 center = vertices.empty() ? Vector3(0.0f) : (boundsMin + boundsMax) * 0.5f;
+		float radius = 0.0f;
+		for (const Vertex& vertex : vertices)
+		{
+			radius = std::max(radius, glm::length(vertex.position - center));
 		}
+		boundsRadii[shapeIdx] = radius;
+
+		MeshSimplifyDesc& desc = descs[shapeIdx];
+		desc.positions = vertices.empty() ? nullptr : &vertices[0].position.x;
+		desc.positionStride = sizeof(Vertex);
+		desc.vertexCount = static_cast<uint32_t>(vertices.size());
+		desc.attributes = vertices.empty() ? nullptr : &vertices[0].texCoord.x;
+		desc.attributeStride = sizeof(Vertex);
+		desc.attributeCount = 2;
+		desc.indices = indices.data();
+		desc.indexCount = static_cast<uint32_t>(indices.size());
+
+		CookedMeshSource& source = sources[shapeIdx];
+		source.vertices = vertices.data();
+		source.vertexCount = static_cast<uint32_t>(vertices.size());
+		source.vertexStride = sizeof(Vertex);
+		source.boundsCenter[0] = center.x;
+		source.boundsCenter[1] = center.y;
+		source.boundsCenter[2] = center.z;
+		source.boundsRadius = radius;
 	}
-}
 
-VkSampleCountFlagBits HelloTriangleApplication::getSupportedSampleCounts()
-{
-	VkPhysicalDeviceProperties physicalDeviceProp;
-	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProp);
+	std::vector<MeshLodChain> lodChains;
+	BuildMeshLodChains(descs, boundsRadii, MeshLodSettings(), lodChains);
+
+	// LOD 0 is reordered into meshlets for cluster culling, coarser LODs are small enough to draw whole
+	std::vector<std::vector<Meshlet>> shapeMeshlets(shapes.size());
+	for (size_t shapeIdx = 0; shapeIdx < shapes.size(); ++shapeIdx)
+	{
+		MeshLodChain& chain = lodChains[shapeIdx];
+		BuildMeshlets(descs[shapeIdx].positions, descs[shapeIdx].positionStride, descs[shapeIdx].vertexCount,
+			chain.indices.data() + chain.levels[0].firstIndex, chain.levels[0].indexCount, shapeMeshlets[shapeIdx]);
+
+		sources[shapeIdx].lods = &chain;
+		sources[shapeIdx].meshlets = &shapeMeshlets[shapeIdx];
+	}
+
+	if (!SaveCookedMeshes(Gear::FileSystem::Get().GetLoosePath(cookedFile).c_str(), sources, HashCookSource(source.GetData(), source.GetSize())))
+	{
+		throw std::runtime_error("Failed to save cooked mesh..");
+	}
+}
+
+VkSampleCountFlagBits HelloTriangleApplication::getSupportedSampleCounts()
+{
+	VkPhysicalDeviceProperties physicalDeviceProp;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProp);
 
 	VkSampleCountFlags sampleCounts = std::min(physicalDeviceProp.limits.framebufferColorSampleCounts, physicalDeviceProp.limits.framebufferDepthSampleCounts);
 	if (sampleCounts & VK_SAMPLE_COUNT_8_BIT)
@@ -1029,7 +1861,7 @@ void HelloTriangleApplication::createVulkanInstance(const uint32_t& glfwExtCount
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName = APPNAME;
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = VK_API_VERSION_1_2;
 
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -1075,6 +1907,12 @@ void HelloTriangleApplication::createVulkanInstance(const uint32_t& glfwExtCount
 
 void HelloTriangleApplication::createSwapChain()
 {
+	if (bHeadless)
+	{
+		createOffscreenImages();
+		return;
+	}
+
 	SwapChainSupportDetail swapChainDetails = querySwapChainSupport(physicalDevice);
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainDetails.formats);
@@ -1120,7 +1958,8 @@ void HelloTriangleApplication::createSwapChain()
 	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapChainCreateInfo.presentMode = presentMode;
 	swapChainCreateInfo.clipped = VK_TRUE;
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Presentation engine may reuse resources of the old swap chain, which is retired by the caller
+	swapChainCreateInfo.oldSwapchain = swapChain;
 
 	if (vkCreateSwapchainKHR(device, &swapChainCreateInfo, nullptr, &swapChain) != VK_SUCCESS)
 	{
@@ -1135,6 +1974,27 @@ void HelloTriangleApplication::createSwapChain()
 	swapChainExtent = swapExtent;
 }
 
+void HelloTriangleApplication::createOffscreenImages()
+{
+	// Stand in for swap chain images, in the format desktop surfaces usually offer and readable for captures
+	swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	swapChainExtent = { WIDTH, HEIGHT };
+
+	swapChainImages.resize(framesInFlight);
+	offscreenImageMemory.resize(framesInFlight);
+	for (size_t i = 0; i < swapChainImages.size(); ++i)
+	{
+		createImage(swapChainExtent.width,
+			swapChainExtent.height,
+			1,
+			swapChainImageFormat,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			offscreenImageMemory[i],
+			swapChainImages[i]);
+	}
+}
+
 void HelloTriangleApplication::createSwapChainImageView()
 {
 	size_t swapChainImageCount = swapChainImages.size();
@@ -1148,15 +2008,15 @@ void HelloTriangleApplication::createSwapChainImageView()
 
 void HelloTriangleApplication::createRenderPass()
 {
-	// Base color attachment
+	// Base color attachment, only its resolve is kept, so tile based GPUs never write the samples to memory
 	VkAttachmentDescription attachmentColor = {};
 	attachmentColor.format = swapChainImageFormat;
 	attachmentColor.samples = msaaSamplePoints;
 	attachmentColor.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;  // clear with constants
-	attachmentColor.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachmentColor.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachmentColor.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentColor.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachmentColor.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachmentColor.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	//attachmentColor.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 	attachmentColor.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
@@ -1172,8 +2032,8 @@ void HelloTriangleApplication::createRenderPass()
 	resolvedColorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	resolvedColorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	resolvedColorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	resolvedColorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	resolvedColorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	resolvedColorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	resolvedColorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference colorAttachmentResolveRef;
 	colorAttachmentResolveRef.attachment = 2;
@@ -1187,7 +2047,7 @@ void HelloTriangleApplication::createRenderPass()
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef;
@@ -1201,14 +2061,7 @@ void HelloTriangleApplication::createRenderPass()
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;  // only one depth/stencil attachement for each subpass 
 	subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0; // index, not null
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
+	// Layouts stay as they are, frame graph transitions attachments and waits for acquire before the pass begins
 	std::array<VkAttachmentDescription, 3> attachments = { attachmentColor, depthAttachment, resolvedColorAttachment };
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -1216,8 +2069,8 @@ void HelloTriangleApplication::createRenderPass()
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = 0;
+	renderPassInfo.pDependencies = nullptr;
 
 	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
 	{
@@ -1243,7 +2096,28 @@ void HelloTriangleApplication::createDescriptorSetLayout()
 	samplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerBinding.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboBinding, samplerBinding };
+	// per-instance transforms/ material indices
+	VkDescriptorSetLayoutBinding instanceTransformBinding = {};
+	instanceTransformBinding.binding = 2;
+	instanceTransformBinding.descriptorCount = 1;
+	instanceTransformBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	instanceTransformBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	instanceTransformBinding.pImmutableSamplers = nullptr;
+
+	VkDescriptorSetLayoutBinding instanceMaterialBinding = instanceTransformBinding;
+	instanceMaterialBinding.binding = 3;
+
+	// visible instance list, gl_InstanceIndex is remapped through it
+	VkDescriptorSetLayoutBinding visibleInstanceBinding = instanceTransformBinding;
+	visibleInstanceBinding.binding = 4;
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { uboBinding, instanceTransformBinding, instanceMaterialBinding, visibleInstanceBinding };
+
+	// Textures come from the bindless set when supported
+	if (!bBindless)
+	{
+		bindings.push_back(samplerBinding);
+	}
 
 	VkDescriptorSetLayoutCreateInfo descSetLayoutInfo;
 	ZeroVkStructure(descSetLayoutInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO);
@@ -1256,10 +2130,40 @@ void HelloTriangleApplication::createDescriptorSetLayout()
 	}
 }
 
+void HelloTriangleApplication::createBindlessDescriptors()
+{
+	if (!bBindless)
+	{
+		return;
+	}
+
+	VkPhysicalDeviceVulkan12Properties vulkan12Property = {};
+	vulkan12Property.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 deviceProperty = {};
+	deviceProperty.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	deviceProperty.pNext = &vulkan12Property;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &deviceProperty);
+
+	// Combined image samplers count as both sampler and sampled image. Per stage limits cover every set of the
+	// pipeline layout, graphics set reads three storage buffers in vertex shader.
+	const uint32_t maxTextures = std::min({ BINDLESS_MAX_TEXTURES,
+		vulkan12Property.maxPerStageDescriptorUpdateAfterBindSamplers,
+		vulkan12Property.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		vulkan12Property.maxDescriptorSetUpdateAfterBindSamplers,
+		vulkan12Property.maxDescriptorSetUpdateAfterBindSampledImages });
+
+	const uint32_t maxBuffers = std::min({ BINDLESS_MAX_BUFFERS,
+		vulkan12Property.maxPerStageDescriptorUpdateAfterBindStorageBuffers - 3,
+		vulkan12Property.maxDescriptorSetUpdateAfterBindStorageBuffers - 3 });
+
+	bindlessDescriptors.Initialize(device, maxTextures, maxBuffers);
+}
+
 void HelloTriangleApplication::createGraphicsPipeline()
 {
 	auto vsCode = ReadFile(DUMMY_VERTEX_SHADER);
-	auto fsCode = ReadFile(DUMMY_FRAGMENT_SHADER);
+	auto fsCode = ReadFile(bBindless ? BINDLESS_FRAGMENT_SHADER : DUMMY_FRAGMENT_SHADER);
 
 	VkShaderModule vsModule = createShaderModule(vsCode);
 	VkShaderModule fsModule = createShaderModule(fsCode);
@@ -1296,13 +2200,11 @@ void HelloTriangleApplication::createGraphicsPipeline()
 	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	// Setup viewport
-	VkViewport viewport = { 0, 0, (float)swapChainExtent.width, (float)swapChainExtent.height, 0.0f, 1.0f };
-	VkRect2D scissor = { VkOffset2D{0, 0}, swapChainExtent };
+	// Setup viewport, both are dynamic so pipeline does not depend on swap chain size
 	VkPipelineViewportStateCreateInfo viewportStateInfo = {};
 	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportStateInfo.pViewports = &viewport;
-	viewportStateInfo.pScissors = &scissor;
+	viewportStateInfo.pViewports = nullptr;
+	viewportStateInfo.pScissors = nullptr;
 	viewportStateInfo.viewportCount = 1;
 	viewportStateInfo.scissorCount = 1;
 
@@ -1365,7 +2267,7 @@ void HelloTriangleApplication::createGraphicsPipeline()
 	// Setup dynamic state
 	VkDynamicState dynamicState[] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_LINE_WIDTH
+		VK_DYNAMIC_STATE_SCISSOR
 	};
 
 	VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
@@ -1373,11 +2275,21 @@ void HelloTriangleApplication::createGraphicsPipeline()
 	dynamicStateInfo.dynamicStateCount = 2;
 	dynamicStateInfo.pDynamicStates = dynamicState;
 
-	// Pipeline layout
+	// Pipeline layout, bindless set follows the per swap chain image set
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, bindlessDescriptors.GetLayout() };
+
+	// First visible instance of the draw, see recordMainPass()
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+	pipelineLayoutInfo.setLayoutCount = bBindless ? 2 : 1;
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
 	{
@@ -1415,7 +2327,7 @@ void HelloTriangleApplication::createFrameBuffers()
 
 	for (size_t i = 0; i< swapChainImageViews.size(); i++)
 	{
-		std::array<VkImageView, 3> attachments = { colorImageView, depthImageView, swapChainImageViews[i]  };
+		std::array<VkImageView, 3> attachments = { frameGraph.GetImageView(msaaColorTarget), frameGraph.GetImageView(depthTarget), swapChainImageViews[i]  };
 
 		VkFramebufferCreateInfo framebufferInfo = {};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -1446,66 +2358,219 @@ void HelloTriangleApplication::createCommandPool()
 	{
 		throw std::runtime_error("Failed to create command pool..");
 	}
+
+	if (bAsyncCompute)
+	{
+		commandPoolInfo.queueFamilyIndex = queueFamilyIndices.computeFamily;
+		if (vkCreateCommandPool(device, &commandPoolInfo, nullptr, &computeCommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute command pool.");
+		}
+	}
 }
 
 void HelloTriangleApplication::createTextureImage()
 {
-	int width, height, channels;
-	stbi_uc* pixels = stbi_load(DUMMY_MESH_DIFFUSE, &width, &height, &channels, STBI_rgb_alpha);
-	VkDeviceSize imageSize = width * height * 4;
+	// Cooked once with its whole mip chain, later runs map the image and only page in mips being streamed
+	cookedTexture = LoadCookedTexture(DUMMY_MESH_DIFFUSE_COOKED, cookedTextureImage);
+	if (!cookedTexture)
+	{
+		// Straight from where it was cooked to, a pak holding an older version would shadow it
+		cookTexture(DUMMY_MESH_DIFFUSE, DUMMY_MESH_DIFFUSE_COOKED);
+		cookedTexture = LoadCookedTexture(DUMMY_MESH_DIFFUSE_COOKED, cookedTextureImage, true);
+	}
+
+	if (!cookedTexture)
+	{
+		throw std::runtime_error("Failed to load cooked texture..");
+	}
+
+	mipLevels = cookedTexture->mipCount;
 
-	mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) +1;
+	TextureStreamingSettings settings;
+	settings.budgetBytes = TEXTURE_STREAMING_BUDGET;
+	textureStreamer.Initialize(settings);
+	diffuseTexture = textureStreamer.AddTexture(cookedTexture);
 
+	// Only the mip tail up front, load time does not depend on texture size
+	textureResidentMip = mipLevels;
+	rebuildTextureImage(textureStreamer.GetTailMip(diffuseTexture), {});
+}
+
+void HelloTriangleApplication::cookTexture(const char* sourceFile, const char* cookedFile)
+{
+	int width, height, channels;
+	Gear::FileData source = ReadFile(sourceFile);
+	stbi_uc* pixels = stbi_load_from_memory(source.GetData(), static_cast<int>(source.GetSize()), &width, &height, &channels, STBI_rgb_alpha);
 	if (!pixels)
 	{
 		throw std::runtime_error("Failed to load external texture.");
 	}
 
-	// Create buffer for texture
-	VkBuffer stageBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	std::vector<std::vector<uint8_t>> mips;
+	BuildTextureMips(pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), mips);
+	stbi_image_free(pixels);
 
-	createBuffer(stagingBufferMemory,
-		imageSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stageBuffer);
+	if (!SaveCookedTexture(Gear::FileSystem::Get().GetLoosePath(cookedFile).c_str(), static_cast<uint32_t>(width), static_cast<uint32_t>(height), mips))
+	{
+		throw std::runtime_error("Failed to save cooked texture..");
+	}
+}
 
-	// Copy texture data to stage buffer 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy_s(data, imageSize, pixels, imageSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+void HelloTriangleApplication::rebuildTextureImage(uint32_t residentMip, const std::vector<TextureResidencyChange>& changes)
+{
+	// Image can not change its mip count, so a residency change moves kept mips into a new image
+	const uint32_t levelCount = mipLevels - residentMip;
+	const uint32_t oldLevelCount = mipLevels - textureResidentMip;
+	const CookedTextureMip& baseMip = cookedTexture->mips[residentMip];
+
+	// Mips the old image does not hold, from the loader if it brought them, from the mapped file otherwise
+	std::vector<const uint8_t*> mipPixels(mipLevels, nullptr);
+	for (uint32_t mip = residentMip; mip < textureResidentMip; ++mip)
+	{
+		mipPixels[mip] = cookedTexture->mips[mip].pixels.Get();
+	}
+	for (const TextureResidencyChange& change : changes)
+	{
+		if (!change.loadedPixels.empty() && change.newResidentMip >= residentMip && change.newResidentMip < textureResidentMip)
+		{
+			mipPixels[change.newResidentMip] = change.loadedPixels.data();
+		}
+	}
 
-	stbi_image_free(pixels);
-	
+	std::vector<VkBufferImageCopy> uploadRegions;
+	VkDeviceSize stageSize = 0;
+	for (uint32_t mip = residentMip; mip < mipLevels; ++mip)
+	{
+		if (!mipPixels[mip])
+		{
+			continue;
+		}
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = stageSize;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = mip - residentMip;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { cookedTexture->mips[mip].width, cookedTexture->mips[mip].height, 1 };
+		uploadRegions.push_back(region);
+
+		stageSize += cookedTexture->mips[mip].size;
+	}
+
+	VkBuffer stageBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory stageBufferMemory = VK_NULL_HANDLE;
+	if (stageSize > 0)
+	{
+		createBuffer(stageBufferMemory,
+			stageSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stageBuffer);
+
+		void* data = nullptr;
+		vkMapMemory(device, stageBufferMemory, 0, stageSize, 0, &data);
+		for (const VkBufferImageCopy& region : uploadRegions)
+		{
+			const uint32_t mip = region.imageSubresource.mipLevel + residentMip;
+			memcpy(static_cast<uint8_t*>(data) + region.bufferOffset, mipPixels[mip], cookedTexture->mips[mip].size);
+		}
+		vkUnmapMemory(device, stageBufferMemory);
+	}
+
+	VkImage newImage;
+	VkDeviceMemory newImageMemory;
 	createImage(
-		width, 
-		height, 
-		mipLevels,
+		baseMip.width,
+		baseMip.height,
+		levelCount,
 		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_IMAGE_TILING_OPTIMAL, 
+		VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		imageMemory,
-		image);
+		newImageMemory,
+		newImage);
 
-	transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-		copyBuffer2Image(stageBuffer, image, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-	//transitionImageLayout(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	//transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
+	VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
 
-	vkDestroyBuffer(device, stageBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	VkImageMemoryBarrier barriers[2];
+	ZeroVkStructure(barriers[0], VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
+	barriers[0].image = newImage;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	ZeroVkStructure(barriers[1], VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
+	barriers[1].image = image;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, oldLevelCount, 0, 1 };
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	const bool bCopyOldMips = image != VK_NULL_HANDLE;
+	vkCmdPipelineBarrier(cmdBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, bCopyOldMips ? 2 : 1, barriers);
 
-	genMipmaps(image, VK_FORMAT_R8G8B8A8_SRGB, width, height, mipLevels);
-}
+	// Mips both images hold move over on GPU
+	if (bCopyOldMips)
+	{
+		std::vector<VkImageCopy> copyRegions;
+		for (uint32_t mip = std::max(residentMip, textureResidentMip); mip < mipLevels; ++mip)
+		{
+			VkImageCopy region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - textureResidentMip, 0, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - residentMip, 0, 1 };
+			region.extent = { cookedTexture->mips[mip].width, cookedTexture->mips[mip].height, 1 };
+			copyRegions.push_back(region);
+		}
 
-void HelloTriangleApplication::createTextureImageView()
-{
-	imageView = createImageView(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+		vkCmdCopyImage(cmdBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+	}
+
+	if (!uploadRegions.empty())
+	{
+		vkCmdCopyBufferToImage(cmdBuffer, stageBuffer, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(uploadRegions.size()), uploadRegions.data());
+	}
+
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, barriers);
+
+	// Queued ahead of the next frame, frames in flight may still sample the old image
+	submitSingleTimeCommands(cmdBuffer);
 
+	const uint64_t deletionValue = getDeletionValue();
+	deletionQueue.DestroyBuffer(deletionValue, stageBuffer);
+	deletionQueue.FreeMemory(deletionValue, stageBufferMemory);
 
+	if (bCopyOldMips)
+	{
+		deletionQueue.DestroyImageView(deletionValue, imageView);
+		deletionQueue.DestroyImage(deletionValue, image);
+		deletionQueue.FreeMemory(deletionValue, imageMemory);
+	}
 
+	image = newImage;
+	imageMemory = newImageMemory;
+	imageView = createImageView(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, levelCount);
+	textureResidentMip = residentMip;
 }
 
 void HelloTriangleApplication::createTextureSampler()
@@ -1613,303 +2678,979 @@ void HelloTriangleApplication::createIndexBuffer()
 	vkFreeMemory(device, stageBufferMemory, nullptr);
 }
 
-void HelloTriangleApplication::createUniformBuffer()
+void HelloTriangleApplication::createInstanceBuffer()
 {
-	VkDeviceSize bufferSize = sizeof(UniformBuffer);
-	uniformBuffer.resize(swapChainImages.size());
-	uniformBufferMemory.resize(swapChainImages.size());
+	// Place every mesh on a grid centered at origin
+	instanceData.Clear();
+	instanceData.Reserve(DummyMeshes.size() * INSTANCE_COUNT_PER_AXIS * INSTANCE_COUNT_PER_AXIS);
 
-	for (size_t i = 0; i< swapChainImages.size(); ++i)
+	// Grid cells are children of one root node, moving the root moves the whole grid
+	TransformHierarchy::NodeHandle gridRoot = sceneTransforms.CreateNode();
+	std::vector<TransformHierarchy::NodeHandle> gridNodes;
+	gridNodes.reserve(INSTANCE_COUNT_PER_AXIS * INSTANCE_COUNT_PER_AXIS);
+
+	const float gridOffset = (INSTANCE_COUNT_PER_AXIS - 1) * INSTANCE_SPACING * 0.5f;
+	for (uint32_t y = 0; y < INSTANCE_COUNT_PER_AXIS; ++y)
 	{
-		createBuffer(uniformBufferMemory[i], 
-			bufferSize, 
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 
-			uniformBuffer[i]);
+		for (uint32_t x = 0; x < INSTANCE_COUNT_PER_AXIS; ++x)
+		{
+			Math::Vec4 position(x * INSTANCE_SPACING - gridOffset, y * INSTANCE_SPACING - gridOffset, 0.0f, 1.0f);
+			gridNodes.push_back(sceneTransforms.CreateNode(gridRoot, position, Math::Quat::Identity(), Math::Vec4(1.0f, 1.0f, 1.0f, 0.0f)));
+		}
 	}
-}
-
-void HelloTriangleApplication::createDescriptorPool()
-{
-	std::array<VkDescriptorPoolSize, 2> poolSize;
-	//
-	poolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSize[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
-	poolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSize[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+	sceneTransforms.Update();
 
-	VkDescriptorPoolCreateInfo descPoolInfo;
-	ZeroVkStructure(descPoolInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO);
-	descPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSize.size());
-	descPoolInfo.pPoolSizes = poolSize.data(); 
-	descPoolInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
-
-	if (vkCreateDescriptorPool(device, &descPoolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	for (TransformHierarchy::NodeHandle node : gridNodes)
 	{
-		throw std::runtime_error("Failed to create descriptor pool..");
-	}
-}
+		const Math::Mat4& transform = sceneTransforms.GetWorldMatrix(node);
 
-void HelloTriangleApplication::createDescriptorSet()
-{
-	std::vector<VkDescriptorSetLayout> descSetLayouts(swapChainImages.size(), descriptorSetLayout);
-	
-	VkDescriptorSetAllocateInfo descSetAllocInfo;
-	ZeroVkStructure(descSetAllocInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO);
-	descSetAllocInfo.descriptorPool = descriptorPool;
-	descSetAllocInfo.descriptorSetCount = swapChainImages.size();
-	descSetAllocInfo.pSetLayouts = descSetLayouts.data();
+		for (uint32_t meshIdx = 0; meshIdx < DummyMeshes.size(); ++meshIdx)
+		{
+			instanceData.AddInstance(meshIdx, &transform.c[0].x, 0);
+		}
+	}
+	instanceData.Build();
 
-	// descriptorSets will be free after descriptor pool destroy
-	descriptorSets.resize(swapChainImages.size());
-	if (vkAllocateDescriptorSets(device, &descSetAllocInfo, descriptorSets.data()) != VK_SUCCESS) 
+	maxClusterDraws = 0;
+	maxClusterInstances = 0;
+	maxBatchMeshletCount = 0;
+	for (const InstanceDrawBatch& batch : instanceData.GetBatches())
 	{
-		throw std::runtime_error("Failed to allocate descriptor sets..");
+		const uint32_t meshletCount = DummyMeshes[batch.meshIndex].meshletCount;
+		maxClusterDraws += meshletCount;
+		maxClusterInstances += batch.instanceCount * meshletCount;
+		maxBatchMeshletCount = std::max(maxBatchMeshletCount, meshletCount);
 	}
 
-	// create descriptor buffer
-	for (size_t i = 0; i < swapChainImages.size(); i++) 
+	// World space bounding spheres in sorted instance order for CPU culling and texture streaming
+	instanceSpheres.resize(instanceData.GetInstanceCount());
+	if (!bGpuDrivenCulling)
 	{
-		VkDescriptorBufferInfo descBufferInfo = {};
-		descBufferInfo.buffer = uniformBuffer[i];
-		descBufferInfo.offset = 0;
-		descBufferInfo.range = sizeof(UniformBuffer);
-
-		VkDescriptorImageInfo descImageInfo = {};
-		descImageInfo.sampler = defaultSampler;
-		descImageInfo.imageView = imageView;
-		descImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
-
-		// Uniform buffer
-		ZeroVkStructure(descriptorWrites[0], VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET);
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0; // index
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &descBufferInfo;
-
-		// Sampler
-		ZeroVkStructure(descriptorWrites[1], VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET);
-		descriptorWrites[1].dstSet = descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1; // binding index
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &descImageInfo;
-
-		// Multiple descriptor need update
-		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+		instanceCuller.Clear();
+		instanceCuller.Reserve(instanceData.GetInstanceCount());
+		instanceLods.assign(instanceData.GetInstanceCount(), 0);
+
+		// (batch, lod) draws followed by the draws of every meshlet, same order as cullInstances() writes them
+		const std::vector<InstanceDrawBatch>& batches = instanceData.GetBatches();
+		drawFirstInstances.resize(batches.size() * MESH_MAX_LODS);
+		for (uint32_t batchIdx = 0; batchIdx < batches.size(); ++batchIdx)
+		{
+			for (uint32_t lod = 0; lod < MESH_MAX_LODS; ++lod)
+			{
+				drawFirstInstances[batchIdx * MESH_MAX_LODS + lod] = GetLodFirstInstance(lod, instanceData.GetInstanceCount(), batches[batchIdx].firstInstance);
+			}
+		}
+
+		uint32_t firstClusterInstance = instanceData.GetInstanceCount() * MESH_MAX_LODS;
+		for (const InstanceDrawBatch& batch : batches)
+		{
+			const uint32_t meshletCount = DummyMeshes[batch.meshIndex].meshletCount;
+			for (uint32_t meshletIdx = 0; meshletIdx < meshletCount; ++meshletIdx)
+			{
+				drawFirstInstances.push_back(GetClusterFirstInstance(meshletIdx, batch.instanceCount, firstClusterInstance));
+			}
+			firstClusterInstance += batch.instanceCount * meshletCount;
+		}
 	}
-}
 
-void HelloTriangleApplication::createCommandBuffers()
-{
-	commandBuffers.resize(swapChainFramebuffers.size());
+	for (uint32_t instanceIdx = 0; instanceIdx < instanceData.GetInstanceCount(); ++instanceIdx)
+	{
+		Math::Mat4 transform;
+		memcpy(&transform, instanceData.GetTransforms() + instanceIdx * 16, sizeof(transform));
 
-	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {}; 
-	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO; 
-	commandBufferAllocateInfo.commandPool = commandPool;
-	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		const MeshDrawInfo& mesh = DummyMeshes[instanceData.GetMeshIndices()[instanceIdx]];
+		Math::Vec4 center = Math::TransformPoint(transform, Math::Vec4(mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2], 1.0f));
+		float scale = std::max({ Math::Length3(transform.c[0]), Math::Length3(transform.c[1]), Math::Length3(transform.c[2]) });
+		instanceSpheres[instanceIdx] = Math::Vec4(center.x, center.y, center.z, mesh.boundsRadius * scale);
 
-	if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers.data()) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate command buffer..");
+		if (!bGpuDrivenCulling)
+		{
+			instanceCuller.AddSphere(center, mesh.boundsRadius * scale);
+		}
 	}
 
-	// Record commands to command buffer
-	for (size_t i = 0; i< commandBuffers.size(); ++i)
+	// Largest instances occlude the rest. Only vertices are added here, cullInstances() adds triangles of the LOD
+	// drawn every frame, a coarser LOD may shrink the silhouette and LOD 0 would hide what is visible around it.
+	// Budget is of LOD 0 so it holds for any LOD.
+	if (!bGpuDrivenCulling && ENABLE_OCCLUSION_CULLING)
 	{
-		VkCommandBufferBeginInfo cmdBeginInfo = {};
-		cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		cmdBeginInfo.pInheritanceInfo = nullptr;
-
-		if (vkBeginCommandBuffer(commandBuffers[i], &cmdBeginInfo) != VK_SUCCESS)
+		std::vector<uint32_t> occluders(instanceData.GetInstanceCount());
+		for (uint32_t instanceIdx = 0; instanceIdx < instanceData.GetInstanceCount(); ++instanceIdx)
 		{
-			throw std::runtime_error("Failed to create command buffers..");
+			occluders[instanceIdx] = instanceIdx;
 		}
+		std::stable_sort(occluders.begin(), occluders.end(), [&](uint32_t a, uint32_t b) { return instanceSpheres[a].w > instanceSpheres[b].w; });
 
-		// Clear color for color buffer/ depth buffer
-		std::array<VkClearValue, 2> clearValue = {};
-		clearValue[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
-		clearValue[1].depthStencil = { 1.0f, 0 };
+		occlusionCuller.Initialize(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+		occlusionCuller.ClearOccluders();
+		occluderInstances.clear();
+		occluderFirstVertices.clear();
 
-		// Rendering process will begin once vkCmdBeginRenderPass invoked
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		renderPassInfo.renderArea.extent = swapChainExtent;
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		//VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };  // For VK_ATTACHMENT_LOAD_OP_CLEAR
-		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValue.size());
-		renderPassInfo.pClearValues = clearValue.data();
+		uint32_t triangleCount = 0;
+		for (uint32_t instanceIdx : occluders)
+		{
+			// Smaller instances after a skipped one may still fit
+			const MeshDrawInfo& mesh = DummyMeshes[instanceData.GetMeshIndices()[instanceIdx]];
+			if (triangleCount + mesh.indexCount / 3 > OCCLUDER_TRIANGLE_BUDGET)
+			{
+				continue;
+			}
+			triangleCount += mesh.indexCount / 3;
 
-		// Begin render pass
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			Math::Mat4 transform;
+			memcpy(&transform, instanceData.GetTransforms() + instanceIdx * 16, sizeof(transform));
+			occluderInstances.push_back(instanceIdx);
+			occluderFirstVertices.push_back(occlusionCuller.AddOccluder(transform, &DummyVertices[mesh.vertexOffset].position.x, mesh.vertexCount, sizeof(Vertex), nullptr, 0));
+		}
+		occlusionCuller.ReserveOccluders(0, triangleCount);
+	}
 
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	// Storage buffer offsets must respect device alignment
+	VkPhysicalDeviceProperties physicalDeviceProp;
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProp);
+	VkDeviceSize alignment = physicalDeviceProp.limits.minStorageBufferOffsetAlignment;
 
-			VkBuffer vertexBuffers[] = { vertexBuffer };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-			//// uint8 need extra extension to support, check if VkPhysicalDeviceIndexTypeUint8FeaturesEXT enabled.
-			//vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT8_EXT);
-			vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	instanceMaterialOffset = instanceData.GetMaterialIndicesOffset(alignment);
+	VkDeviceSize bufferSize = instanceData.GetPackedSize(alignment);
 
-			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+	VkBuffer stageBuffer;
+	VkDeviceMemory stageBufferMemory;
+	void* data = nullptr;
 
-			//vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(DummyVertices.size()), 1, 0, 0);
-			vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(DummyIndices.size()), 1, 0, 0, 0);
+	createBuffer(stageBufferMemory,
+		bufferSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		stageBuffer);
 
-		vkCmdEndRenderPass(commandBuffers[i]);
+	vkMapMemory(device, stageBufferMemory, 0, bufferSize, 0, &data);
+		instanceData.Pack(data, alignment);
+	vkUnmapMemory(device, stageBufferMemory);
 
-		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to record command buffer..");
-		}
-	}
+	// Static instances for now, so keep it in GPU local memory
+	createBuffer(instanceBufferMemory,
+		bufferSize,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		instanceBuffer,
+		true);
+
+	copyBuffer(stageBuffer, instanceBuffer, bufferSize);
+
+	vkDestroyBuffer(device, stageBuffer, nullptr);
+	vkFreeMemory(device, stageBufferMemory, nullptr);
 }
 
-void HelloTriangleApplication::createSyncObjects()
+void HelloTriangleApplication::createMaterials()
 {
-	imageAvailableSemaphores.resize(MAX_FRAMES_IN_SWAPCHAIN);
-	renderFinishSemaphores.resize(MAX_FRAMES_IN_SWAPCHAIN);
-	presentFences.resize(MAX_FRAMES_IN_SWAPCHAIN);
+	if (!bBindless)
+	{
+		return;
+	}
 
-	VkSemaphoreCreateInfo semaphoreInfo = {}; 
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	diffuseTextureSlot = bindlessDescriptors.AddTexture(imageView, defaultSampler);
+
+	// Every instance uses material 0 for now, more materials only need their textures added and a table entry
+	std::vector<MaterialData> materials(1);
+	materials[0] = {};
+	materials[0].albedoTexture = diffuseTextureSlot;
+	materials[0].baseColor = Vector4(1.0f);
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	const VkDeviceSize materialTableSize = sizeof(MaterialData) * materials.size();
+	createDeviceLocalBuffer(materials.data(), materialTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, materialBufferMemory, materialBuffer);
 
-	for (size_t i= 0; i< MAX_FRAMES_IN_SWAPCHAIN; ++i)
+	// Fragment shader finds the table at a fixed slot
+	if (bindlessDescriptors.AddBuffer(materialBuffer, 0, materialTableSize) != MATERIAL_TABLE_BUFFER)
 	{
-		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(device, & fenceInfo, nullptr, &presentFences[i]))
-		{
-			throw std::runtime_error("Failed to create semaphore");
-		}
+		throw std::runtime_error("Material table has to be the first bindless buffer..");
 	}
 }
 
-void HelloTriangleApplication::createDepthResource()
+void HelloTriangleApplication::createCullingBuffers()
 {
-	VkFormat depthFormat = getPreferredDepthFormat();
+	if (!bGpuDrivenCulling)
+	{
+		return;
+	}
+
+	const std::vector<InstanceDrawBatch>& batches = instanceData.GetBatches();
 
-	createImage(swapChainExtent.width, 
-		        swapChainExtent.height, 
-				1,
-		        depthFormat, 
-		        VK_IMAGE_TILING_OPTIMAL,
-				VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		        depthImageMemory,
-		        depthImage,
-				msaaSamplePoints);
+	// Static per batch draw arguments and bounds
+	std::vector<CullBatch> cullBatches(batches.size());
+	std::vector<uint32_t> instanceBatches(instanceData.GetInstanceCount());
+	uint32_t firstClusterInstance = instanceData.GetInstanceCount() * MESH_MAX_LODS;
+	for (uint32_t batchIdx = 0; batchIdx < batches.size(); ++batchIdx)
+	{
+		const InstanceDrawBatch& batch = batches[batchIdx];
+		const MeshDrawInfo& mesh = DummyMeshes[batch.meshIndex];
+
+		CullBatch& cullBatch = cullBatches[batchIdx];
+		cullBatch.lodCount = mesh.lodCount;
+		cullBatch.vertexOffset = mesh.vertexOffset;
+		cullBatch.firstInstance = batch.firstInstance;
+		cullBatch.meshletCount = mesh.meshletCount;
+		cullBatch.firstMeshlet = mesh.firstMeshlet;
+		cullBatch.firstClusterInstance = firstClusterInstance;
+		cullBatch.instanceCount = batch.instanceCount;
+		firstClusterInstance += batch.instanceCount * mesh.meshletCount;
+		cullBatch.boundingSphere = Vector4(mesh.boundsCenter[0], mesh.boundsCenter[1], mesh.boundsCenter[2], mesh.boundsRadius);
+		for (uint32_t lod = 0; lod < MESH_MAX_LODS; ++lod)
+		{
+			const MeshLodLevel& level = mesh.lods[std::min(lod, mesh.lodCount - 1)];
+			cullBatch.lodFirstIndex[lod] = level.firstIndex;
+			cullBatch.lodIndexCount[lod] = level.indexCount;
+			cullBatch.lodScreenRadius[lod] = mesh.lodThresholds.screenRadius[std::min(lod, mesh.lodCount - 1)];
+		}
 
-	depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+		std::fill_n(instanceBatches.begin() + batch.firstInstance, batch.instanceCount, batchIdx);
+	}
 
-	transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	createDeviceLocalBuffer(cullBatches.data(),
+		sizeof(CullBatch) * cullBatches.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		cullBatchBufferMemory,
+		cullBatchBuffer,
+		true);
+
+	createDeviceLocalBuffer(instanceBatches.data(),
+		sizeof(uint32_t) * instanceBatches.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		instanceBatchBufferMemory,
+		instanceBatchBuffer,
+		true);
+
+	// Everything starts at LOD 0. Shared, it is uploaded on graphics and rewritten by async compute every frame
+	// from what it held the frame before.
+	std::vector<uint32_t> instanceLodData(std::max(instanceData.GetInstanceCount(), 1u), 0);
+	createDeviceLocalBuffer(instanceLodData.data(),
+		sizeof(uint32_t) * instanceLodData.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		instanceLodBufferMemory,
+		instanceLodBuffer,
+		true);
+
+	// Storage buffer can not be empty, dummy meshlet is never read then
+	std::vector<Meshlet> meshlets(DummyMeshlets);
+	meshlets.resize(std::max<size_t>(meshlets.size(), 1));
+	createDeviceLocalBuffer(meshlets.data(),
+		sizeof(Meshlet) * meshlets.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		meshletBufferMemory,
+		meshletBuffer,
+		true);
 }
 
-void HelloTriangleApplication::createColorResource()
+void HelloTriangleApplication::createFrameCullingBuffers()
 {
-	VkFormat colorFormat = swapChainImageFormat;
-
-	createImage(swapChainExtent.width,
-				swapChainExtent.height,
-				1,
-				colorFormat,
-				VK_IMAGE_TILING_OPTIMAL,
-				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
-				colorImageMemory,
-				colorImage,
-		        msaaSamplePoints);
-
-	colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	// Draws and counters per (batch, lod), visible list has a region per LOD. Cluster draws follow batch draws,
+	// their regions follow the LOD regions.
+	const uint32_t batchCount = static_cast<uint32_t>(instanceData.GetBatches().size()) * MESH_MAX_LODS;
+	const uint32_t drawCount = batchCount + maxClusterDraws;
+	const uint32_t visibleCount = std::max(instanceData.GetInstanceCount() * MESH_MAX_LODS + maxClusterInstances, 1u);
+
+	visibleInstanceBuffer.resize(swapChainImages.size());
+	visibleInstanceBufferMemory.resize(swapChainImages.size());
+	cullCounterBuffer.resize(swapChainImages.size());
+	cullCounterBufferMemory.resize(swapChainImages.size());
+	drawCommandBuffer.resize(swapChainImages.size());
+	drawCommandBufferMemory.resize(swapChainImages.size());
+
+	for (size_t i = 0; i < swapChainImages.size(); ++i)
+	{
+		if (!bGpuDrivenCulling)
+		{
+			// Rewritten by cullInstances() every frame
+			createBuffer(visibleInstanceBufferMemory[i],
+				sizeof(uint32_t) * visibleCount,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				visibleInstanceBuffer[i]);
+
+			createBuffer(drawCommandBufferMemory[i],
+				sizeof(VkDrawIndexedIndirectCommand) * std::max(drawCount, 1u),
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				drawCommandBuffer[i]);
+
+			continue;
+		}
 
-	transitionImageLayout(colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1);
+		createBuffer(visibleInstanceBufferMemory[i],
+			sizeof(uint32_t) * visibleCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			visibleInstanceBuffer[i]);
+
+		// draw count followed by visible instance counter of each (batch, lod), cleared every frame
+		createBuffer(cullCounterBufferMemory[i],
+			sizeof(uint32_t) * (1 + batchCount),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			cullCounterBuffer[i]);
+
+		createBuffer(drawCommandBufferMemory[i],
+			sizeof(VkDrawIndexedIndirectCommand) * drawCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			drawCommandBuffer[i]);
+	}
 }
 
-void HelloTriangleApplication::recreateSwapChain()
+void HelloTriangleApplication::createCullingPipeline()
 {
-	// minimize
-	int width = 0;
-	int height = 0;
-	while (width == 0 || height == 0)
+	if (!bGpuDrivenCulling)
 	{
-		glfwGetFramebufferSize(window, &width, &height);
-		glfwWaitEvents();
+		return;
 	}
 
-	vkDeviceWaitIdle(device);
-
-	cleanupSwapChain();
-
-	createSwapChain();
-	createSwapChainImageView();
-	createRenderPass();
-	createGraphicsPipeline();
-	createColorResource();
-	createDepthResource();
-	createFrameBuffers();
-	createUniformBuffer();
-	createDescriptorPool();
-	createDescriptorSet();
-	createCommandBuffers();
-}
-
-void HelloTriangleApplication::cleanupSwapChain()
-{
-	// Cleanup frame buffer, command buffer, pipeline object, pipeline layout, render pass, image view, swap chain in order
-	for (size_t i = 0; i< swapChainFramebuffers.size(); ++i)
+	// ubo, instance transforms, instance batches, batches, counters, draw commands, visible instances, instance lods,
+	// meshlets
+	std::array<VkDescriptorSetLayoutBinding, 9> bindings = {};
+	for (uint32_t binding = 0; binding < bindings.size(); ++binding)
 	{
-		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+		bindings[binding].binding = binding;
+		bindings[binding].descriptorCount = 1;
+		bindings[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[binding].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[binding].pImmutableSamplers = nullptr;
 	}
 
-	vkDestroyImageView(device, colorImageView, nullptr);
-	vkDestroyImage(device, colorImage, nullptr);
-	vkFreeMemory(device, colorImageMemory, nullptr);
+	VkDescriptorSetLayoutCreateInfo descSetLayoutInfo;
+	ZeroVkStructure(descSetLayoutInfo, VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO);
+	descSetLayoutInfo.bindingCount = bindings.size();
+	descSetLayoutInfo.pBindings = bindings.data();
 
-	vkDestroyImageView(device, depthImageView, nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
+	if (vkCreateDescriptorSetLayout(device, &descSetLayoutInfo, nullptr, &cullDescriptorSetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create culling descriptor set layout..");
+	}
 
-	vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullConstants);
 
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr);
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
-	for (size_t i = 0; i < swapChainImages.size(); i++) 
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS)
 	{
-		vkDestroyBuffer(device, uniformBuffer[i], nullptr);
-		vkFreeMemory(device, uniformBufferMemory[i], nullptr);
+		throw std::runtime_error("Failed to create culling pipeline layout");
 	}
 
-	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	const char* shaderFiles[] = { CULL_INSTANCES_SHADER, COMPACT_DRAWS_SHADER, CLUSTER_CULL_SHADER };
+	VkPipeline* pipelines[] = { &cullInstancesPipeline, &compactDrawsPipeline, &clusterCullPipeline };
 
-	for (size_t i = 0; i < swapChainImageViews.size(); ++i)
+	for (size_t i = 0; i < 3; ++i)
+	{
+		VkShaderModule csModule = createShaderModule(ReadFile(shaderFiles[i]));
+
+		VkComputePipelineCreateInfo pipelineInfo = {};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = csModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = cullPipelineLayout;
+
+		VkResult ret = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipelines[i]);
+		vkDestroyShaderModule(device, csModule, nullptr);
+
+		if (ret != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create culling pipeline..");
+		}
+	}
+}
+
+void HelloTriangleApplication::bindCulling(VkCommandBuffer commandBuffer, size_t imageIdx)
+{
+	CullConstants constants = {};
+	constants.instanceCount = instanceData.GetInstanceCount();
+	constants.batchCount = static_cast<uint32_t>(instanceData.GetBatches().size());
+	constants.viewportHalfHeight = swapChainExtent.height * 0.5f;
+	constants.lodHysteresis = LOD_HYSTERESIS;
+
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSets[imageIdx], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+}
+
+void HelloTriangleApplication::createUniformBuffer()
+{
+	VkDeviceSize bufferSize = sizeof(UniformBuffer);
+	uniformBuffer.resize(swapChainImages.size());
+	uniformBufferMemory.resize(swapChainImages.size());
+	imageSubmitCounts.resize(swapChainImages.size(), 0);
+
+	for (size_t i = 0; i< swapChainImages.size(); ++i)
+	{
+		createBuffer(uniformBufferMemory[i], 
+			bufferSize, 
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 
+			uniformBuffer[i],
+			true);
+	}
+}
+
+void HelloTriangleApplication::createDescriptorAllocators()
+{
+	// Average set, graphics set has a uniform buffer, three storage buffers and a sampler, culling set a uniform
+	// buffer and eight storage buffers
+	const std::vector<VkDescriptorPoolSize> descriptorsPerSet = {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 },
+	};
+
+	descriptorAllocator.Initialize(device, descriptorsPerSet, static_cast<uint32_t>(swapChainImages.size() * 2));
+	descriptorSetCache.Initialize(device, &descriptorAllocator);
+}
+
+void HelloTriangleApplication::createDescriptorSet()
+{
+	// descriptorSets are owned by the cache, allocator reset frees them
+	descriptorSets.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++) 
+	{
+		// Both SoA arrays live in the same buffer. Sampler goes last, it is left out when textures are bindless.
+		std::array<DescriptorBinding, 5> bindings = {
+			DescriptorBinding::Buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer[i], 0, sizeof(UniformBuffer)),
+			DescriptorBinding::Buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceBuffer, 0, instanceData.GetTransformsSize()),
+			DescriptorBinding::Buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceBuffer, instanceMaterialOffset, instanceData.GetMaterialIndicesSize()),
+			DescriptorBinding::Buffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleInstanceBuffer[i], 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Image(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageView, defaultSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		};
+
+		const uint32_t bindingCount = static_cast<uint32_t>(bindings.size()) - (bBindless ? 1 : 0);
+		descriptorSets[i] = descriptorSetCache.Get(descriptorSetLayout, bindings.data(), bindingCount);
+	}
+
+	if (!bGpuDrivenCulling)
+	{
+		return;
+	}
+
+	cullDescriptorSets.resize(swapChainImages.size());
+	for (size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		// Binding order matches CullInstances.comp/ CompactDraws.comp/ ClusterCull.comp
+		std::array<DescriptorBinding, 9> bindings = {
+			DescriptorBinding::Buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer[i], 0, sizeof(UniformBuffer)),
+			DescriptorBinding::Buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceBuffer, 0, instanceData.GetTransformsSize()),
+			DescriptorBinding::Buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceBatchBuffer, 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, cullBatchBuffer, 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, cullCounterBuffer[i], 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawCommandBuffer[i], 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, visibleInstanceBuffer[i], 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instanceLodBuffer, 0, VK_WHOLE_SIZE),
+			DescriptorBinding::Buffer(8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, meshletBuffer, 0, VK_WHOLE_SIZE)
+		};
+
+		cullDescriptorSets[i] = descriptorSetCache.Get(cullDescriptorSetLayout, bindings.data(), static_cast<uint32_t>(bindings.size()));
+	}
+}
+
+void HelloTriangleApplication::createCommandBuffers()
+{
+	commandBuffers.resize(swapChainFramebuffers.size());
+
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {}; 
+	commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO; 
+	commandBufferAllocateInfo.commandPool = commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+	if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate command buffer..");
+	}
+
+	// Record commands to command buffer, passes and barriers between them come from frame graph
+	for (size_t i = 0; i< commandBuffers.size(); ++i)
+	{
+		VkCommandBufferBeginInfo cmdBeginInfo = {};
+		cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		cmdBeginInfo.pInheritanceInfo = nullptr;
+
+		if (vkBeginCommandBuffer(commandBuffers[i], &cmdBeginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create command buffers..");
+		}
+
+		frameGraph.Execute(commandBuffers[i], static_cast<uint32_t>(i));
+
+		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record command buffer..");
+		}
+	}
+
+	if (!bAsyncCompute)
+	{
+		return;
+	}
+
+	// Async compute passes of the same frame, submitted ahead of the graphics command buffer
+	computeCommandBuffers.resize(swapChainFramebuffers.size());
+	commandBufferAllocateInfo.commandPool = computeCommandPool;
+
+	if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, computeCommandBuffers.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate compute command buffer.");
+	}
+
+	for (size_t i = 0; i < computeCommandBuffers.size(); ++i)
+	{
+		VkCommandBufferBeginInfo cmdBeginInfo = {};
+		cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+
+		if (vkBeginCommandBuffer(computeCommandBuffers[i], &cmdBeginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to begin compute command buffer.");
+		}
+
+		frameGraph.Execute(computeCommandBuffers[i], static_cast<uint32_t>(i), RenderGraphQueue::AsyncCompute);
+
+		if (vkEndCommandBuffer(computeCommandBuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to record compute command buffer.");
+		}
+	}
+}
+
+void HelloTriangleApplication::recordMainPass(VkCommandBuffer commandBuffer, size_t imageIdx)
+{
+	// Clear color for color buffer/ depth buffer
+	std::array<VkClearValue, 2> clearValue = {};
+	clearValue[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	clearValue[1].depthStencil = { 1.0f, 0 };
+
+	// Rendering process will begin once vkCmdBeginRenderPass invoked
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIdx];
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	//VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };  // For VK_ATTACHMENT_LOAD_OP_CLEAR
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValue.size());
+	renderPassInfo.pClearValues = clearValue.data();
+
+	// Begin render pass
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+		VkViewport viewport = { 0, 0, (float)swapChainExtent.width, (float)swapChainExtent.height, 0.0f, 1.0f };
+		VkRect2D scissor = { VkOffset2D{0, 0}, swapChainExtent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		VkBuffer vertexBuffers[] = { vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		//// uint8 need extra extension to support, check if VkPhysicalDeviceIndexTypeUint8FeaturesEXT enabled.
+		//vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT8_EXT);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		// One bind for every draw, materials pick their textures from the bindless set
+		std::array<VkDescriptorSet, 2> sets = { descriptorSets[imageIdx], bindlessDescriptors.GetSet() };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, bBindless ? 2 : 1, sets.data(), 0, nullptr);
+
+		//vkCmdDraw(commandBuffer, static_cast<uint32_t>(DummyVertices.size()), 1, 0, 0);
+		if (bGpuDrivenCulling)
+		{
+			// Draws and count come from compute pass, recorded once no matter how many instances.
+			// Their firstInstance already points at their visible slots.
+			const uint32_t firstInstance = 0;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &firstInstance);
+			vkCmdDrawIndexedIndirectCount(commandBuffer,
+				drawCommandBuffer[imageIdx], 0,
+				cullCounterBuffer[imageIdx], 0,
+				static_cast<uint32_t>(instanceData.GetBatches().size()) * MESH_MAX_LODS + maxClusterDraws,
+				sizeof(VkDrawIndexedIndirectCommand));
+		}
+		else
+		{
+			// One instanced draw per unique mesh and LOD followed by cluster draws, instance counts written by
+			// cullInstances() every frame. Single draw per call, so no multiDrawIndirect needed. Visible slots
+			// are fixed per draw and pushed, firstInstance stays 0 so drawIndirectFirstInstance is not needed.
+			for (uint32_t drawIdx = 0; drawIdx < drawFirstInstances.size(); ++drawIdx)
+			{
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &drawFirstInstances[drawIdx]);
+				vkCmdDrawIndexedIndirect(commandBuffer,
+					drawCommandBuffer[imageIdx],
+					drawIdx * sizeof(VkDrawIndexedIndirectCommand),
+					1,
+					sizeof(VkDrawIndexedIndirectCommand));
+			}
+		}
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void HelloTriangleApplication::createSyncObjects()
+{
+	imageAvailableSemaphores.resize(framesInFlight);
+	renderFinishSemaphores.resize(framesInFlight);
+
+	VkSemaphoreCreateInfo semaphoreInfo = {}; 
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (size_t i= 0; i< framesInFlight; ++i)
+	{
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishSemaphores[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create semaphore");
+		}
+	}
+
+	// Starts at 0, no frame completed yet
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+	semaphoreInfo.pNext = &timelineInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create frame timeline semaphore.");
+	}
+
+	if (bAsyncCompute && vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeTimeline) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create compute timeline semaphore.");
+	}
+}
+
+void HelloTriangleApplication::createFrameGraph()
+{
+	// Swap chain image is the resolve target, presented or read back after the frame
+	const uint32_t backbuffer = frameGraph.ImportImage("Backbuffer",
+		swapChainImages,
+		swapChainImageFormat,
+		RenderGraphUsage::Acquired,
+		bHeadless ? RenderGraphUsage::TransferSrc : RenderGraphUsage::Present);
+
+	RenderGraphImageDesc targetDesc = {};
+	targetDesc.width = swapChainExtent.width;
+	targetDesc.height = swapChainExtent.height;
+	targetDesc.format = swapChainImageFormat;
+	targetDesc.samples = msaaSamplePoints;
+	targetDesc.extraUsage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	msaaColorTarget = frameGraph.CreateImage("MsaaColor", targetDesc);
+
+	// Cleared on load and discarded on store like the MSAA color, so both never need backing memory on tilers
+	targetDesc.format = getPreferredDepthFormat();
+	depthTarget = frameGraph.CreateImage("Depth", targetDesc);
+
+	// Per swap chain image buffers, imageIdx picks the one of the command buffer. Handles are for the queue
+	// family ownership transfers of async compute.
+	const uint32_t drawCommands = frameGraph.ImportBuffer("DrawCommands", drawCommandBuffer);
+	const uint32_t cullCounters = frameGraph.ImportBuffer("CullCounters", cullCounterBuffer);
+	const uint32_t visibleInstances = frameGraph.ImportBuffer("VisibleInstances", visibleInstanceBuffer);
+
+	// Culling runs outside of render pass. On async compute the buffers it writes for an image are free once the
+	// last frame rendered to that image completed, draw() waits for it before submitting.
+	if (bGpuDrivenCulling)
+	{
+		const RenderGraphQueue cullQueue = bAsyncCompute ? RenderGraphQueue::AsyncCompute : RenderGraphQueue::Graphics;
+		const uint32_t instanceLods = frameGraph.ImportBuffer("InstanceLods");
+
+		uint32_t pass = frameGraph.AddPass("ClearCullCounters", [this](VkCommandBuffer commandBuffer, uint32_t imageIdx)
+		{
+			vkCmdFillBuffer(commandBuffer, cullCounterBuffer[imageIdx], 0, VK_WHOLE_SIZE, 0);
+		}, false, cullQueue);
+		frameGraph.Write(pass, cullCounters, RenderGraphUsage::TransferDst);
+
+		// Frustum cull instances and pick their LOD, fills visible list and per (batch, lod) counters.
+		// Instance LODs of the previous frame are read back for hysteresis.
+		pass = frameGraph.AddPass("CullInstances", [this](VkCommandBuffer commandBuffer, uint32_t imageIdx)
+		{
+			bindCulling(commandBuffer, imageIdx);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullInstancesPipeline);
+			vkCmdDispatch(commandBuffer, (instanceData.GetInstanceCount() + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		}, false, cullQueue);
+		frameGraph.Write(pass, cullCounters, RenderGraphUsage::ComputeWrite);
+		frameGraph.Write(pass, visibleInstances, RenderGraphUsage::ComputeWrite);
+		frameGraph.Write(pass, instanceLods, RenderGraphUsage::ComputeWrite);
+
+		pass = frameGraph.AddPass("BuildDraws", [this](VkCommandBuffer commandBuffer, uint32_t imageIdx)
+		{
+			const uint32_t batchCount = static_cast<uint32_t>(instanceData.GetBatches().size());
+
+			// Compact non-empty (batch, lod) pairs into indirect draws
+			bindCulling(commandBuffer, imageIdx);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compactDrawsPipeline);
+			vkCmdDispatch(commandBuffer, (batchCount * MESH_MAX_LODS + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+			// Meshlets against the visible LOD 0 instances of their batch, appended to the same draw list through
+			// the draw count atomic, so no barrier against the compaction is needed. One group per (meshlet, batch).
+			if (maxClusterDraws > 0)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, clusterCullPipeline);
+				vkCmdDispatch(commandBuffer, maxBatchMeshletCount, batchCount, 1);
+			}
+		}, false, cullQueue);
+		frameGraph.Write(pass, cullCounters, RenderGraphUsage::ComputeWrite);
+		frameGraph.Write(pass, drawCommands, RenderGraphUsage::ComputeWrite);
+		frameGraph.Write(pass, visibleInstances, RenderGraphUsage::ComputeWrite);
+	}
+
+	// Without GPU culling draws and visible list are written by host before submit, nothing to wait for then
+	const uint32_t pass = frameGraph.AddPass("Main", [this](VkCommandBuffer commandBuffer, uint32_t imageIdx)
+	{
+		recordMainPass(commandBuffer, imageIdx);
+	});
+	frameGraph.Read(pass, drawCommands, RenderGraphUsage::IndirectRead);
+	frameGraph.Read(pass, cullCounters, RenderGraphUsage::IndirectRead);
+	frameGraph.Read(pass, visibleInstances, RenderGraphUsage::VertexShaderRead);
+	frameGraph.Write(pass, msaaColorTarget, RenderGraphUsage::ColorAttachment);
+	frameGraph.Write(pass, depthTarget, RenderGraphUsage::DepthAttachment);
+	frameGraph.Write(pass, backbuffer, RenderGraphUsage::ColorAttachment);
+
+	frameGraph.Compile();
+}
+
+void HelloTriangleApplication::captureImage(VkImage image, const char* fileName)
+{
+	const uint32_t width = swapChainExtent.width;
+	const uint32_t height = swapChainExtent.height;
+	const VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+	VkBuffer readbackBuffer;
+	VkDeviceMemory readbackBufferMemory;
+	createBuffer(readbackBufferMemory,
+		size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		readbackBuffer);
+
+	VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
+
+	// Frame graph leaves the image in transfer source layout, only its resolve writes need to be visible
+	VkImageMemoryBarrier imageBarrier;
+	ZeroVkStructure(imageBarrier, VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
+	imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	imageBarrier.image = image;
+	imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBarrier.subresourceRange.levelCount = 1;
+	imageBarrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(cmdBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+	VkBufferImageCopy copyRegion = {};
+	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageExtent = { width, height, 1 };
+
+	vkCmdCopyImageToBuffer(cmdBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &copyRegion);
+
+	VkBufferMemoryBarrier hostBarrier;
+	ZeroVkStructure(hostBarrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+	hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	hostBarrier.buffer = readbackBuffer;
+	hostBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(cmdBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0, 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+	endSingleTimeCommands(cmdBuffer);
+
+	// Binary PPM, swizzled from BGRA
+	std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+	void* mapped = nullptr;
+	vkMapMemory(device, readbackBufferMemory, 0, size, 0, &mapped);
+		const uint8_t* bgra = static_cast<const uint8_t*>(mapped);
+		for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
+		{
+			rgb[i * 3 + 0] = bgra[i * 4 + 2];
+			rgb[i * 3 + 1] = bgra[i * 4 + 1];
+			rgb[i * 3 + 2] = bgra[i * 4 + 0];
+		}
+	vkUnmapMemory(device, readbackBufferMemory);
+
+	vkDestroyBuffer(device, readbackBuffer, nullptr);
+	vkFreeMemory(device, readbackBufferMemory, nullptr);
+
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+	{
+		throw std::runtime_error("Failed to open capture file..");
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	const bool bWritten = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+	fclose(file);
+
+	if (!bWritten)
+	{
+		throw std::runtime_error("Failed to write capture file..");
+	}
+}
+
+void HelloTriangleApplication::recreateSwapChain()
+{
+	// Called from render thread, minimizing is handled by game thread which stops recording frames then.
+	// Frames in flight keep using the old swap chain and its size dependent objects, those go to the deletion
+	// queue. Viewport and scissor are dynamic, so render pass and pipeline survive a resize.
+	const uint64_t deletionValue = getDeletionValue();
+	for (VkFramebuffer framebuffer : swapChainFramebuffers)
+	{
+		deletionQueue.DestroyFramebuffer(deletionValue, framebuffer);
+	}
+	frameGraph.Reset(deletionQueue, deletionValue);
+	deletionQueue.FreeCommandBuffers(deletionValue, commandPool, commandBuffers);
+	deletionQueue.FreeCommandBuffers(deletionValue, computeCommandPool, computeCommandBuffers);
+	for (VkImageView imageView : swapChainImageViews)
+	{
+		deletionQueue.DestroyImageView(deletionValue, imageView);
+	}
+	deletionQueue.DestroySwapchain(deletionValue, swapChain);
+
+	const VkFormat oldFormat = swapChainImageFormat;
+	const size_t oldImageCount = swapChainImages.size();
+
+	createSwapChain();
+	createSwapChainImageView();
+
+	// Rare, e.g. window moved to a HDR monitor, objects built for the old format or image count are still in use
+	if (swapChainImageFormat != oldFormat || swapChainImages.size() != oldImageCount)
+	{
+		vkDeviceWaitIdle(device);
+
+		if (swapChainImageFormat != oldFormat)
+		{
+			vkDestroyPipeline(device, graphicsPipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+			vkDestroyRenderPass(device, renderPass, nullptr);
+			createRenderPass();
+			createGraphicsPipeline();
+		}
+
+		if (swapChainImages.size() != oldImageCount)
+		{
+			destroyFrameResources(oldImageCount);
+			createUniformBuffer();
+			createFrameCullingBuffers();
+			createDescriptorSet();
+		}
+	}
+
+	createFrameGraph();
+	createFrameBuffers();
+	createCommandBuffers();
+}
+
+uint64_t HelloTriangleApplication::getDeletionValue() const
+{
+	// Work submitted from now on completes at the latest with the next frame
+	return submittedFrameCount + 1;
+}
+
+void HelloTriangleApplication::cleanupSwapChain()
+{
+	// Cleanup frame buffer, command buffer, pipeline object, pipeline layout, render pass, image view, swap chain in order
+	for (size_t i = 0; i< swapChainFramebuffers.size(); ++i)
+	{
+		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
+	}
+
+	frameGraph.Reset();
+
+	vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
+	if (bAsyncCompute)
+	{
+		vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+	}
+
+	vkDestroyPipeline(device, graphicsPipeline, nullptr);
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyRenderPass(device, renderPass, nullptr);
+
+	destroyFrameResources(swapChainImages.size());
+
+	for (size_t i = 0; i < swapChainImageViews.size(); ++i)
 	{
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
 
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	if (bHeadless)
+	{
+		for (size_t i = 0; i < swapChainImages.size(); ++i)
+		{
+			vkDestroyImage(device, swapChainImages[i], nullptr);
+			vkFreeMemory(device, offscreenImageMemory[i], nullptr);
+		}
+	}
+	else
+	{
+		vkDestroySwapchainKHR(device, swapChain, nullptr);
+	}
+}
+
+void HelloTriangleApplication::destroyFrameResources(size_t imageCount)
+{
+	for (size_t i = 0; i < imageCount; i++) 
+	{
+		vkDestroyBuffer(device, uniformBuffer[i], nullptr);
+		vkFreeMemory(device, uniformBufferMemory[i], nullptr);
+
+		vkDestroyBuffer(device, visibleInstanceBuffer[i], nullptr);
+		vkFreeMemory(device, visibleInstanceBufferMemory[i], nullptr);
+
+		vkDestroyBuffer(device, drawCommandBuffer[i], nullptr);
+		vkFreeMemory(device, drawCommandBufferMemory[i], nullptr);
+
+		if (bGpuDrivenCulling)
+		{
+			vkDestroyBuffer(device, cullCounterBuffer[i], nullptr);
+			vkFreeMemory(device, cullCounterBufferMemory[i], nullptr);
+		}
+	}
+
+	// Sets point at the per swap chain image buffers destroyed above, pools are kept for the new ones
+	descriptorSetCache.Clear();
+	descriptorAllocator.Reset();
 }
 
-void HelloTriangleApplication::createBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperty, VkBuffer& buffer)
+void HelloTriangleApplication::createBuffer(VkDeviceMemory& bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperty, VkBuffer& buffer, bool bShared)
 {
 	VkBufferCreateInfo bufferInfo;
 	ZeroVkStructure(bufferInfo, VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO);
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // For now
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Used by both queues without ownership transfers: uploaded on graphics and read by async compute, read by
+	// both, or kept by async compute from one frame to the next, which the frame graph does not transfer
+	if (bShared && !sharedQueueFamilies.empty())
+	{
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedQueueFamilies.size());
+		bufferInfo.pQueueFamilyIndices = sharedQueueFamilies.data();
+	}
 
 	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 	{
@@ -1988,6 +3729,35 @@ void HelloTriangleApplication::createImage(uint32_t width, uint32_t height, uint
 	vkBindImageMemory(device, image, memory, 0);
 }
 
+void HelloTriangleApplication::createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceMemory& bufferMemory, VkBuffer& buffer, bool bShared)
+{
+	VkBuffer stageBuffer;
+	VkDeviceMemory stageBufferMemory;
+	void* mapped = nullptr;
+
+	createBuffer(stageBufferMemory,
+		size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		stageBuffer);
+
+	vkMapMemory(device, stageBufferMemory, 0, size, 0, &mapped);
+		memcpy_s(mapped, size, data, size);
+	vkUnmapMemory(device, stageBufferMemory);
+
+	createBuffer(bufferMemory,
+		size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		buffer,
+		bShared);
+
+	copyBuffer(stageBuffer, buffer, size);
+
+	vkDestroyBuffer(device, stageBuffer, nullptr);
+	vkFreeMemory(device, stageBufferMemory, nullptr);
+}
+
 void HelloTriangleApplication::copyBuffer2Image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
 {
 	VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
@@ -2043,91 +3813,24 @@ void HelloTriangleApplication::endSingleTimeCommands(VkCommandBuffer commandBuff
 	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-void HelloTriangleApplication::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout preLayout, VkImageLayout targetLayout, uint32_t miplevels)
+void HelloTriangleApplication::submitSingleTimeCommands(VkCommandBuffer commandBuffer)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkImageMemoryBarrier barrier;
-	ZeroVkStructure(barrier, VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER);
-	barrier.oldLayout = preLayout;
-	barrier.newLayout = targetLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = miplevels;
-
-	if (targetLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) 
-	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (hasStencilComponent(format)) 
-		{
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	}
-	else 
-	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-
-	//
-	VkPipelineStageFlags srcStage;
-	VkPipelineStageFlags dstStage;
-
-	if (preLayout == VK_IMAGE_LAYOUT_UNDEFINED && targetLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (preLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && targetLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	// Same queue as frames, so barriers in the commands order them against frames before and after
+	vkEndCommandBuffer(commandBuffer);
 
-		srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (preLayout == VK_IMAGE_LAYOUT_UNDEFINED && targetLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		// How about other stage?
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT; 
-		dstStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	}
-	else if (preLayout == VK_IMAGE_LAYOUT_UNDEFINED && targetLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	VkSubmitInfo submitInfo;
+	ZeroVkStructure(submitInfo, VK_STRUCTURE_TYPE_SUBMIT_INFO);
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
 
-		srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		dstStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	}
-	else
+	// Never reached the GPU if submit failed, so nothing to wait for before freeing it
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
-		throw std::invalid_argument("Incorrect layout transition.");
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		throw std::runtime_error("Failed to submit single time commands.");
 	}
 
-
-	vkCmdPipelineBarrier(commandBuffer,
-		srcStage, // src stage mask
-		dstStage, // dst stage mask
-		0, // dependency flag
-		0, // memory barrier count
-		nullptr, // memory barrier
-		0, // buffer memory barrier count
-		nullptr, // buffer memory barrier
-		1, // image memory barrier count
-		&barrier // image memory barrier
-		);
-
-	endSingleTimeCommands(commandBuffer);
+	deletionQueue.FreeCommandBuffers(getDeletionValue(), commandPool, { commandBuffer });
 }
 
 VkImageView HelloTriangleApplication::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlag, uint32_t miplevels)
@@ -2153,12 +3856,12 @@ VkImageView HelloTriangleApplication::createImageView(VkImage image, VkFormat fo
 	return view;
 }
 
-VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<char>& code)
+VkShaderModule HelloTriangleApplication::createShaderModule(const Gear::FileData& code)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	createInfo.codeSize = code.GetSize();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.GetData());
 	
 	VkShaderModule shaderModule;
 	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule))
@@ -2169,18 +3872,21 @@ VkShaderModule HelloTriangleApplication::createShaderModule(const std::vector<ch
 	return shaderModule;
 }
 
-void HelloTriangleApplication::updateUniformBuffer(uint32_t imageIdx)
+UniformBuffer HelloTriangleApplication::updateScene(float aspectRatio)
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	float duration = std::chrono::duration<float, std::chrono::seconds::period>(currentTime- startTime).count();
+	float duration = static_cast<float>(bHeadless ? frameIndex * HEADLESS_FRAME_SECONDS : Gear::Timer::GetSeconds() - startSeconds);
 
 	UniformBuffer ubo = {};
 	ubo.model = glm::rotate(Matrix4(1.0f), duration* glm::radians(90.0f), Vector3(0.0f, 0.0f, 1.0f));
 	ubo.view = glm::lookAt(Vector3(2.0f, 2.0f, 2.0f), Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f));
-	ubo.projection = glm::perspective(glm::radians(45.0f), swapChainExtent.width/ (float)swapChainExtent.height, 0.01f, 100.0f);
+	ubo.projection = glm::perspective(glm::radians(45.0f), aspectRatio, 0.01f, 100.0f);
 	ubo.projection[1][1] *= -1.0f;	// Matrix should be row major in VK
 
+	return ubo;
+}
+
+void HelloTriangleApplication::updateUniformBuffer(uint32_t imageIdx, const UniformBuffer& ubo)
+{
 	// Map vertex buffer data to stage buffer memory
 	void* data = nullptr;
 	size_t bufferSize = sizeof(UniformBuffer);
@@ -2189,63 +3895,368 @@ void HelloTriangleApplication::updateUniformBuffer(uint32_t imageIdx)
 	vkUnmapMemory(device, uniformBufferMemory[imageIdx]);
 }
 
-void HelloTriangleApplication::draw()
+void HelloTriangleApplication::cullInstances(uint32_t imageIdx, const UniformBuffer& ubo)
 {
-	vkWaitForFences(device, 1, &presentFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t >::max());
+	// Planes in instance world space, model matrix is applied on top of instance transforms
+	Matrix4 modelView = ubo.view * ubo.model;
+	Matrix4 modelViewProjection = ubo.projection * modelView;
+	Math::Mat4 cullMatrix;
+	memcpy(&cullMatrix, &modelViewProjection[0][0], sizeof(cullMatrix));
+
+	const Frustum frustum = Frustum::FromMatrix(cullMatrix);
+	instanceCuller.CullParallel(frustum, visibleInstances);
+
+	// LOD of instances in the frustum from their projected radius, each instance keeps its own state.
+	// Selected before occlusion, so occluders are rasterized at the LOD they are drawn with.
+	const Vector4 cameraPosition = glm::inverse(modelView)[3];
+	const float projectionScale = std::abs(ubo.projection[1][1]) * swapChainExtent.height * 0.5f;
+	const uint32_t* meshIndices = instanceData.GetMeshIndices();
+
+	Gear::TaskSystem::Get().ParallelFor(static_cast<uint32_t>(visibleInstances.size()), 1024, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const uint32_t instanceIdx = visibleInstances[i];
+			const Math::Vec4& sphere = instanceSpheres[instanceIdx];
+			const Math::Vec4 toCamera(sphere.x - cameraPosition.x, sphere.y - cameraPosition.y, sphere.z - cameraPosition.z, 0.0f);
+
+			const float projectedRadius = ProjectSphereRadius(sphere.w, Math::Length3(toCamera), projectionScale);
+			const MeshDrawInfo& mesh = DummyMeshes[meshIndices[instanceIdx]];
+			instanceLods[instanceIdx] = static_cast<uint8_t>(SelectMeshLod(mesh.lodThresholds, projectedRadius, instanceLods[instanceIdx], LOD_HYSTERESIS));
+		}
+	});
+
+	// Occluders are in instance world space as well, list stays sorted. Occluders out of the frustum keep
+	// an old LOD, but none of their triangles reach the screen.
+	if (ENABLE_OCCLUSION_CULLING)
+	{
+		occlusionCuller.ClearOccluderTriangles();
+		for (size_t i = 0; i < occluderInstances.size(); ++i)
+		{
+			const MeshDrawInfo& mesh = DummyMeshes[meshIndices[occluderInstances[i]]];
+			const MeshLodLevel& level = mesh.lods[std::min<uint32_t>(instanceLods[occluderInstances[i]], mesh.lodCount - 1)];
+			occlusionCuller.AddOccluderTriangles(occluderFirstVertices[i], &DummyIndices[level.firstIndex], level.indexCount);
+		}
+
+		occlusionCuller.Render(cullMatrix);
+		occlusionCuller.CullSpheres(instanceSpheres.data(), visibleInstances);
+	}
+
+	const std::vector<InstanceDrawBatch>& batches = instanceData.GetBatches();
+
+	void* visibleData = nullptr;
+	void* drawData = nullptr;
+	vkMapMemory(device, visibleInstanceBufferMemory[imageIdx], 0, VK_WHOLE_SIZE, 0, &visibleData);
+	vkMapMemory(device, drawCommandBufferMemory[imageIdx], 0, VK_WHOLE_SIZE, 0, &drawData);
+
+	uint32_t* visibleIndices = static_cast<uint32_t*>(visibleData);
+	VkDrawIndexedIndirectCommand* drawCommands = static_cast<VkDrawIndexedIndirectCommand*>(drawData);
+
+	// Visible list is sorted, so it splits into batch ranges. Each range goes to the region of
+	// its (batch, lod) the same way the compute pass does it.
+	// Visible slots of draws are fixed, see recordMainPass()
+	uint32_t firstClusterDraw = static_cast<uint32_t>(batches.size()) * MESH_MAX_LODS;
+	std::vector<uint32_t> clusterInstanceCounts;
+	size_t visibleIdx = 0;
+	for (uint32_t batchIdx = 0; batchIdx < batches.size(); ++batchIdx)
+	{
+		const InstanceDrawBatch& batch = batches[batchIdx];
+		const uint32_t batchEnd = batch.firstInstance + batch.instanceCount;
+
+		uint32_t lodInstanceCounts[MESH_MAX_LODS] = {};
+		for (; visibleIdx < visibleInstances.size() && visibleInstances[visibleIdx] < batchEnd; ++visibleIdx)
+		{
+			const uint32_t instanceIdx = visibleInstances[visibleIdx];
+			const uint32_t lod = instanceLods[instanceIdx];
+			visibleIndices[drawFirstInstances[batchIdx * MESH_MAX_LODS + lod] + lodInstanceCounts[lod]++] = instanceIdx;
+		}
+
+		const MeshDrawInfo& mesh = DummyMeshes[batch.meshIndex];
+		for (uint32_t lod = 0; lod < MESH_MAX_LODS; ++lod)
+		{
+			const MeshLodLevel& level = mesh.lods[std::min(lod, mesh.lodCount - 1)];
+
+			VkDrawIndexedIndirectCommand& drawCommand = drawCommands[batchIdx * MESH_MAX_LODS + lod];
+			drawCommand.indexCount = level.indexCount;
+			drawCommand.instanceCount = lodInstanceCounts[lod];
+			drawCommand.firstIndex = level.firstIndex;
+			drawCommand.vertexOffset = mesh.vertexOffset;
+			drawCommand.firstInstance = 0;
+		}
+
+		if (mesh.meshletCount == 0)
+		{
+			continue;
+		}
+
+		// LOD 0 draws per meshlet instead, every instance goes to the region of each meshlet it keeps,
+		// as ClusterCull.comp does
+		drawCommands[batchIdx * MESH_MAX_LODS].instanceCount = 0;
+		clusterInstanceCounts.assign(mesh.meshletCount, 0);
+		for (uint32_t i = 0; i < lodInstanceCounts[0]; ++i)
+		{
+			const uint32_t instanceIdx = visibleIndices[drawFirstInstances[batchIdx * MESH_MAX_LODS] + i];
+
+			Math::Mat4 transform;
+			memcpy(&transform, instanceData.GetTransforms() + instanceIdx * 16, sizeof(transform));
+			const float scale = std::max({ Math::Length3(transform.c[0]), Math::Length3(transform.c[1]), Math::Length3(transform.c[2]) });
+
+			// Cone test in mesh space, holds for uniform scale
+			const Math::Vec4 localCamera = Math::TransformPoint(Math::Inverse(transform), Math::Vec4(cameraPosition.x, cameraPosition.y, cameraPosition.z, 1.0f));
+
+			for (uint32_t meshletIdx = 0; meshletIdx < mesh.meshletCount; ++meshletIdx)
+			{
+				const Meshlet& meshlet = DummyMeshlets[mesh.firstMeshlet + meshletIdx];
+				if (IsMeshletBackfacing(meshlet, &localCamera.x))
+				{
+					continue;
+				}
+
+				const Math::Vec4 center = Math::TransformPoint(transform, Math::Vec4(meshlet.center[0], meshlet.center[1], meshlet.center[2], 1.0f));
+				const float radius = meshlet.radius * scale;
+
+				bool bVisible = true;
+				for (uint32_t planeIdx = 0; planeIdx < Frustum::FP_Count && bVisible; ++planeIdx)
+				{
+					bVisible = Math::Dot3(frustum.Planes[planeIdx], center) + frustum.Planes[planeIdx].w > -radius;
+				}
+				if (!bVisible)
+				{
+					continue;
+				}
+
+				visibleIndices[drawFirstInstances[firstClusterDraw + meshletIdx] + clusterInstanceCounts[meshletIdx]++] = instanceIdx;
+			}
+		}
+
+		// Every meshlet keeps its draw slot, ones culled for all instances draw nothing
+		for (uint32_t meshletIdx = 0; meshletIdx < mesh.meshletCount; ++meshletIdx)
+		{
+			const Meshlet& meshlet = DummyMeshlets[mesh.firstMeshlet + meshletIdx];
+
+			VkDrawIndexedIndirectCommand& drawCommand = drawCommands[firstClusterDraw + meshletIdx];
+			drawCommand.indexCount = meshlet.indexCount;
+			drawCommand.instanceCount = clusterInstanceCounts[meshletIdx];
+			drawCommand.firstIndex = meshlet.firstIndex;
+			drawCommand.vertexOffset = mesh.vertexOffset;
+			drawCommand.firstInstance = 0;
+		}
+
+		firstClusterDraw += mesh.meshletCount;
+	}
+
+	vkUnmapMemory(device, drawCommandBufferMemory[imageIdx]);
+	vkUnmapMemory(device, visibleInstanceBufferMemory[imageIdx]);
+}
+
+void HelloTriangleApplication::updateTextureStreaming(const UniformBuffer& ubo)
+{
+	// Texture is assumed to span its mesh once, so the largest projected instance decides the mip
+	const Vector4 cameraPosition = glm::inverse(ubo.view * ubo.model)[3];
+	const float projectionScale = std::abs(ubo.projection[1][1]) * swapChainExtent.height * 0.5f;
+
+	float projectedSize = 0.0f;
+	for (const Math::Vec4& sphere : instanceSpheres)
+	{
+		const Math::Vec4 toCamera(sphere.x - cameraPosition.x, sphere.y - cameraPosition.y, sphere.z - cameraPosition.z, 0.0f);
+		projectedSize = std::max(projectedSize, 2.0f * ProjectSphereRadius(sphere.w, Math::Length3(toCamera), projectionScale));
+	}
+
+	if (!instanceSpheres.empty())
+	{
+		textureStreamer.RequestMip(diffuseTexture, ComputeStreamingMip(*cookedTexture, projectedSize));
+	}
+
+	textureStreamer.Update(textureChanges);
+	if (textureChanges.empty())
+	{
+		return;
+	}
+
+	// Only one streamed texture, its last change is where it ends up
+	rebuildTextureImage(textureChanges.back().newResidentMip, textureChanges);
+
+	// Frames in flight read the old slot, so the new image gets its own and the material table is pointed at it
+	// ahead of the next frame. Old slot is reused once those frames completed. Command buffers stay valid.
+	if (bBindless)
+	{
+		const uint32_t oldSlot = diffuseTextureSlot;
+		diffuseTextureSlot = bindlessDescriptors.AddTexture(imageView, defaultSampler);
+
+		VkBufferMemoryBarrier barrier;
+		ZeroVkStructure(barrier, VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER);
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = materialBuffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		VkCommandBuffer cmdBuffer = beginSingleTimeCommands();
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		vkCmdUpdateBuffer(cmdBuffer, materialBuffer, offsetof(MaterialData, albedoTexture), sizeof(uint32_t), &diffuseTextureSlot);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+		submitSingleTimeCommands(cmdBuffer);
+
+		deletionQueue.Release(getDeletionValue(), [this, oldSlot]() { bindlessDescriptors.RemoveTexture(oldSlot); });
+		return;
+	}
+
+	// Descriptor sets are baked into the prerecorded command buffers, frames in flight have to finish first.
+	// Sets of the old image view are dropped, cached sets must not outlive what they point at.
+	vkDeviceWaitIdle(device);
+	descriptorSetCache.Clear();
+	descriptorAllocator.Reset();
+	createDescriptorSet();
+
+	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+	if (bAsyncCompute)
+	{
+		vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+	}
+	createCommandBuffers();
+}
+
+void HelloTriangleApplication::draw(const UniformBuffer& ubo, bool bResized)
+{
+	// Residency changes swap the texture image, done before this frame records anything
+	updateTextureStreaming(ubo);
+
+	// Frame last submitted with this slot's semaphores, framesInFlight frames ago
+	waitForFrame(frameSubmitCounts[currentFrame]);
+
+	uint64_t completedFrame = 0;
+	vkGetSemaphoreCounterValue(device, frameTimeline, &completedFrame);
+	deletionQueue.Collect(completedFrame);
 
 	// Get image from swap chain
 	uint32_t imageIdx = 0;
 	constexpr uint64_t timeOut = std::numeric_limits<uint64_t >::max();
 
-	// If we got available image, acquire it otherwise block it.
-	VkResult ret = vkAcquireNextImageKHR(device, swapChain, timeOut, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIdx);
-	if (ret == VK_ERROR_OUT_OF_DATE_KHR)
+	VkResult ret = VK_SUCCESS;
+	if (bHeadless)
 	{
-		recreateSwapChain();
-		return;
+		// Offscreen image per frame in flight, the wait above tells it is not rendered to any more
+		imageIdx = static_cast<uint32_t>(currentFrame);
 	}
-	else if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR)
+	else
 	{
-		throw std::runtime_error("Failed to acquire swap chain image.");
+		// If we got available image, acquire it otherwise block it.
+		ret = vkAcquireNextImageKHR(device, swapChain, timeOut, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIdx);
+		if (ret == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			recreateSwapChain();
+			return;
+		}
+		else if (ret != VK_SUCCESS && ret != VK_SUBOPTIMAL_KHR)
+		{
+			throw std::runtime_error("Failed to acquire swap chain image.");
+		}
 	}
 
+	// Per image buffers are written below, the frame which rendered this image last may be in flight still
+	waitForFrame(imageSubmitCounts[imageIdx]);
+
 	// Prepare submit to command list
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphore = imageAvailableSemaphores[currentFrame];
+	// Culling of this frame, where the frame graph first reads its results. Waited for even if nothing crosses
+	// queues, so frame timeline covers the compute work for the deletion queue.
+	const VkPipelineStageFlags computeWaitStage = static_cast<VkPipelineStageFlags>(frameGraph.GetWaitStages(RenderGraphQueue::Graphics));
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], computeTimeline };
 	VkPipelineStageFlags waitStage[] = {
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		computeWaitStage != 0 ? computeWaitStage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
 	};
 
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = &waitSemaphore;
-	submitInfo.pWaitDstStageMask = waitStage;
+	// Nothing to wait for or signal without swap chain
+	const uint32_t imageWaitCount = bHeadless ? 0 : 1;
+	submitInfo.waitSemaphoreCount = imageWaitCount + (bAsyncCompute ? 1 : 0);
+	submitInfo.pWaitSemaphores = waitSemaphores + (1 - imageWaitCount);
+	submitInfo.pWaitDstStageMask = waitStage + (1 - imageWaitCount);
 
 	// Specify which command buffer to submit
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffers[imageIdx];
 
-	VkSemaphore signalSemaphore = renderFinishSemaphores[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &signalSemaphore;
-
-	vkResetFences(device, 1, &presentFences[currentFrame]);
+	// Binary semaphore for present, timeline value for everything else. Binary values are ignored.
+	const uint64_t frame = submittedFrameCount + 1;
+	const uint64_t signalValues[] = { frame, 0 };
+	VkSemaphore signalSemaphores[] = { frameTimeline, renderFinishSemaphores[currentFrame] };
+	submitInfo.signalSemaphoreCount = bHeadless ? 1 : 2;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	const uint64_t waitValues[] = { 0, frame };
+	VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+	timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineSubmitInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+	timelineSubmitInfo.pWaitSemaphoreValues = waitValues + (1 - imageWaitCount);
+	timelineSubmitInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+	timelineSubmitInfo.pSignalSemaphoreValues = signalValues;
+	submitInfo.pNext = &timelineSubmitInfo;
 
 	// Updated should be ahead of commands submit
-	updateUniformBuffer(imageIdx);
+	updateUniformBuffer(imageIdx, ubo);
+	if (!bGpuDrivenCulling)
+	{
+		cullInstances(imageIdx, ubo);
+	}
+
+	// Culling reads the uniform buffer, queued right away so it overlaps with graphics of the previous frame.
+	// Its per image buffers were released by the frame waited for above.
+	if (bAsyncCompute)
+	{
+		VkTimelineSemaphoreSubmitInfo computeTimelineInfo = {};
+		computeTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		computeTimelineInfo.signalSemaphoreValueCount = 1;
+		computeTimelineInfo.pSignalSemaphoreValues = &frame;
+
+		VkSubmitInfo computeSubmitInfo = {};
+		computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		computeSubmitInfo.pNext = &computeTimelineInfo;
+		computeSubmitInfo.commandBufferCount = 1;
+		computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[imageIdx];
+		computeSubmitInfo.signalSemaphoreCount = 1;
+		computeSubmitInfo.pSignalSemaphores = &computeTimeline;
+
+		if (vkQueueSubmit(asyncComputeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit to async compute queue.");
+		}
+	}
+
+	// Prepared while GPU rendered the previous frame, queued once it is done
+	if (framePacing == FramePacing::LowLatency)
+	{
+		waitForFrame(frame - 1);
+	}
 
 	// Submit to graphic command queue
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, presentFences[currentFrame]) != VK_SUCCESS)
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to submit to graphic command queue..");
 	}
+	frameSubmitCounts[currentFrame] = frame;
+	imageSubmitCounts[imageIdx] = frame;
+	submittedFrameCount.store(frame, std::memory_order_release);
+
+	if (bHeadless)
+	{
+		lastImageIdx = imageIdx;
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		return;
+	}
 
 	//
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = &signalSemaphore;
+	presentInfo.pWaitSemaphores = &renderFinishSemaphores[currentFrame];
 
 	VkSwapchainKHR swapChains[] = { swapChain };
 	presentInfo.swapchainCount = 1;
@@ -2255,9 +4266,8 @@ void HelloTriangleApplication::draw()
 
 	ret = vkQueuePresentKHR(presentQueue, &presentInfo);
 
-	if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR || bFrameBufferResized)
+	if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_SUBOPTIMAL_KHR || bResized)
 	{
-		bFrameBufferResized = false;
 		recreateSwapChain();
 	}
 	else if (ret != VK_SUCCESS)
@@ -2265,6 +4275,72 @@ void HelloTriangleApplication::draw()
 		throw std::runtime_error("Failed to present swap chain image.");
 	}
 
-	currentFrame = (currentFrame+ 1)% MAX_FRAMES_IN_SWAPCHAIN;
+	currentFrame = (currentFrame+ 1)% framesInFlight;
 }
 
+void HelloTriangleApplication::waitForFrame(uint64_t frame)
+{
+	// Frame 0 is never submitted, timeline starts there
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &frameTimeline;
+	waitInfo.pValues = &frame;
+
+	if (vkWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to wait for frame timeline.");
+	}
+}
+
+void HelloTriangleApplication::waitForLastFrame()
+{
+	// Previous frame has to be submitted by render thread first, then GPU finishes it
+	while (renderCommands.GetConsumedFrames() < renderCommands.GetProducedFrames() && !bRenderThreadFailed)
+	{
+		std::this_thread::yield();
+	}
+
+	waitForFrame(submittedFrameCount.load(std::memory_order_acquire));
+}
+
+void HelloTriangleApplication::startRenderThread()
+{
+	if (ENABLE_RENDER_THREAD)
+	{
+		renderThread = std::thread(&HelloTriangleApplication::renderThreadMain, this);
+	}
+}
+
+void HelloTriangleApplication::stopRenderThread()
+{
+	// Render thread drains recorded frames before it quits
+	renderCommands.Shutdown();
+
+	if (renderThread.joinable())
+	{
+		renderThread.join();
+	}
+
+	if (renderThreadException)
+	{
+		std::rethrow_exception(renderThreadException);
+	}
+}
+
+void HelloTriangleApplication::renderThreadMain()
+{
+	try
+	{
+		while (renderCommands.ExecuteFrame(*this))
+		{
+		}
+	}
+	catch (...)
+	{
+		// Rethrown on game thread, wake it up in case it waits for a free command list
+		renderThreadException = std::current_exception();
+		bRenderThreadFailed = true;
+		renderCommands.Shutdown();
+	}
+}